@@ -89,6 +89,7 @@ BuildRequires: zeromq-devel
 BuildRequires: gcc
 buildRequires: gcc-c++
 BuildRequires: net-snmp-devel
+BuildRequires: zlib-devel
 BuildRequires: CUnit-devel
 BuildRequires: doxygen
 BuildRequires: doxypypy
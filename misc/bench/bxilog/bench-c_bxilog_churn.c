@@ -0,0 +1,154 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: Jul 16, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+/*
+ * Measure the cost of short-lived logging threads: each thread logs a few records
+ * and exits, as in thread-pool heavy applications.
+ *
+ * Compiled twice: with -DTSD_POOL_SIZE=0 (bench-c_bxilog_churn) and
+ * -DTSD_POOL_SIZE=64 (bench-c_bxilog_churn_pool) so thread attach with and without
+ * thread-specific data reuse can be compared.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include <bxi/base/err.h>
+#include <bxi/base/log/level.h>
+#include <bxi/base/log/logger.h>
+#include <bxi/base/log.h>
+#include <bxi/base/mem.h>
+#include <bxi/base/str.h>
+#include <bxi/base/time.h>
+#include <bxi/base/log/file_handler.h>
+#include <bxi/base/log/null_handler.h>
+
+#ifndef TSD_POOL_SIZE
+#define TSD_POOL_SIZE 0
+#endif
+
+// Number of logs of each short-lived thread
+#define LOGS_PER_THREAD 10
+
+SET_LOGGER(logger, "bench");
+
+static void * logging_thread(void * param) {
+    size_t thread_rank = (size_t) param;
+
+    struct timespec start;
+    bxierr_p err = bxitime_get(CLOCK_MONOTONIC, &start);
+    bxierr_abort_ifko(err);
+
+    // The first log attaches the thread to bxilog
+    OUT(logger, "Thread %zu: first log", thread_rank);
+
+    double * first_log = bximem_calloc(sizeof(*first_log));
+    err = bxitime_duration(CLOCK_MONOTONIC, start, first_log);
+    bxierr_abort_ifko(err);
+
+    for (size_t i = 1; i < LOGS_PER_THREAD; i++) {
+        OUT(logger, "Thread %zu: log %zu", thread_rank, i);
+    }
+    return first_log;
+}
+
+int main(int argc, char * argv[]) {
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s threads_nb handlers_nb seconds_to_run\n",
+                basename(argv[0]));
+        exit(1);
+    }
+    const size_t threads_nb = (size_t) atoi(argv[1]);
+    const size_t handlers_nb = (size_t) atoi(argv[2]);
+    const double seconds = atof(argv[3]);
+
+    char * fullprogname = strdup(argv[0]);
+    char * progname = basename(fullprogname);
+    char * filename = bxistr_new("/tmp/%s%s", progname, ".log");
+
+    if( access(filename, F_OK) != -1) {
+        unlink(filename);
+    }
+
+    bxilog_config_p config = bxilog_config_new(progname);
+    config->tsd_pool_size = TSD_POOL_SIZE;
+    bxilog_config_add_handler(config, BXILOG_FILE_HANDLER,
+                              BXILOG_FILTERS_ALL_ALL,
+                              progname, filename, BXI_TRUNC_OPEN_FLAGS);
+    // Thread attach cost grows with the number of handlers
+    for (size_t i = 1; i < handlers_nb; i++) {
+        bxilog_config_add_handler(config, BXILOG_NULL_HANDLER, BXILOG_FILTERS_ALL_ALL);
+    }
+
+    bxierr_p bxierr = bxilog_init(config);
+    assert(bxierr_isok(bxierr));
+
+    struct timespec start;
+    bxitime_get(CLOCK_MONOTONIC, &start);
+
+    size_t rounds_nb = 0;
+    double first_log_total = 0, first_log_max = 0;
+    double elapsed = 0;
+    pthread_t threads[threads_nb];
+    while (elapsed < seconds) {
+        for (size_t i = 0; i < threads_nb; i++) {
+            int rc = pthread_create(&threads[i], NULL, logging_thread,
+                                    (void *) (rounds_nb * threads_nb + i));
+            assert(0 == rc);
+        }
+        for (size_t i = 0; i < threads_nb; i++) {
+            double * first_log;
+            int rc = pthread_join(threads[i], (void**) &first_log);
+            assert(0 == rc);
+            first_log_total += *first_log;
+            if (*first_log > first_log_max) first_log_max = *first_log;
+            BXIFREE(first_log);
+        }
+        rounds_nb++;
+        bxitime_duration(CLOCK_MONOTONIC, start, &elapsed);
+    }
+    const size_t total_threads_nb = rounds_nb * threads_nb;
+
+    bxierr = bxilog_finalize(true);
+    if (!bxierr_isok(bxierr)) {
+        char * str = bxierr_str(bxierr);
+        fprintf(stderr, "WARNING: bxilog finalization returned: %s", str);
+        BXIFREE(str);
+        bxierr_destroy(&bxierr);
+    }
+
+    char * thread_str = bxitime_duration_str(elapsed / (double) total_threads_nb);
+    char * first_log_str = bxitime_duration_str(first_log_total /
+                                                (double) total_threads_nb);
+    char * first_log_max_str = bxitime_duration_str(first_log_max);
+    printf("Thread churn (tsd pool size: %d, handlers: %zu): %zu threads of %d logs, "
+           "%.1f threads/s, average=%s/thread, first log: average=%s, max=%s\n",
+           TSD_POOL_SIZE, handlers_nb, total_threads_nb, LOGS_PER_THREAD,
+           (double) total_threads_nb / elapsed, thread_str,
+           first_log_str, first_log_max_str);
+    BXIFREE(thread_str);
+    BXIFREE(first_log_str);
+    BXIFREE(first_log_max_str);
+
+    unlink(filename);
+    BXIFREE(fullprogname);
+    BXIFREE(filename);
+}
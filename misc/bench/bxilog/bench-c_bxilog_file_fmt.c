@@ -0,0 +1,121 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: Jul 16, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+/*
+ * Measure the CPU time the file handler spends per written line.
+ *
+ * A single business thread logs records of the given number of lines, then the
+ * handler CPU time is computed as the process CPU time minus the business thread
+ * one (the handler thread is the only other busy thread).
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include <bxi/base/err.h>
+#include <bxi/base/log/level.h>
+#include <bxi/base/log/logger.h>
+#include <bxi/base/log.h>
+#include <bxi/base/mem.h>
+#include <bxi/base/str.h>
+#include <bxi/base/time.h>
+#include <bxi/base/log/file_handler.h>
+
+SET_LOGGER(logger, "bench");
+
+static double _cputime(clockid_t clock) {
+    struct timespec now;
+    int rc = clock_gettime(clock, &now);
+    assert(0 == rc);
+    return (double) now.tv_sec + (double) now.tv_nsec * 1e-9;
+}
+
+int main(int argc, char * argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s logs_nb lines_per_log\n", basename(argv[0]));
+        exit(1);
+    }
+    const size_t logs_nb = (size_t) atoi(argv[1]);
+    const size_t lines_nb = (size_t) atoi(argv[2]);
+    assert(0 < lines_nb);
+
+    char * fullprogname = strdup(argv[0]);
+    char * progname = basename(fullprogname);
+    char * filename = bxistr_new("/tmp/%s%s", progname, ".log");
+
+    if( access(filename, F_OK) != -1) {
+        unlink(filename);
+    }
+
+    // A message of lines_nb lines
+    char * msg = bximem_calloc(lines_nb * 16);
+    for (size_t i = 0; i < lines_nb; i++) {
+        strcat(msg, (i + 1 < lines_nb) ? "Some line text\n" : "Some line text");
+    }
+
+    bxilog_config_p config = bxilog_config_new(progname);
+    bxilog_config_add_handler(config, BXILOG_FILE_HANDLER,
+                              BXILOG_FILTERS_ALL_ALL,
+                              progname, filename, BXI_TRUNC_OPEN_FLAGS);
+
+    bxierr_p bxierr = bxilog_init(config);
+    assert(bxierr_isok(bxierr));
+    bxierr = bxilog_flush();
+    assert(bxierr_isok(bxierr));
+
+    const double process_start = _cputime(CLOCK_PROCESS_CPUTIME_ID);
+    const double thread_start = _cputime(CLOCK_THREAD_CPUTIME_ID);
+    struct timespec start;
+    bxitime_get(CLOCK_MONOTONIC, &start);
+
+    for (size_t i = 0; i < logs_nb; i++) {
+        OUT(logger, "%s", msg);
+    }
+    bxierr = bxilog_flush();
+    assert(bxierr_isok(bxierr));
+
+    double elapsed;
+    bxitime_duration(CLOCK_MONOTONIC, start, &elapsed);
+    const double thread_cpu = _cputime(CLOCK_THREAD_CPUTIME_ID) - thread_start;
+    const double handler_cpu = _cputime(CLOCK_PROCESS_CPUTIME_ID) - process_start -
+                               thread_cpu;
+
+    bxierr = bxilog_finalize(true);
+    if (!bxierr_isok(bxierr)) {
+        char * str = bxierr_str(bxierr);
+        fprintf(stderr, "WARNING: bxilog finalization returned: %s", str);
+        BXIFREE(str);
+        bxierr_destroy(&bxierr);
+    }
+
+    const size_t total_lines = logs_nb * lines_nb;
+    char * line_str = bxitime_duration_str(handler_cpu / (double) total_lines);
+    char * elapsed_str = bxitime_duration_str(elapsed);
+    printf("File handler: %zu logs of %zu lines in %s, %.1f lines/s, "
+           "handler CPU: %s/line\n",
+           logs_nb, lines_nb, elapsed_str, (double) total_lines / elapsed, line_str);
+    BXIFREE(line_str);
+    BXIFREE(elapsed_str);
+
+    unlink(filename);
+    BXIFREE(msg);
+    BXIFREE(fullprogname);
+    BXIFREE(filename);
+}
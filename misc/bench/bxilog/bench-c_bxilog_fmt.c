@@ -0,0 +1,148 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: Jul 16, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+/*
+ * Measure the caller side cost of a log with a multi-arguments format.
+ *
+ * Compiled twice: with -DDEFERRED=false (bench-c_bxilog_eager) and
+ * -DDEFERRED=true (bench-c_bxilog_deferred) so both formatting modes can be compared.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <float.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <libgen.h>
+
+#include <bxi/base/err.h>
+#include <bxi/base/log/level.h>
+#include <bxi/base/log/logger.h>
+#include <bxi/base/log.h>
+#include <bxi/base/mem.h>
+#include <bxi/base/str.h>
+#include <bxi/base/time.h>
+#include <bxi/base/log/file_handler.h>
+
+#include "common.h"
+
+#ifndef DEFERRED
+#define DEFERRED false
+#endif
+
+static volatile bool AGAIN = true;
+
+SET_LOGGER(logger, "bench")
+
+static void * logging_thread(void * param) {
+    size_t thread_rank = (size_t) param;
+
+    struct stats_s * stats = bximem_calloc(sizeof(*stats));
+    stats->min_duration = DBL_MAX;
+    stats->max_duration = DBL_MIN;
+    stats->total_duration = 0;
+    stats->n = 0;
+
+    while (AGAIN) {
+        struct timespec start;
+        bxierr_p err = bxitime_get(CLOCK_MONOTONIC, &start);
+        bxierr_abort_ifko(err);
+
+        bxilog_logger_log(logger, stats->n % BXILOG_LOWEST + 1,
+                          (char *)__FILE__, ARRAYLEN(__FILE__),
+                          __func__, ARRAYLEN(__func__), __LINE__,
+                          "Thread %zu, step %zu: node=%s, port=%d, load=%.3f, flags=%#x",
+                          thread_rank, stats->n, "compute-042", 8080 + (int) thread_rank,
+                          (double) stats->n / 1000.0, (unsigned) stats->n & 0xff);
+
+        double duration;
+        err = bxitime_duration(CLOCK_MONOTONIC, start, &duration);
+        bxierr_abort_ifko(err);
+        stats->min_duration = (duration < stats->min_duration) ? duration : stats->min_duration;
+        stats->max_duration = (duration > stats->max_duration) ? duration : stats->max_duration;
+        stats->total_duration += duration;
+        stats->n++;
+    }
+    return stats;
+}
+
+int main(int argc, char * argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s threads_nb seconds_to_run\n", basename(argv[0]));
+        exit(1);
+    }
+    struct timespec start;
+    bxitime_get(CLOCK_MONOTONIC, &start);
+
+    char * fullprogname = strdup(argv[0]);
+    char * progname = basename(fullprogname);
+    char * filename = bxistr_new("/tmp/%s%s", progname, ".log");
+
+    if( access(filename, F_OK) != -1) {
+        unlink(filename);
+    }
+
+    bxilog_config_p config = bxilog_config_new(progname);
+    config->deferred_formatting = DEFERRED;
+    bxilog_config_add_handler(config, BXILOG_FILE_HANDLER,
+                              BXILOG_FILTERS_ALL_ALL,
+                              progname, filename, BXI_TRUNC_OPEN_FLAGS);
+
+    bxierr_p bxierr = bxilog_init(config);
+    assert(bxierr_isok(bxierr));
+
+    int n = atoi(argv[1]);
+    pthread_t threads[n];
+    for (int i = 0; i < n; i++) {
+        pthread_create(&threads[i], NULL, logging_thread, (void *) (size_t) i);
+    }
+
+    sleep(atoi(argv[2]));
+    AGAIN = false;
+    struct stats_s * statss[n];
+    double caller_total = 0;
+    size_t caller_n = 0;
+    for (int i = 0; i < n; i++) {
+        struct stats_s * stats;
+        pthread_join(threads[i], (void**)&stats);
+        statss[i] = stats;
+        caller_total += stats->total_duration;
+        caller_n += stats->n;
+    }
+    bxierr = bxilog_finalize(true);
+    if (!bxierr_isok(bxierr)) {
+        char * str = bxierr_str(bxierr);
+        fprintf(stderr, "WARNING: bxilog finalization returned: %s", str);
+        BXIFREE(str);
+        bxierr_destroy(&bxierr);
+    }
+
+    // The time spent in the business threads is what deferred formatting reduces
+    char * caller_str = bxitime_duration_str(caller_total / (double) caller_n);
+    printf("Caller side (%s formatting): %zu logs, average=%s/log\n",
+           DEFERRED ? "deferred" : "eager", caller_n, caller_str);
+    BXIFREE(caller_str);
+
+    display_stats(start, statss, n, filename);
+
+    BXIFREE(fullprogname);
+    BXIFREE(filename);
+}
@@ -0,0 +1,131 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: Jul 16, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+/*
+ * Measure the latency from a log call to the record being written to the file:
+ * each iteration logs one record and calls bxilog_flush(), which returns once the
+ * file handler has written it. Iterations are paced so the handler thread
+ * is idle when the record comes, as for a low logging rate.
+ *
+ * Compiled twice: with -DSPIN_US=0 (bench-c_bxilog_latency) and -DSPIN_US=200
+ * (bench-c_bxilog_latency_spin) so blocking and busy-polling handlers can be
+ * compared.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include <bxi/base/err.h>
+#include <bxi/base/log/level.h>
+#include <bxi/base/log/logger.h>
+#include <bxi/base/log.h>
+#include <bxi/base/mem.h>
+#include <bxi/base/str.h>
+#include <bxi/base/time.h>
+#include <bxi/base/log/file_handler.h>
+
+#ifndef SPIN_US
+#define SPIN_US 0
+#endif
+
+SET_LOGGER(logger, "bench");
+
+static int _cmp_double(const void * a, const void * b) {
+    const double x = *(const double *) a;
+    const double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char * argv[]) {
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s zmq|ring logs_nb pause_us\n",
+                basename(argv[0]));
+        exit(1);
+    }
+    const bool ring = (0 == strcmp("ring", argv[1]));
+    const size_t logs_nb = (size_t) atoi(argv[2]);
+    const long pause_us = atol(argv[3]);
+
+    char * fullprogname = strdup(argv[0]);
+    char * progname = basename(fullprogname);
+    char * filename = bxistr_new("/tmp/%s%s", progname, ".log");
+
+    if( access(filename, F_OK) != -1) {
+        unlink(filename);
+    }
+
+    bxilog_config_p config = bxilog_config_new(progname);
+    if (ring) config->transport = BXILOG_TRANSPORT_RING;
+    bxilog_config_add_handler(config, BXILOG_FILE_HANDLER,
+                              BXILOG_FILTERS_ALL_ALL,
+                              progname, filename, BXI_TRUNC_OPEN_FLAGS);
+    config->handlers_params[0]->spin_us = SPIN_US;
+
+    bxierr_p bxierr = bxilog_init(config);
+    assert(bxierr_isok(bxierr));
+
+    double * latencies = bximem_calloc(logs_nb * sizeof(*latencies));
+    const struct timespec pause = {.tv_sec = pause_us / 1000000,
+                                   .tv_nsec = (pause_us % 1000000) * 1000};
+    for (size_t i = 0; i < logs_nb; i++) {
+        nanosleep(&pause, NULL);
+
+        struct timespec start;
+        bxitime_get(CLOCK_MONOTONIC, &start);
+        OUT(logger, "Record %zu", i);
+        bxierr = bxilog_flush();
+        assert(bxierr_isok(bxierr));
+        bxitime_duration(CLOCK_MONOTONIC, start, &latencies[i]);
+    }
+
+    bxilog_spin_stats_s spin;
+    bxierr = bxilog_get_spin_stats(0, &spin);
+    assert(bxierr_isok(bxierr));
+
+    bxierr = bxilog_finalize(true);
+    if (!bxierr_isok(bxierr)) {
+        char * str = bxierr_str(bxierr);
+        fprintf(stderr, "WARNING: bxilog finalization returned: %s", str);
+        BXIFREE(str);
+        bxierr_destroy(&bxierr);
+    }
+
+    qsort(latencies, logs_nb, sizeof(*latencies), _cmp_double);
+    const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+    printf("Log to file latency (%s, spin: %d us, pause: %ld us): %zu logs",
+           argv[1], SPIN_US, pause_us, logs_nb);
+    for (size_t p = 0; p < sizeof(percentiles) / sizeof(*percentiles); p++) {
+        char * str = bxitime_duration_str(latencies[(size_t) ((double) (logs_nb - 1) *
+                                                              percentiles[p])]);
+        printf(", p%g=%s", percentiles[p] * 100, str);
+        BXIFREE(str);
+    }
+    char * max_str = bxitime_duration_str(latencies[logs_nb - 1]);
+    char * spin_str = bxitime_duration_str((double) spin.spin_ns / 1e9);
+    printf(", max=%s, spins: %zu (hits: %zu), spin time: %s\n",
+           max_str, spin.spins_nb, spin.hits_nb, spin_str);
+    BXIFREE(max_str);
+    BXIFREE(spin_str);
+
+    unlink(filename);
+    BXIFREE(latencies);
+    BXIFREE(fullprogname);
+    BXIFREE(filename);
+}
@@ -5,6 +5,7 @@
 
 #ifndef BXICFFI
 #include <stdbool.h>
+#include <stdint.h>
 #else
 FILE *fmemopen(void *, size_t, const char*);
 int fclose(FILE*);
@@ -143,6 +144,74 @@ void free(void *ptr);
 // ********************************** Types   **************************************
 // *********************************************************************************
 
+/**
+ * Records allocation statistics, see bxilog_get_alloc_stats().
+ *
+ * They help sizing bxilog_config_s.slab_max_size: many oversized records
+ * mean the slab is too small.
+ */
+typedef struct {
+    size_t slab_bytes;          //!< Memory currently held by all threads slabs
+    size_t slab_refills_nb;     //!< Number of times a slab allocated new blocks
+    size_t oversize_nb;         //!< Number of records too large for slabs (malloc()ed)
+    size_t oversize_max;        //!< Size in bytes of the largest oversized record
+} bxilog_alloc_stats_s;
+
+/**
+ * Records allocation statistics.
+ */
+typedef bxilog_alloc_stats_s * bxilog_alloc_stats_p;
+
+/**
+ * Number of records dropped by a handler backpressure policy,
+ * see bxilog_get_drop_stats() and bxilog_backpressure_e.
+ */
+typedef struct {
+    size_t newest_nb;           //!< Dropped by BXILOG_BACKPRESSURE_DROP_NEWEST
+    size_t oldest_nb;           //!< Dropped by BXILOG_BACKPRESSURE_DROP_OLDEST
+    size_t below_level_nb;      //!< Dropped by BXILOG_BACKPRESSURE_DROP_BELOW_LEVEL
+    size_t overflow_nb;         //!< Kept by a non blocking policy, but dropped
+                                //!< because the queue stayed full
+} bxilog_drop_stats_s;
+
+/**
+ * Number of records dropped by a handler.
+ */
+typedef bxilog_drop_stats_s * bxilog_drop_stats_p;
+
+/**
+ * Queue statistics of a handler lane (its data or priority zocket, see
+ * bxilog_get_lane_stats()).
+ *
+ * Counted in frames: a frame is a record, or a batch of records (see
+ * bxilog_config_s.batch_size), as for the ZMQ High Water Marks.
+ */
+typedef struct {
+    size_t queued_nb;           //!< Frames currently waiting for the handler
+    size_t queued_max;          //!< Largest number of waiting frames seen by the handler
+    size_t processed_nb;        //!< Frames processed by the handler
+} bxilog_lane_stats_s;
+
+/**
+ * Queue statistics of a handler lane.
+ */
+typedef bxilog_lane_stats_s * bxilog_lane_stats_p;
+
+/**
+ * Busy-polling statistics of a handler thread (see
+ * bxilog_handler_param_s.spin_us and bxilog_get_spin_stats()).
+ */
+typedef struct {
+    size_t spins_nb;            //!< Number of times the handler busy-polled its inputs
+    size_t hits_nb;             //!< Number of spins that found something to process
+    uint64_t spin_ns;           //!< CPU time spent busy-polling, in nanoseconds
+} bxilog_spin_stats_s;
+
+/**
+ * Busy-polling statistics of a handler thread.
+ */
+typedef bxilog_spin_stats_s * bxilog_spin_stats_p;
+
 /**
  * BXI Logging Constants Type (mainly for higher level languages binding)
  */
@@ -228,6 +297,52 @@ bool bxilog_is_ready();
  */
 bxierr_p bxilog_flush(void);
 
+/**
+ * Fill the given structure with the process-wide records allocation statistics.
+ *
+ * @param[out] stats the statistics
+ */
+void bxilog_get_alloc_stats(bxilog_alloc_stats_p stats);
+
+/**
+ * Fill the given structure with the number of records dropped so far by the
+ * backpressure policy of the given handler.
+ *
+ * Non zero counters are also reported on stderr by bxilog_finalize().
+ *
+ * @param[in] handler_rank the handler rank, in the order handlers have been added
+ *            to the configuration
+ * @param[out] stats the statistics
+ *
+ * @return BXIERR_OK on success, anything else is an error.
+ */
+bxierr_p bxilog_get_drop_stats(size_t handler_rank, bxilog_drop_stats_p stats);
+
+/**
+ * Fill the given structure with the queue statistics of a lane of the given handler.
+ *
+ * @param[in] handler_rank the handler rank, in the order handlers have been added
+ *            to the configuration
+ * @param[in] priority true for the priority lane (see
+ *            bxilog_handler_param_s.priority_level), false for the normal one
+ * @param[out] stats the statistics
+ *
+ * @return BXIERR_OK on success, anything else is an error.
+ */
+bxierr_p bxilog_get_lane_stats(size_t handler_rank, bool priority,
+                               bxilog_lane_stats_p stats);
+
+/**
+ * Fill the given structure with the busy-polling statistics of the given handler.
+ *
+ * @param[in] handler_rank the handler rank, in the order handlers have been added
+ *            to the configuration
+ * @param[out] stats the statistics
+ *
+ * @return BXIERR_OK on success, anything else is an error.
+ */
+bxierr_p bxilog_get_spin_stats(size_t handler_rank, bxilog_spin_stats_p stats);
+
 
 /**
  * Write the set of registered loggers along with the list of bxilog_level_e to
@@ -53,6 +53,16 @@
 // ********************************** Types   **************************************
 // *********************************************************************************
 
+/**
+ * The transport used to send log records from business code threads
+ * to the logging handlers.
+ */
+typedef enum {
+    BXILOG_TRANSPORT_ZMQ = 0,       //!< One ZMQ inproc PUSH socket per thread and handler
+    BXILOG_TRANSPORT_RING = 1,      //!< One lock-free SPSC ring per thread and handler,
+                                    //!< ZMQ is only used for control messages
+} bxilog_transport_e;
+
 /**
  * The bxilog configuration structure.
  */
@@ -60,6 +70,47 @@ typedef struct {
     int data_hwm;                               //!< ZMQ High Water Mark of data zocket
     int ctrl_hwm;                               //!< ZMQ High Water Mark of control zocket
     size_t tsd_log_buf_size;                    //!< Size in bytes of the logging buffer
+    bxilog_transport_e transport;               //!< The records transport
+    size_t ring_size;                           //!< Size in bytes of each ring when
+                                                //!< transport is BXILOG_TRANSPORT_RING
+    bool shared_records;                        //!< When true, a single reference-counted
+                                                //!< record is sent to all handlers instead
+                                                //!< of one copy per handler
+                                                //!< (BXILOG_TRANSPORT_ZMQ only)
+    bool deferred_formatting;                   //!< When true, log messages are formatted
+                                                //!< by handler threads: business threads
+                                                //!< only capture the format and its
+                                                //!< arguments. Formats must then remain
+                                                //!< valid until processed (string
+                                                //!< literals are fine)
+    size_t slab_max_size;                       //!< Records up to this size in bytes are
+                                                //!< allocated from a per-thread slab,
+                                                //!< larger ones are malloc()ed
+                                                //!< (0 disables the slab)
+    size_t batch_size;                          //!< When not 0, each thread batches its
+                                                //!< records into frames of up to this
+                                                //!< size in bytes
+                                                //!< (BXILOG_TRANSPORT_ZMQ only)
+    size_t batch_records_max;                   //!< A batch is sent once it holds
+                                                //!< this number of records
+    double batch_latency_s;                     //!< A batch is sent once its first record
+                                                //!< is older than this, within half this
+                                                //!< delay: batches of idle threads are
+                                                //!< sent by a timer thread. Batches of
+                                                //!< all threads are also sent on
+                                                //!< bxilog_flush(), bxilog_finalize()
+                                                //!< and fatal signals, a thread batch
+                                                //!< on its exit
+    size_t tsd_pool_size;                       //!< When not 0, the thread-specific data
+                                                //!< (zockets, rings, buffers) of up to
+                                                //!< this number of exited threads are
+                                                //!< kept and given to new threads, so
+                                                //!< thread creation is cheap for thread
+                                                //!< pools churning threads
+    size_t handler_threads_nb;                  //!< When not 0, handlers share this
+                                                //!< number of threads (handler i runs
+                                                //!< in thread i % handler_threads_nb)
+                                                //!< instead of one thread each
     size_t handlers_nb;                         //!< Number of logging handlers
     const char * progname;                      //!< Program name used by bxilog_init()
                                                 //!< to set the process name (on linux
@@ -159,5 +210,26 @@ void bxilog_config_add_handler(bxilog_config_p self,
                                bxilog_filters_p filters,
                                ...);
 
+/**
+ * Add the given handler to the given configuration, run by shards_nb threads.
+ *
+ * Each thread is a distinct instance of the handler, created with the same
+ * parameters: its bxilog_handler_param_s.shard tells which shard it is (handlers
+ * usually write to their own output segment, e.g. the file handler appends
+ * ".<shard>" to its filename). All records of a given business thread are processed
+ * by the same shard, so their order is kept.
+ *
+ * @param[in] self a bxilog configuration
+ * @param[in] shards_nb the number of threads (at least 1)
+ * @param[in] handler a bxilog handler
+ * @param[in] filters a set of bxilog_filter_p terminated by NULL
+ *
+ */
+void bxilog_config_add_sharded_handler(bxilog_config_p self,
+                                       size_t shards_nb,
+                                       bxilog_handler_p handler,
+                                       bxilog_filters_p filters,
+                                       ...);
+
 
 #endif /* BXILOG_H_ */
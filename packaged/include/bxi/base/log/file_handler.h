@@ -37,6 +37,32 @@
 //********************************** Types ****************************************
 //*********************************************************************************
 
+/**
+ * How the file handler writes its buffer, see bxilog_file_handler_param_set_write().
+ */
+typedef enum {
+    BXILOG_FILE_WRITE_SYNC=0,       //!< write() from the handler thread (default)
+    BXILOG_FILE_WRITE_ASYNC=1,      //!< io_uring when available for the file, a writer
+                                    //!< thread otherwise
+    BXILOG_FILE_WRITE_THREAD=2,     //!< A writer thread
+    BXILOG_FILE_WRITE_MMAP=3,       //!< Lines are formatted directly into the mapped
+                                    //!< file, grown by preallocated extents and
+                                    //!< truncated to its written length on exit
+                                    //!< (regular files only, write() otherwise)
+    BXILOG_FILE_WRITE_WRITEV=4,     //!< Batches of records are written with writev()
+                                    //!< from the handler thread: messages are written
+                                    //!< from the records instead of being copied to a
+                                    //!< buffer first
+} bxilog_file_write_e;
+
+/**
+ * How rotated segments are compressed, see bxilog_file_handler_param_set_rotation().
+ */
+typedef enum {
+    BXILOG_FILE_COMPRESS_NONE=0,    //!< Segments are kept as is (default)
+    BXILOG_FILE_COMPRESS_GZIP=1,    //!< Into <segment>.gz (when built with zlib)
+    BXILOG_FILE_COMPRESS_ZSTD=2,    //!< Into <segment>.zst (when built with zstd)
+} bxilog_file_compress_e;
 
 //*********************************************************************************
 //********************************** Global Variables  ****************************
@@ -67,9 +93,62 @@ extern char BXILOG_FILE_HANDLER_LOG_LEVEL_STR[];
 //********************************** Interfaces        ****************************
 //*********************************************************************************
 
+/**
+ * Set how the given file handler parameters write logs.
+ *
+ * In asynchronous modes, the handler formats lines into the next buffer while up to
+ * queue_depth previous ones are being written, in order. An explicit flush
+ * (bxilog_flush()) still returns once everything has been written.
+ *
+ * In ::BXILOG_FILE_WRITE_MMAP mode, the file is only written by its handler: it
+ * must not be shared with other writers and, until the handler exits, it includes
+ * the zeroed end of the last preallocated extent.
+ *
+ * Modes are exclusive: queue_depth and inflight_max only apply to
+ * ::BXILOG_FILE_WRITE_ASYNC and ::BXILOG_FILE_WRITE_THREAD and must be 0 otherwise.
+ *
+ * @param[inout] param parameters created for ::BXILOG_FILE_HANDLER
+ * @param[in] mode the write mode
+ * @param[in] queue_depth the maximum number of buffers being written
+ *            (0: default, 2)
+ * @param[in] inflight_max the maximum number of bytes being written (0: no limit)
+ *
+ * @return BXIERR_OK on success, anything else if the mode is unknown or does not
+ *         take the given queue_depth or inflight_max
+ */
+bxierr_p bxilog_file_handler_param_set_write(bxilog_handler_param_p param,
+                                             bxilog_file_write_e mode,
+                                             size_t queue_depth,
+                                             size_t inflight_max);
 
-#endif
-
-
-
+/**
+ * Set when the file of the given file handler parameters is rotated.
+ *
+ * On rotation, the file becomes the segment <filename>.<YYYYMMDDTHHMMSS>[.<n>] and a
+ * new file, created beforehand as <filename>.rotating, takes its place: the file name
+ * always refers to a complete file. Creating, naming, closing, compressing and
+ * removing files are done by a low priority background thread, never by the handler
+ * thread: a rotation is postponed while the next file is not created yet, and the
+ * file name may refer to the previous segment for a while after it. Records are never
+ * split across segments.
+ *
+ * Rotation only applies to regular files (not to stdout nor stderr).
+ *
+ * @param[inout] param parameters created for ::BXILOG_FILE_HANDLER
+ * @param[in] max_bytes the file is rotated once it reaches this size (0: no limit)
+ * @param[in] interval_s the file is rotated on each multiple of this number of
+ *            seconds, in local time (e.g. 86400: every midnight), 0: never
+ * @param[in] keep_nb the number of segments kept, older ones are removed
+ *            (0: all of them)
+ * @param[in] compress how segments are compressed
+ *
+ * @return BXIERR_OK on success, anything else if compress is unknown or not
+ *         available in this build
+ */
+bxierr_p bxilog_file_handler_param_set_rotation(bxilog_handler_param_p param,
+                                                size_t max_bytes,
+                                                long interval_s,
+                                                size_t keep_nb,
+                                                bxilog_file_compress_e compress);
 
+#endif
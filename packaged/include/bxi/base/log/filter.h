@@ -74,6 +74,8 @@ struct bxilog_filters_s {
     bool allocated;                 //!< If true, means it must be deallocated
     size_t nb;                      //!< Number of filters in the list
     size_t allocated_slots;         //!< Number of allocated slots in the list
+    void * trie;                    //!< Prefix tree of the list, maintained by
+                                    //!< bxilog_filters_add() (internal)
     bxilog_filter_p list[];         //!< The list of filter.
 };
 
@@ -53,6 +53,11 @@
  */
 #define BXILOG_TOO_MANY_IERR 700471322     // Leet code  for TOO .A.7 IERR
 
+/**
+ * Maximum number of records given at once to process_log_batch().
+ */
+#define BXILOG_HANDLER_BATCH_MAX 64
+
 #if defined(__x86_64__)  || defined(__aarch64__)
 #define TIMESPEC_SIZE 16
 #elif defined(__i386__) || defined(__arm__)
@@ -74,6 +79,8 @@ typedef struct {
 // TODO: reorganize with most-often used data first
 // see cachegrind results.
     bxilog_level_e level;               //!< log level
+    uint32_t flags;                     //!< internal flags, always 0 in records
+                                        //!< given to process_log()
 #ifndef BXICFFI
     struct timespec detail_time;        //!< log timestamp
 #else
@@ -93,6 +100,10 @@ typedef struct {
 #endif
     uintptr_t thread_rank;              //!< user thread rank
     int line_nb;                        //!< line nb
+    uint32_t site_id;                   //!< call site id (process local), when not 0
+                                        //!< filename and funcname are not stored
+                                        //!< after the record
+    uint32_t logger_id;                 //!< logger id (process local), 0 if unknown
     size_t filename_len;                //!< file name length
     size_t funcname_len;                //!< function name length
     size_t logname_len;                 //!< logger name length
@@ -104,12 +115,59 @@ typedef struct {
  */
 typedef bxilog_record_s * bxilog_record_p;
 
+/**
+ * A record given to process_log_batch() with its strings.
+ */
+typedef struct {
+    bxilog_record_p record;             //!< the logging record
+    char * filename;                    //!< the filename
+    char * funcname;                    //!< the function name
+    char * loggername;                  //!< the logger name
+    char * logmsg;                      //!< the actual log message
+} bxilog_batch_entry_s;
+
+/**
+ * A batch entry object.
+ */
+typedef bxilog_batch_entry_s * bxilog_batch_entry_p;
+
 typedef enum {
     BXI_LOG_HANDLER_NOT_READY=0,
     BXI_LOG_HANDLER_READY=1,
     BXI_LOG_HANDLER_ERROR=2,
 } bxilog_handler_state_e;
 
+/**
+ * What business threads do when a handler does not keep up with the logging rate
+ * (its data queue or ring is full).
+ *
+ * Only BXILOG_BACKPRESSURE_BLOCK waits for the handler. Other policies retry
+ * the records they keep a few times without blocking: if the queue is still full,
+ * such records are dropped too, see bxilog_drop_stats_s.overflow_nb.
+ */
+typedef enum {
+    BXILOG_BACKPRESSURE_BLOCK=0,            //!< Wait for the handler (default)
+    BXILOG_BACKPRESSURE_DROP_NEWEST=1,      //!< Drop the record being logged
+    BXILOG_BACKPRESSURE_DROP_OLDEST=2,      //!< Ask the handler to drop the records
+                                            //!< queued so far, retry the new one
+    BXILOG_BACKPRESSURE_DROP_BELOW_LEVEL=3, //!< Drop the record if its level is lower
+                                            //!< than backpressure_level, retry it
+                                            //!< otherwise
+} bxilog_backpressure_e;
+
+/**
+ * The scheduling policy of a handler thread, see sched(7).
+ */
+typedef enum {
+    BXILOG_SCHED_INHERIT=0,                 //!< Keep the policy of the thread calling
+                                            //!< bxilog_init() (default)
+    BXILOG_SCHED_OTHER=1,                   //!< SCHED_OTHER
+    BXILOG_SCHED_BATCH=2,                   //!< SCHED_BATCH
+    BXILOG_SCHED_IDLE=3,                    //!< SCHED_IDLE
+    BXILOG_SCHED_FIFO=4,                    //!< SCHED_FIFO, see sched_priority
+    BXILOG_SCHED_RR=5,                      //!< SCHED_RR, see sched_priority
+} bxilog_sched_policy_e;
+
 
 // Log handler parameter forward reference.
 typedef struct bxilog_handler_param_s bxilog_handler_param_s;
@@ -135,9 +193,40 @@ struct bxilog_handler_param_s {
     long flush_freq_ms;                 //!< Implicit flush frequency
     char * data_url;                    //!< The data zocket URL
     char * ctrl_url;                    //!< The control zocket URL
+    bxilog_level_e priority_level;      //!< Records at this level or above are sent
+                                        //!< through the priority zocket, which is
+                                        //!< always processed first (BXILOG_OFF:
+                                        //!< no priority zocket)
+    int priority_hwm;                   //!< ZMQ High Water Mark for the priority zocket
+    char * priority_url;                //!< The priority zocket URL
     bxilog_filters_p filters;           //!< The filters
     size_t rank;                        //!< identifier of the handler
     bxilog_handler_state_e status;      //!< handler status
+    bxilog_backpressure_e backpressure; //!< What to do when the handler is saturated
+    bxilog_level_e backpressure_level;  //!< Lowest level kept when saturated with
+                                        //!< BXILOG_BACKPRESSURE_DROP_BELOW_LEVEL
+    size_t shards_nb;                   //!< Number of threads the logical handler is
+                                        //!< made of (1: not sharded), see
+                                        //!< bxilog_config_add_sharded_handler()
+    size_t shard;                       //!< This thread shard, in [0, shards_nb)
+    char * cpus;                        //!< CPUs the handler thread runs on, in the
+                                        //!< cpuset(7) list format (e.g. "0-3,8"),
+                                        //!< NULL: inherited. Set it with
+                                        //!< bxilog_handler_param_set_cpus()
+    int numa_node;                      //!< NUMA node the handler thread allocates
+                                        //!< its memory (e.g. buffers) on, and runs on
+                                        //!< when cpus is NULL (-1: no placement)
+    int nice;                           //!< Nice value of the handler thread
+                                        //!< (0: inherited)
+    bxilog_sched_policy_e sched_policy; //!< Scheduling policy of the handler thread
+    int sched_priority;                 //!< Scheduling priority, for BXILOG_SCHED_FIFO
+                                        //!< and BXILOG_SCHED_RR
+    long spin_us;                       //!< When not 0, the handler thread busy-polls
+                                        //!< its inputs up to this time before
+                                        //!< blocking: lower latency for one CPU. The
+                                        //!< actual spin time shrinks while spinning
+                                        //!< finds nothing. Ignored by handlers sharing
+                                        //!< a thread. See bxilog_get_spin_stats()
     size_t private_items_nb;            //!< Number of private items
 #ifndef BXICFFI
     zmq_pollitem_t * private_items;     //!< Private items (zmq/standard sockets or
@@ -218,6 +307,25 @@ struct bxilog_handler_s_f {
                             char * logmsg,
                             bxilog_handler_param_p param);
 
+    /**
+     * Optional: when not NULL, this function is called instead of process_log()
+     * with the records accepted by the filters, in the order they were received.
+     *
+     * The handler thread drains all pending records on each wakeup and gives them
+     * by batches of at most BXILOG_HANDLER_BATCH_MAX records, so a handler can
+     * produce a single write or send for many records.
+     *
+     * Entries, and the records and strings they refer to, are only valid during
+     * the call.
+     *
+     * @param[in] entries the records with their strings
+     * @param[in] n the number of entries (never 0)
+     * @param[in] param the log handler parameter as returned by param_new()
+     */
+    bxierr_p (*process_log_batch)(bxilog_batch_entry_p entries,
+                                  size_t n,
+                                  bxilog_handler_param_p param);
+
     /**
      * Process an internal error, that is an error raised in the handler code itself.
      *
@@ -281,4 +389,18 @@ void bxilog_handler_init_param(bxilog_handler_p handler,
  */
 void bxilog_handler_clean_param(bxilog_handler_param_p param);
 
+/**
+ * Set the CPUs the handler thread runs on.
+ *
+ * Handlers sharing a thread (see bxilog_config_s.handler_threads_nb) should have the
+ * same placement: the last one started wins.
+ *
+ * @param[inout] param the handler parameters
+ * @param[in] cpus a CPU list in the cpuset(7) list format such as "0-3,8", or NULL
+ *            to inherit the affinity of the thread calling bxilog_init()
+ *
+ * @return BXIERR_OK on success, anything else if the list can't be parsed
+ */
+bxierr_p bxilog_handler_param_set_cpus(bxilog_handler_param_p param, const char * cpus);
+
 #endif /* BXILOG_H_ */
@@ -5,6 +5,7 @@
 
 #ifndef BXICFFI
 #include <stdbool.h>
+#include <stdint.h>
 #endif
 
 
@@ -32,54 +33,75 @@
 // *********************************************************************************
 // ********************************** Defines **************************************
 // *********************************************************************************
+#ifndef BXILOG_COMPILE_MIN_LEVEL
+/**
+ * The least severe level compiled in.
+ *
+ * Logs produced by the macros below at a less severe level are removed at compile
+ * time, while their arguments are still type checked. Define it on the compiler
+ * command line for release builds, e.g: `-DBXILOG_COMPILE_MIN_LEVEL=BXILOG_INFO`.
+ *
+ * @see bxilog_get_compile_min_level()
+ */
+#define BXILOG_COMPILE_MIN_LEVEL BXILOG_LOWEST
+#endif
+
+/**
+ * Return true if logs at the given level are compiled in.
+ *
+ * This is a constant expression when lvl is, so the compiler removes
+ * the dead logging code.
+ */
+#define bxilog_compiled_for(lvl) ((lvl) <= BXILOG_COMPILE_MIN_LEVEL)
+
 /**
  * Produce a log at the `BXILOG_LOWEST` level
  */
-#define LOWEST(logger, ...) bxilog_logger_log(logger, BXILOG_LOWEST, (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__);
+#define LOWEST(logger, ...) bxilog_site_log(logger, BXILOG_LOWEST, __VA_ARGS__);
 /**
  * Produce a log at the `BXILOG_TRACE` level
  */
-#define TRACE(logger, ...) bxilog_logger_log(logger, BXILOG_TRACE, (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__);
+#define TRACE(logger, ...) bxilog_site_log(logger, BXILOG_TRACE, __VA_ARGS__);
 /**
  * Produce a log at the `BXILOG_FINE` level
  */
-#define FINE(logger, ...) bxilog_logger_log(logger, BXILOG_FINE, (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__)
+#define FINE(logger, ...) bxilog_site_log(logger, BXILOG_FINE, __VA_ARGS__)
 /**
  * Produce a log at the `BXILOG_DEBUG` level
  */
-#define DEBUG(logger, ...) bxilog_logger_log(logger, BXILOG_DEBUG, (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__)
+#define DEBUG(logger, ...) bxilog_site_log(logger, BXILOG_DEBUG, __VA_ARGS__)
 /**
  * Produce a log at the `BXILOG_INFO` level
  */
-#define INFO(logger, ...)  bxilog_logger_log(logger, BXILOG_INFO, (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__)
+#define INFO(logger, ...)  bxilog_site_log(logger, BXILOG_INFO, __VA_ARGS__)
 /**
  * Produce a log at the `BXILOG_OUTPUT` level
  */
-#define OUT(logger, ...)   bxilog_logger_log(logger, BXILOG_OUTPUT, (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__)
+#define OUT(logger, ...)   bxilog_site_log(logger, BXILOG_OUTPUT, __VA_ARGS__)
 /**
  * Produce a log at the `BXILOG_NOTICE` level
  */
-#define NOTICE(logger, ...)  bxilog_logger_log(logger, BXILOG_NOTICE, (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__)
+#define NOTICE(logger, ...)  bxilog_site_log(logger, BXILOG_NOTICE, __VA_ARGS__)
 /**
  * Produce a log at the `BXILOG_WARNING` level
  */
-#define WARNING(logger, ...)  bxilog_logger_log(logger, BXILOG_WARNING, (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__)
+#define WARNING(logger, ...)  bxilog_site_log(logger, BXILOG_WARNING, __VA_ARGS__)
 /**
  * Produce a log at the `BXILOG_ERROR` level
  */
-#define ERROR(logger, ...)   bxilog_logger_log(logger, BXILOG_ERROR, (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__)
+#define ERROR(logger, ...)   bxilog_site_log(logger, BXILOG_ERROR, __VA_ARGS__)
 /**
  * Produce a log at the `BXILOG_CRITICAL` level
  */
-#define CRITICAL(logger, ...)  bxilog_logger_log(logger, BXILOG_CRITICAL, (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__)
+#define CRITICAL(logger, ...)  bxilog_site_log(logger, BXILOG_CRITICAL, __VA_ARGS__)
 /**
  * Produce a log at the `BXILOG_ALERT` level
  */
-#define ALERT(logger, ...)  bxilog_logger_log(logger, BXILOG_ALERT, (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__)
+#define ALERT(logger, ...)  bxilog_site_log(logger, BXILOG_ALERT, __VA_ARGS__)
 /**
  * Produce a log at the `BXILOG_PANIC` level
  */
-#define PANIC(logger, ...)  bxilog_logger_log(logger, BXILOG_PANIC, (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__)
+#define PANIC(logger, ...)  bxilog_site_log(logger, BXILOG_PANIC, __VA_ARGS__)
 
 
 
@@ -91,7 +113,7 @@
 // TODO: do log the actual log also with the same format than the actual log instead
 // of throwing it away
 #define bxilog_logger_log(logger, lvl, filename, filename_len, funcname, funcname_len, line, ...) do {\
-        if (bxilog_logger_is_enabled_for((logger), (lvl))) {                            \
+        if (bxilog_compiled_for(lvl) && bxilog_logger_is_enabled_for((logger), (lvl))) {\
             bxierr_p __err__ = bxilog_logger_log_nolevelcheck((logger), (lvl),          \
                                                        (filename), (filename_len),      \
                                                        (funcname), (funcname_len),      \
@@ -102,6 +124,77 @@
         }                                                                               \
     } while(false);
 
+/**
+ * Initial value of the static `bxilog_site_s` of the current call site.
+ */
+#define BXILOG_SITE_INITIALIZER {                                                       \
+            (char *)__FILE__, ARRAYLEN(__FILE__), __func__, ARRAYLEN(__func__),         \
+            __LINE__, 0, {0, 0, 0, 0}, NULL, 0                                          \
+        }
+
+/**
+ * Create a log using the given logger at the given level from the current call site.
+ *
+ * The source file, function and line of the call site are stored once in a static
+ * `bxilog_site_s`: records only carry the site id instead of copies of those strings.
+ *
+ * @see `bxilog_logger_log_site_nolevelcheck()`
+ */
+#define bxilog_site_log(logger, lvl, ...) do {\
+        static bxilog_site_s __site__ = BXILOG_SITE_INITIALIZER;                        \
+        if (bxilog_compiled_for(lvl) && bxilog_logger_is_enabled_for((logger), (lvl))) {\
+            bxierr_p __err__ = bxilog_logger_log_site_nolevelcheck((logger), (lvl),     \
+                                                                   &__site__,           \
+                                                                   __VA_ARGS__);        \
+            if (bxierr_isko(__err__)) {                                                 \
+                bxierr_report(&__err__, STDOUT_FILENO);                                 \
+            }                                                                           \
+        }                                                                               \
+    } while(false);
+
+/**
+ * Same as `bxilog_site_log()` but the call site emits at most `rate_per_s` logs per
+ * second, with bursts of up to `burst` logs.
+ *
+ * Suppressed logs are counted and reported periodically by a summary log.
+ *
+ * @see `bxilog_logger_log_site_limited_nolevelcheck()`
+ */
+#define bxilog_site_log_ratelimit(logger, lvl, rate_per_s, burst, ...) do {\
+        static bxilog_site_s __site__ = BXILOG_SITE_INITIALIZER;                        \
+        if (bxilog_compiled_for(lvl) && bxilog_logger_is_enabled_for((logger), (lvl))) {\
+            bxierr_p __err__ = bxilog_logger_log_site_limited_nolevelcheck((logger),    \
+                                                                   (lvl),               \
+                                                                   &__site__,           \
+                                                                   (rate_per_s),        \
+                                                                   (burst), 0,          \
+                                                                   __VA_ARGS__);        \
+            if (bxierr_isko(__err__)) {                                                 \
+                bxierr_report(&__err__, STDOUT_FILENO);                                 \
+            }                                                                           \
+        }                                                                               \
+    } while(false);
+
+/**
+ * Same as `bxilog_site_log()` but the call site emits only 1 log every `every` logs.
+ *
+ * Suppressed logs are counted and reported periodically by a summary log.
+ *
+ * @see `bxilog_logger_log_site_limited_nolevelcheck()`
+ */
+#define bxilog_site_log_sample(logger, lvl, every, ...) do {\
+        static bxilog_site_s __site__ = BXILOG_SITE_INITIALIZER;                        \
+        if (bxilog_compiled_for(lvl) && bxilog_logger_is_enabled_for((logger), (lvl))) {\
+            bxierr_p __err__ = bxilog_logger_log_site_limited_nolevelcheck((logger),    \
+                                                                   (lvl),               \
+                                                                   &__site__,           \
+                                                                   0, 0, (every),       \
+                                                                   __VA_ARGS__);        \
+            if (bxierr_isko(__err__)) {                                                 \
+                bxierr_report(&__err__, STDOUT_FILENO);                                 \
+            }                                                                           \
+        }                                                                               \
+    } while(false);
 
 /**
  * Defines a new logger as a global variable
@@ -114,7 +207,10 @@
                                         false, \
                                         logger_name,\
                                         ARRAYLEN(logger_name),\
-                                        BXILOG_LOWEST\
+                                        BXILOG_LOWEST,\
+                                        0, 0, 0,\
+                                        {0, 0, 0, 0},\
+                                        0\
     };\
     static bxilog_logger_p const variable_name = &variable_name ## _s;\
     static __attribute__((constructor)) void __bxilog_register_log__ ## variable_name(void) {\
@@ -156,6 +252,19 @@
 // ********************************** Types   **************************************
 // *********************************************************************************
 
+/**
+ * The state of a rate limiter, see `bxilog_logger_set_ratelimit()`.
+ *
+ * Zero initialized, updated lock-free by logging threads.
+ */
+typedef struct bxilog_ratelimit_s {
+    uint64_t tat_ns;                //!< Theoretical arrival time of the next log
+    uint64_t seen_nb;               //!< Number of logs seen, for sampling
+    uint64_t suppressed_nb;         //!< Number of logs suppressed since the last report,
+                                    //!< kept by the library for registered call sites
+    uint64_t reported_ns;           //!< Time of the last report
+} bxilog_ratelimit_s;
+
 /**
  * Data structure representing a logger.
  *
@@ -166,6 +275,11 @@ struct bxilog_logger_s {
     const char * name;              //!< Logger name
     size_t name_length;             //!< Logger name length, including NULL ending byte
     bxilog_level_e level;           //!< Logger level
+    double rate_per_s;              //!< Maximum logs per second per call site, 0: no limit
+    size_t rate_burst;              //!< Logs allowed at once above rate_per_s
+    size_t sample_every;            //!< Keep 1 log every sample_every per call site
+    bxilog_ratelimit_s ratelimit;   //!< Limiter of the logs without call site
+    uint32_t id;                    //!< Process local id, given on first registration
 };
 
 
@@ -177,6 +291,36 @@ struct bxilog_logger_s {
  */
 typedef struct bxilog_logger_s * bxilog_logger_p;
 
+#ifndef BXICFFI
+/**
+ * A static log call site, see `bxilog_site_log()`.
+ *
+ * The first fields are set at compile time, the others when the site
+ * is registered, on its first log. The registration copies what handlers need,
+ * so the module of the site may be unloaded while its records are still queued.
+ *
+ * Whether handlers accept the logs of the site is cached, so records no handler
+ * wants are not even produced. The cache is invalidated whenever loggers are
+ * reconfigured or their level changes.
+ */
+typedef struct bxilog_site_s {
+    const char * fullfilename;      //!< Source file name, as given by __FILE__
+    size_t fullfilename_len;        //!< Including NULL ending byte
+    const char * funcname;          //!< Function name
+    size_t funcname_len;            //!< Including NULL ending byte
+    int line;                       //!< Line number in the source file
+    uint32_t id;                    //!< Site id, 0 until the site is registered
+    bxilog_ratelimit_s ratelimit;   //!< Rate limiting and sampling of this site
+    bxilog_logger_p logger;         //!< Logger of the first log, set on registration
+    uint64_t wanted;                //!< Cached "a handler accepts it" decision for logger
+} bxilog_site_s;
+
+/**
+ * A static log call site.
+ */
+typedef bxilog_site_s * bxilog_site_p;
+#endif
+
 
 // *********************************************************************************
 // ********************************** Global Variables *****************************
@@ -275,6 +419,57 @@ bxierr_p bxilog_logger_log_nolevelcheck(const bxilog_logger_p logger, const bxil
 
 
 #ifndef BXICFFI
+/**
+ * Create a log unconditionally from the given call site.
+ *
+ * This is what `bxilog_site_log()` (and therefore all level macros) calls.
+ * The site is registered on its first use.
+ *
+ * @param[in] logger the logger to perform the log with
+ * @param[in] level the level at which the log must be emitted
+ * @param[in] site the static call site the log comes from
+ * @param[in] fmt the printf like format of the message
+ *
+ * @return BXIERR_OK on success, any other value is an error
+ *
+ * @see bxilog_site_log()
+ * @see bxierr_p
+ */
+bxierr_p bxilog_logger_log_site_nolevelcheck(const bxilog_logger_p logger,
+                                             const bxilog_level_e level,
+                                             bxilog_site_p site,
+                                             const char * fmt, ...)
+                                             __attribute__ ((format (printf, 4, 5)));
+
+/**
+ * Create a log from the given call site unless it is rate limited.
+ *
+ * The given limits take precedence over those of the logger
+ * (see `bxilog_logger_set_ratelimit()`), which apply when none is given.
+ * The check is done before any formatting, so suppressed logs are cheap.
+ *
+ * @param[in] logger the logger to perform the log with
+ * @param[in] level the level at which the log must be emitted
+ * @param[in] site the static call site the log comes from
+ * @param[in] rate_per_s the maximum number of logs per second, 0 for no limit
+ * @param[in] burst the number of logs allowed at once
+ * @param[in] sample_every keep only 1 log every sample_every, 0 or 1 to keep them all
+ * @param[in] fmt the printf like format of the message
+ *
+ * @return BXIERR_OK on success (including when the log is suppressed),
+ *         any other value is an error
+ *
+ * @see bxilog_site_log_ratelimit()
+ * @see bxilog_site_log_sample()
+ */
+bxierr_p bxilog_logger_log_site_limited_nolevelcheck(const bxilog_logger_p logger,
+                                                     const bxilog_level_e level,
+                                                     bxilog_site_p site,
+                                                     double rate_per_s, size_t burst,
+                                                     size_t sample_every,
+                                                     const char * fmt, ...)
+                                                     __attribute__ ((format (printf, 7, 8)));
+
 /**
  * Equivalent to `bxilog_log_nolevelcheck()` but with a va_list instead of
  * a variable number of arguments.
@@ -316,6 +511,33 @@ bxilog_level_e bxilog_logger_get_level(const bxilog_logger_p logger);
  */
 void bxilog_logger_set_level(const bxilog_logger_p logger, const bxilog_level_e level);
 
+/**
+ * Limit the rate of the logs produced by the given logger.
+ *
+ * Each call site is limited to rate_per_s logs per second with bursts of up to
+ * burst logs (a token bucket). Logs produced without a call site (such as from
+ * high level languages) share a single limiter per logger.
+ *
+ * Suppressed logs are counted and a summary log is produced at most once per second,
+ * and at `bxilog_finalize()`.
+ *
+ * @param[in] logger the logger instance
+ * @param[in] rate_per_s the maximum number of logs per second, 0 for no limit
+ * @param[in] burst the number of logs allowed at once
+ */
+void bxilog_logger_set_ratelimit(const bxilog_logger_p logger,
+                                 double rate_per_s, size_t burst);
+
+/**
+ * Keep only 1 log every `every` logs of each call site of the given logger.
+ *
+ * @param[in] logger the logger instance
+ * @param[in] every the sampling period, 0 or 1 to keep all logs
+ *
+ * @see bxilog_logger_set_ratelimit()
+ */
+void bxilog_logger_set_sampling(const bxilog_logger_p logger, size_t every);
+
 /**
  * Reconfigure the given logger according to the current bxilog configuration.
  *
@@ -323,6 +545,18 @@ void bxilog_logger_set_level(const bxilog_logger_p logger, const bxilog_level_e
  */
 void bxilog_logger_reconfigure(const bxilog_logger_p logger);
 
+/**
+ * Return the least severe level compiled in the library.
+ *
+ * Logs less severe than this level are not produced by the library itself,
+ * whatever the loggers level.
+ *
+ * @return the BXILOG_COMPILE_MIN_LEVEL the library has been compiled with
+ *
+ * @see BXILOG_COMPILE_MIN_LEVEL
+ */
+bxilog_level_e bxilog_get_compile_min_level(void);
+
 /**
  * Return true if the given logger is enabled at the given log level.
  *
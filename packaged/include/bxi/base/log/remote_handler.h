@@ -24,6 +24,14 @@
 //*********************************************************************************
 
 #define BXILOG_REMOTE_HANDLER_RECORD_HEADER "level/"
+/**
+ * Record frames start with a bxilog_remote_record_header_s.
+ *
+ * Records are sent raw: the version must be increased whenever the layout of
+ * bxilog_record_s changes, so receivers reject records they would misread.
+ */
+#define BXILOG_REMOTE_HANDLER_RECORD_MAGIC 0x42584c47u   // "BXLG"
+#define BXILOG_REMOTE_HANDLER_RECORD_VERSION 2u
 #define BXILOG_REMOTE_HANDLER_EXITING_HEADER ".ctrl/exit"
 #define BXILOG_REMOTE_HANDLER_CFG_CMD "get-config"
 
@@ -36,6 +44,14 @@
 //*********************************  Types  ***************************************
 //*********************************************************************************
 
+/**
+ * The header of a record frame, followed by the record.
+ */
+typedef struct {
+    uint32_t magic;                     //!< BXILOG_REMOTE_HANDLER_RECORD_MAGIC
+    uint32_t version;                   //!< BXILOG_REMOTE_HANDLER_RECORD_VERSION
+} bxilog_remote_record_header_s;
+
 //*********************************************************************************
 //****************************  Global Variables  *********************************
 //*********************************************************************************
@@ -15,6 +15,7 @@ from __future__ import print_function
 import importlib
 
 import bxi.base as bxibase
+import bxi.base.err as bxierr
 
 # Find the C library
 __FFI__ = bxibase.get_ffi()
@@ -32,4 +33,43 @@ def add_handler(configobj, section_name, c_config):
     section = configobj[section_name]
     module_name = section['module']
     module = importlib.import_module(module_name)
+    first = c_config.handlers_nb
     module.add_handler(configobj, section_name, c_config)
+    # A handler might be made of several threads (e.g. sharded file handler)
+    for i in range(first, c_config.handlers_nb):
+        _set_thread_options(section, c_config.handlers_params[i])
+
+
+def _set_thread_options(section, c_param):
+    """
+    Set the handler thread options found in the given section, if any
+
+    Options are:
+        - cpus: the CPUs the thread runs on, such as '0-3,8' (see cpuset(7))
+        - numa_node: the NUMA node the thread allocates its buffers on
+        - nice: the thread nice value
+        - sched_policy: one of 'other', 'batch', 'idle', 'fifo' or 'rr'
+        - sched_priority: the priority for the 'fifo' and 'rr' policies
+        - spin_us: the time the thread busy-polls its inputs before blocking
+
+    @param[in] section the handler section in the configobj
+    @param[inout] c_param the handler parameters
+    """
+    if section.get('cpus') is not None:
+        err_p = __BXIBASE_CAPI__.bxilog_handler_param_set_cpus(c_param,
+                                                              str(section['cpus']))
+        bxierr.BXICError.raise_if_ko(err_p)
+    if section.get('numa_node') is not None:
+        c_param.numa_node = int(section['numa_node'])
+    if section.get('nice') is not None:
+        c_param.nice = int(section['nice'])
+    if section.get('sched_policy') is not None:
+        name = 'BXILOG_SCHED_%s' % section['sched_policy'].upper()
+        if not hasattr(__BXIBASE_CAPI__, name):
+            raise bxierr.BXIError("Unknown scheduling policy: '%s'" %
+                                  section['sched_policy'])
+        c_param.sched_policy = getattr(__BXIBASE_CAPI__, name)
+    if section.get('sched_priority') is not None:
+        c_param.sched_priority = int(section['sched_priority'])
+    if section.get('spin_us') is not None:
+        c_param.spin_us = int(section['spin_us'])
@@ -50,6 +50,26 @@ def add_handler(configobj, section_name, c_config):
         filename = os.path.abspath(filename)
     section['path'] = filename
     append = section.as_bool('append')
+    # Number of threads writing their own segment (path.<shard>) when greater than 1
+    shards = section.as_int('shards') if 'shards' in section else 1
+    handler = __BXIBASE_CAPI__.BXILOG_FILE_HANDLER
+    # One of 'sync', 'async' (io_uring when available), 'thread', 'mmap' or 'writev'
+    # (batches are written from the records instead of being copied to a buffer)
+    write = section.get('write', 'sync')
+    write_mode = 'BXILOG_FILE_WRITE_%s' % write.upper()
+    if not hasattr(__BXIBASE_CAPI__, write_mode):
+        raise bxierr.BXIError("Unknown file write mode: '%s'" % write)
+    queue_depth = section.as_int('queue_depth') if 'queue_depth' in section else 0
+    inflight_max = section.as_int('inflight_max') if 'inflight_max' in section else 0
+    # Rotation on a size in bytes and/or every interval in seconds
+    rotate_bytes = section.as_int('rotate_bytes') if 'rotate_bytes' in section else 0
+    rotate_interval = section.as_int('rotate_interval') if 'rotate_interval' in section else 0
+    rotate_keep = section.as_int('rotate_keep') if 'rotate_keep' in section else 0
+    # One of 'none', 'gzip' or 'zstd'
+    rotate_compress = section.get('rotate_compress', 'none')
+    compress = 'BXILOG_FILE_COMPRESS_%s' % rotate_compress.upper()
+    if not hasattr(__BXIBASE_CAPI__, compress):
+        raise bxierr.BXIError("Unknown compression: '%s'" % rotate_compress)
 
     if filters_str == FILTERS_AUTO:
         # Compute file filters automatically according to console handler filters
@@ -82,10 +102,34 @@ def add_handler(configobj, section_name, c_config):
     open_flags = __FFI__.cast('int',
                               os.O_CREAT |
                               (os.O_APPEND if append else os.O_TRUNC))
-    __BXIBASE_CAPI__.bxilog_config_add_handler(c_config,
-                                               __BXIBASE_CAPI__.BXILOG_FILE_HANDLER,
-                                               file_filters._cstruct,
-                                               c_config.progname,
-                                               filename,
-                                               open_flags)
+    first = c_config.handlers_nb
+    if shards > 1:
+        __BXIBASE_CAPI__.bxilog_config_add_sharded_handler(c_config,
+                                                           shards,
+                                                           handler,
+                                                           file_filters._cstruct,
+                                                           c_config.progname,
+                                                           filename,
+                                                           open_flags)
+    else:
+        __BXIBASE_CAPI__.bxilog_config_add_handler(c_config,
+                                                   handler,
+                                                   file_filters._cstruct,
+                                                   c_config.progname,
+                                                   filename,
+                                                   open_flags)
 #    __BXIBASE_CAPI__.bxilog_filters_free(file_filters);
+    for i in range(first, c_config.handlers_nb):
+        err_p = __BXIBASE_CAPI__.bxilog_file_handler_param_set_write(c_config.handlers_params[i],
+                                                                    getattr(__BXIBASE_CAPI__,
+                                                                            write_mode),
+                                                                    queue_depth,
+                                                                    inflight_max)
+        bxierr.BXICError.raise_if_ko(err_p)
+        err_p = __BXIBASE_CAPI__.bxilog_file_handler_param_set_rotation(c_config.handlers_params[i],
+                                                                       rotate_bytes,
+                                                                       rotate_interval,
+                                                                       rotate_keep,
+                                                                       getattr(__BXIBASE_CAPI__,
+                                                                               compress))
+        bxierr.BXICError.raise_if_ko(err_p)
@@ -95,6 +95,18 @@ def _get_usable_filename_from(fullfilename):
     return filename
 
 
+def get_compile_min_level():
+    """
+    Return the least severe level compiled in the underlying C library.
+
+    C logs less severe than this level have been removed at compile time
+    (see BXILOG_COMPILE_MIN_LEVEL), whatever the loggers level.
+
+    @return the least severe logging level compiled in
+    """
+    return __BXIBASE_CAPI__.bxilog_get_compile_min_level()
+
+
 class BXILogger(object):
     """
     A BXILogger instance provides various methods for logging.
@@ -260,6 +272,27 @@ class BXILogger(object):
         """
         __BXIBASE_CAPI__.bxilog_logger_set_level(self.clogger, level)
 
+    def set_ratelimit(self, rate_per_s, burst=1):
+        """
+        Limit the rate of the logs produced by this logger.
+
+        Suppressed logs are counted and periodically reported by a summary log.
+
+        @param[in] rate_per_s the maximum number of logs per second, 0 for no limit
+        @param[in] burst the number of logs allowed at once
+        @return
+        """
+        __BXIBASE_CAPI__.bxilog_logger_set_ratelimit(self.clogger, rate_per_s, burst)
+
+    def set_sampling(self, every):
+        """
+        Keep only 1 log every given number of logs produced by this logger.
+
+        @param[in] every the sampling period, 0 or 1 to keep all logs
+        @return
+        """
+        __BXIBASE_CAPI__.bxilog_logger_set_sampling(self.clogger, every)
+
     def is_enabled_for(self, level):
         """
         Return True if this logger is enabled for the given logging level.
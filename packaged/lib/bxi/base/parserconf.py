@@ -510,6 +510,57 @@ def _configure_log(parser):
                                "%s, instead of owerwriting. " % section +
                                "Value: %(default)s")
 
+        # Placement of any handler thread
+        handlers = config.get('handlers', [])
+        if isinstance(handlers, basestring):
+            handlers = [handlers]
+        for section in handlers:
+            group.add_argument("--log-%s-cpus" % section,
+                               metavar='CPUS',
+                               mustbeprinted=False,
+                               envvar='BXILOG_%s_CPUS' % section.upper(),
+                               default=config[section].get('cpus'),
+                               help="Define the CPUs the %s handler thread " % section +
+                               "runs on, such as '0-3,8'. Value: %(default)s")
+            group.add_argument("--log-%s-numa_node" % section,
+                               metavar='NODE',
+                               mustbeprinted=False,
+                               envvar='BXILOG_%s_NUMA_NODE' % section.upper(),
+                               default=config[section].get('numa_node'),
+                               help="Define the NUMA node the %s handler thread " % section +
+                               "allocates its buffers on. Value: %(default)s")
+            group.add_argument("--log-%s-nice" % section,
+                               metavar='NICE',
+                               mustbeprinted=False,
+                               envvar='BXILOG_%s_NICE' % section.upper(),
+                               default=config[section].get('nice'),
+                               help="Define the nice value of the %s handler " % section +
+                               "thread. Value: %(default)s")
+            group.add_argument("--log-%s-sched_policy" % section,
+                               metavar='POLICY',
+                               mustbeprinted=False,
+                               envvar='BXILOG_%s_SCHED_POLICY' % section.upper(),
+                               default=config[section].get('sched_policy'),
+                               help="Define the scheduling policy of the %s " % section +
+                               "handler thread, one of 'other', 'batch', 'idle', "
+                               "'fifo' or 'rr'. Value: %(default)s")
+            group.add_argument("--log-%s-sched_priority" % section,
+                               metavar='PRIORITY',
+                               mustbeprinted=False,
+                               envvar='BXILOG_%s_SCHED_PRIORITY' % section.upper(),
+                               default=config[section].get('sched_priority'),
+                               help="Define the scheduling priority of the %s " % section +
+                               "handler thread, for the 'fifo' and 'rr' policies. "
+                               "Value: %(default)s")
+            group.add_argument("--log-%s-spin_us" % section,
+                               metavar='US',
+                               mustbeprinted=False,
+                               envvar='BXILOG_%s_SPIN_US' % section.upper(),
+                               default=config[section].get('spin_us'),
+                               help="Define how long the %s handler thread " % section +
+                               "busy-polls its inputs before blocking, in "
+                               "microseconds. Value: %(default)s")
+
     def _override_logconfig(config, known_args, parser):
         """
         Override the given logging configuration with given known_args
@@ -542,6 +593,12 @@ def _configure_log(parser):
             _override_kv(option, 'colors', config, args)
             _override_kv(option, 'path', config, args)
             _override_kv(option, 'append', config, args)
+            _override_kv(option, 'cpus', config, args)
+            _override_kv(option, 'numa_node', config, args)
+            _override_kv(option, 'nice', config, args)
+            _override_kv(option, 'sched_policy', config, args)
+            _override_kv(option, 'sched_priority', config, args)
+            _override_kv(option, 'spin_us', config, args)
 
             # if --quiet option is provided, set output log level for console handlers
             # to minimal settings so that nothing is printed on stdout (nothing change
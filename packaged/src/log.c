@@ -22,6 +22,7 @@
 #include <execinfo.h>
 #include <time.h>
 #include <errno.h>
+#include <inttypes.h>
 
 #include <limits.h>
 
@@ -55,6 +56,9 @@
 #include "log/handler_impl.h"
 #include "log/fork_impl.h"
 #include "log/registry_impl.h"
+#include "log/slab_impl.h"
+#include "log/site_impl.h"
+#include "log/timer_impl.h"
 
 #include "log/log_impl.h"
 
@@ -80,11 +84,15 @@ static bxierr_p _reset_globals();
 static bxierr_p _cleanup(void);
 
 static bxierr_p _start_handler_thread(bxilog_handler_p handler,
-                                      bxilog_handler_param_p param);
+                                      bxilog_handler_param_p param,
+                                      bxilog__ring_set_p ring_set);
+static bxierr_p _start_handler_pool(size_t threads_nb);
 static bxierr_p _sync_handler();
+static bool _handler_failed(size_t handler_rank);
 static bxierr_p _join_handler(size_t handler_rank, bxierr_p *handler_err);
 static void _setprocname();
 static bxierr_p _zmq_str_rcv_timeout(void * zocket, char ** reply, long timeout);
+static void _report_drops(void);
 //*********************************************************************************
 //********************************** Global Variables  ****************************
 //*********************************************************************************
@@ -225,6 +233,7 @@ bxierr_p bxilog_finalize() {
     }
 
     BXIFREE(loggers);
+    bxilog__report_suppressed();
 
     DEBUG(LOGGER, "Exiting bxilog");
     err = bxilog__finalize();
@@ -276,12 +285,16 @@ bxierr_p bxilog_flush(void) {
     tsd_p tsd = NULL;
     bxierr_p err = bxilog__tsd_get(&tsd);
     if (bxierr_isko(err)) return err;
+    // Records batched by all threads must be flushed too
+    err = bxilog__batch_flush_all(false, true);
+    if (bxierr_isko(err)) return err;
     void * ctl_channel = tsd->ctrl_channel;
     bxierr_list_p errlist = bxierr_list_new();
     for (size_t i = 0; i < BXILOG__GLOBALS->internal_handlers_nb; i++) {
 
         int ret = pthread_kill(BXILOG__GLOBALS->handlers_threads[i], 0);
         if (ESRCH == ret) continue;
+        if (_handler_failed(i)) continue;
 
         err = bxizmq_str_snd(FLUSH_CTRL_MSG_REQ, ctl_channel, 0, 0, 0);
         if (bxierr_isko(err)) {
@@ -318,6 +331,68 @@ bxierr_p bxilog_flush(void) {
     return BXIERR_OK;
 }
 
+void bxilog_get_alloc_stats(bxilog_alloc_stats_p stats) {
+    bxilog__slab_get_stats(stats);
+}
+
+bxierr_p bxilog_get_drop_stats(size_t handler_rank, bxilog_drop_stats_p stats) {
+    bxiassert(NULL != stats);
+    if (INITIALIZED != BXILOG__GLOBALS->state) {
+        return bxierr_new(BXILOG_ILLEGAL_STATE_ERR, NULL, NULL, NULL, NULL,
+                          "Illegal state: %d", BXILOG__GLOBALS->state);
+    }
+    if (handler_rank >= BXILOG__GLOBALS->internal_handlers_nb) {
+        return bxierr_gen("Bad handler rank: %zu, only %zu handlers",
+                          handler_rank, BXILOG__GLOBALS->internal_handlers_nb);
+    }
+    bxilog_drop_stats_p drops = &BXILOG__GLOBALS->backpressure[handler_rank].drops;
+    stats->newest_nb = __atomic_load_n(&drops->newest_nb, __ATOMIC_RELAXED);
+    stats->oldest_nb = __atomic_load_n(&drops->oldest_nb, __ATOMIC_RELAXED);
+    stats->below_level_nb = __atomic_load_n(&drops->below_level_nb, __ATOMIC_RELAXED);
+    stats->overflow_nb = __atomic_load_n(&drops->overflow_nb, __ATOMIC_RELAXED);
+
+    return BXIERR_OK;
+}
+
+bxierr_p bxilog_get_lane_stats(size_t handler_rank, bool priority,
+                               bxilog_lane_stats_p stats) {
+    bxiassert(NULL != stats);
+    if (INITIALIZED != BXILOG__GLOBALS->state) {
+        return bxierr_new(BXILOG_ILLEGAL_STATE_ERR, NULL, NULL, NULL, NULL,
+                          "Illegal state: %d", BXILOG__GLOBALS->state);
+    }
+    if (handler_rank >= BXILOG__GLOBALS->internal_handlers_nb) {
+        return bxierr_gen("Bad handler rank: %zu, only %zu handlers",
+                          handler_rank, BXILOG__GLOBALS->internal_handlers_nb);
+    }
+    bxilog__lane_s * lane = &BXILOG__GLOBALS->backpressure[handler_rank].lanes[
+                                priority ? BXILOG__LANE_PRIORITY : BXILOG__LANE_NORMAL];
+    const size_t received = __atomic_load_n(&lane->received_nb, __ATOMIC_RELAXED);
+    const size_t sent = __atomic_load_n(&lane->sent_nb, __ATOMIC_RELAXED);
+    stats->queued_nb = (sent > received) ? sent - received : 0;
+    stats->queued_max = __atomic_load_n(&lane->depth_max, __ATOMIC_RELAXED);
+    stats->processed_nb = received;
+
+    return BXIERR_OK;
+}
+
+bxierr_p bxilog_get_spin_stats(size_t handler_rank, bxilog_spin_stats_p stats) {
+    bxiassert(NULL != stats);
+    if (INITIALIZED != BXILOG__GLOBALS->state) {
+        return bxierr_new(BXILOG_ILLEGAL_STATE_ERR, NULL, NULL, NULL, NULL,
+                          "Illegal state: %d", BXILOG__GLOBALS->state);
+    }
+    if (handler_rank >= BXILOG__GLOBALS->internal_handlers_nb) {
+        return bxierr_gen("Bad handler rank: %zu, only %zu handlers",
+                          handler_rank, BXILOG__GLOBALS->internal_handlers_nb);
+    }
+    bxilog_spin_stats_p spin = &BXILOG__GLOBALS->backpressure[handler_rank].spin;
+    stats->spins_nb = __atomic_load_n(&spin->spins_nb, __ATOMIC_RELAXED);
+    stats->hits_nb = __atomic_load_n(&spin->hits_nb, __ATOMIC_RELAXED);
+    stats->spin_ns = __atomic_load_n(&spin->spin_ns, __ATOMIC_RELAXED);
+
+    return BXIERR_OK;
+}
 
 void bxilog_display_loggers(int fd) {
     char ** level_names;
@@ -348,6 +423,22 @@ void bxilog_display_loggers(int fd) {
 }
 
 
+void bxilog__report_suppressed(void) {
+    bxilog_logger_p * loggers = NULL;
+    size_t n = bxilog_registry_getall(&loggers);
+
+    for (size_t i = 0; i < n; i++) {
+        const uint64_t suppressed = __atomic_exchange_n(&loggers[i]->ratelimit.suppressed_nb,
+                                                        0, __ATOMIC_RELAXED);
+        if (0 == suppressed) continue;
+        NOTICE(LOGGER, "Logger %s: %" PRIu64 " logs suppressed by rate limiting "
+               "since the last report", loggers[i]->name, suppressed);
+    }
+
+    BXIFREE(loggers);
+    bxilog__site_report_suppressed();
+}
+
 void bxilog__wipeout() {
     // Remove allocated configuration
     bxilog_registry_reset();
@@ -371,7 +462,15 @@ bxierr_p bxilog__init_globals() {
     BXILOG__GLOBALS->pid = getpid();
     pthread_t * threads = bximem_calloc(BXILOG__GLOBALS->config->handlers_nb * sizeof(*threads));
     BXILOG__GLOBALS->internal_handlers_nb = 0;
+    BXILOG__GLOBALS->pool_threads_nb = 0;
     BXILOG__GLOBALS->handlers_threads = threads;
+    BXILOG__GLOBALS->backpressure = bximem_calloc(BXILOG__GLOBALS->config->handlers_nb *
+                                                  sizeof(*BXILOG__GLOBALS->backpressure));
+    BXILOG__GLOBALS->priority_level = BXILOG_OFF;
+    for (size_t i = 0; i < BXILOG__GLOBALS->config->handlers_nb; i++) {
+        const bxilog_level_e level = BXILOG__GLOBALS->config->handlers_params[i]->priority_level;
+        if (level > BXILOG__GLOBALS->priority_level) BXILOG__GLOBALS->priority_level = level;
+    }
 
     bxiassert(NULL == BXILOG__GLOBALS->zmq_ctx);
 
@@ -391,6 +490,16 @@ bxierr_p bxilog__init_globals() {
 
     BXILOG__GLOBALS->zmq_ctx = ctx;
 
+    if (BXILOG_TRANSPORT_RING == BXILOG__GLOBALS->config->transport) {
+        size_t handlers_nb = BXILOG__GLOBALS->config->handlers_nb;
+        BXILOG__GLOBALS->ring_sets = bximem_calloc(handlers_nb *
+                                                   sizeof(*BXILOG__GLOBALS->ring_sets));
+        for (size_t i = 0; i < handlers_nb; i++) {
+            err = bxilog__ring_set_new(&BXILOG__GLOBALS->ring_sets[i]);
+            if (bxierr_isko(err)) return err;
+        }
+    }
+
     rc = pthread_once(&BXILOG__GLOBALS->tsd_key_once, bxilog__tsd_key_new);
     if (0 != rc) {
         BXILOG__GLOBALS->state = ILLEGAL;
@@ -406,6 +515,18 @@ bxierr_p bxilog__start_handlers(void) {
     bxierr_p err = BXIERR_OK;
     bxierr_list_p errlist = bxierr_list_new();
 
+    size_t threads_nb = 0;
+    for (size_t i = 0; i < BXILOG__GLOBALS->config->handlers_nb; i++) {
+        if (NULL != BXILOG__GLOBALS->config->handlers[i]) threads_nb++;
+    }
+    if (BXILOG__GLOBALS->config->handler_threads_nb < threads_nb) {
+        threads_nb = BXILOG__GLOBALS->config->handler_threads_nb;
+    }
+    if (0 < threads_nb) {
+        bxierr_p ierr = _start_handler_pool(threads_nb);
+        if (bxierr_isko(ierr)) bxierr_list_append(errlist, ierr);
+    }
+
     // Starting handlers
     for (size_t i = 0; i < BXILOG__GLOBALS->config->handlers_nb; i++) {
         bxilog_handler_p handler = BXILOG__GLOBALS->config->handlers[i];
@@ -414,10 +535,15 @@ bxierr_p bxilog__start_handlers(void) {
             bxierr_list_append(errlist, ierr);
             continue;
         }
+        // Already started by the pool
+        if (0 < threads_nb) continue;
         bxierr_p ierr = BXIERR_OK, ierr2;
 
+        bxilog__ring_set_p ring_set = (NULL == BXILOG__GLOBALS->ring_sets) ?
+                                       NULL : BXILOG__GLOBALS->ring_sets[i];
         ierr2 = _start_handler_thread(handler,
-                                      BXILOG__GLOBALS->config->handlers_params[i]);
+                                      BXILOG__GLOBALS->config->handlers_params[i],
+                                      ring_set);
         BXIERR_CHAIN(ierr, ierr2);
 
         if (bxierr_isko(ierr)) bxierr_list_append(errlist, ierr);
@@ -431,10 +557,19 @@ bxierr_p bxilog__start_handlers(void) {
             bxierr_list_append(errlist, ierr);
             continue;
         }
+        // Its pool thread could not be created
+        if (0 < threads_nb &&
+            BXI_LOG_HANDLER_ERROR == BXILOG__GLOBALS->config->handlers_params[i]->status) {
+            continue;
+        }
         bxierr_p ierr = _sync_handler();
         if (bxierr_isko(ierr)) bxierr_list_append(errlist, ierr);
     }
 
+    // Sends batches to the handlers and reports suppressed logs
+    bxierr_p ierr = bxilog__timer_start();
+    if (bxierr_isko(ierr)) bxierr_list_append(errlist, ierr);
+
     if (0 < errlist->errors_nb) {
         err = bxierr_from_list(BXIERR_GROUP_CODE,
                                 errlist,
@@ -457,11 +592,21 @@ bxierr_p bxilog__finalize(void) {
         BXILOG__GLOBALS->state = ILLEGAL;
         return err;
     }
-    BXILOG__GLOBALS->state = FINALIZING;
     bxierr_p err = BXIERR_OK, err2;
+    err2 = bxilog__timer_stop();
+    BXIERR_CHAIN(err, err2);
+    if (INITIALIZED == BXILOG__GLOBALS->state) {
+        // Records batched by threads that did not log since
+        err2 = bxilog__batch_flush_all(false, true);
+        BXIERR_CHAIN(err, err2);
+    }
+    BXILOG__GLOBALS->state = FINALIZING;
     err2 = bxilog__stop_handlers();
     BXIERR_CHAIN(err, err2);
 
+    // Handlers are stopped: counters are final
+    _report_drops();
+
     err2 = _cleanup();
     BXIERR_CHAIN(err, err2);
 
@@ -480,6 +625,8 @@ bxierr_p bxilog__stop_handlers(void) {
         int ret = pthread_kill(handler_thread, 0);
 
         if (ESRCH == ret) continue;
+        // Handlers that failed in a pool thread won't reply anymore
+        if (_handler_failed(i)) continue;
 
         char * url = BXILOG__GLOBALS->config->handlers_params[i]->ctrl_url;
         bxiassert(NULL != url);
@@ -531,6 +678,9 @@ bxierr_p bxilog__stop_handlers(void) {
         }
         BXIFREE(msg);
 
+        // Pool threads exit with their last handler, they are joined below
+        if (0 < BXILOG__GLOBALS->pool_threads_nb) continue;
+
         bxierr_p handler_err;
         err2 = _join_handler(i, &handler_err);
         BXIERR_CHAIN(err, err2);
@@ -538,6 +688,18 @@ bxierr_p bxilog__stop_handlers(void) {
         if (bxierr_isko(handler_err)) bxierr_list_append(errlist, handler_err);
         if (bxierr_isko(err)) bxierr_list_append(errlist, err);
     }
+    // The first handlers are in distinct pool threads
+    for (size_t i = 0; i < BXILOG__GLOBALS->pool_threads_nb; i++) {
+        bxierr_p handler_err;
+        err2 = _join_handler(i, &handler_err);
+        BXIERR_CHAIN(err, err2);
+
+        if (bxierr_isko(handler_err)) bxierr_list_append(errlist, handler_err);
+    }
+    if (0 < BXILOG__GLOBALS->pool_threads_nb && bxierr_isko(err)) {
+        bxierr_list_append(errlist, err);
+        err = BXIERR_OK;
+    }
 
     if (0 < errlist->errors_nb) {
         err2 = bxierr_from_list(BXIERR_GROUP_CODE, errlist,
@@ -616,14 +778,29 @@ bxierr_p _reset_globals() {
     UNUSED(rc); // Nothing to do on pthread_key_delete() see man page
     BXILOG__GLOBALS->tsd_key_once = PTHREAD_ONCE_INIT;
     BXILOG__GLOBALS->internal_handlers_nb = 0;
+    BXILOG__GLOBALS->pool_threads_nb = 0;
     BXIFREE(BXILOG__GLOBALS->handlers_threads);
+    BXIFREE(BXILOG__GLOBALS->backpressure);
+    if (NULL != BXILOG__GLOBALS->ring_sets) {
+        for (size_t i = 0; i < BXILOG__GLOBALS->config->handlers_nb; i++) {
+            bxilog__ring_set_destroy(&BXILOG__GLOBALS->ring_sets[i]);
+        }
+        BXIFREE(BXILOG__GLOBALS->ring_sets);
+    }
 
     return err;
 }
 
 bxierr_p _cleanup(void) {
+    // Pooled zockets would prevent the zmq context destruction
+    bxilog__tsd_pool_drain();
+    // Already stopped, unless bxilog_init() failed
+    bxierr_p err = bxilog__timer_stop();
+    if (bxierr_isko(err)) return err;
+    // The zockets of living threads are not used anymore
+    bxilog__batch_forget_all();
     tsd_p tsd;
-    bxierr_p err = bxilog__tsd_get(&tsd);
+    err = bxilog__tsd_get(&tsd);
     if (tsd != NULL) {
         bxilog__tsd_free(tsd);
     }
@@ -639,7 +816,9 @@ void _check_set_params(bxilog_config_p config) {
     BXILOG__GLOBALS->config = config;
 }
 
-bxierr_p _start_handler_thread(bxilog_handler_p handler, bxilog_handler_param_p param) {
+bxierr_p _start_handler_thread(bxilog_handler_p handler,
+                               bxilog_handler_param_p param,
+                               bxilog__ring_set_p ring_set) {
     bxierr_p err = BXIERR_OK, err2;
     pthread_attr_t attr;
     int rc = pthread_attr_init(&attr);
@@ -656,6 +835,7 @@ bxierr_p _start_handler_thread(bxilog_handler_p handler, bxilog_handler_param_p
     param->rank = BXILOG__GLOBALS->internal_handlers_nb;
     param->status = BXI_LOG_HANDLER_NOT_READY;
     bundle->param = param;
+    bundle->ring_set = ring_set;
 
     pthread_t thread;
     rc = pthread_create(&thread, &attr,
@@ -673,6 +853,79 @@ bxierr_p _start_handler_thread(bxilog_handler_p handler, bxilog_handler_param_p
     return err;
 }
 
+bxierr_p _start_handler_pool(size_t threads_nb) {
+    bxilog_config_p config = BXILOG__GLOBALS->config;
+    bxilog__handler_pool_bundle_p bundles[threads_nb];
+    for (size_t t = 0; t < threads_nb; t++) {
+        bundles[t] = bximem_calloc(sizeof(*bundles[t]));
+        bundles[t]->handlers = bximem_calloc(config->handlers_nb *
+                                             sizeof(*bundles[t]->handlers));
+        bundles[t]->params = bximem_calloc(config->handlers_nb *
+                                           sizeof(*bundles[t]->params));
+        bundles[t]->ring_sets = bximem_calloc(config->handlers_nb *
+                                              sizeof(*bundles[t]->ring_sets));
+    }
+    for (size_t i = 0; i < config->handlers_nb; i++) {
+        if (NULL == config->handlers[i]) continue;
+        bxilog_handler_param_p param = config->handlers_params[i];
+        param->rank = BXILOG__GLOBALS->internal_handlers_nb;
+        param->status = BXI_LOG_HANDLER_NOT_READY;
+
+        bxilog__handler_pool_bundle_p bundle = bundles[param->rank % threads_nb];
+        bundle->handlers[bundle->handlers_nb] = config->handlers[i];
+        bundle->params[bundle->handlers_nb] = param;
+        bundle->ring_sets[bundle->handlers_nb] = (NULL == BXILOG__GLOBALS->ring_sets) ?
+                                                  NULL : BXILOG__GLOBALS->ring_sets[i];
+        bundle->handlers_nb++;
+        BXILOG__GLOBALS->internal_handlers_nb++;
+    }
+
+    bxierr_p err = BXIERR_OK, err2;
+    pthread_attr_t attr;
+    int rc = pthread_attr_init(&attr);
+    if (0 != rc) {
+        err2 = bxierr_fromidx(rc, NULL,
+                              "Calling pthread_attr_init() failed (rc=%d)", rc);
+        BXIERR_CHAIN(err, err2);
+    }
+    rc = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    bxiassert(rc == 0);
+
+    for (size_t t = 0; t < threads_nb; t++) {
+        bxilog__handler_pool_bundle_p bundle = bundles[t];
+        pthread_t thread;
+        if (bxierr_isok(err)) {
+            rc = pthread_create(&thread, &attr,
+                                (void* (*) (void*)) bxilog__handler_pool_start,
+                                bundle);
+            if (0 != rc) {
+                err2 = bxierr_fromidx(rc, NULL,
+                                      "Calling pthread_create() failed (rc=%d)", rc);
+                BXIERR_CHAIN(err, err2);
+            }
+        }
+        if (bxierr_isko(err)) {
+            // Next threads are not created either: pool threads stay the first ones
+            for (size_t h = 0; h < bundle->handlers_nb; h++) {
+                bundle->params[h]->status = BXI_LOG_HANDLER_ERROR;
+            }
+            BXIFREE(bundle->handlers);
+            BXIFREE(bundle->params);
+            BXIFREE(bundle->ring_sets);
+            BXIFREE(bundle);
+            continue;
+        }
+        // The bundle now belongs to the thread
+        for (size_t h = 0; h < bundle->handlers_nb; h++) {
+            BXILOG__GLOBALS->handlers_threads[bundle->params[h]->rank] = thread;
+        }
+        BXILOG__GLOBALS->pool_threads_nb++;
+    }
+    pthread_attr_destroy(&attr);
+
+    return err;
+}
+
 bxierr_p _sync_handler() {
     tsd_p tsd;
     bxierr_p fatal_err = bxilog__tsd_get(&tsd);
@@ -701,6 +954,14 @@ bxierr_p _sync_handler() {
         // Ok, the handler sends us an error msg.
         // We expect the handler to display its own error message so we can free it
         BXILOG__GLOBALS->config->handlers_params[*rank]->status = BXI_LOG_HANDLER_ERROR;
+        if (0 < BXILOG__GLOBALS->pool_threads_nb) {
+            // Its pool thread goes on with other handlers: it can't be joined yet
+            err2 = bxierr_gen("Handler of rank %zu could not start: %s", *rank, msg);
+            BXIERR_CHAIN(err, err2);
+            BXIFREE(msg);
+            BXIFREE(rank);
+            return err;
+        }
         // We expect it to die and the actual error will be returned
         bxierr_p handler_err;
         fatal_err = _join_handler(*rank, &handler_err);
@@ -730,6 +991,13 @@ bxierr_p _join_handler(size_t handler_rank, bxierr_p *handler_err) {
 }
 
 
+bool _handler_failed(size_t handler_rank) {
+    if (0 == BXILOG__GLOBALS->pool_threads_nb) return false;
+    bxilog_handler_param_p param = BXILOG__GLOBALS->config->handlers_params[handler_rank];
+
+    return BXI_LOG_HANDLER_ERROR == __atomic_load_n(&param->status, __ATOMIC_ACQUIRE);
+}
+
 void _setprocname(char * name) {
 #ifdef __linux__
     errno = 0;
@@ -768,3 +1036,23 @@ bxierr_p _zmq_str_rcv_timeout(void * zocket, char ** reply, long timeout) {
 
     return err;
 }
+
+void _report_drops(void) {
+    if (NULL == BXILOG__GLOBALS->backpressure) return;
+    for (size_t i = 0; i < BXILOG__GLOBALS->internal_handlers_nb; i++) {
+        const bxilog_drop_stats_p drops = &BXILOG__GLOBALS->backpressure[i].drops;
+        const size_t total = drops->newest_nb + drops->oldest_nb
+                             + drops->below_level_nb + drops->overflow_nb;
+        if (0 == total) continue;
+        // Logging is over: use stderr
+        char * str = bxistr_new("[W] Handler %s (rank %zu) dropped %zu records "
+                                "because it was saturated "
+                                "(newest: %zu, oldest: %zu, below level: %zu, "
+                                "overflow: %zu)\n",
+                                BXILOG__GLOBALS->config->handlers[i]->name, i, total,
+                                drops->newest_nb, drops->oldest_nb,
+                                drops->below_level_nb, drops->overflow_nb);
+        bxilog_rawprint(str, STDERR_FILENO);
+        BXIFREE(str);
+    }
+}
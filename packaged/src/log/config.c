@@ -42,6 +42,12 @@
 //********************************** Static Functions  ****************************
 //*********************************************************************************
 //--------------------------------- Generic Helpers --------------------------------
+static void _add_handler(bxilog_config_p self,
+                         bxilog_handler_p handler,
+                         bxilog_filters_p filters,
+                         size_t shards_nb,
+                         size_t shard,
+                         va_list ap);
 
 //*********************************************************************************
 //********************************** Global Variables  ****************************
@@ -140,6 +146,16 @@ bxilog_config_p bxilog_config_new(const char * const progname) {
     config->handlers_nb = 0;
     config->ctrl_hwm = 1000;
     config->data_hwm = 1000;
+    config->transport = BXILOG_TRANSPORT_ZMQ;
+    config->ring_size = 64 * 1024;
+    config->shared_records = true;
+    config->deferred_formatting = false;
+    config->slab_max_size = 4096;
+    config->batch_size = 0;
+    config->batch_records_max = 64;
+    config->batch_latency_s = 0.01;
+    config->tsd_pool_size = 0;
+    config->handler_threads_nb = 0;
 
     return config;
 }
@@ -149,21 +165,35 @@ void bxilog_config_add_handler(bxilog_config_p self,
                                bxilog_filters_p filters,
                                ...) {
 
-    size_t new_size = self->handlers_nb + 1;
-    self->handlers = bximem_realloc(self->handlers,
-                                    self->handlers_nb * sizeof(*self->handlers),
-                                    new_size * sizeof(*self->handlers));
-    self->handlers_params = bximem_realloc(self->handlers_params,
-                                           self->handlers_nb * sizeof(*self->handlers_params),
-                                           new_size * sizeof(*self->handlers_params));
-    self->handlers[self->handlers_nb] = handler;
-
     va_list ap;
     va_start(ap, filters);
-    self->handlers_params[self->handlers_nb] = handler->param_new(handler, filters, ap);
+    _add_handler(self, handler, filters, 1, 0, ap);
     va_end(ap);
+}
 
-    self->handlers_nb++;
+void bxilog_config_add_sharded_handler(bxilog_config_p self,
+                                       size_t shards_nb,
+                                       bxilog_handler_p handler,
+                                       bxilog_filters_p filters,
+                                       ...) {
+    bxiassert(0 < shards_nb);
+
+    // Each instance owns its filters
+    bxilog_filters_p shard_filters[shards_nb];
+    shard_filters[0] = filters;
+    for (size_t shard = 1; shard < shards_nb; shard++) {
+        shard_filters[shard] = bxilog_filters_dup(filters);
+    }
+
+    va_list ap;
+    va_start(ap, filters);
+    for (size_t shard = 0; shard < shards_nb; shard++) {
+        va_list shard_ap;
+        va_copy(shard_ap, ap);
+        _add_handler(self, handler, shard_filters[shard], shards_nb, shard, shard_ap);
+        va_end(shard_ap);
+    }
+    va_end(ap);
 }
 
 bxierr_p bxilog__config_destroy(bxilog_config_p * config_p) {
@@ -195,17 +225,9 @@ bxierr_p bxilog__config_loggers() {
     bxilog_logger_p *loggers;
     static char ** level_names;
     bxilog_level_names(&level_names);
+    // Sorted by name: consecutive loggers share most of their lookup
     size_t loggers_nb = bxilog_registry_getall(&loggers);
-    for (size_t i = 0; i < loggers_nb; i++) {
-//        bxilog_level_e old_level = loggers[i]->level;
-        bxilog_logger_reconfigure(loggers[i]);
-//        bxilog_level_e new_level = loggers[i]->level;
-        //TODO: use DBG macro when available
-//        fprintf(stderr, "Configuration of %s: %s -> %s\n",
-//                loggers[i]->name,
-//                level_names[old_level],
-//                level_names[new_level]);
-    }
+    bxilog__loggers_reconfigure(loggers, loggers_nb);
     BXIFREE(loggers);
 
     return BXIERR_OK;
@@ -277,3 +299,27 @@ bxierr_p bxilog_get_level_from_str(char * level_str, bxilog_level_e *level) {
 //*********************************************************************************
 //********************************** Static Helpers Implementation ****************
 //*********************************************************************************
+
+void _add_handler(bxilog_config_p self,
+                  bxilog_handler_p handler,
+                  bxilog_filters_p filters,
+                  size_t shards_nb,
+                  size_t shard,
+                  va_list ap) {
+
+    size_t new_size = self->handlers_nb + 1;
+    self->handlers = bximem_realloc(self->handlers,
+                                    self->handlers_nb * sizeof(*self->handlers),
+                                    new_size * sizeof(*self->handlers));
+    self->handlers_params = bximem_realloc(self->handlers_params,
+                                           self->handlers_nb * sizeof(*self->handlers_params),
+                                           new_size * sizeof(*self->handlers_params));
+    self->handlers[self->handlers_nb] = handler;
+
+    bxilog_handler_param_p param = handler->param_new(handler, filters, ap);
+    param->shards_nb = shards_nb;
+    param->shard = shard;
+    self->handlers_params[self->handlers_nb] = param;
+
+    self->handlers_nb++;
+}
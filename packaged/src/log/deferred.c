@@ -0,0 +1,445 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "bxi/base/err.h"
+
+#include "deferred_impl.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+// Longest conversion specification we deal with, including the '%'
+#define SPEC_MAX_LEN 32
+
+#define NULL_STR "(null)"
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+typedef enum {
+    KIND_INT, KIND_UINT, KIND_DOUBLE, KIND_LDOUBLE, KIND_CHAR, KIND_STR, KIND_PTR,
+} _kind_e;
+
+typedef enum {
+    LEN_NONE, LEN_HH, LEN_H, LEN_L, LEN_LL, LEN_J, LEN_Z, LEN_T, LEN_BIGL,
+} _len_e;
+
+// A parsed conversion specification: %[flags][width][.precision][length]conversion
+typedef struct {
+    const char * flags;
+    size_t flags_len;
+    const char * width;         // Digits or '*'
+    size_t width_len;
+    bool width_star;
+    bool has_prec;
+    bool prec_star;
+    const char * prec;          // Digits following the '.'
+    size_t prec_len;
+    _len_e len;
+    char conv;
+    _kind_e kind;
+} _spec_s;
+
+//*********************************************************************************
+//********************************** Static Functions  ****************************
+//*********************************************************************************
+
+static const char * _parse_spec(const char * p, _spec_s * spec);
+static int _parse_prec(const _spec_s * spec);
+static void _put(char * buf, size_t buf_size, size_t * pos,
+                 const void * data, size_t size);
+static void _get(const char * blob, size_t blob_len, size_t * pos,
+                 void * data, size_t size);
+static size_t _mkspec(const _spec_s * spec, char * result);
+static void _emit(char * out, size_t out_size, size_t * pos,
+                  const char * data, size_t size);
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Implementation    ****************************
+//*********************************************************************************
+
+size_t bxilog__deferred_capture(const char * const fmt, va_list ap,
+                                char * const buf, const size_t buf_size) {
+    size_t pos = 0;
+
+    _put(buf, buf_size, &pos, &fmt, sizeof(fmt));
+
+    const char * p = fmt;
+    while (NULL != (p = strchr(p, '%'))) {
+        p++;
+        if ('%' == *p) {
+            p++;
+            continue;
+        }
+        _spec_s spec;
+        p = _parse_spec(p, &spec);
+        if (NULL == p) return 0;
+
+        if (spec.width_star) {
+            int width = va_arg(ap, int);
+            _put(buf, buf_size, &pos, &width, sizeof(width));
+        }
+        int prec = -1;
+        if (spec.prec_star) {
+            prec = va_arg(ap, int);
+            _put(buf, buf_size, &pos, &prec, sizeof(prec));
+        } else if (spec.has_prec) {
+            prec = _parse_prec(&spec);
+        }
+
+        switch (spec.kind) {
+            case KIND_INT: {
+                intmax_t value;
+                switch (spec.len) {
+                    case LEN_HH: value = (signed char) va_arg(ap, int); break;
+                    case LEN_H: value = (short) va_arg(ap, int); break;
+                    case LEN_L: value = va_arg(ap, long); break;
+                    case LEN_LL: value = va_arg(ap, long long); break;
+                    case LEN_J: value = va_arg(ap, intmax_t); break;
+                    case LEN_Z: value = va_arg(ap, ssize_t); break;
+                    case LEN_T: value = va_arg(ap, ptrdiff_t); break;
+                    default: value = va_arg(ap, int); break;
+                }
+                _put(buf, buf_size, &pos, &value, sizeof(value));
+                break;
+            }
+            case KIND_UINT: {
+                uintmax_t value;
+                switch (spec.len) {
+                    case LEN_HH: value = (unsigned char) va_arg(ap, unsigned int); break;
+                    case LEN_H: value = (unsigned short) va_arg(ap, unsigned int); break;
+                    case LEN_L: value = va_arg(ap, unsigned long); break;
+                    case LEN_LL: value = va_arg(ap, unsigned long long); break;
+                    case LEN_J: value = va_arg(ap, uintmax_t); break;
+                    case LEN_Z: value = va_arg(ap, size_t); break;
+                    case LEN_T: value = (uintmax_t) va_arg(ap, ptrdiff_t); break;
+                    default: value = va_arg(ap, unsigned int); break;
+                }
+                _put(buf, buf_size, &pos, &value, sizeof(value));
+                break;
+            }
+            case KIND_DOUBLE: {
+                double value = va_arg(ap, double);
+                _put(buf, buf_size, &pos, &value, sizeof(value));
+                break;
+            }
+            case KIND_LDOUBLE: {
+                long double value = va_arg(ap, long double);
+                _put(buf, buf_size, &pos, &value, sizeof(value));
+                break;
+            }
+            case KIND_CHAR: {
+                int value = va_arg(ap, int);
+                _put(buf, buf_size, &pos, &value, sizeof(value));
+                break;
+            }
+            case KIND_PTR: {
+                void * value = va_arg(ap, void *);
+                _put(buf, buf_size, &pos, &value, sizeof(value));
+                break;
+            }
+            case KIND_STR: {
+                const char * value = va_arg(ap, const char *);
+                if (NULL == value) value = NULL_STR;
+                // With a precision, the string might not be NULL terminated
+                size_t len = (0 <= prec) ? strnlen(value, (size_t) prec) : strlen(value);
+                _put(buf, buf_size, &pos, &len, sizeof(len));
+                _put(buf, buf_size, &pos, value, len);
+                break;
+            }
+            default:
+                bxiunreachable_statement;
+        }
+    }
+
+    return pos;
+}
+
+size_t bxilog__deferred_format(const char * const blob, const size_t blob_len,
+                               char * const out, const size_t out_size) {
+    size_t in = 0;
+    size_t pos = 0;
+
+    const char * fmt;
+    _get(blob, blob_len, &in, &fmt, sizeof(fmt));
+
+    const char * p = fmt;
+    while ('\0' != *p) {
+        const char * next = strchr(p, '%');
+        if (NULL == next) {
+            _emit(out, out_size, &pos, p, strlen(p));
+            break;
+        }
+        _emit(out, out_size, &pos, p, (size_t) (next - p));
+        p = next + 1;
+        if ('%' == *p) {
+            _emit(out, out_size, &pos, p, 1);
+            p++;
+            continue;
+        }
+        _spec_s spec;
+        p = _parse_spec(p, &spec);
+        // Checked by bxilog__deferred_capture()
+        bxiassert(NULL != p);
+
+        int width = 0, prec = 0;
+        if (spec.width_star) _get(blob, blob_len, &in, &width, sizeof(width));
+        if (spec.prec_star) _get(blob, blob_len, &in, &prec, sizeof(prec));
+
+        char spec_str[SPEC_MAX_LEN];
+        _mkspec(&spec, spec_str);
+
+        char * dst = (pos < out_size) ? out + pos : NULL;
+        size_t avail = (pos < out_size) ? out_size - pos : 0;
+        bool with_prec = spec.prec_star;
+        int n;
+
+#define _SNPRINTF(value) \
+        (spec.width_star ? \
+            (with_prec ? snprintf(dst, avail, spec_str, width, prec, value) :\
+                         snprintf(dst, avail, spec_str, width, value)) :\
+            (with_prec ? snprintf(dst, avail, spec_str, prec, value) :\
+                         snprintf(dst, avail, spec_str, value)))
+
+        switch (spec.kind) {
+            case KIND_INT: {
+                intmax_t value;
+                _get(blob, blob_len, &in, &value, sizeof(value));
+                n = _SNPRINTF(value);
+                break;
+            }
+            case KIND_UINT: {
+                uintmax_t value;
+                _get(blob, blob_len, &in, &value, sizeof(value));
+                n = _SNPRINTF(value);
+                break;
+            }
+            case KIND_DOUBLE: {
+                double value;
+                _get(blob, blob_len, &in, &value, sizeof(value));
+                n = _SNPRINTF(value);
+                break;
+            }
+            case KIND_LDOUBLE: {
+                long double value;
+                _get(blob, blob_len, &in, &value, sizeof(value));
+                n = _SNPRINTF(value);
+                break;
+            }
+            case KIND_CHAR: {
+                int value;
+                _get(blob, blob_len, &in, &value, sizeof(value));
+                n = _SNPRINTF(value);
+                break;
+            }
+            case KIND_PTR: {
+                void * value;
+                _get(blob, blob_len, &in, &value, sizeof(value));
+                n = _SNPRINTF(value);
+                break;
+            }
+            case KIND_STR: {
+                size_t len;
+                _get(blob, blob_len, &in, &len, sizeof(len));
+                bxiassert(in + len <= blob_len);
+                // The string is not NULL terminated in the blob: the
+                // precision is always given (see _mkspec())
+                with_prec = true;
+                prec = (int) len;
+                n = _SNPRINTF(blob + in);
+                in += len;
+                break;
+            }
+            default:
+                bxiunreachable_statement;
+        }
+#undef _SNPRINTF
+        bxiassert(0 <= n);
+        pos += (size_t) n;
+    }
+
+    if (0 < out_size) out[(pos < out_size) ? pos : out_size - 1] = '\0';
+
+    return pos;
+}
+
+//*********************************************************************************
+//********************************** Static Helpers Implementation ****************
+//*********************************************************************************
+
+const char * _parse_spec(const char * p, _spec_s * const spec) {
+    const char * const start = p;
+    memset(spec, 0, sizeof(*spec));
+
+    spec->flags = p;
+    while ('\0' != *p && NULL != strchr("-+ #0'", *p)) p++;
+    spec->flags_len = (size_t) (p - spec->flags);
+
+    spec->width = p;
+    if ('*' == *p) {
+        spec->width_star = true;
+        p++;
+    } else {
+        while ('0' <= *p && '9' >= *p) p++;
+    }
+    spec->width_len = (size_t) (p - spec->width);
+    // Positional arguments (%1$s) are not supported
+    if ('$' == *p) return NULL;
+
+    if ('.' == *p) {
+        p++;
+        spec->has_prec = true;
+        spec->prec = p;
+        if ('*' == *p) {
+            spec->prec_star = true;
+            p++;
+        } else {
+            while ('0' <= *p && '9' >= *p) p++;
+        }
+        spec->prec_len = (size_t) (p - spec->prec);
+    }
+
+    switch (*p) {
+        case 'h':
+            p++;
+            if ('h' == *p) {
+                p++;
+                spec->len = LEN_HH;
+            } else {
+                spec->len = LEN_H;
+            }
+            break;
+        case 'l':
+            p++;
+            if ('l' == *p) {
+                p++;
+                spec->len = LEN_LL;
+            } else {
+                spec->len = LEN_L;
+            }
+            break;
+        case 'q': p++; spec->len = LEN_LL; break;
+        case 'j': p++; spec->len = LEN_J; break;
+        case 'z': p++; spec->len = LEN_Z; break;
+        case 't': p++; spec->len = LEN_T; break;
+        case 'L': p++; spec->len = LEN_BIGL; break;
+        default: spec->len = LEN_NONE; break;
+    }
+
+    spec->conv = *p;
+    switch (*p) {
+        case 'd': case 'i':
+            spec->kind = KIND_INT;
+            break;
+        case 'u': case 'o': case 'x': case 'X':
+            spec->kind = KIND_UINT;
+            break;
+        case 'f': case 'F': case 'e': case 'E':
+        case 'g': case 'G': case 'a': case 'A':
+            spec->kind = (LEN_BIGL == spec->len) ? KIND_LDOUBLE : KIND_DOUBLE;
+            break;
+        case 'c':
+            // Wide characters are not supported
+            if (LEN_NONE != spec->len) return NULL;
+            spec->kind = KIND_CHAR;
+            break;
+        case 's':
+            if (LEN_NONE != spec->len) return NULL;
+            spec->kind = KIND_STR;
+            break;
+        case 'p':
+            spec->kind = KIND_PTR;
+            break;
+        default:
+            // %n, %m (depends on errno at call time), %C, %S, ...
+            return NULL;
+    }
+    p++;
+
+    // Leave room for the rewritten length modifier and the '.*'
+    if ((size_t) (p - start) + 4 >= SPEC_MAX_LEN) return NULL;
+
+    return p;
+}
+
+int _parse_prec(const _spec_s * const spec) {
+    int prec = 0;
+    for (size_t i = 0; i < spec->prec_len; i++) {
+        prec = prec * 10 + (spec->prec[i] - '0');
+    }
+    return prec;
+}
+
+size_t _mkspec(const _spec_s * const spec, char * const result) {
+    size_t n = 0;
+    result[n++] = '%';
+    memcpy(result + n, spec->flags, spec->flags_len);
+    n += spec->flags_len;
+    memcpy(result + n, spec->width, spec->width_len);
+    n += spec->width_len;
+    if (KIND_STR == spec->kind) {
+        result[n++] = '.';
+        result[n++] = '*';
+    } else if (spec->has_prec) {
+        result[n++] = '.';
+        memcpy(result + n, spec->prec, spec->prec_len);
+        n += spec->prec_len;
+    }
+    switch (spec->kind) {
+        // Integers have been captured as intmax_t/uintmax_t
+        case KIND_INT: case KIND_UINT: result[n++] = 'j'; break;
+        case KIND_LDOUBLE: result[n++] = 'L'; break;
+        default: break;
+    }
+    result[n++] = spec->conv;
+    result[n] = '\0';
+    bxiassert(n < SPEC_MAX_LEN);
+
+    return n;
+}
+
+void _put(char * const buf, const size_t buf_size, size_t * const pos,
+          const void * const data, const size_t size) {
+    // Just compute the required size when the buffer is too small
+    if (*pos + size <= buf_size) memcpy(buf + *pos, data, size);
+    *pos += size;
+}
+
+void _get(const char * const blob, const size_t blob_len, size_t * const pos,
+          void * const data, const size_t size) {
+    bxiassert(*pos + size <= blob_len);
+    // The blob is not aligned
+    memcpy(data, blob + *pos, size);
+    *pos += size;
+}
+
+void _emit(char * const out, const size_t out_size, size_t * const pos,
+           const char * const data, const size_t size) {
+    if (*pos < out_size) {
+        const size_t avail = out_size - *pos;
+        memcpy(out + *pos, data, (size < avail) ? size : avail);
+    }
+    *pos += size;
+}
@@ -0,0 +1,60 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#ifndef BXILOG_DEFERRED_IMPL_H
+#define BXILOG_DEFERRED_IMPL_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Interface         ****************************
+//*********************************************************************************
+
+/*
+ * Capture the given format and its arguments into buf without formatting them.
+ *
+ * Only the format pointer is stored, it must therefore remain valid until the
+ * handlers have processed the record (string literals are fine). Strings given
+ * with %s are copied.
+ *
+ * Return the number of bytes required (nothing is written past buf_size in which case
+ * the caller must retry with a larger buffer and a fresh copy of ap), or 0 if the
+ * format contains a conversion that can't be deferred (%n, %m, positional
+ * arguments, wide characters): the caller must format it immediately.
+ */
+size_t bxilog__deferred_capture(const char * fmt, va_list ap,
+                                char * buf, size_t buf_size);
+
+/*
+ * Format a blob produced by bxilog__deferred_capture() into out.
+ *
+ * Like snprintf(): return the number of characters (excluding the NUL terminating
+ * byte) that would have been written if out_size had been large enough.
+ */
+size_t bxilog__deferred_format(const char * blob, size_t blob_len,
+                               char * out, size_t out_size);
+
+#endif
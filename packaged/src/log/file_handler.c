@@ -21,6 +21,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
+#include <limits.h>
 #include <sys/mman.h>
 
 
@@ -33,6 +34,8 @@
 
 #include "handler_impl.h"
 #include "log_impl.h"
+#include "file_writer_impl.h"
+#include "file_rotation_impl.h"
 
 #include "bxi/base/log/file_handler.h"
 
@@ -44,8 +47,13 @@
 
 #define INTERNAL_LOGGER_NAME BXILOG_LIB_PREFIX "bxilog.handler.file"
 #define DEFAULT_BLOCKS_NB 4
+#define DEFAULT_QUEUE_DEPTH 2   // Triple buffering
+#define MMAP_EXTENT_SIZE (32 * 1024 * 1024) // File growth in BXILOG_FILE_WRITE_MMAP mode
+#define MMAP_WINDOW_MIN (64 * 1024)         // Room left for lines before remapping
 
 // WARNING: highly dependent on the log format
+// O|20140918T090752.472145261|11297.11302=01792:unit_t|unit_t.c:308@_dummy|bxiclib.test|msg
+// (without "=%tid" when not on linux)
 #define YEAR_SIZE 4
 #define MONTH_SIZE 2
 #define DAY_SIZE 2
@@ -57,22 +65,23 @@
 #define TID_SIZE 5
 #define THREAD_RANK_SIZE 5
 
-// WARNING: highly dependent on the log format
-#ifdef __linux__
-// LOG_FMT "%c|%0*d%0*d%0*dT%0*d%0*d%0*d.%0*ld|%0*u.%0*u=%0*u:%s|%s:%d@%s|%s|%s\n";
-// O|20140918T090752.472145261|11297.11302=01792:unit_t|unit_t.c:308@_dummy|bxiclib.test|msg
+// The date part of the prefix: 20140918T090752
+#define DATE_SIZE (YEAR_SIZE + MONTH_SIZE + DAY_SIZE + 1 + HOUR_SIZE + MINUTE_SIZE +\
+                   SECOND_SIZE)
 
-#define FIXED_LOG_SIZE 2 + YEAR_SIZE + MONTH_SIZE + DAY_SIZE +\
-                       1 + HOUR_SIZE + MINUTE_SIZE + SECOND_SIZE + 1 + SUBSECOND_SIZE +\
-                       1 + PID_SIZE + 1 + TID_SIZE + 1 + THREAD_RANK_SIZE + \
-                       1 + 1 + 1 + 1 + 1 + 1 + 1  // Add all remaining fixed characters
-                                                  // such as ':|:@||\n' in that order
-#else
-#define FIXED_LOG_SIZE 2 + YEAR_SIZE + MONTH_SIZE + DAY_SIZE +\
-                       1 + HOUR_SIZE + MINUTE_SIZE + SECOND_SIZE + 1 + SUBSECOND_SIZE +\
-                       1 + PID_SIZE + 1 + THREAD_RANK_SIZE + \
-                       1 + 1 + 1 + 1 + 1 + 1 +1  // Add all remaining fixed characters
-                                                 // such as ':|:@||\n' in that order
+// Largest numbers written in a prefix
+#define INT32_DIGITS_MAX 11         // Including the sign
+#define UINTPTR_XDIGITS_MAX (2 * sizeof(uintptr_t))
+
+// Largest prefix excluding program, file, function and logger names
+#define PREFIX_FIXED_MAX (2 + DATE_SIZE + 1 + SUBSECOND_SIZE +\
+                          1 + INT32_DIGITS_MAX + 1 + INT32_DIGITS_MAX +\
+                          1 + UINTPTR_XDIGITS_MAX +\
+                          1 + 1 + INT32_DIGITS_MAX + 1 + 1 + 1) // Remaining
+                                                                // separators ':|:@||'
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
 #endif
 
 #define _ilog(level, data, ...) _internal_log_func(level, data, __func__, ARRAYLEN(__func__), __LINE__, __VA_ARGS__)
@@ -85,6 +94,7 @@ typedef struct bxilog_file_handler_param_s_f {
     bxilog_handler_param_s generic;
     int open_flags;
     char * filename;
+    bool shard_suffixed;            // filename includes the shard (sharded handler)
     char * progname;
     size_t progname_len;
     pid_t pid;
@@ -101,19 +111,50 @@ typedef struct bxilog_file_handler_param_s_f {
     size_t next_char;
     size_t buf_size;
     char * buf;
+    time_t date_sec;                // Second of the cached date (-1: none)
+    char date[DATE_SIZE];           // Date part of prefixes of records of date_sec
+    char * prefix;                  // Prefix of the lines of the current record
+    size_t prefix_size;             // Allocated size of prefix
+    char * arena;                   // Prefixes of the records of the current batch
+    size_t arena_size;              // Allocated size of arena
+    struct iovec * iovs;            // Segments not written yet (IOV_MAX at most)
+    size_t iovs_nb;
+    bxilog_file_write_e write_mode; // See bxilog_file_handler_param_set_write()
+    size_t queue_depth;
+    size_t inflight_max;
+    bxilog__file_writer_p writer;   // Owns buf, NULL in BXILOG_FILE_WRITE_SYNC mode
+    char * map;                     // Mapped region of the file (BXILOG_FILE_WRITE_MMAP),
+                                    // buf points into it
+    off_t map_offset;               // File offset of map, page aligned
+    size_t map_size;
+    off_t file_size;                // Including preallocated extents
+    off_t end;                      // Length actually written
+    off_t synced;                   // Length given to msync()
+    size_t rotate_bytes_max;        // See bxilog_file_handler_param_set_rotation()
+    long rotate_interval_s;
+    size_t rotate_keep_nb;
+    bxilog_file_compress_e rotate_compress;
+    bxilog__file_rotator_p rotator; // NULL when the file is not rotated
+    size_t file_bytes;              // Given to the current file so far
+    size_t rotate_bytes;            // The file is rotated once file_bytes reaches it
+    time_t rotate_at;               // The file is rotated by records of this second
 } bxilog_file_handler_param_s;
 
 typedef struct {
     const bxilog_file_handler_param_p data;
-    const bxilog_record_p record;
-    const char * filename;
-    const char *funcname;
-    const char * loggername;
-    const char *logmsg;
+    const size_t prefix_len;        // Of data->prefix, shared by all lines of a record
 } log_single_line_param_s;
 
 typedef log_single_line_param_s * log_single_line_param_p;
 
+typedef struct {
+    const bxilog_file_handler_param_p data;
+    const char * prefix;            // In data->arena
+    size_t prefix_len;
+} iov_single_line_param_s;
+
+typedef iov_single_line_param_s * iov_single_line_param_p;
+
 //*********************************************************************************
 //********************************** Static Functions  ****************************
 //*********************************************************************************
@@ -127,6 +168,9 @@ static bxierr_p _process_log(bxilog_record_p record,
                              char * loggername,
                              char * logmsg,
                              bxilog_file_handler_param_p data);
+static bxierr_p _process_log_batch(bxilog_batch_entry_p entries,
+                                   size_t n,
+                                   bxilog_file_handler_param_p data);
 static bxierr_p _process_ierr(bxierr_p * err, bxilog_file_handler_param_p data);
 static bxierr_p _process_implicit_flush(bxilog_file_handler_param_p data);
 static bxierr_p _process_explicit_flush(bxilog_file_handler_param_p data);
@@ -141,23 +185,40 @@ static bxierr_p _log_single_line(char * line,
                              bool last,
                              log_single_line_param_p param);
 
-static size_t _mkmsg(const size_t n, char buf[n],
-                     const char level,
-                     const struct timespec * const detail_time,
-                     const pid_t pid,
+static bxierr_p _iov_single_line(char * line,
+                                 size_t line_len,
+                                 bool last,
+                                 iov_single_line_param_p param);
+static bxierr_p _writev_batch(bxilog_batch_entry_p entries,
+                              size_t n,
+                              bxilog_file_handler_param_p data);
+static bxierr_p _writev(bxilog_file_handler_param_p data);
+static size_t _prefix_max(bxilog_file_handler_param_p data, bxilog_record_p record);
+static size_t _mkprefix(bxilog_file_handler_param_p data,
+                        bxilog_record_p record,
+                        const char * filename,
+                        const char * funcname,
+                        const char * loggername,
+                        char * prefix);
+static void _cache_date(bxilog_file_handler_param_p data, time_t sec);
+static size_t _utoa(char * buf, uint32_t value, size_t width);
+static size_t _itoa(char * buf, int32_t value);
 #ifdef __linux__
-                     const pid_t tid,
+static size_t _xtoa(char * buf, uintptr_t value, size_t width);
 #endif
-                     const uintptr_t thread_rank,
-                     const char * const progname,
-                     const char * const filename,
-                     const int line_nb,
-                     const char * const funcname,
-                     const char * const loggername,
-                     const char * const logmsg,
-                     size_t line_len);
 
 static bxierr_p _flush(bxilog_file_handler_param_p data);
+static bxierr_p _drain(bxilog_file_handler_param_p data);
+static bxierr_p _writer_err(bxilog_file_handler_param_p data, bxierr_p err);
+static bxierr_p _mmap_end(bxilog_file_handler_param_p data, off_t size, off_t * end);
+static bxierr_p _mmap_window(bxilog_file_handler_param_p data, size_t min);
+static void _mmap_rebase(bxilog_file_handler_param_p data);
+static void _mmap_sync(bxilog_file_handler_param_p data);
+static bxierr_p _mmap_stop(bxilog_file_handler_param_p data);
+static void _mmap_fallback(bxilog_file_handler_param_p data, bxierr_p * err);
+static bool _rotation_due(bxilog_file_handler_param_p data, time_t sec);
+static bxierr_p _rotate(bxilog_file_handler_param_p data, time_t sec);
+static time_t _next_rotation(bxilog_file_handler_param_p data, time_t sec);
 static bxierr_p _write(bxilog_file_handler_param_p data, const void * buf, size_t count);
 static bxierr_p _sync(bxilog_file_handler_param_p data);
 static void _tune_io(bxilog_file_handler_param_p data);
@@ -175,13 +236,20 @@ static void _record_new_error(bxilog_file_handler_param_p data, bxierr_p * err);
 // The various log levels specific characters
 const char BXILOG_FILE_HANDLER_LOG_LEVEL_STR[] = { '-', 'P', 'A', 'C', 'E', 'W', 'N', 'O',
                                                    'I', 'D', 'F', 'T', 'L'};
-// The log format used by the IHT when writing
-// WARNING: If you change this format, change also different #define above
-// along with FIXED_LOG_SIZE
+// "00" to "99", to convert two digits at once
+static const char DIGIT_PAIRS[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
 #ifdef __linux__
-static const char LOG_FMT[] = "%c|%0*d%0*d%0*dT%0*d%0*d%0*d.%0*ld|%0*u.%0*u=%0*" PRIxPTR ":%s|%s:%d@%s|%s|";
-#else
-static const char LOG_FMT[] = "%c|%0*d%0*d%0*dT%0*d%0*d%0*d.%0*ld|%0*u.%0*u:%s|%s:%d@%s|%s|";
+static const char XDIGITS[] = "0123456789abcdef";
 #endif
 
 static const bxilog_handler_s BXILOG_FILE_HANDLER_S = {
@@ -194,6 +262,9 @@ static const bxilog_handler_s BXILOG_FILE_HANDLER_S = {
                                                char * loggername,
                                                char * logmsg,
                                                bxilog_handler_param_p param)) _process_log,
+                  .process_log_batch = (bxierr_p (*)(bxilog_batch_entry_p entries,
+                                                     size_t n,
+                                                     bxilog_handler_param_p param)) _process_log_batch,
                   .process_ierr = (bxierr_p (*) (bxierr_p*, bxilog_handler_param_p)) _process_ierr,
                   .process_implicit_flush = (bxierr_p (*) (bxilog_handler_param_p)) _process_implicit_flush,
                   .process_explicit_flush = (bxierr_p (*) (bxilog_handler_param_p)) _process_explicit_flush,
@@ -225,10 +296,79 @@ bxilog_handler_param_p _param_new(bxilog_handler_p self,
     result->open_flags = open_flags;
     result->progname = strdup(progname);
     result->progname_len = strlen(progname) + 1; // Include the NULL terminal byte
+    result->write_mode = BXILOG_FILE_WRITE_SYNC;
+    result->queue_depth = DEFAULT_QUEUE_DEPTH;
+    result->inflight_max = 0;
 
     return (bxilog_handler_param_p) result;
 }
 
+bxierr_p bxilog_file_handler_param_set_write(bxilog_handler_param_p param,
+                                             bxilog_file_write_e mode,
+                                             size_t queue_depth,
+                                             size_t inflight_max) {
+    bxiassert(NULL != param);
+
+    switch (mode) {
+        case BXILOG_FILE_WRITE_ASYNC:
+        case BXILOG_FILE_WRITE_THREAD:
+            break;
+        case BXILOG_FILE_WRITE_SYNC:
+        case BXILOG_FILE_WRITE_MMAP:
+        case BXILOG_FILE_WRITE_WRITEV:
+            // Nothing is written asynchronously
+            if (0 != queue_depth || 0 != inflight_max) {
+                return bxierr_gen("File write mode %d takes no queue depth (%zu) "
+                                  "nor in-flight limit (%zu)",
+                                  mode, queue_depth, inflight_max);
+            }
+            break;
+        default:
+            return bxierr_gen("Unknown file write mode: %d", mode);
+    }
+
+    bxilog_file_handler_param_p data = (bxilog_file_handler_param_p) param;
+    data->write_mode = mode;
+    data->queue_depth = (0 == queue_depth) ? DEFAULT_QUEUE_DEPTH : queue_depth;
+    data->inflight_max = inflight_max;
+
+    return BXIERR_OK;
+}
+
+bxierr_p bxilog_file_handler_param_set_rotation(bxilog_handler_param_p param,
+                                                size_t max_bytes,
+                                                long interval_s,
+                                                size_t keep_nb,
+                                                bxilog_file_compress_e compress) {
+    bxiassert(NULL != param);
+
+    switch (compress) {
+        case BXILOG_FILE_COMPRESS_NONE:
+            break;
+        case BXILOG_FILE_COMPRESS_GZIP:
+#ifndef HAVE_LIBZ
+            return bxierr_gen("Compression with gzip is not available (no zlib)");
+#endif
+            break;
+        case BXILOG_FILE_COMPRESS_ZSTD:
+#ifndef HAVE_LIBZSTD
+            return bxierr_gen("Compression with zstd is not available (no libzstd)");
+#endif
+            break;
+        default:
+            return bxierr_gen("Unknown compression: %d", compress);
+    }
+    if (0 > interval_s) return bxierr_gen("Negative rotation interval: %ld", interval_s);
+
+    bxilog_file_handler_param_p data = (bxilog_file_handler_param_p) param;
+    data->rotate_bytes_max = max_bytes;
+    data->rotate_interval_s = interval_s;
+    data->rotate_keep_nb = keep_nb;
+    data->rotate_compress = compress;
+
+    return BXIERR_OK;
+}
+
 //*********************************************************************************
 //********************************** Static Helpers Implementation ****************
 //*********************************************************************************
@@ -249,6 +389,25 @@ bxierr_p _init(bxilog_file_handler_param_p data) {
     data->bytes_lost = 0;
     data->bytes_written = 0;
     data->dirty = false;
+    data->date_sec = (time_t) -1;
+    data->prefix = NULL;
+    data->prefix_size = 0;
+    data->arena = NULL;
+    data->arena_size = 0;
+    data->iovs = (BXILOG_FILE_WRITE_WRITEV == data->write_mode) ?
+                 bximem_calloc(IOV_MAX * sizeof(*data->iovs)) : NULL;
+    data->iovs_nb = 0;
+
+    if (1 < data->generic.shards_nb && !data->shard_suffixed &&
+        0 != strncmp("-", data->filename, ARRAYLEN("-")) &&
+        0 != strncmp("+", data->filename, ARRAYLEN("+"))) {
+        // Each shard writes its own segment
+        char * filename = bxistr_new("%s.%zu", data->filename, data->generic.shard);
+        BXIFREE(data->filename);
+        data->filename = filename;
+        // Handlers are started again with the same parameters after a fork()
+        data->shard_suffixed = true;
+    }
 
     err2 = _get_file_fd(data);
     BXIERR_CHAIN(err, err2);
@@ -256,6 +415,7 @@ bxierr_p _init(bxilog_file_handler_param_p data) {
     errno = 0;
     struct stat st;
     int rc = fstat(data->fd, &st);
+    const bool regular = (0 == rc) && S_ISREG(st.st_mode);
     if (0 != rc) {
         err2 = bxierr_errno("Calling fstat(%s) failed", data->filename);
         BXIERR_CHAIN(err, err2);
@@ -264,15 +424,61 @@ bxierr_p _init(bxilog_file_handler_param_p data) {
         data->buf_size = ((size_t) st.st_blksize) * sizeof(*data->buf) * DEFAULT_BLOCKS_NB;
     }
 //    data->buf_size = 241 * sizeof(*data->buf) * DEFAULT_BLOCKS_NB;
-    size_t align = (size_t) sysconf(_SC_PAGESIZE);
+    data->file_bytes = regular ? (size_t) st.st_size : 0;
+    data->rotator = NULL;
+    if (regular && (0 < data->rotate_bytes_max || 0 < data->rotate_interval_s)) {
+        data->rotate_bytes = data->rotate_bytes_max;
+        data->rotate_at = _next_rotation(data, time(NULL));
+        const bool mmapped = (BXILOG_FILE_WRITE_MMAP == data->write_mode);
+        err2 = bxilog__file_rotator_new(data->filename,
+                                        // mmap() requires read access
+                                        (mmapped ? O_RDWR : O_WRONLY) | data->open_flags,
+                                        mmapped ? MMAP_EXTENT_SIZE : 0,
+                                        data->rotate_keep_nb, data->rotate_compress,
+                                        &data->rotator);
+        BXIERR_CHAIN(err, err2);
+    }
 
-    errno = 0;
-    rc = posix_memalign((void**) &data->buf, align, data->buf_size);
-    if (0 != rc) {
-        err2 = bxierr_errno("Calling posix_memalign(%ld, %zu) failed",
-                            align, data->buf_size);
+    data->writer = NULL;
+    data->map = NULL;
+    if (BXILOG_FILE_WRITE_MMAP == data->write_mode && regular) {
+        // Lines are appended to the current content
+        data->file_size = st.st_size;
+        err2 = _mmap_end(data, st.st_size, &data->end);
+        BXIERR_CHAIN(err, err2);
+        data->synced = data->end;
+        data->file_bytes = (size_t) data->end;
+        err2 = _mmap_window(data, MMAP_WINDOW_MIN);
+        if (bxierr_isko(err2)) {
+            // Fall back to synchronous writes
+            BXIERR_CHAIN(err, err2);
+            err2 = _mmap_stop(data);
+            BXIERR_CHAIN(err, err2);
+        }
+    } else if (BXILOG_FILE_WRITE_ASYNC == data->write_mode ||
+               BXILOG_FILE_WRITE_THREAD == data->write_mode) {
+        err2 = bxilog__file_writer_new(data->fd, data->write_mode, data->buf_size,
+                                       data->queue_depth, data->inflight_max,
+                                       &data->bytes_written, &data->bytes_lost,
+                                       &data->writer);
+        // Fall back to synchronous writes
         BXIERR_CHAIN(err, err2);
     }
+    if (NULL != data->map) {
+        // buf points into the mapped region
+    } else if (NULL != data->writer) {
+        data->buf = bxilog__file_writer_buf(data->writer);
+    } else {
+        size_t align = (size_t) sysconf(_SC_PAGESIZE);
+
+        errno = 0;
+        rc = posix_memalign((void**) &data->buf, align, data->buf_size);
+        if (0 != rc) {
+            err2 = bxierr_errno("Calling posix_memalign(%ld, %zu) failed",
+                                align, data->buf_size);
+            BXIERR_CHAIN(err, err2);
+        }
+    }
 
     _tune_io(data);
 
@@ -296,6 +502,18 @@ bxierr_p _process_exit(bxilog_file_handler_param_p data) {
 //            bxierr_destroy(&err);
 //        }
 
+        if (NULL != data->writer) {
+            err2 = _writer_err(data, bxilog__file_writer_destroy(&data->writer));
+            BXIERR_CHAIN(err, err2);
+            // Owned by the writer
+            data->buf = NULL;
+        }
+        if (NULL != data->map) {
+            // Preallocated extents are given back
+            err2 = _mmap_stop(data);
+            BXIERR_CHAIN(err, err2);
+            data->buf = NULL;
+        }
         err2 = _sync(data);
         BXIERR_CHAIN(err, err2);
         errno = 0;
@@ -307,6 +525,9 @@ bxierr_p _process_exit(bxilog_file_handler_param_p data) {
             }
         }
     }
+    // Segments already rotated are compressed before exiting
+    err2 = bxilog__file_rotator_destroy(&data->rotator);
+    BXIERR_CHAIN(err, err2);
 
     if (data->bytes_lost > 0) {
         char * str = bxistr_new("BXI Log File Handler Error Summary:\n"
@@ -329,6 +550,11 @@ bxierr_p _process_exit(bxilog_file_handler_param_p data) {
         bxierr_set_destroy(&data->errset);
     }
     BXIFREE(data->buf);
+    BXIFREE(data->prefix);
+    data->prefix_size = 0;
+    BXIFREE(data->arena);
+    data->arena_size = 0;
+    BXIFREE(data->iovs);
 
 //    fprintf(stderr, "%d.%d: process_exit: ok\n", data->pid, data->tid);
     return err;
@@ -340,6 +566,14 @@ inline bxierr_p _process_implicit_flush(bxilog_file_handler_param_p data) {
     err2 = _flush(data);
     BXIERR_CHAIN(err, err2);
 
+    _mmap_sync(data);
+
+    if (NULL != data->rotator) {
+        // Reported as write errors
+        bxierr_p rotation_err = bxilog__file_rotator_errors(data->rotator);
+        if (bxierr_isko(rotation_err)) _record_new_error(data, &rotation_err);
+    }
+
     err2 = _sync(data);
     BXIERR_CHAIN(err, err2);
 
@@ -357,6 +591,10 @@ inline bxierr_p _process_explicit_flush(bxilog_file_handler_param_p data) {
 //    fprintf(stderr, "Flushed\n");
     BXIERR_CHAIN(err, err2);
 
+    // Flushed means written
+    err2 = _drain(data);
+    BXIERR_CHAIN(err, err2);
+
     err2 = _sync(data);
     BXIERR_CHAIN(err, err2);
 
@@ -373,13 +611,23 @@ inline bxierr_p _process_log(bxilog_record_p record,
                              char * logmsg,
                              bxilog_file_handler_param_p data) {
 
+    if (_rotation_due(data, record->detail_time.tv_sec)) {
+        // Logs go on in the current file on failure
+        bxierr_p err = _rotate(data, record->detail_time.tv_sec);
+        if (bxierr_isko(err)) _record_new_error(data, &err);
+    }
+
+    const size_t max_size = _prefix_max(data, record);
+    if (data->prefix_size < max_size) {
+        data->prefix = bximem_realloc(data->prefix, data->prefix_size, max_size);
+        data->prefix_size = max_size;
+    }
+    // All lines of the record have the same prefix
     log_single_line_param_s param = {
                                      .data = data,
-                                     .record = record,
-                                     .filename = filename,
-                                     .funcname = funcname,
-                                     .loggername = loggername,
-                                     .logmsg = logmsg,
+                                     .prefix_len = _mkprefix(data, record, filename,
+                                                             funcname, loggername,
+                                                             data->prefix),
     };
 //    fprintf(stderr, "Processing log\n");
     bxierr_p err = bxistr_apply_lines(logmsg,
@@ -392,6 +640,29 @@ inline bxierr_p _process_log(bxilog_record_p record,
 
 }
 
+bxierr_p _process_log_batch(bxilog_batch_entry_p entries,
+                            size_t n,
+                            bxilog_file_handler_param_p data) {
+
+    if (BXILOG_FILE_WRITE_WRITEV == data->write_mode) {
+        return _writev_batch(entries, n, data);
+    }
+
+    bxierr_p err = BXIERR_OK, err2;
+    // Lines are appended to the buffer, which is written only when full or flushed
+    for (size_t i = 0; i < n; i++) {
+        err2 = _process_log(entries[i].record,
+                            entries[i].filename,
+                            entries[i].funcname,
+                            entries[i].loggername,
+                            entries[i].logmsg,
+                            data);
+        BXIERR_CHAIN(err, err2);
+    }
+
+    return err;
+}
+
 
 bxierr_p _process_ierr(bxierr_p *err, bxilog_file_handler_param_p data) {
     bxierr_p result = BXIERR_OK;
@@ -456,17 +727,9 @@ bxierr_p _log_single_line(char * line,
 
     UNUSED(last);
     bxilog_file_handler_param_p data = param->data;
-    bxilog_record_p record = param->record;
 
-    const size_t prefix_size = FIXED_LOG_SIZE + \
-            // Exclude NULL terminating byte from preprocessed length
-            data->progname_len - 1 + \
-            record->filename_len -1 + \
-            record->funcname_len - 1 + \
-            record->logname_len - 1 + \
-            bxistr_digits_nb(record->line_nb);
-
-    size_t size = prefix_size + line_len;
+    // Including the '\n'
+    size_t size = param->prefix_len + line_len + 1;
 
     if (data->buf_size - data->next_char <= size) {
         bxierr_p err = _flush(data);
@@ -475,97 +738,268 @@ bxierr_p _log_single_line(char * line,
 
     char * buf;
     if (size > data->buf_size) {
-        buf = bximem_calloc(size + 1); // Include the NULL terminating byte since we
-                                       // use a specific buffer.
+        buf = bximem_calloc(size);
     } else {
         buf = data->buf + data->next_char;
     }
 
-    // Include the NULL terminating byte in the size given to
-    // underlying snprintf() call, it is required.
-    _mkmsg(prefix_size + 1, buf,
-           BXILOG_FILE_HANDLER_LOG_LEVEL_STR[record->level],
-           &record->detail_time,
-           record->pid,
-#ifdef __linux__
-           record->tid,
-#endif
-           record->thread_rank,
-           data->progname,
-           param->filename,
-           record->line_nb,
-           param->funcname,
-           param->loggername,
-           line, line_len);
+    memcpy(buf, data->prefix, param->prefix_len);
+    memcpy(buf + param->prefix_len, line, line_len);
+    buf[size - 1] = '\n';
 
     if (size > data->buf_size) {
+        data->file_bytes += size;
         bxierr_p err = _write(data, buf, size);
         BXIFREE(buf);
         return err;
     }
 
     data->next_char += (size_t) size;
+    data->file_bytes += size;
     data->dirty = true;
     bxiassert(data->next_char <= data->buf_size);
 
     return BXIERR_OK;
 }
 
+bxierr_p _iov_single_line(char * line,
+                          size_t line_len,
+                          bool last,
+                          iov_single_line_param_p param) {
+
+    bxilog_file_handler_param_p data = param->data;
+
+    if (IOV_MAX < data->iovs_nb + 3) {
+        bxierr_p err = _writev(data);
+        if (bxierr_isko(err)) return err;
+    }
+    // Including the '\n'
+    data->file_bytes += param->prefix_len + line_len + 1;
+    struct iovec * iov = data->iovs + data->iovs_nb;
+    iov[0].iov_base = (void *) param->prefix;
+    iov[0].iov_len = param->prefix_len;
+    iov[1].iov_base = line;
+    if (!last) {
+        // The line is followed by its '\n' in the message
+        iov[1].iov_len = line_len + 1;
+        data->iovs_nb += 2;
+    } else {
+        iov[1].iov_len = line_len;
+        iov[2].iov_base = "\n";
+        iov[2].iov_len = 1;
+        data->iovs_nb += 3;
+    }
+
+    return BXIERR_OK;
+}
+
+bxierr_p _writev_batch(bxilog_batch_entry_p entries,
+                       size_t n,
+                       bxilog_file_handler_param_p data) {
+
+    bxierr_p err = BXIERR_OK, err2;
+
+    // Lines of records processed one by one come first
+    err2 = _flush(data);
+    BXIERR_CHAIN(err, err2);
+    err2 = _drain(data);
+    BXIERR_CHAIN(err, err2);
+
+    size_t arena_size = 0;
+    for (size_t i = 0; i < n; i++) arena_size += _prefix_max(data, entries[i].record);
+    if (data->arena_size < arena_size) {
+        data->arena = bximem_realloc(data->arena, data->arena_size, arena_size);
+        data->arena_size = arena_size;
+    }
+
+    // Messages are not copied: they are written from the records, which are released
+    // by the caller once this function returns
+    char * prefix = data->arena;
+    for (size_t i = 0; i < n; i++) {
+        bxilog_record_p record = entries[i].record;
+        if (_rotation_due(data, record->detail_time.tv_sec)) {
+            // Previous records belong to the current file
+            err2 = _writev(data);
+            BXIERR_CHAIN(err, err2);
+            err2 = _rotate(data, record->detail_time.tv_sec);
+            if (bxierr_isko(err2)) _record_new_error(data, &err2);
+        }
+        iov_single_line_param_s param = {
+                                         .data = data,
+                                         .prefix = prefix,
+                                         .prefix_len = _mkprefix(data, record,
+                                                                 entries[i].filename,
+                                                                 entries[i].funcname,
+                                                                 entries[i].loggername,
+                                                                 prefix),
+        };
+        prefix += param.prefix_len;
+        err2 = bxistr_apply_lines(entries[i].logmsg,
+                                  record->logmsg_len - 1,
+                                  (bxierr_p (*)(char*, size_t, bool, void*)) _iov_single_line,
+                                  &param);
+        BXIERR_CHAIN(err, err2);
+    }
+    err2 = _writev(data);
+    BXIERR_CHAIN(err, err2);
+
+    return err;
+}
+
+bxierr_p _writev(bxilog_file_handler_param_p data) {
+    struct iovec * iov = data->iovs;
+    int iovcnt = (int) data->iovs_nb;
+    data->iovs_nb = 0;
+
+    while (0 < iovcnt) {
+        errno = 0;
+        ssize_t written = writev(data->fd, iov, iovcnt);
+
+        if (0 >= written) {
+            if (EINTR == errno) continue;
+            if (EPIPE == errno) {
+                return bxierr_errno("Can't write to pipe (fd=%d, name=%s). "
+                        "Exiting. Some messages will be lost.",
+                        data->fd, data->filename);
+            }
+
+            bxierr_p bxierr = bxierr_errno("Calling writev(fd=%d, name=%s) "
+                    "failed (written=%zd)",
+                    data->fd, data->filename, written);
+            for (int i = 0; i < iovcnt; i++) data->bytes_lost += iov[i].iov_len;
+            _record_new_error(data, &bxierr);
+            return BXIERR_OK;
+        }
+        data->bytes_written += (size_t) written;
+
+        // Partial write: go on with what is left
+        size_t left = (size_t) written;
+        while (0 < iovcnt && iov->iov_len <= left) {
+            left -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (0 < iovcnt) {
+            iov->iov_base = (char *) iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+
+    return BXIERR_OK;
+}
+
+size_t _prefix_max(bxilog_file_handler_param_p data, bxilog_record_p record) {
+    // Names lengths include their NULL terminating byte
+    return PREFIX_FIXED_MAX + data->progname_len + record->filename_len +
+           record->funcname_len + record->logname_len;
+}
+
+size_t _mkprefix(bxilog_file_handler_param_p data,
+                 bxilog_record_p record,
+                 const char * filename,
+                 const char * funcname,
+                 const char * loggername,
+                 char * prefix) {
 
-size_t _mkmsg(const size_t n, char buf[n],
-               const char level,
-               const struct timespec * const detail_time,
-               const pid_t pid,
+    // localtime_r() is costly: it is called once per second only
+    if (record->detail_time.tv_sec != data->date_sec) {
+        _cache_date(data, record->detail_time.tv_sec);
+    }
+
+    char * p = prefix;
+    *p++ = BXILOG_FILE_HANDLER_LOG_LEVEL_STR[record->level];
+    *p++ = '|';
+    memcpy(p, data->date, DATE_SIZE);
+    p += DATE_SIZE;
+    *p++ = '.';
+    p += _utoa(p, (uint32_t) record->detail_time.tv_nsec, SUBSECOND_SIZE);
+    *p++ = '|';
+    p += _utoa(p, (uint32_t) record->pid, PID_SIZE);
+    *p++ = '.';
 #ifdef __linux__
-               const pid_t tid,
+    p += _utoa(p, (uint32_t) record->tid, TID_SIZE);
+    *p++ = '=';
+    p += _xtoa(p, record->thread_rank, THREAD_RANK_SIZE);
+#else
+    p += _utoa(p, (uint32_t) record->thread_rank, THREAD_RANK_SIZE);
 #endif
-               const uintptr_t thread_rank,
-               const char * const progname,
-               const char * const filename,
-               const int line_nb,
-               const char * const funcname,
-               const char * const loggername,
-               const char * const logmsg,
-               size_t logmsg_len) {
+    *p++ = ':';
+    memcpy(p, data->progname, data->progname_len - 1);
+    p += data->progname_len - 1;
+    *p++ = '|';
+    memcpy(p, filename, record->filename_len - 1);
+    p += record->filename_len - 1;
+    *p++ = ':';
+    p += _itoa(p, record->line_nb);
+    *p++ = '@';
+    memcpy(p, funcname, record->funcname_len - 1);
+    p += record->funcname_len - 1;
+    *p++ = '|';
+    memcpy(p, loggername, record->logname_len - 1);
+    p += record->logname_len - 1;
+    *p++ = '|';
+
+    bxiassert((size_t) (p - prefix) <= _prefix_max(data, record));
+    return (size_t) (p - prefix);
+}
 
-    errno = 0;
+void _cache_date(bxilog_file_handler_param_p data, time_t sec) {
+    // Timezone and daylight saving changes are seen on the next second
     struct tm dummy, *now;
-    now = localtime_r(&detail_time->tv_sec, &dummy);
+    now = localtime_r(&sec, &dummy);
     bxiassert(NULL != now);
 
-    int written = snprintf(buf, n, LOG_FMT,
-                           level,
-                           YEAR_SIZE, now->tm_year + 1900,
-                           MONTH_SIZE, now->tm_mon + 1,
-                           DAY_SIZE, now->tm_mday,
-                           HOUR_SIZE, now->tm_hour,
-                           MINUTE_SIZE, now->tm_min,
-                           SECOND_SIZE, now->tm_sec,
-                           SUBSECOND_SIZE, detail_time->tv_nsec,
-                           PID_SIZE, pid,
-#ifdef __linux__
-                           TID_SIZE, tid,
-#endif
-                           THREAD_RANK_SIZE, thread_rank,
-                           progname,
-                           filename,
-                           line_nb,
-                           funcname,
-                           loggername);
-    memcpy(buf + written, logmsg, logmsg_len);
-    buf[(size_t) written + logmsg_len] = '\n';
+    char * p = data->date;
+    p += _utoa(p, (uint32_t) (now->tm_year + 1900), YEAR_SIZE);
+    p += _utoa(p, (uint32_t) (now->tm_mon + 1), MONTH_SIZE);
+    p += _utoa(p, (uint32_t) now->tm_mday, DAY_SIZE);
+    *p++ = 'T';
+    p += _utoa(p, (uint32_t) now->tm_hour, HOUR_SIZE);
+    p += _utoa(p, (uint32_t) now->tm_min, MINUTE_SIZE);
+    p += _utoa(p, (uint32_t) now->tm_sec, SECOND_SIZE);
+    bxiassert(DATE_SIZE == p - data->date);
+
+    data->date_sec = sec;
+}
+
+size_t _utoa(char * buf, uint32_t value, size_t width) {
+    // Zero padded to width, as printf("%0*u", width, value)
+    size_t n = (INT32_MAX < value) ? 10 : bxistr_digits_nb((int32_t) value);
+    if (n < width) n = width;
+
+    // Two digits per division, from the end
+    char * p = buf + n;
+    while (2 <= p - buf) {
+        p -= 2;
+        memcpy(p, DIGIT_PAIRS + 2 * (value % 100), 2);
+        value /= 100;
+    }
+    if (p > buf) *--p = (char) ('0' + value % 10);
 
+    return n;
+}
 
-    // WARNING: Truncation can happen if the logmsg is part of a larger string.
-    // Therefore the assertion below might not be true.
-    // If we want to guarantee that no truncation can happen, the logmsg in the
-    // original record string must be copied, and each '\n' might then be replaced by
-    // an '\0'. For speed reason, we don't do that: no copy -> faster.
-    //    bxiassert(written < (int)n);
+size_t _itoa(char * buf, int32_t value) {
+    if (0 <= value) return _utoa(buf, (uint32_t) value, 1);
+    *buf = '-';
+    return 1 + _utoa(buf + 1, (uint32_t) -(int64_t) value, 1);
+}
+
+#ifdef __linux__
+size_t _xtoa(char * buf, uintptr_t value, size_t width) {
+    // Zero padded to width, as printf("%0*" PRIxPTR, width, value)
+    size_t n = 1;
+    for (uintptr_t v = value >> 4; 0 != v; v >>= 4) n++;
+    if (n < width) n = width;
+
+    for (size_t i = n; i > 0; i--) {
+        buf[i - 1] = XDIGITS[value & 0xf];
+        value >>= 4;
+    }
 
-    bxiassert(written >= 0);
-    return (size_t) written + logmsg_len;
+    return n;
 }
+#endif
 
 bxierr_p _get_file_fd(bxilog_file_handler_param_p data) {
     errno = 0;
@@ -576,7 +1010,9 @@ bxierr_p _get_file_fd(bxilog_file_handler_param_p data) {
     } else {
         errno = 0;
         data->fd = open(data->filename,
-                        O_WRONLY | data->open_flags,
+                        // mmap() requires read access
+                        ((BXILOG_FILE_WRITE_MMAP == data->write_mode) ?
+                         O_RDWR : O_WRONLY) | data->open_flags,
                         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
         if (-1 == data->fd) return bxierr_errno("Can't open %s", data->filename);
     }
@@ -595,13 +1031,289 @@ void _tune_io(bxilog_file_handler_param_p data) {
 inline bxierr_p _flush(bxilog_file_handler_param_p data) {
     if (!data->dirty) return BXIERR_OK;
 
-    bxierr_p err = _write(data, data->buf, data->next_char);
+    bxierr_p err;
+    if (NULL != data->map) {
+        // Lines are already in the file
+        data->end += (off_t) data->next_char;
+        data->bytes_written += data->next_char;
+        _mmap_rebase(data);
+        data->dirty = false;
+        if (MMAP_WINDOW_MIN <= data->buf_size) return BXIERR_OK;
+
+        err = _mmap_window(data, MMAP_WINDOW_MIN);
+        if (bxierr_isko(err)) _mmap_fallback(data, &err);
+        return BXIERR_OK;
+    } else if (NULL != data->writer) {
+        // Lines are formatted into the next buffer while this one is written
+        err = _writer_err(data, bxilog__file_writer_submit(data->writer,
+                                                           data->next_char));
+        data->buf = bxilog__file_writer_buf(data->writer);
+    } else {
+        err = _write(data, data->buf, data->next_char);
+    }
     data->next_char = 0;
     data->dirty = false;
     return err;
 }
 
+inline bxierr_p _drain(bxilog_file_handler_param_p data) {
+    if (NULL == data->writer) return BXIERR_OK;
+
+    return _writer_err(data, bxilog__file_writer_drain(data->writer));
+}
+
+bxierr_p _mmap_end(bxilog_file_handler_param_p data, const off_t size, off_t * end) {
+    // A process that did not finalize left its preallocated extent: lines are
+    // never null terminated, so the written content ends at the last non null byte
+    *end = size;
+    const off_t limit = (size > MMAP_EXTENT_SIZE) ? size - MMAP_EXTENT_SIZE : 0;
+    char chunk[4096];
+    while (*end > limit) {
+        const size_t len = (size_t) ((*end - limit < (off_t) sizeof(chunk)) ?
+                                     *end - limit : (off_t) sizeof(chunk));
+        const off_t offset = *end - (off_t) len;
+        errno = 0;
+        const ssize_t n = pread(data->fd, chunk, len, offset);
+        if ((ssize_t) len != n) {
+            *end = size;
+            return bxierr_errno("Calling pread(%s, %zu, %jd) failed",
+                                data->filename, len, (intmax_t) offset);
+        }
+        for (size_t i = len; i > 0; i--) {
+            if ('\0' != chunk[i - 1]) return BXIERR_OK;
+            (*end)--;
+        }
+    }
+
+    return BXIERR_OK;
+}
+
+bxierr_p _mmap_window(bxilog_file_handler_param_p data, size_t min) {
+    if (NULL != data->map &&
+        data->end + (off_t) min <= data->map_offset + (off_t) data->map_size) {
+        return BXIERR_OK;
+    }
+
+    if (NULL != data->map) {
+        errno = 0;
+        int rc = munmap(data->map, data->map_size);
+        if (0 != rc) return bxierr_errno("Calling munmap(%s) failed", data->filename);
+        data->map = NULL;
+    }
+
+    // A mapping starts on a page boundary
+    const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    const off_t offset = data->end - data->end % (off_t) page;
+    size_t size = (size_t) (data->end - offset) + min;
+    if (MMAP_EXTENT_SIZE > size) size = MMAP_EXTENT_SIZE;
+    size = (size + page - 1) / page * page;
+
+    // Blocks are allocated beforehand so a full filesystem does not raise SIGBUS
+    if (data->file_size < offset + (off_t) size) {
+        int rc = posix_fallocate(data->fd, data->file_size,
+                                 offset + (off_t) size - data->file_size);
+        if (0 != rc) {
+            return bxierr_fromidx(rc, NULL,
+                                  "Calling posix_fallocate(%s, %jd, %jd) failed",
+                                  data->filename, (intmax_t) data->file_size,
+                                  (intmax_t) (offset + (off_t) size - data->file_size));
+        }
+        data->file_size = offset + (off_t) size;
+    }
+
+    errno = 0;
+    void * map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, data->fd, offset);
+    if (MAP_FAILED == map) {
+        return bxierr_errno("Calling mmap(%s, %zu, %jd) failed",
+                            data->filename, size, (intmax_t) offset);
+    }
+    // We just tune, so we don't care on error
+    int rc = madvise(map, size, MADV_SEQUENTIAL);
+    UNUSED(rc);
+
+    data->map = map;
+    data->map_offset = offset;
+    data->map_size = size;
+    if (data->synced < offset) data->synced = offset;
+    _mmap_rebase(data);
+
+    return BXIERR_OK;
+}
+
+void _mmap_rebase(bxilog_file_handler_param_p data) {
+    const size_t pos = (size_t) (data->end - data->map_offset);
+    data->buf = data->map + pos;
+    data->buf_size = data->map_size - pos;
+    data->next_char = 0;
+}
+
+void _mmap_sync(bxilog_file_handler_param_p data) {
+    if (NULL == data->map || data->synced == data->end) return;
+
+    // Start the write back of the lines written since the last call
+    const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t start = (size_t) (data->synced - data->map_offset);
+    start -= start % page;
+    int rc = msync(data->map + start, (size_t) (data->end - data->map_offset) - start,
+                   MS_ASYNC);
+    UNUSED(rc);
+    data->synced = data->end;
+}
+
+bxierr_p _mmap_stop(bxilog_file_handler_param_p data) {
+    bxierr_p err = BXIERR_OK, err2;
+
+    if (NULL != data->map) {
+        errno = 0;
+        int rc = munmap(data->map, data->map_size);
+        if (0 != rc) {
+            err2 = bxierr_errno("Calling munmap(%s) failed", data->filename);
+            BXIERR_CHAIN(err, err2);
+        }
+        data->map = NULL;
+    }
+
+    // Preallocated bytes past the written length are removed
+    errno = 0;
+    int rc = ftruncate(data->fd, data->end);
+    if (0 != rc) {
+        err2 = bxierr_errno("Calling ftruncate(%s, %jd) failed",
+                            data->filename, (intmax_t) data->end);
+        BXIERR_CHAIN(err, err2);
+    }
+    data->file_size = data->end;
+
+    // For the write() calls that may follow
+    errno = 0;
+    off_t pos = lseek(data->fd, data->end, SEEK_SET);
+    if (-1 == pos) {
+        err2 = bxierr_errno("Calling lseek(%s, %jd) failed",
+                            data->filename, (intmax_t) data->end);
+        BXIERR_CHAIN(err, err2);
+    }
+
+    return err;
+}
+
+void _mmap_fallback(bxilog_file_handler_param_p data, bxierr_p * err) {
+    // Lines are written with write() from now on
+    bxierr_p err2 = _mmap_stop(data);
+    BXIERR_CHAIN(*err, err2);
+    _record_new_error(data, err);
+
+    data->buf_size = MMAP_WINDOW_MIN;
+    data->next_char = 0;
+    int rc = posix_memalign((void**) &data->buf, (size_t) sysconf(_SC_PAGESIZE),
+                            data->buf_size);
+    bxiassert(0 == rc);
+}
+
+inline bool _rotation_due(bxilog_file_handler_param_p data, time_t sec) {
+    return NULL != data->rotator &&
+           ((0 < data->rotate_bytes_max && data->rotate_bytes <= data->file_bytes) ||
+            (0 < data->rotate_interval_s && data->rotate_at <= sec));
+}
+
+bxierr_p _rotate(bxilog_file_handler_param_p data, time_t sec) {
+    bxierr_p err = BXIERR_OK, err2;
+
+    // Attempted again by the next record otherwise
+    if (!bxilog__file_rotator_ready(data->rotator)) return err;
+
+    data->rotate_at = _next_rotation(data, sec);
+
+    // Lines formatted so far belong to the segment
+    err2 = _flush(data);
+    BXIERR_CHAIN(err, err2);
+
+    const bool mapped = (NULL != data->map);
+    if (mapped) {
+        // The segment is truncated to its written length in the background
+        errno = 0;
+        int rc = munmap(data->map, data->map_size);
+        if (0 != rc) {
+            err2 = bxierr_errno("Calling munmap(%s) failed", data->filename);
+            BXIERR_CHAIN(err, err2);
+        }
+        data->map = NULL;
+    }
+
+    // Named, closed once written, compressed and removed in the background
+    int fd;
+    off_t size;
+    void * segment;
+    bxilog__file_rotator_switch(data->rotator, data->fd, mapped ? data->end : -1, sec,
+                                NULL == data->writer, &fd, &size, &segment);
+    data->fd = fd;
+    data->file_bytes = 0;
+    data->rotate_bytes = data->rotate_bytes_max;
+    if (NULL != data->writer) {
+        // Writes in flight go on to the segment
+        bxilog__file_writer_set_fd(data->writer, fd, bxilog__file_rotator_written,
+                                   segment);
+    }
+    if (mapped) {
+        data->end = 0;
+        data->file_size = size;
+        data->synced = 0;
+        err2 = _mmap_window(data, MMAP_WINDOW_MIN);
+        if (bxierr_isko(err2)) _mmap_fallback(data, &err2);
+    } else if (0 < size) {
+        // Lines are written with write(): no preallocation
+        errno = 0;
+        int rc = ftruncate(fd, 0);
+        if (0 != rc) {
+            err2 = bxierr_errno("Calling ftruncate(%s, 0) failed", data->filename);
+            BXIERR_CHAIN(err, err2);
+        }
+    }
+
+    return err;
+}
+
+time_t _next_rotation(bxilog_file_handler_param_p data, time_t sec) {
+    if (0 >= data->rotate_interval_s) return (time_t) -1;
+
+    // On multiples of the interval in local time (e.g. midnight for a day)
+    struct tm dummy;
+    struct tm * now = localtime_r(&sec, &dummy);
+    bxiassert(NULL != now);
+    const time_t interval = (time_t) data->rotate_interval_s;
+    const time_t local = sec + now->tm_gmtoff;
+
+    return (local / interval + 1) * interval - now->tm_gmtoff;
+}
+
+bxierr_p _writer_err(bxilog_file_handler_param_p data, bxierr_p err) {
+    if (bxierr_isok(err)) return err;
+
+    if (EPIPE == err->code) {
+        return bxierr_new(EPIPE, NULL, NULL, NULL, err,
+                          "Can't write to pipe (fd=%d, name=%s). "
+                          "Exiting. Some messages will be lost.",
+                          data->fd, data->filename);
+    }
+    _record_new_error(data, &err);
+    return BXIERR_OK;
+}
+
 bxierr_p _write(bxilog_file_handler_param_p data, const void * buf, size_t count) {
+    if (NULL != data->map) {
+        bxierr_p err = _mmap_window(data, count);
+        if (bxierr_isok(err)) {
+            memcpy(data->buf, buf, count);
+            data->end += (off_t) count;
+            data->bytes_written += count;
+            _mmap_rebase(data);
+            return BXIERR_OK;
+        }
+        _mmap_fallback(data, &err);
+    }
+
+    // Writes in flight come first
+    bxierr_p err = _drain(data);
+    if (bxierr_isko(err)) return err;
+
     // Do not write more bytes than expected.
     ssize_t written = write(data->fd, buf, count);
 
@@ -663,6 +1375,9 @@ bxierr_p _internal_log_func(bxilog_level_e level,
 
     bxilog_record_s record;
     record.level = level;
+    record.flags = 0;
+    record.site_id = 0;
+    record.logger_id = 0;
 
     err2 = bxitime_get(CLOCK_REALTIME, &record.detail_time);
     BXIERR_CHAIN(err, err2);
@@ -0,0 +1,730 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#include <unistd.h>
+#include <syscall.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "bxi/base/err.h"
+#include "bxi/base/mem.h"
+#include "bxi/base/str.h"
+
+#include "file_rotation_impl.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+#define COMPRESS_CHUNK_SIZE (64 * 1024)
+
+// See ioprio_set(2)
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+typedef struct job_s_f * job_p;
+typedef struct job_s_f {
+    job_p next;
+    bxilog__file_rotator_p rotator;
+    int fd;
+    off_t length;                   // The segment is truncated to it (-1: not)
+    time_t sec;                     // Of the rotation, in the segment name
+    char * segment;                 // NULL until named
+    bool written;                   // No write in flight anymore, protected by lock
+} job_s;
+
+typedef struct {
+    const char * name;
+    const char * date;              // In name
+    unsigned long rank;             // Of segments of the same date
+} segment_s;
+
+struct bxilog__file_rotator_s {
+    char * filename;
+    char * next_filename;           // "<filename>.rotating", created beforehand
+    int open_flags;
+    off_t prealloc;
+    char * dirname;
+    char * prefix;                  // "<basename>.", segments names start with it
+    size_t prefix_len;
+    size_t keep_nb;
+    bxilog_file_compress_e compress;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    job_p first;                    // Protected by lock
+    job_p last;                     // Protected by lock
+    job_p unnamed;                  // First job to name, protected by lock
+    int next_fd;                    // Next file (-1: not created), protected by lock
+    off_t next_size;                // Preallocated, protected by lock
+    bool prepare;                   // next_fd must be created, protected by lock
+    time_t prepare_at;              // Not before (after a failure), protected by lock
+    bool exiting;                   // Protected by lock
+    bxierr_p errors;                // Protected by lock
+};
+
+//*********************************************************************************
+//********************************** Static Functions  ****************************
+//*********************************************************************************
+
+static void * _thread_main(void * arg);
+static void _lower_priority(void);
+static bool _has_work(bxilog__file_rotator_p self);
+static bool _prepare_due(bxilog__file_rotator_p self);
+static bxierr_p _prepare(bxilog__file_rotator_p self, int * fd, off_t * size);
+static bxierr_p _name(bxilog__file_rotator_p self, job_p job);
+static bxierr_p _segment_new(bxilog__file_rotator_p self, time_t sec,
+                             char ** segment_p, bool * linked);
+static bxierr_p _process_job(bxilog__file_rotator_p self, job_p job);
+static bxierr_p _compress(bxilog__file_rotator_p self, const char * segment);
+#ifdef HAVE_LIBZ
+static bxierr_p _gzip(int in, const char * out);
+#endif
+#ifdef HAVE_LIBZSTD
+static bxierr_p _zstd(int in, const char * out);
+#endif
+static bxierr_p _remove_old(bxilog__file_rotator_p self);
+static bool _is_segment(bxilog__file_rotator_p self, const char * name,
+                        segment_s * segment);
+static int _segment_cmp(const void * a, const void * b);
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+static const char * const COMPRESS_SUFFIX[] = {
+    [BXILOG_FILE_COMPRESS_NONE] = "",
+    [BXILOG_FILE_COMPRESS_GZIP] = ".gz",
+    [BXILOG_FILE_COMPRESS_ZSTD] = ".zst",
+};
+
+//*********************************************************************************
+//********************************** Implementation    ****************************
+//*********************************************************************************
+
+bxierr_p bxilog__file_rotator_new(const char * filename, int open_flags, off_t prealloc,
+                                  size_t keep_nb, bxilog_file_compress_e compress,
+                                  bxilog__file_rotator_p * result) {
+    bxiassert(NULL != filename);
+    bxiassert(NULL != result);
+
+    bxilog__file_rotator_p self = bximem_calloc(sizeof(*self));
+    self->filename = strdup(filename);
+    self->next_filename = bxistr_new("%s.rotating", filename);
+    self->open_flags = open_flags;
+    self->prealloc = prealloc;
+    self->next_fd = -1;
+    self->prepare = true;
+
+    // Left empty by a process that did not finalize
+    struct stat st;
+    if (0 == stat(self->next_filename, &st) && 0 == st.st_size) {
+        unlink(self->next_filename);
+    }
+
+    // dirname() and basename() may modify their argument
+    char * tmp = strdup(filename);
+    self->dirname = strdup(dirname(tmp));
+    BXIFREE(tmp);
+    tmp = strdup(filename);
+    self->prefix = bxistr_new("%s.", basename(tmp));
+    self->prefix_len = strlen(self->prefix);
+    BXIFREE(tmp);
+    self->keep_nb = keep_nb;
+    self->compress = compress;
+    self->errors = BXIERR_OK;
+
+    int rc = pthread_mutex_init(&self->lock, NULL);
+    bxiassert(0 == rc);
+    rc = pthread_cond_init(&self->cond, NULL);
+    bxiassert(0 == rc);
+    rc = pthread_create(&self->thread, NULL, _thread_main, self);
+    if (0 != rc) {
+        pthread_cond_destroy(&self->cond);
+        pthread_mutex_destroy(&self->lock);
+        BXIFREE(self->prefix);
+        BXIFREE(self->dirname);
+        BXIFREE(self->next_filename);
+        BXIFREE(self->filename);
+        BXIFREE(self);
+        return bxierr_fromidx(rc, NULL, "Calling pthread_create() failed (rc=%d)", rc);
+    }
+
+    *result = self;
+    return BXIERR_OK;
+}
+
+bxierr_p bxilog__file_rotator_destroy(bxilog__file_rotator_p * self_p) {
+    bxilog__file_rotator_p self = *self_p;
+    if (NULL == self) return BXIERR_OK;
+
+    int rc = pthread_mutex_lock(&self->lock);
+    bxiassert(0 == rc);
+    self->exiting = true;
+    rc = pthread_cond_signal(&self->cond);
+    bxiassert(0 == rc);
+    rc = pthread_mutex_unlock(&self->lock);
+    bxiassert(0 == rc);
+
+    rc = pthread_join(self->thread, NULL);
+    bxiassert(0 == rc);
+
+    bxierr_p err = self->errors;
+    if (-1 != self->next_fd) {
+        // Not used
+        close(self->next_fd);
+        unlink(self->next_filename);
+    }
+    pthread_cond_destroy(&self->cond);
+    pthread_mutex_destroy(&self->lock);
+    BXIFREE(self->prefix);
+    BXIFREE(self->dirname);
+    BXIFREE(self->next_filename);
+    BXIFREE(self->filename);
+    bximem_destroy((char**) self_p);
+
+    return err;
+}
+
+bool bxilog__file_rotator_ready(bxilog__file_rotator_p self) {
+    int rc = pthread_mutex_lock(&self->lock);
+    bxiassert(0 == rc);
+    const bool ready = (-1 != self->next_fd);
+    if (!ready && !self->prepare) {
+        // Creating it failed: try again
+        self->prepare = true;
+        rc = pthread_cond_signal(&self->cond);
+        bxiassert(0 == rc);
+    }
+    rc = pthread_mutex_unlock(&self->lock);
+    bxiassert(0 == rc);
+
+    return ready;
+}
+
+void bxilog__file_rotator_switch(bxilog__file_rotator_p self,
+                                 int old_fd, off_t length, time_t sec, bool written,
+                                 int * fd, off_t * size, void ** segment) {
+    job_p job = bximem_calloc(sizeof(*job));
+    job->rotator = self;
+    job->fd = old_fd;
+    job->length = length;
+    job->sec = sec;
+    job->written = written;
+
+    int rc = pthread_mutex_lock(&self->lock);
+    bxiassert(0 == rc);
+    // Only the file handler thread takes it
+    bxiassert(-1 != self->next_fd);
+    *fd = self->next_fd;
+    *size = self->next_size;
+    // Created once the current one is named
+    self->next_fd = -1;
+    self->prepare = true;
+    if (NULL == self->last) {
+        self->first = job;
+    } else {
+        self->last->next = job;
+    }
+    self->last = job;
+    if (NULL == self->unnamed) self->unnamed = job;
+    rc = pthread_cond_signal(&self->cond);
+    bxiassert(0 == rc);
+    rc = pthread_mutex_unlock(&self->lock);
+    bxiassert(0 == rc);
+
+    *segment = job;
+}
+
+void bxilog__file_rotator_written(void * segment) {
+    job_p job = segment;
+    bxilog__file_rotator_p self = job->rotator;
+
+    int rc = pthread_mutex_lock(&self->lock);
+    bxiassert(0 == rc);
+    job->written = true;
+    rc = pthread_cond_signal(&self->cond);
+    bxiassert(0 == rc);
+    rc = pthread_mutex_unlock(&self->lock);
+    bxiassert(0 == rc);
+}
+
+bxierr_p bxilog__file_rotator_errors(bxilog__file_rotator_p self) {
+    int rc = pthread_mutex_lock(&self->lock);
+    bxiassert(0 == rc);
+    bxierr_p err = self->errors;
+    self->errors = BXIERR_OK;
+    rc = pthread_mutex_unlock(&self->lock);
+    bxiassert(0 == rc);
+
+    return err;
+}
+
+//*********************************************************************************
+//********************************** Static Helpers Implementation ****************
+//*********************************************************************************
+
+void * _thread_main(void * arg) {
+    bxilog__file_rotator_p self = arg;
+
+    _lower_priority();
+
+    int rc = pthread_mutex_lock(&self->lock);
+    bxiassert(0 == rc);
+    while (true) {
+        while (!_has_work(self)) {
+            if (self->exiting) break;
+            if (self->prepare && -1 == self->next_fd) {
+                // Created again once the delay after a failure has elapsed
+                struct timespec deadline = {.tv_sec = self->prepare_at, .tv_nsec = 0};
+                rc = pthread_cond_timedwait(&self->cond, &self->lock, &deadline);
+                bxiassert(0 == rc || ETIMEDOUT == rc);
+            } else {
+                rc = pthread_cond_wait(&self->cond, &self->lock);
+                bxiassert(0 == rc);
+            }
+        }
+        bxierr_p err = BXIERR_OK;
+        job_p job = self->unnamed;
+        if (NULL != job) {
+            // The current file takes its name as soon as possible
+            self->unnamed = job->next;
+            rc = pthread_mutex_unlock(&self->lock);
+            bxiassert(0 == rc);
+            err = _name(self, job);
+        } else if (_prepare_due(self)) {
+            self->prepare = false;
+            rc = pthread_mutex_unlock(&self->lock);
+            bxiassert(0 == rc);
+            int fd;
+            off_t size;
+            err = _prepare(self, &fd, &size);
+            rc = pthread_mutex_lock(&self->lock);
+            bxiassert(0 == rc);
+            if (-1 != fd) {
+                self->next_fd = fd;
+                self->next_size = size;
+            } else {
+                self->prepare_at = time(NULL) + 1;
+            }
+            rc = pthread_mutex_unlock(&self->lock);
+            bxiassert(0 == rc);
+        } else if (NULL != self->first && (self->first->written || self->exiting)) {
+            // Segments handed over are processed before exiting: writes in flight
+            // are complete by then
+            job = self->first;
+            self->first = job->next;
+            if (NULL == self->first) self->last = NULL;
+            rc = pthread_mutex_unlock(&self->lock);
+            bxiassert(0 == rc);
+            err = _process_job(self, job);
+            BXIFREE(job->segment);
+            BXIFREE(job);
+        } else {
+            break;
+        }
+
+        rc = pthread_mutex_lock(&self->lock);
+        bxiassert(0 == rc);
+        BXIERR_CHAIN(self->errors, err);
+    }
+    rc = pthread_mutex_unlock(&self->lock);
+    bxiassert(0 == rc);
+
+    return NULL;
+}
+
+void _lower_priority(void) {
+    // We just tune, so we don't care on error
+    int rc = setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), 19);
+#ifdef SCHED_IDLE
+    struct sched_param sp = {.sched_priority = 0};
+    rc = pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+#endif
+#ifdef SYS_ioprio_set
+    rc = (int) syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, (int) syscall(SYS_gettid),
+                       IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+#endif
+    UNUSED(rc);
+}
+
+bool _has_work(bxilog__file_rotator_p self) {
+    if (NULL != self->unnamed || _prepare_due(self)) return true;
+    if (NULL == self->first) return false;
+    return self->first->written || self->exiting;
+}
+
+bool _prepare_due(bxilog__file_rotator_p self) {
+    return self->prepare && -1 == self->next_fd && !self->exiting &&
+           time(NULL) >= self->prepare_at;
+}
+
+bxierr_p _prepare(bxilog__file_rotator_p self, int * fd, off_t * size) {
+    // Never truncate a file that was not named after a failure
+    errno = 0;
+    *fd = open(self->next_filename, self->open_flags | O_CREAT | O_EXCL,
+               S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (-1 == *fd) return bxierr_errno("Can't create %s", self->next_filename);
+
+    *size = 0;
+    if (0 == self->prealloc) return BXIERR_OK;
+
+    int rc = posix_fallocate(*fd, 0, self->prealloc);
+    // Allocated by the file handler then
+    if (0 != rc) return bxierr_fromidx(rc, NULL,
+                                       "Calling posix_fallocate(%s, %jd) failed",
+                                       self->next_filename, (intmax_t) self->prealloc);
+    *size = self->prealloc;
+
+    return BXIERR_OK;
+}
+
+bxierr_p _name(bxilog__file_rotator_p self, job_p job) {
+    bxierr_p err = BXIERR_OK, err2;
+
+    // The file handler writes to the next file already: the segment keeps its lines
+    // whatever happens here
+    char * segment;
+    bool linked;
+    err2 = _segment_new(self, job->sec, &segment, &linked);
+    if (bxierr_isko(err2)) return err2;
+
+    errno = 0;
+    if (0 != rename(self->next_filename, self->filename)) {
+        err2 = bxierr_errno("Calling rename(%s, %s) failed",
+                            self->next_filename, self->filename);
+        BXIERR_CHAIN(err, err2);
+    }
+
+    // Only read by this thread
+    job->segment = segment;
+    return err;
+}
+
+bxierr_p _segment_new(bxilog__file_rotator_p self, time_t sec,
+                      char ** segment_p, bool * linked) {
+
+    struct tm dummy;
+    struct tm * now = localtime_r(&sec, &dummy);
+    bxiassert(NULL != now);
+    char date[BXILOG__FILE_SEGMENT_DATE_SIZE + 1];
+    size_t n = strftime(date, sizeof(date), "%Y%m%dT%H%M%S", now);
+    bxiassert(BXILOG__FILE_SEGMENT_DATE_SIZE == n);
+
+    // Several rotations may happen in the same second
+    for (unsigned rank = 0; ; rank++) {
+        char * segment = (0 == rank) ? bxistr_new("%s.%s", self->filename, date) :
+                                       bxistr_new("%s.%s.%u", self->filename, date, rank);
+        // A compressed segment may be there already
+        char * compressed = bxistr_new("%s.gz", segment);
+        bool exists = (0 == access(compressed, F_OK));
+        BXIFREE(compressed);
+        compressed = bxistr_new("%s.zst", segment);
+        exists = exists || (0 == access(compressed, F_OK));
+        BXIFREE(compressed);
+
+        // A hard link keeps the file name valid until the new file takes it
+        errno = 0;
+        int rc = exists ? -1 : link(self->filename, segment);
+        if (0 == rc) {
+            *linked = true;
+            *segment_p = segment;
+            return BXIERR_OK;
+        }
+        if (!exists && EEXIST != errno) {
+            // No hard links on this filesystem: the file name is missing for a while
+            if (0 == access(segment, F_OK)) {
+                exists = true;
+            } else {
+                errno = 0;
+                if (0 == rename(self->filename, segment)) {
+                    *linked = false;
+                    *segment_p = segment;
+                    return BXIERR_OK;
+                }
+                bxierr_p err = bxierr_errno("Calling rename(%s, %s) failed",
+                                            self->filename, segment);
+                BXIFREE(segment);
+                return err;
+            }
+        }
+        BXIFREE(segment);
+    }
+}
+
+bxierr_p _process_job(bxilog__file_rotator_p self, job_p job) {
+    bxierr_p err = BXIERR_OK, err2;
+
+    const char * name = (NULL == job->segment) ? self->filename : job->segment;
+    if (0 <= job->length) {
+        // Preallocated bytes past the written length are removed
+        errno = 0;
+        int rc = ftruncate(job->fd, job->length);
+        if (0 != rc) {
+            err2 = bxierr_errno("Calling ftruncate(%s, %jd) failed",
+                                name, (intmax_t) job->length);
+            BXIERR_CHAIN(err, err2);
+        }
+    }
+
+    // Closing may take a while (e.g. NFS): never done by the handler thread
+    errno = 0;
+    int rc = close(job->fd);
+    if (0 != rc) {
+        err2 = bxierr_errno("Closing logging file segment '%s' failed", name);
+        BXIERR_CHAIN(err, err2);
+    }
+
+    // Not named
+    if (NULL == job->segment) return err;
+
+    err2 = _compress(self, job->segment);
+    BXIERR_CHAIN(err, err2);
+
+    err2 = _remove_old(self);
+    BXIERR_CHAIN(err, err2);
+
+    return err;
+}
+
+bxierr_p _compress(bxilog__file_rotator_p self, const char * segment) {
+    if (BXILOG_FILE_COMPRESS_NONE == self->compress) return BXIERR_OK;
+
+    errno = 0;
+    int in = open(segment, O_RDONLY);
+    if (-1 == in) {
+        // Already removed, rotations being faster than compression
+        if (ENOENT == errno) return BXIERR_OK;
+        return bxierr_errno("Can't open %s", segment);
+    }
+
+    // The compressed segment is renamed once complete
+    char * out = bxistr_new("%s%s", segment, COMPRESS_SUFFIX[self->compress]);
+    char * tmp = bxistr_new("%s.tmp", out);
+    bxierr_p err = BXIERR_OK, err2;
+    switch (self->compress) {
+#ifdef HAVE_LIBZ
+        case BXILOG_FILE_COMPRESS_GZIP:
+            err = _gzip(in, tmp);
+            break;
+#endif
+#ifdef HAVE_LIBZSTD
+        case BXILOG_FILE_COMPRESS_ZSTD:
+            err = _zstd(in, tmp);
+            break;
+#endif
+        default:
+            bxiunreachable_statement;
+    }
+    close(in);
+
+    errno = 0;
+    if (bxierr_isok(err) && 0 != rename(tmp, out)) {
+        err = bxierr_errno("Calling rename(%s, %s) failed", tmp, out);
+    }
+    if (bxierr_isko(err)) {
+        unlink(tmp);
+    } else if (0 != unlink(segment)) {
+        err2 = bxierr_errno("Calling unlink(%s) failed", segment);
+        BXIERR_CHAIN(err, err2);
+    }
+    BXIFREE(tmp);
+    BXIFREE(out);
+
+    return err;
+}
+
+#ifdef HAVE_LIBZ
+bxierr_p _gzip(int in, const char * out) {
+    bxierr_p err = BXIERR_OK;
+
+    errno = 0;
+    gzFile gz = gzopen(out, "wb");
+    if (NULL == gz) return bxierr_errno("Calling gzopen(%s) failed", out);
+
+    char * buf = bximem_calloc(COMPRESS_CHUNK_SIZE);
+    while (true) {
+        errno = 0;
+        ssize_t n = read(in, buf, COMPRESS_CHUNK_SIZE);
+        if (-1 == n && EINTR == errno) continue;
+        if (-1 == n) {
+            err = bxierr_errno("Reading the segment to compress into %s failed", out);
+            break;
+        }
+        if (0 == n) break;
+        if (0 == gzwrite(gz, buf, (unsigned) n)) {
+            int zerr;
+            err = bxierr_gen("Calling gzwrite(%s) failed: %s", out, gzerror(gz, &zerr));
+            break;
+        }
+    }
+    BXIFREE(buf);
+
+    int rc = gzclose(gz);
+    if (Z_OK != rc && bxierr_isok(err)) {
+        err = bxierr_gen("Calling gzclose(%s) failed (rc=%d)", out, rc);
+    }
+
+    return err;
+}
+#endif
+
+#ifdef HAVE_LIBZSTD
+bxierr_p _zstd(int in, const char * out) {
+    bxierr_p err = BXIERR_OK;
+
+    errno = 0;
+    int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (-1 == fd) return bxierr_errno("Can't open %s", out);
+
+    ZSTD_CCtx * cctx = ZSTD_createCCtx();
+    bxiassert(NULL != cctx);
+    const size_t out_size = ZSTD_CStreamOutSize();
+    char * ibuf = bximem_calloc(COMPRESS_CHUNK_SIZE);
+    char * obuf = bximem_calloc(out_size);
+
+    bool last = false;
+    while (!last && bxierr_isok(err)) {
+        errno = 0;
+        ssize_t n = read(in, ibuf, COMPRESS_CHUNK_SIZE);
+        if (-1 == n && EINTR == errno) continue;
+        if (-1 == n) {
+            err = bxierr_errno("Reading the segment to compress into %s failed", out);
+            break;
+        }
+        last = (0 == n);
+        ZSTD_inBuffer input = {ibuf, (size_t) n, 0};
+        bool done;
+        do {
+            ZSTD_outBuffer output = {obuf, out_size, 0};
+            size_t left = ZSTD_compressStream2(cctx, &output, &input,
+                                               last ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(left)) {
+                err = bxierr_gen("Calling ZSTD_compressStream2(%s) failed: %s",
+                                 out, ZSTD_getErrorName(left));
+                break;
+            }
+            for (size_t written = 0; written < output.pos;) {
+                errno = 0;
+                ssize_t w = write(fd, obuf + written, output.pos - written);
+                if (-1 == w && EINTR == errno) continue;
+                if (0 >= w) {
+                    err = bxierr_errno("Writing to %s failed", out);
+                    break;
+                }
+                written += (size_t) w;
+            }
+            done = last ? (0 == left) : (input.pos == input.size);
+        } while (!done && bxierr_isok(err));
+    }
+    BXIFREE(obuf);
+    BXIFREE(ibuf);
+    ZSTD_freeCCtx(cctx);
+
+    errno = 0;
+    if (0 != close(fd) && bxierr_isok(err)) {
+        err = bxierr_errno("Closing %s failed", out);
+    }
+
+    return err;
+}
+#endif
+
+bxierr_p _remove_old(bxilog__file_rotator_p self) {
+    if (0 == self->keep_nb) return BXIERR_OK;
+
+    struct dirent ** entries;
+    errno = 0;
+    int n = scandir(self->dirname, &entries, NULL, NULL);
+    if (-1 == n) return bxierr_errno("Calling scandir(%s) failed", self->dirname);
+
+    bxierr_p err = BXIERR_OK, err2;
+    segment_s * segments = bximem_calloc(((size_t) n + 1) * sizeof(*segments));
+    size_t segments_nb = 0;
+    for (int i = 0; i < n; i++) {
+        if (_is_segment(self, entries[i]->d_name, &segments[segments_nb])) segments_nb++;
+    }
+    // Oldest first
+    qsort(segments, segments_nb, sizeof(*segments), _segment_cmp);
+    for (size_t i = 0; i + self->keep_nb < segments_nb; i++) {
+        char * path = bxistr_new("%s/%s", self->dirname, segments[i].name);
+        errno = 0;
+        if (0 != unlink(path) && ENOENT != errno) {
+            err2 = bxierr_errno("Calling unlink(%s) failed", path);
+            BXIERR_CHAIN(err, err2);
+        }
+        BXIFREE(path);
+    }
+    BXIFREE(segments);
+    for (int i = 0; i < n; i++) BXIFREE(entries[i]);
+    BXIFREE(entries);
+
+    return err;
+}
+
+bool _is_segment(bxilog__file_rotator_p self, const char * name, segment_s * segment) {
+    // <prefix><YYYYMMDDTHHMMSS>[.<rank>][.gz|.zst], but not an unfinished compression
+    if (0 != strncmp(self->prefix, name, self->prefix_len)) return false;
+
+    const char * date = name + self->prefix_len;
+    for (size_t i = 0; i < BXILOG__FILE_SEGMENT_DATE_SIZE; i++) {
+        if (8 == i) {
+            if ('T' != date[i]) return false;
+        } else if (!isdigit((unsigned char) date[i])) {
+            return false;
+        }
+    }
+    const char * suffix = strrchr(date, '.');
+    if (NULL != suffix && 0 == strcmp(".tmp", suffix)) return false;
+
+    segment->name = name;
+    segment->date = date;
+    segment->rank = 0;
+    const char * rank = date + BXILOG__FILE_SEGMENT_DATE_SIZE;
+    if ('.' == rank[0] && isdigit((unsigned char) rank[1])) {
+        segment->rank = strtoul(rank + 1, NULL, 10);
+    }
+    return true;
+}
+
+int _segment_cmp(const void * a, const void * b) {
+    const segment_s * x = a;
+    const segment_s * y = b;
+    int rc = strncmp(x->date, y->date, BXILOG__FILE_SEGMENT_DATE_SIZE);
+    if (0 != rc) return rc;
+    return (x->rank > y->rank) - (x->rank < y->rank);
+}
@@ -0,0 +1,96 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#ifndef BXILOG_FILE_ROTATION_IMPL_H
+#define BXILOG_FILE_ROTATION_IMPL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "bxi/base/err.h"
+
+#include "bxi/base/log/file_handler.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+// Length of the date of a segment name: 20140918T090752
+#define BXILOG__FILE_SEGMENT_DATE_SIZE 15
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+/*
+ * The background part of the file handler rotation.
+ *
+ * Segments are named after the file and the date of the rotation:
+ * <filename>.<YYYYMMDDTHHMMSS>[.<n>]. A low priority thread creates the next file
+ * beforehand as <filename>.rotating, so a rotation only switches file descriptors in
+ * the handler thread. The thread then names the segments handed over, truncates,
+ * closes and compresses them, and removes the oldest ones, so the handler thread
+ * never waits for it.
+ */
+typedef struct bxilog__file_rotator_s bxilog__file_rotator_s;
+typedef bxilog__file_rotator_s * bxilog__file_rotator_p;
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Interface         ****************************
+//*********************************************************************************
+
+/*
+ * Start the background thread for the segments of filename.
+ *
+ * Next files are opened with open_flags and prealloc bytes are allocated to them.
+ * Only the keep_nb most recent segments are kept (0: all of them).
+ */
+bxierr_p bxilog__file_rotator_new(const char * filename, int open_flags, off_t prealloc,
+                                  size_t keep_nb, bxilog_file_compress_e compress,
+                                  bxilog__file_rotator_p * result);
+
+/* Wait for the segments handed over then stop the thread, errors met are returned */
+bxierr_p bxilog__file_rotator_destroy(bxilog__file_rotator_p * self_p);
+
+/*
+ * Return true when the next file is created: the rotation can take place.
+ *
+ * Otherwise, it is created (again after a failure) in the background.
+ */
+bool bxilog__file_rotator_ready(bxilog__file_rotator_p self);
+
+/*
+ * Switch to the next file, bxilog__file_rotator_ready() must have returned true.
+ *
+ * *fd is the next file and *size its preallocated length. The current file, old_fd,
+ * becomes a segment named after sec in the background, truncated to length unless
+ * negative. When written is false, writes to old_fd are still in flight:
+ * bxilog__file_rotator_written() must be given *segment once they are complete.
+ */
+void bxilog__file_rotator_switch(bxilog__file_rotator_p self,
+                                 int old_fd, off_t length, time_t sec, bool written,
+                                 int * fd, off_t * size, void ** segment);
+
+/* The writes to the given segment are complete: it can be closed */
+void bxilog__file_rotator_written(void * segment);
+
+/* Return the errors met in the background since the last call */
+bxierr_p bxilog__file_rotator_errors(bxilog__file_rotator_p self);
+
+#endif
@@ -0,0 +1,505 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "bxi/base/err.h"
+#include "bxi/base/mem.h"
+
+#include "file_writer_impl.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+typedef struct {
+    char * buf;
+    int fd;                         // Written to, set on submission
+    size_t count;                   // Bytes to write
+    size_t written;                 // Bytes written so far (io_uring), set on completion
+    int error;                      // errno of an incomplete write, set on completion
+    bool done;                      // Set (atomically) on completion
+    void (*release)(void * arg);    // Called once reaped (e.g. last write to an fd)
+    void * release_arg;
+} slot_s;
+
+typedef slot_s * slot_p;
+
+struct bxilog__file_writer_s {
+    int fd;
+    size_t buf_size;
+    size_t queue_depth;
+    size_t inflight_max;
+    size_t * bytes_written;
+    size_t * bytes_lost;
+    slot_p slots;                   // queue_depth + 1 buffers
+    size_t slots_nb;
+    size_t head;                    // Oldest slot in flight, the others follow
+    size_t inflight_nb;             // The next one is the current buffer
+    size_t inflight_bytes;
+    bool uring;                     // io_uring is used, the writer thread otherwise
+#ifdef HAVE_LIBURING
+    struct io_uring ring;
+#endif
+    size_t uring_next;              // Next slot handed over to io_uring
+    size_t uring_pending_nb;        // Slots submitted but not handed over yet
+    bool uring_busy;                // A write is in the kernel
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t todo_cond;       // Signaled when a slot is queued
+    pthread_cond_t done_cond;       // Signaled when a slot is written
+    size_t queued_nb;               // Slots the thread has to write, protected by lock
+    size_t next;                    // Next slot the thread writes
+    bool exiting;                   // Protected by lock
+};
+
+//*********************************************************************************
+//********************************** Static Functions  ****************************
+//*********************************************************************************
+
+static bxierr_p _reap(bxilog__file_writer_p self, bool wait);
+static void _complete(slot_p slot, size_t written, int error);
+static void _free(bxilog__file_writer_p self);
+static bool _uring_init(bxilog__file_writer_p self);
+static void _uring_submit(bxilog__file_writer_p self);
+static void _uring_write(bxilog__file_writer_p self, slot_p slot);
+static void _uring_reap(bxilog__file_writer_p self, bool wait);
+static bxierr_p _thread_init(bxilog__file_writer_p self);
+static void _thread_submit(bxilog__file_writer_p self);
+static void _thread_reap(bxilog__file_writer_p self, bool wait);
+static void _thread_exit(bxilog__file_writer_p self);
+static void * _thread_main(void * arg);
+static int _write_all(int fd, const char * buf, size_t count, size_t * written);
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Implementation    ****************************
+//*********************************************************************************
+
+bxierr_p bxilog__file_writer_new(int fd, bxilog_file_write_e mode,
+                                 size_t buf_size,
+                                 size_t queue_depth, size_t inflight_max,
+                                 size_t * bytes_written, size_t * bytes_lost,
+                                 bxilog__file_writer_p * result) {
+
+    bxiassert(BXILOG_FILE_WRITE_SYNC != mode);
+    bxiassert(0 < queue_depth);
+    bxiassert(NULL != result);
+
+    bxierr_p err = BXIERR_OK;
+    bxilog__file_writer_p self = bximem_calloc(sizeof(*self));
+    self->fd = fd;
+    self->buf_size = buf_size;
+    self->queue_depth = queue_depth;
+    self->inflight_max = inflight_max;
+    self->bytes_written = bytes_written;
+    self->bytes_lost = bytes_lost;
+    self->slots_nb = queue_depth + 1;
+    self->slots = bximem_calloc(self->slots_nb * sizeof(*self->slots));
+
+    size_t align = (size_t) sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < self->slots_nb; i++) {
+        int rc = posix_memalign((void**) &self->slots[i].buf, align, buf_size);
+        if (0 != rc) {
+            err = bxierr_fromidx(rc, NULL, "Calling posix_memalign(%zu, %zu) failed",
+                                 align, buf_size);
+            goto QUIT;
+        }
+    }
+
+    self->uring = (BXILOG_FILE_WRITE_ASYNC == mode) && _uring_init(self);
+    if (!self->uring) {
+        err = _thread_init(self);
+        if (bxierr_isko(err)) goto QUIT;
+    }
+
+    *result = self;
+    return BXIERR_OK;
+
+QUIT:
+    _free(self);
+    return err;
+}
+
+bxierr_p bxilog__file_writer_destroy(bxilog__file_writer_p * self_p) {
+    bxilog__file_writer_p self = *self_p;
+    if (NULL == self) return BXIERR_OK;
+
+    bxierr_p err = bxilog__file_writer_drain(self);
+
+    if (self->uring) {
+#ifdef HAVE_LIBURING
+        io_uring_queue_exit(&self->ring);
+#endif
+    } else {
+        _thread_exit(self);
+    }
+    _free(self);
+    *self_p = NULL;
+
+    return err;
+}
+
+char * bxilog__file_writer_buf(bxilog__file_writer_p self) {
+    return self->slots[(self->head + self->inflight_nb) % self->slots_nb].buf;
+}
+
+const char * bxilog__file_writer_backend(bxilog__file_writer_p self) {
+    return self->uring ? "io_uring" : "thread";
+}
+
+bxierr_p bxilog__file_writer_submit(bxilog__file_writer_p self, size_t count) {
+    bxiassert(count <= self->buf_size);
+
+    bxierr_p err = BXIERR_OK, err2;
+
+    err2 = _reap(self, false);
+    BXIERR_CHAIN(err, err2);
+
+    if (0 == count) return err;
+
+    while (self->queue_depth <= self->inflight_nb ||
+           (0 < self->inflight_max && 0 < self->inflight_nb &&
+            self->inflight_max < self->inflight_bytes + count)) {
+        err2 = _reap(self, true);
+        BXIERR_CHAIN(err, err2);
+    }
+
+    slot_p slot = &self->slots[(self->head + self->inflight_nb) % self->slots_nb];
+    slot->fd = self->fd;
+    slot->count = count;
+    slot->written = 0;
+    slot->error = 0;
+    __atomic_store_n(&slot->done, false, __ATOMIC_RELAXED);
+    self->inflight_nb++;
+    self->inflight_bytes += count;
+
+    if (self->uring) {
+        _uring_submit(self);
+    } else {
+        _thread_submit(self);
+    }
+
+    return err;
+}
+
+bxierr_p bxilog__file_writer_drain(bxilog__file_writer_p self) {
+    bxierr_p err = BXIERR_OK, err2;
+
+    while (0 < self->inflight_nb) {
+        err2 = _reap(self, true);
+        BXIERR_CHAIN(err, err2);
+    }
+
+    return err;
+}
+
+void bxilog__file_writer_set_fd(bxilog__file_writer_p self, int fd,
+                                void (*release)(void * arg), void * arg) {
+    // Slots are reaped in order: the last one written to the current fd releases it
+    slot_p last = NULL;
+    if (0 < self->inflight_nb) {
+        last = &self->slots[(self->head + self->inflight_nb - 1) % self->slots_nb];
+        if (last->fd != self->fd) last = NULL;
+    }
+    self->fd = fd;
+    if (NULL == last) {
+        if (NULL != release) release(arg);
+        return;
+    }
+    bxiassert(NULL == last->release);
+    last->release = release;
+    last->release_arg = arg;
+}
+
+//*********************************************************************************
+//********************************** Static Helpers Implementation ****************
+//*********************************************************************************
+
+bxierr_p _reap(bxilog__file_writer_p self, bool wait) {
+    bxierr_p err = BXIERR_OK, err2;
+
+    if (0 == self->inflight_nb) return err;
+
+    // Wait for the oldest write at most: writes complete in order
+    if (self->uring) {
+        _uring_reap(self, wait);
+    } else {
+        _thread_reap(self, wait);
+    }
+
+    while (0 < self->inflight_nb &&
+           __atomic_load_n(&self->slots[self->head].done, __ATOMIC_ACQUIRE)) {
+
+        slot_p slot = &self->slots[self->head];
+        *self->bytes_written += slot->written;
+        if (slot->written < slot->count) {
+            *self->bytes_lost += slot->count - slot->written;
+            err2 = bxierr_fromidx(slot->error, NULL,
+                                  "Writing %zu bytes to fd %d with %s failed "
+                                  "(written=%zu)",
+                                  slot->count, slot->fd,
+                                  bxilog__file_writer_backend(self),
+                                  slot->written);
+            BXIERR_CHAIN(err, err2);
+        }
+        self->inflight_bytes -= slot->count;
+        self->inflight_nb--;
+        self->head = (self->head + 1) % self->slots_nb;
+        if (NULL != slot->release) {
+            slot->release(slot->release_arg);
+            slot->release = NULL;
+        }
+    }
+
+    return err;
+}
+
+void _complete(slot_p slot, size_t written, int error) {
+    slot->written = written;
+    slot->error = (written < slot->count && 0 == error) ? EIO : error;
+    __atomic_store_n(&slot->done, true, __ATOMIC_RELEASE);
+}
+
+void _free(bxilog__file_writer_p self) {
+    for (size_t i = 0; i < self->slots_nb; i++) BXIFREE(self->slots[i].buf);
+    BXIFREE(self->slots);
+    BXIFREE(self);
+}
+
+bool _uring_init(bxilog__file_writer_p self) {
+#ifdef HAVE_LIBURING
+    // Pipes and terminals may be written partially: left to the writer thread
+    struct stat st;
+    if (0 != fstat(self->fd, &st) || !S_ISREG(st.st_mode)) return false;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int rc = io_uring_queue_init_params((unsigned) self->queue_depth,
+                                        &self->ring, &params);
+    // Not supported by the kernel, or forbidden (e.g. seccomp)
+    if (0 != rc) return false;
+
+    // Writes are made at the current file position (offset -1)
+    if (0 == (params.features & IORING_FEAT_RW_CUR_POS)) {
+        io_uring_queue_exit(&self->ring);
+        return false;
+    }
+    return true;
+#else
+    UNUSED(self);
+    return false;
+#endif
+}
+
+void _uring_submit(bxilog__file_writer_p self) {
+    self->uring_pending_nb++;
+    // Otherwise, handed over when the write in the kernel completes
+    if (!self->uring_busy) _uring_write(self, &self->slots[self->uring_next]);
+}
+
+void _uring_write(bxilog__file_writer_p self, slot_p slot) {
+#ifdef HAVE_LIBURING
+    // Slots are handed over one at a time: the remainder of a short write must
+    // reach the file before the next slot, which is then submitted on completion
+    struct io_uring_sqe * sqe = io_uring_get_sqe(&self->ring);
+    bxiassert(NULL != sqe);
+
+    io_uring_prep_write(sqe, slot->fd, slot->buf + slot->written,
+                        (unsigned) (slot->count - slot->written), (uint64_t) -1);
+    io_uring_sqe_set_data(sqe, slot);
+    self->uring_busy = true;
+
+    int rc;
+    do {
+        rc = io_uring_submit(&self->ring);
+    } while (-EINTR == rc || -EAGAIN == rc);
+    if (0 > rc) {
+        bxierr_abort_ifko(bxierr_fromidx(-rc, NULL, "Calling io_uring_submit() failed"));
+    }
+#else
+    UNUSED(self);
+    UNUSED(slot);
+    bxiunreachable_statement;
+#endif
+}
+
+void _uring_reap(bxilog__file_writer_p self, bool wait) {
+#ifdef HAVE_LIBURING
+    slot_p head = &self->slots[self->head];
+    while (true) {
+        struct io_uring_cqe * cqe;
+        int rc = io_uring_peek_cqe(&self->ring, &cqe);
+        if (-EAGAIN == rc) {
+            if (!wait || __atomic_load_n(&head->done, __ATOMIC_RELAXED)) break;
+            rc = io_uring_wait_cqe(&self->ring, &cqe);
+            if (-EINTR == rc) continue;
+        }
+        if (0 != rc) {
+            bxierr_abort_ifko(bxierr_fromidx(-rc, NULL,
+                                             "Calling io_uring_wait_cqe() failed"));
+        }
+        slot_p slot = io_uring_cqe_get_data(cqe);
+        const int res = cqe->res;
+        io_uring_cqe_seen(&self->ring, cqe);
+        self->uring_busy = false;
+
+        if (0 < res) slot->written += (size_t) res;
+        if (slot->written < slot->count &&
+            (0 < res || -EINTR == res || -EAGAIN == res)) {
+            // Short write: resubmit the remainder
+            _uring_write(self, slot);
+            continue;
+        }
+        int error = 0;
+        if (0 > res) error = -res;
+        else if (slot->written < slot->count) error = EIO;
+        _complete(slot, slot->written, error);
+
+        self->uring_next = (self->uring_next + 1) % self->slots_nb;
+        self->uring_pending_nb--;
+        if (0 < self->uring_pending_nb) _uring_write(self, &self->slots[self->uring_next]);
+    }
+#else
+    UNUSED(self);
+    UNUSED(wait);
+    bxiunreachable_statement;
+#endif
+}
+
+bxierr_p _thread_init(bxilog__file_writer_p self) {
+    int rc = pthread_mutex_init(&self->lock, NULL);
+    if (0 != rc) {
+        return bxierr_fromidx(rc, NULL, "Calling pthread_mutex_init() failed (rc=%d)", rc);
+    }
+    rc = pthread_cond_init(&self->todo_cond, NULL);
+    bxiassert(0 == rc);
+    rc = pthread_cond_init(&self->done_cond, NULL);
+    bxiassert(0 == rc);
+
+    rc = pthread_create(&self->thread, NULL, _thread_main, self);
+    if (0 != rc) {
+        pthread_cond_destroy(&self->done_cond);
+        pthread_cond_destroy(&self->todo_cond);
+        pthread_mutex_destroy(&self->lock);
+        return bxierr_fromidx(rc, NULL, "Calling pthread_create() failed (rc=%d)", rc);
+    }
+
+    return BXIERR_OK;
+}
+
+void _thread_submit(bxilog__file_writer_p self) {
+    int rc = pthread_mutex_lock(&self->lock);
+    bxiassert(0 == rc);
+    self->queued_nb++;
+    rc = pthread_cond_signal(&self->todo_cond);
+    bxiassert(0 == rc);
+    rc = pthread_mutex_unlock(&self->lock);
+    bxiassert(0 == rc);
+}
+
+void _thread_reap(bxilog__file_writer_p self, bool wait) {
+    if (!wait) return;
+
+    slot_p head = &self->slots[self->head];
+    int rc = pthread_mutex_lock(&self->lock);
+    bxiassert(0 == rc);
+    while (!__atomic_load_n(&head->done, __ATOMIC_RELAXED)) {
+        rc = pthread_cond_wait(&self->done_cond, &self->lock);
+        bxiassert(0 == rc);
+    }
+    rc = pthread_mutex_unlock(&self->lock);
+    bxiassert(0 == rc);
+}
+
+void _thread_exit(bxilog__file_writer_p self) {
+    int rc = pthread_mutex_lock(&self->lock);
+    bxiassert(0 == rc);
+    self->exiting = true;
+    rc = pthread_cond_signal(&self->todo_cond);
+    bxiassert(0 == rc);
+    rc = pthread_mutex_unlock(&self->lock);
+    bxiassert(0 == rc);
+
+    rc = pthread_join(self->thread, NULL);
+    bxiassert(0 == rc);
+    pthread_cond_destroy(&self->done_cond);
+    pthread_cond_destroy(&self->todo_cond);
+    pthread_mutex_destroy(&self->lock);
+}
+
+void * _thread_main(void * arg) {
+    bxilog__file_writer_p self = arg;
+
+    int rc = pthread_mutex_lock(&self->lock);
+    bxiassert(0 == rc);
+    while (true) {
+        while (0 == self->queued_nb && !self->exiting) {
+            rc = pthread_cond_wait(&self->todo_cond, &self->lock);
+            bxiassert(0 == rc);
+        }
+        if (0 == self->queued_nb) break;
+
+        slot_p slot = &self->slots[self->next];
+        rc = pthread_mutex_unlock(&self->lock);
+        bxiassert(0 == rc);
+
+        // Slots are written one at a time, in order
+        size_t written;
+        int error = _write_all(slot->fd, slot->buf, slot->count, &written);
+
+        rc = pthread_mutex_lock(&self->lock);
+        bxiassert(0 == rc);
+        _complete(slot, written, error);
+        self->next = (self->next + 1) % self->slots_nb;
+        self->queued_nb--;
+        rc = pthread_cond_signal(&self->done_cond);
+        bxiassert(0 == rc);
+    }
+    rc = pthread_mutex_unlock(&self->lock);
+    bxiassert(0 == rc);
+
+    return NULL;
+}
+
+int _write_all(int fd, const char * buf, size_t count, size_t * written) {
+    *written = 0;
+    while (*written < count) {
+        errno = 0;
+        ssize_t n = write(fd, buf + *written, count - *written);
+        if (0 > n) {
+            if (EINTR == errno) continue;
+            return errno;
+        }
+        if (0 == n) return EIO;
+        *written += (size_t) n;
+    }
+    return 0;
+}
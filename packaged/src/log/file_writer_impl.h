@@ -0,0 +1,92 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#ifndef BXILOG_FILE_WRITER_IMPL_H
+#define BXILOG_FILE_WRITER_IMPL_H
+
+#include <stddef.h>
+
+#include "bxi/base/err.h"
+
+#include "bxi/base/log/file_handler.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+/*
+ * Asynchronous writes of a file handler buffers.
+ *
+ * The writer owns queue_depth + 1 buffers: the file handler formats lines into the
+ * current one while up to queue_depth previous ones are being written, in order, by
+ * io_uring or by a writer thread. All functions must be called from the file
+ * handler thread.
+ */
+typedef struct bxilog__file_writer_s bxilog__file_writer_s;
+typedef bxilog__file_writer_s * bxilog__file_writer_p;
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Interface         ****************************
+//*********************************************************************************
+
+/*
+ * Create a new writer of buffers of buf_size bytes to fd.
+ *
+ * At most queue_depth writes and inflight_max bytes (0: no limit) are in flight.
+ * Bytes written and lost by completed writes are added to *bytes_written and
+ * *bytes_lost.
+ */
+bxierr_p bxilog__file_writer_new(int fd, bxilog_file_write_e mode,
+                                 size_t buf_size,
+                                 size_t queue_depth, size_t inflight_max,
+                                 size_t * bytes_written, size_t * bytes_lost,
+                                 bxilog__file_writer_p * result);
+
+/* Drain then destroy the given writer, its buffers are released */
+bxierr_p bxilog__file_writer_destroy(bxilog__file_writer_p * self_p);
+
+/* The buffer lines must be formatted into */
+char * bxilog__file_writer_buf(bxilog__file_writer_p self);
+
+/* Name of the backend actually used: "io_uring" or "thread" */
+const char * bxilog__file_writer_backend(bxilog__file_writer_p self);
+
+/*
+ * Write the first count bytes of the current buffer asynchronously and move to the
+ * next buffer, waiting for previous writes if limits are reached.
+ *
+ * Errors of the writes completed in between are returned.
+ */
+bxierr_p bxilog__file_writer_submit(bxilog__file_writer_p self, size_t count);
+
+/* Wait for all writes in flight, their errors are returned */
+bxierr_p bxilog__file_writer_drain(bxilog__file_writer_p self);
+
+/*
+ * Write to fd from now on (e.g. after a rotation).
+ *
+ * Writes in flight go on to the previous fd: release(arg) is called once they are
+ * complete, immediately when none is in flight.
+ */
+void bxilog__file_writer_set_fd(bxilog__file_writer_p self, int fd,
+                                void (*release)(void * arg), void * arg);
+
+#endif
@@ -24,6 +24,8 @@
 #include "bxi/base/log/level.h"
 #include "bxi/base/log/filter.h"
 
+#include "log_impl.h"
+
 //*********************************************************************************
 //********************************** Defines **************************************
 //*********************************************************************************
@@ -32,9 +34,23 @@
 //********************************** Types ****************************************
 //*********************************************************************************
 
+// A node of the prefix tree of a set of filters: the path from the root spells
+// the prefix. Children are a linked list of siblings.
+typedef struct trie_node_s trie_node_s;
+typedef trie_node_s * trie_node_p;
+
+struct trie_node_s {
+    trie_node_p child;
+    trie_node_p sibling;
+    size_t filter_rank;             // 1 + rank of the last filter with this prefix, or 0
+    char c;
+};
+
 //*********************************************************************************
 //********************************** Static Functions  ****************************
 //*********************************************************************************
+static void _trie_add(trie_node_p * root_p, const char * prefix, size_t filter_rank);
+static void _trie_free(trie_node_p node);
 //static int _filter_compar(const void * filter1, const void* filter2);
 //static void _merge_filter_visitor(const void *nodep, const VISIT which, const int depth);
 
@@ -94,6 +110,7 @@ void bxilog_filters_free(bxilog_filters_p filters) {
         BXIFREE(filters->list[i]->prefix);
         BXIFREE(filters->list[i]);
     }
+    _trie_free(filters->trie);
     BXIFREE(filters);
 }
 
@@ -118,6 +135,7 @@ void bxilog_filters_add(bxilog_filters_p * filters_p,
     bxilog_filters_p filters = *filters_p;
     filters->list[filters->nb] = filter;
     filters->nb++;
+    _trie_add((trie_node_p *) &filters->trie, filter->prefix, filters->nb);
 
     if (filters->nb >= filters->allocated_slots) {
         size_t old = filters->allocated_slots;
@@ -130,6 +148,34 @@ void bxilog_filters_add(bxilog_filters_p * filters_p,
     }
 }
 
+bxilog_level_e bxilog__filters_level(const bxilog_filters_p filters,
+                                     const char * const loggername) {
+    // The last matching filter wins
+    if (NULL != filters->trie) {
+        // Walk down the prefixes of loggername: O(strlen(loggername))
+        trie_node_p node = filters->trie;
+        size_t rank = node->filter_rank;
+        for (const char * c = loggername; '\0' != *c; c++) {
+            node = node->child;
+            while (NULL != node && *c != node->c) node = node->sibling;
+            if (NULL == node) break;
+            if (rank < node->filter_rank) rank = node->filter_rank;
+        }
+        return (0 == rank) ? BXILOG_OFF : filters->list[rank - 1]->level;
+    }
+    // Static sets of filters have no trie
+    bxilog_level_e level = BXILOG_OFF;
+    for (size_t i = 0; i < filters->nb; i++) {
+        bxilog_filter_p filter = filters->list[i];
+        if (NULL == filter) break;
+
+        if (0 == strncmp(filter->prefix, loggername, strlen(filter->prefix))) {
+            level = filter->level;
+        }
+    }
+    return level;
+}
+
 bxilog_filters_p  bxilog_filters_dup(bxilog_filters_p filters) {
     bxiassert(NULL != filters);
     bxilog_filters_p result = bxilog_filters_new();
@@ -340,6 +386,35 @@ bxilog_filters_p bxilog_filters_merge(bxilog_filters_p * filters_array, size_t n
 //*********************************************************************************
 //********************************** Static Helpers Implementation ****************
 //*********************************************************************************
+
+void _trie_add(trie_node_p * const root_p, const char * const prefix,
+               const size_t filter_rank) {
+    // The root stands for the empty prefix
+    if (NULL == *root_p) *root_p = bximem_calloc(sizeof(**root_p));
+    trie_node_p node = *root_p;
+    for (const char * c = prefix; '\0' != *c; c++) {
+        trie_node_p child = node->child;
+        while (NULL != child && *c != child->c) child = child->sibling;
+        if (NULL == child) {
+            child = bximem_calloc(sizeof(*child));
+            child->c = *c;
+            child->sibling = node->child;
+            node->child = child;
+        }
+        node = child;
+    }
+    // Filters are only appended: the last one with this prefix wins
+    node->filter_rank = filter_rank;
+}
+
+void _trie_free(trie_node_p node) {
+    while (NULL != node) {
+        trie_node_p sibling = node->sibling;
+        _trie_free(node->child);
+        BXIFREE(node);
+        node = sibling;
+    }
+}
 //int _filter_compar(const void * filter1, const void * filter2) {
 //    bxiassert(NULL != filter1);
 //    bxiassert(NULL != filter2);
@@ -12,11 +12,19 @@
  */
 
 
+// For pthread_setaffinity_np(), CPU_SET() and SCHED_BATCH/SCHED_IDLE
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <sys/syscall.h>
+#include <sys/resource.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sysexits.h>
 #include <string.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#endif
 
 #include "bxi/base/err.h"
 #include "bxi/base/mem.h"
@@ -29,11 +37,30 @@
 
 #include "handler_impl.h"
 #include "log_impl.h"
+#include "deferred_impl.h"
+#include "site_impl.h"
 
 
 //*********************************************************************************
 //********************************** Defines **************************************
 //*********************************************************************************
+// Maximum number of records processed from a single ring in one pass, so a busy
+// thread can't starve other rings and control messages.
+#define RING_DRAIN_MAX 1024
+
+// Entry of the per logger filter levels table not resolved yet
+#define FILTER_LEVEL_UNKNOWN UINT8_MAX
+
+// Maximum number of priority records processed per wakeup by a handler sharing its
+// thread with others, so it can't starve them
+#define POOL_PRIORITY_BUDGET 1024
+
+// The spin time of a handler never shrinks below its spin_us / SPIN_SHRINK_MAX
+#define SPIN_SHRINK_MAX 16
+
+// While spinning, the rings are checked this number of times per zmq_poll(),
+// which costs a system call
+#define SPIN_RINGS_CHECKS 64
 
 
 //*********************************************************************************
@@ -43,6 +70,34 @@
 typedef struct {
     void * ctrl_zocket;
     void * data_zocket;
+    void * priority_zocket;                 // NULL without priority lane
+
+    bxilog__ring_set_p ring_set;            // NULL unless the ring transport is used
+    bxilog__ring_p * rings;                 // Rings taken from ring_set
+    size_t rings_nb;
+    size_t rings_version;
+
+    // Where deferred records are formatted, one buffer per batch entry
+    char * deferred_bufs[BXILOG_HANDLER_BATCH_MAX];
+    size_t deferred_bufs_size[BXILOG_HANDLER_BATCH_MAX];
+
+    // Records accepted but not given to process_log_batch() yet
+    bxilog_batch_entry_s batch[BXILOG_HANDLER_BATCH_MAX];
+    size_t batch_nb;
+    bxilog_record_s resolved[BXILOG_HANDLER_BATCH_MAX]; // With site strings lengths
+
+    uint8_t * filter_levels;                // Level accepted by the filters, indexed by
+    size_t filter_levels_nb;                // logger id: resolved on first record
+
+    // Layout of this handler items in the poll set: ctrl, data, then optionally
+    // priority and wakeup, then private items
+    size_t items_nb;
+    size_t priority_item;
+    size_t wakeup_item;
+    size_t first_private;
+    long actual_timeout;                    // Before the next implicit flush
+    uint64_t spin_ns;                       // Current busy-polling time
+    struct timespec last_flush_time;
 
 #ifdef __linux__
     pid_t tid;                              // the thread pid
@@ -55,6 +110,11 @@ typedef handler_data_s * handler_data_p;
 //********************************** Static Functions  ****************************
 //*********************************************************************************
 static bxierr_p _mask_signals(bxilog_handler_p);
+static bxierr_p _place_thread(bxilog_handler_param_p);
+#ifdef __linux__
+static bxierr_p _parse_cpus(const char * list, cpu_set_t * cpus);
+static bxierr_p _numa_node_cpus(int node, cpu_set_t * cpus);
+#endif
 static bxierr_p _create_zockets(bxilog_handler_p,
                                 bxilog_handler_param_p,
                                 handler_data_p);
@@ -64,15 +124,49 @@ static bxierr_p _bind_ctrl_zocket(bxilog_handler_p,
 static bxierr_p _bind_data_zocket(bxilog_handler_p,
                                   bxilog_handler_param_p,
                                   handler_data_p);
+static bxierr_p _bind_priority_zocket(bxilog_handler_p,
+                                      bxilog_handler_param_p,
+                                      handler_data_p);
 static bxierr_p _init_handler(bxilog_handler_p,
                               bxilog_handler_param_p,
                               handler_data_p);
 static bxierr_p _send_ready_status(bxilog_handler_p,
                                    bxilog_handler_param_p,
                                    handler_data_p, bxierr_p err);
+static bxierr_p _setup(bxilog_handler_p,
+                       bxilog_handler_param_p,
+                       handler_data_p);
+static bxierr_p _teardown(bxilog_handler_p,
+                          bxilog_handler_param_p,
+                          handler_data_p);
 static bxierr_p _loop(bxilog_handler_p,
                       bxilog_handler_param_p,
                       handler_data_p);
+static void _loop_init(bxilog_handler_param_p,
+                       handler_data_p,
+                       zmq_pollitem_t * items);
+static long _loop_timeout(handler_data_p);
+static bool _loop_spin(bxilog_handler_param_p,
+                       handler_data_p,
+                       zmq_pollitem_t * items);
+static bxierr_p _loop_poll_failed(bxilog_handler_p,
+                                  bxilog_handler_param_p,
+                                  handler_data_p);
+static bxierr_p _loop_step(bxilog_handler_p,
+                           bxilog_handler_param_p,
+                           handler_data_p,
+                           zmq_pollitem_t * items,
+                           size_t priority_budget,
+                           bool pooled);
+static size_t _items_nb(bxilog_handler_param_p, handler_data_p);
+static bxierr_p _pool_sync(bxilog__handler_pool_bundle_p bundle,
+                           handler_data_p datas,
+                           bxierr_p * eerrs,
+                           bool * exited);
+static bxierr_p _pool_loop(bxilog__handler_pool_bundle_p bundle,
+                           handler_data_p datas,
+                           bxierr_p * eerrs,
+                           bool * exited);
 static bxierr_p _cleanup(bxilog_handler_p,
                          bxilog_handler_param_p,
                          handler_data_p);
@@ -82,12 +176,41 @@ static bxierr_p _internal_flush(bxilog_handler_p,
 static bxierr_p _process_ierr(bxilog_handler_p handler,
                               bxilog_handler_param_p,
                               bxierr_p err);
-static bxierr_p _process_log_record(bxilog_handler_p,
-                                    bxilog_handler_param_p,
-                                    handler_data_p);
-static bxierr_p _process_log_zmsg(bxilog_handler_p handler,
+static bxierr_p _process_log_records(bxilog_handler_p,
+                                     bxilog_handler_param_p,
+                                     handler_data_p,
+                                     size_t lane,
+                                     size_t * received);
+static bxierr_p _process_batch(bxilog_handler_p handler,
+                               bxilog_handler_param_p param,
+                               handler_data_p data);
+static bxierr_p _process_priority(bxilog_handler_p handler,
                                   bxilog_handler_param_p param,
-                                  handler_data_p data, zmq_msg_t zmsg);
+                                  handler_data_p data,
+                                  size_t budget,
+                                  size_t * processed);
+static void _lane_received(bxilog_handler_param_p param, size_t lane);
+static bxilog_record_s * _format_deferred(handler_data_p data,
+                                          size_t slot,
+                                          bxilog_record_s * record);
+static bxilog_level_e _filter_level(bxilog_handler_param_p param,
+                                    handler_data_p data,
+                                    uint32_t logger_id,
+                                    const char * loggername);
+static bxierr_p _process_log_record_data(bxilog_handler_p handler,
+                                        bxilog_handler_param_p param,
+                                        handler_data_p data,
+                                        bxilog_record_p record);
+static bxierr_p _process_log_data(bxilog_handler_p handler,
+                                  bxilog_handler_param_p param,
+                                  handler_data_p data,
+                                  size_t lane,
+                                  void * buf, size_t size);
+static bxierr_p _process_rings(bxilog_handler_p handler,
+                               bxilog_handler_param_p param,
+                               handler_data_p data,
+                               size_t * processed);
+static bool _rings_isempty(handler_data_p data);
 static bxierr_p _process_ctrl_cmd(bxilog_handler_p,
                                   bxilog_handler_param_p,
                                   handler_data_p);
@@ -119,24 +242,56 @@ void bxilog_handler_init_param(bxilog_handler_p handler,
     param->flush_freq_ms = 1000;
     param->ierr_max = 10;
     param->filters = filters;
+    param->backpressure = BXILOG_BACKPRESSURE_BLOCK;
+    param->backpressure_level = BXILOG_WARNING;
+    param->priority_level = BXILOG_OFF;
+    param->priority_hwm = 1000;
+    param->shards_nb = 1;
+    param->shard = 0;
+    param->cpus = NULL;
+    param->numa_node = -1;
+    param->nice = 0;
+    param->sched_policy = BXILOG_SCHED_INHERIT;
+    param->sched_priority = 0;
+    param->spin_us = 0;
 
     // Use the param pointer to guarantee a unique URL name for different instances of
     // the same handler
     param->ctrl_url = bxistr_new("inproc://%s/%p.ctrl", handler->name, param);
     param->data_url = bxistr_new("inproc://%s/%p.data", handler->name, param);
+    param->priority_url = bxistr_new("inproc://%s/%p.priority", handler->name, param);
 }
 
 void bxilog_handler_clean_param(bxilog_handler_param_p param) {
     BXIFREE(param->ctrl_url);
     BXIFREE(param->data_url);
+    BXIFREE(param->priority_url);
+    BXIFREE(param->cpus);
     bxilog_filters_destroy(&param->filters);
     // Do not free param since it has not been allocated by init()
     // BXIFREE(param);
  }
 
+bxierr_p bxilog_handler_param_set_cpus(bxilog_handler_param_p param, const char * cpus) {
+    bxiassert(NULL != param);
+
+#ifdef __linux__
+    if (NULL != cpus) {
+        cpu_set_t set;
+        bxierr_p err = _parse_cpus(cpus, &set);
+        if (bxierr_isko(err)) return err;
+    }
+#endif
+    BXIFREE(param->cpus);
+    if (NULL != cpus) param->cpus = strdup(cpus);
+
+    return BXIERR_OK;
+}
+
 bxierr_p bxilog__handler_start(bxilog__handler_thread_bundle_p bundle) {
     bxilog_handler_p handler = bundle->handler;
     bxilog_handler_param_p param = bundle->param;
+    bxilog__ring_set_p ring_set = bundle->ring_set;
 
     BXIFREE(bundle);
 
@@ -144,24 +299,12 @@ bxierr_p bxilog__handler_start(bxilog__handler_thread_bundle_p bundle) {
     bxierr_p ierr = BXIERR_OK;        // Internal errors
     handler_data_s data;
     memset(&data, 0, sizeof(data));
+    data.ring_set = ring_set;
 
-    // Constants for the IHT
-#ifdef __linux__
-    data.tid = (pid_t) syscall(SYS_gettid);
-#endif
-
-    eerr2 = _init_handler(handler, param, &data);
+    eerr2 = _setup(handler, param, &data);
     BXIERR_CHAIN(eerr, eerr2);
     // Do not quit immediately, we need to send a ready message to BC.
 
-    ierr = _create_zockets(handler, param, &data);
-    eerr2 = _process_ierr(handler, param, ierr);
-    BXIERR_CHAIN(eerr, eerr2);
-
-    ierr = _mask_signals(handler);
-    eerr2 = _process_ierr(handler, param, ierr);
-    BXIERR_CHAIN(eerr, eerr2);
-
     ierr = _send_ready_status(handler, param, &data, eerr);
     eerr2 = _process_ierr(handler, param, ierr);
     BXIERR_CHAIN(eerr, eerr2);
@@ -175,16 +318,46 @@ bxierr_p bxilog__handler_start(bxilog__handler_thread_bundle_p bundle) {
     BXIERR_CHAIN(eerr, eerr2);
 
 CLEANUP:
-    ierr = _cleanup(handler, param, &data);
-    eerr2 = _process_ierr(handler, param, ierr);
-    BXIERR_CHAIN(eerr, eerr2);
-
-    eerr2 = _process_exit(handler, param, &data);
+    eerr2 = _teardown(handler, param, &data);
     BXIERR_CHAIN(eerr, eerr2);
 
     return eerr;
 }
 
+bxierr_p bxilog__handler_pool_start(bxilog__handler_pool_bundle_p bundle) {
+    const size_t handlers_nb = bundle->handlers_nb;
+    handler_data_p datas = bximem_calloc(handlers_nb * sizeof(*datas));
+    bxierr_p * eerrs = bximem_calloc(handlers_nb * sizeof(*eerrs)); // External errors
+    bool * exited = bximem_calloc(handlers_nb * sizeof(*exited));
+
+    for (size_t i = 0; i < handlers_nb; i++) {
+        eerrs[i] = BXIERR_OK;
+        datas[i].ring_set = bundle->ring_sets[i];
+        bxierr_p eerr2 = _setup(bundle->handlers[i], bundle->params[i], &datas[i]);
+        BXIERR_CHAIN(eerrs[i], eerr2);
+    }
+
+    bxierr_p err = _pool_sync(bundle, datas, eerrs, exited);
+    if (bxierr_isok(err)) err = _pool_loop(bundle, datas, eerrs, exited);
+
+    for (size_t i = 0; i < handlers_nb; i++) {
+        if (!exited[i]) {
+            bxierr_p eerr2 = _teardown(bundle->handlers[i], bundle->params[i], &datas[i]);
+            BXIERR_CHAIN(eerrs[i], eerr2);
+        }
+        BXIERR_CHAIN(err, eerrs[i]);
+    }
+    BXIFREE(exited);
+    BXIFREE(eerrs);
+    BXIFREE(datas);
+    BXIFREE(bundle->handlers);
+    BXIFREE(bundle->params);
+    BXIFREE(bundle->ring_sets);
+    BXIFREE(bundle);
+
+    return err;
+}
+
 //*********************************************************************************
 //********************************** Static Helpers Implementation ****************
 //*********************************************************************************
@@ -228,6 +401,11 @@ bxierr_p _create_zockets(bxilog_handler_p handler,
     err2 = _bind_data_zocket(handler, param, data);
     BXIERR_CHAIN(err, err2);
 
+    if (BXILOG_OFF != param->priority_level) {
+        err2 = _bind_priority_zocket(handler, param, data);
+        BXIERR_CHAIN(err, err2);
+    }
+
     return err;
 }
 
@@ -288,6 +466,165 @@ bxierr_p _bind_data_zocket(bxilog_handler_p handler,
     return err;
 }
 
+bxierr_p _bind_priority_zocket(bxilog_handler_p handler,
+                               bxilog_handler_param_p param,
+                               handler_data_p data) {
+    UNUSED(handler);
+    bxierr_p err = BXIERR_OK, err2;
+
+    bxiassert(NULL == data->priority_zocket);
+
+    err2 = bxizmq_zocket_create(BXILOG__GLOBALS->zmq_ctx,
+                                ZMQ_PULL,
+                                &data->priority_zocket);
+    BXIERR_CHAIN(err, err2);
+
+    err2 = bxizmq_zocket_setopt(data->priority_zocket,
+                                ZMQ_RCVHWM,
+                                &param->priority_hwm,
+                                sizeof(param->priority_hwm));
+    BXIERR_CHAIN(err, err2);
+
+    int affected_port;
+
+    err2 = bxizmq_zocket_bind(data->priority_zocket,
+                              param->priority_url,
+                              &affected_port);
+    BXIERR_CHAIN(err, err2);
+
+    return err;
+}
+
+bxierr_p _place_thread(bxilog_handler_param_p param) {
+    bxierr_p err = BXIERR_OK, err2;
+#ifdef __linux__
+    int rc;
+    cpu_set_t cpus;
+    bool pinned = false;
+    if (NULL != param->cpus) {
+        err2 = _parse_cpus(param->cpus, &cpus);
+        BXIERR_CHAIN(err, err2);
+        pinned = bxierr_isok(err2);
+    } else if (0 <= param->numa_node) {
+        // Run close to the memory
+        err2 = _numa_node_cpus(param->numa_node, &cpus);
+        BXIERR_CHAIN(err, err2);
+        pinned = bxierr_isok(err2);
+    }
+    if (pinned) {
+        rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (0 != rc) {
+            err2 = bxierr_fromidx(rc, NULL,
+                                  "Calling pthread_setaffinity_np(%s) failed (rc=%d)",
+                                  (NULL != param->cpus) ? param->cpus : "", rc);
+            BXIERR_CHAIN(err, err2);
+        }
+    }
+    if (0 <= param->numa_node) {
+        // Pages are allocated on first touch: all memory the handler thread
+        // touches first (its buffers) is preferably taken from the node
+        const size_t bits = 8 * sizeof(unsigned long);
+        unsigned long nodemask[(size_t) param->numa_node / bits + 1];
+        memset(nodemask, 0, sizeof(nodemask));
+        nodemask[(size_t) param->numa_node / bits] = 1UL << ((size_t) param->numa_node % bits);
+        errno = 0;
+        long ret = syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodemask,
+                           ARRAYLEN(nodemask) * bits + 1);
+        if (0 != ret) {
+            err2 = bxierr_errno("Calling set_mempolicy(MPOL_PREFERRED, %d) failed",
+                                param->numa_node);
+            BXIERR_CHAIN(err, err2);
+        }
+    }
+    if (0 != param->nice) {
+        // On Linux, the nice value is per thread
+        errno = 0;
+        rc = setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), param->nice);
+        if (0 != rc) {
+            err2 = bxierr_errno("Calling setpriority(%d) failed", param->nice);
+            BXIERR_CHAIN(err, err2);
+        }
+    }
+    if (BXILOG_SCHED_INHERIT != param->sched_policy) {
+        static const int POLICIES[] = {
+            [BXILOG_SCHED_OTHER] = SCHED_OTHER,
+            [BXILOG_SCHED_BATCH] = SCHED_BATCH,
+            [BXILOG_SCHED_IDLE] = SCHED_IDLE,
+            [BXILOG_SCHED_FIFO] = SCHED_FIFO,
+            [BXILOG_SCHED_RR] = SCHED_RR,
+        };
+        bxiassert(param->sched_policy < ARRAYLEN(POLICIES));
+        struct sched_param sched_param;
+        memset(&sched_param, 0, sizeof(sched_param));
+        sched_param.sched_priority = param->sched_priority;
+        rc = pthread_setschedparam(pthread_self(), POLICIES[param->sched_policy],
+                                   &sched_param);
+        if (0 != rc) {
+            err2 = bxierr_fromidx(rc, NULL,
+                                  "Calling pthread_setschedparam(%d, %d) failed (rc=%d)",
+                                  param->sched_policy, param->sched_priority, rc);
+            BXIERR_CHAIN(err, err2);
+        }
+    }
+#else
+    if (NULL != param->cpus || 0 <= param->numa_node || 0 != param->nice ||
+        BXILOG_SCHED_INHERIT != param->sched_policy) {
+        err2 = bxierr_gen("Handler thread placement is not supported on this system");
+        BXIERR_CHAIN(err, err2);
+    }
+#endif
+
+    return err;
+}
+
+#ifdef __linux__
+bxierr_p _parse_cpus(const char * list, cpu_set_t * cpus) {
+    CPU_ZERO(cpus);
+    const char * s = list;
+    while ('\0' != *s && '\n' != *s) {
+        char * end;
+        unsigned long first = strtoul(s, &end, 10);
+        if (end == s) goto BAD;
+        unsigned long last = first;
+        if ('-' == *end) {
+            s = end + 1;
+            last = strtoul(s, &end, 10);
+            if (end == s || last < first) goto BAD;
+        }
+        if (CPU_SETSIZE <= last) goto BAD;
+        for (unsigned long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, cpus);
+        s = end;
+        if (',' == *s) s++;
+        else if ('\0' != *s && '\n' != *s) goto BAD;
+    }
+    if (0 == CPU_COUNT(cpus)) goto BAD;
+
+    return BXIERR_OK;
+
+BAD:
+    return bxierr_gen("Bad CPU list: '%s'", list);
+}
+
+bxierr_p _numa_node_cpus(int node, cpu_set_t * cpus) {
+    char * path = bxistr_new("/sys/devices/system/node/node%d/cpulist", node);
+    errno = 0;
+    int fd = open(path, O_RDONLY);
+    if (-1 == fd) {
+        bxierr_p err = bxierr_errno("Can't open %s", path);
+        BXIFREE(path);
+        return err;
+    }
+    char list[4096];
+    ssize_t n = read(fd, list, sizeof(list) - 1);
+    close(fd);
+    BXIFREE(path);
+    if (0 >= n) return bxierr_gen("Can't read the CPUs of NUMA node %d", node);
+    list[n] = '\0';
+
+    return _parse_cpus(list, cpus);
+}
+#endif
+
 bxierr_p _init_handler(bxilog_handler_p handler,
                        bxilog_handler_param_p param,
                        handler_data_p data) {
@@ -341,117 +678,451 @@ bxierr_p _send_ready_status(bxilog_handler_p handler,
     return BXIERR_OK;
 }
 
+bxierr_p _setup(bxilog_handler_p handler,
+                bxilog_handler_param_p param,
+                handler_data_p data) {
+
+    bxierr_p eerr = BXIERR_OK, eerr2;
+    bxierr_p ierr;
+
+    // Constants for the IHT
+#ifdef __linux__
+    data->tid = (pid_t) syscall(SYS_gettid);
+#endif
+
+    // Before the handler allocates its buffers, so they are on the right node
+    ierr = _place_thread(param);
+    eerr2 = _process_ierr(handler, param, ierr);
+    BXIERR_CHAIN(eerr, eerr2);
+
+    eerr2 = _init_handler(handler, param, data);
+    BXIERR_CHAIN(eerr, eerr2);
+
+    ierr = _create_zockets(handler, param, data);
+    eerr2 = _process_ierr(handler, param, ierr);
+    BXIERR_CHAIN(eerr, eerr2);
+
+    ierr = _mask_signals(handler);
+    eerr2 = _process_ierr(handler, param, ierr);
+    BXIERR_CHAIN(eerr, eerr2);
+
+    return eerr;
+}
+
+bxierr_p _teardown(bxilog_handler_p handler,
+                   bxilog_handler_param_p param,
+                   handler_data_p data) {
+
+    bxierr_p eerr = BXIERR_OK, eerr2;
+
+    bxierr_p ierr = _cleanup(handler, param, data);
+    eerr2 = _process_ierr(handler, param, ierr);
+    BXIERR_CHAIN(eerr, eerr2);
+
+    eerr2 = _process_exit(handler, param, data);
+    BXIERR_CHAIN(eerr, eerr2);
+
+    return eerr;
+}
+
 bxierr_p _loop(bxilog_handler_p handler,
                bxilog_handler_param_p param,
                handler_data_p data) {
 
-    bxierr_p err = BXIERR_OK, err2;
+    bxierr_p err = BXIERR_OK;
 
-    size_t items_nb = 2 + param->private_items_nb;
+    const size_t items_nb = _items_nb(param, data);
     zmq_pollitem_t items[items_nb];
+    _loop_init(param, data, items);
+    data->spin_ns = (uint64_t) param->spin_us * 1000;
+
+    while (true) {
+        const bool ready = (0 < data->spin_ns) && _loop_spin(param, data, items);
+        const long poll_timeout = ready ? 0 : _loop_timeout(data);
+        errno = 0;
+        int rc = zmq_poll(items, (int) items_nb, poll_timeout);
+
+        if (-1 == rc) {
+            if (EINTR == errno) continue; // One interruption happened
+                                          // (e.g. with profiling)
+            err = _loop_poll_failed(handler, param, data);
+            if (bxierr_isko(err)) break;
+        }
+        err = _loop_step(handler, param, data, items, SIZE_MAX, false);
+        // Including an explicit exit message
+        if (bxierr_isko(err)) break;
+    }
+
+    return err;
+}
+
+size_t _items_nb(bxilog_handler_param_p param, handler_data_p data) {
+    // The priority zocket and the ring transport wakeup pipe are polled after
+    // the data zocket, when used
+    data->first_private = 2;
+    data->priority_item = data->first_private;
+    if (NULL != data->priority_zocket) data->first_private++;
+    data->wakeup_item = data->first_private;
+    if (NULL != data->ring_set) data->first_private++;
+    data->items_nb = data->first_private + param->private_items_nb;
+
+    return data->items_nb;
+}
+
+void _loop_init(bxilog_handler_param_p param,
+                handler_data_p data,
+                zmq_pollitem_t * items) {
+
+    memset(items, 0, data->items_nb * sizeof(*items));
     items[0].socket = data->ctrl_zocket;
     items[0].events = ZMQ_POLLIN;
     items[1].socket = data->data_zocket;
     items[1].events = ZMQ_POLLIN;
+    if (NULL != data->priority_zocket) {
+        items[data->priority_item].socket = data->priority_zocket;
+        items[data->priority_item].events = ZMQ_POLLIN;
+    }
+    if (NULL != data->ring_set) {
+        items[data->wakeup_item].socket = NULL;
+        items[data->wakeup_item].fd = data->ring_set->wakeup_fd[0];
+        items[data->wakeup_item].events = ZMQ_POLLIN;
+    }
     for (size_t i = 0; i < param->private_items_nb; i++) {
-        memcpy(items + 2 + i, param->private_items + i, sizeof(items[2+i]));
+        memcpy(items + data->first_private + i, param->private_items + i,
+               sizeof(items[data->first_private + i]));
     }
 
+    data->actual_timeout = param->flush_freq_ms;
+    bxierr_p err = bxitime_get(CLOCK_MONOTONIC_RAW, &data->last_flush_time);
+    if (bxierr_isko(err)) bxierr_report(&err, STDERR_FILENO);
+}
 
-    long actual_timeout = param->flush_freq_ms;
-    struct timespec last_flush_time;
-    err2 = bxitime_get(CLOCK_MONOTONIC_RAW, &last_flush_time);
-    if (bxierr_isko(err2)) bxierr_report(&err2, STDERR_FILENO);
+long _loop_timeout(handler_data_p data) {
+    if (NULL != data->ring_set) {
+        // Tell producers we are going to sleep, then check the rings once more:
+        // a record published in between would be missed otherwise.
+        __atomic_store_n(&data->ring_set->sleeping, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!_rings_isempty(data)) return 0;
+    }
+    return data->actual_timeout;
+}
 
-    while (true) {
-        errno = 0;
-        int rc = zmq_poll(items, (int) items_nb, actual_timeout);
+bool _loop_spin(bxilog_handler_param_p param,
+                handler_data_p data,
+                zmq_pollitem_t * items) {
 
-        if (-1 == rc) {
-            if (EINTR == errno) continue; // One interruption happened
-                                          // (e.g. with profiling)
-
-            int code = zmq_errno();
-            const char * msg = zmq_strerror(code);
-            bxierr_p ierr = bxierr_new(code, NULL, NULL, NULL, NULL,
-                                       "Calling zmq_poll() failed: %s", msg);
-            err2 = _process_implicit_flush(handler, param, data);
-            BXIERR_CHAIN(err, err2);
-            err2 = _process_ierr(handler, param, ierr);
-            BXIERR_CHAIN(err, err2);
-            if (bxierr_isko(err)) goto QUIT;
+    struct timespec start;
+    bxierr_p err = bxitime_get(CLOCK_MONOTONIC, &start);
+    if (bxierr_isko(err)) {
+        bxierr_report(&err, STDERR_FILENO);
+        return false;
+    }
+    bool ready = false;
+    uint64_t spun_ns = 0;
+    for (size_t i = 0; !ready && spun_ns < data->spin_ns; i++) {
+        if (NULL != data->ring_set) ready = !_rings_isempty(data);
+        if (!ready && (NULL == data->ring_set || 0 == i % SPIN_RINGS_CHECKS)) {
+            ready = (0 < zmq_poll(items, (int) data->items_nb, 0));
         }
         double tmp;
-        err2 = bxitime_duration(CLOCK_MONOTONIC_RAW, last_flush_time, &tmp);
-        if (bxierr_isko(err2)) bxierr_report(&err2, STDERR_FILENO);
-        long duration_since_last_flush = (long) (tmp * 1e3);
-
-        actual_timeout = param->flush_freq_ms - duration_since_last_flush;
-
-//        fprintf(stderr,
-//                "Duration: %ld, Actual Timeout:  %ld\n",
-//                duration_since_last_flush, actual_timeout);
-
-        if (0 == rc || 0 >= actual_timeout) {
-            // 0 == rc: nothing to poll -> do a flush() and start again
-            // 0 >= actual_timeout:
-            // we might have received billions of logs that were filtered out
-            // and very few of them have been filtered in (accepted by the handler)
-            // however, if we do not flush, those accepted messages might never
-            // be seen unless an explicit flush is requested. As an example,
-            // if the handler (file_handler) buffers messages, only few of them have
-            // reached the buffer in let say 10 minutes which is therefore almost
-            // empty and not written to the underlying storage. For the end user
-            // it seems therefore that nothing happened at all! So we must guarantee
-            // implicit flush is requested at regular interval
-
-//            fprintf(stderr, "Implicit flush\n");
-            err2 = _process_implicit_flush(handler, param, data);
-            BXIERR_CHAIN(err, err2);
+        err = bxitime_duration(CLOCK_MONOTONIC, start, &tmp);
+        if (bxierr_isko(err)) {
+            bxierr_report(&err, STDERR_FILENO);
+            break;
+        }
+        spun_ns = (uint64_t) (tmp * 1e9);
+    }
 
-            err2 = bxitime_get(CLOCK_MONOTONIC_RAW, &last_flush_time);
-            if (bxierr_isko(err2)) bxierr_report(&err2, STDERR_FILENO);
-            actual_timeout = param->flush_freq_ms;
+    // Adapt to the logging rate: spin longer while it pays off
+    const uint64_t max_ns = (uint64_t) param->spin_us * 1000;
+    if (ready) {
+        data->spin_ns = (2 * data->spin_ns < max_ns) ? 2 * data->spin_ns : max_ns;
+    } else if (data->spin_ns / 2 >= max_ns / SPIN_SHRINK_MAX) {
+        data->spin_ns /= 2;
+    }
 
-            err = _process_ierr(handler, param, err);
-            if (bxierr_isko(err)) goto QUIT;
-            continue;
+    bxilog_spin_stats_p stats = &BXILOG__GLOBALS->backpressure[param->rank].spin;
+    __atomic_store_n(&stats->spins_nb, stats->spins_nb + 1, __ATOMIC_RELAXED);
+    if (ready) __atomic_store_n(&stats->hits_nb, stats->hits_nb + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->spin_ns, stats->spin_ns + spun_ns, __ATOMIC_RELAXED);
+
+    return ready;
+}
+
+bxierr_p _loop_poll_failed(bxilog_handler_p handler,
+                           bxilog_handler_param_p param,
+                           handler_data_p data) {
+
+    bxierr_p err = BXIERR_OK, err2;
+
+    int code = zmq_errno();
+    const char * msg = zmq_strerror(code);
+    bxierr_p ierr = bxierr_new(code, NULL, NULL, NULL, NULL,
+                               "Calling zmq_poll() failed: %s", msg);
+    err2 = _process_implicit_flush(handler, param, data);
+    BXIERR_CHAIN(err, err2);
+    err2 = _process_ierr(handler, param, ierr);
+    BXIERR_CHAIN(err, err2);
+
+    return err;
+}
+
+bxierr_p _loop_step(bxilog_handler_p handler,
+                    bxilog_handler_param_p param,
+                    handler_data_p data,
+                    zmq_pollitem_t * items,
+                    size_t priority_budget,
+                    const bool pooled) {
+
+    bxierr_p err = BXIERR_OK, err2;
+
+    bool polled = false;
+    for (size_t i = 0; i < data->items_nb; i++) polled |= (0 != items[i].revents);
+
+    size_t processed = 0;
+    if (NULL != data->priority_zocket) {
+        // Always drained first, so important records never wait behind others
+        err2 = _process_priority(handler, param, data, priority_budget, &processed);
+        BXIERR_CHAIN(err, err2);
+
+        err = _process_ierr(handler, param, err);
+        if (bxierr_isko(err)) return err;
+    }
+    if (NULL != data->ring_set) {
+        __atomic_store_n(&data->ring_set->sleeping, 0, __ATOMIC_RELAXED);
+        if (items[data->wakeup_item].revents & ZMQ_POLLIN) {
+            char wakeups[64];
+            while (0 < read(data->ring_set->wakeup_fd[0], wakeups, sizeof(wakeups)));
         }
-        if (items[0].revents & ZMQ_POLLIN) {
-            // Process ctrl message
-            err2 = _process_ctrl_cmd(handler, param, data);
-            BXIERR_CHAIN(err, err2);
-            // Treat explicit exit message
-            if (BXILOG_HANDLER_EXIT_CODE == err->code) goto QUIT;
-            err = _process_ierr(handler, param, err);
-            if (bxierr_isko(err)) goto QUIT;
+        size_t ring_processed;
+        err2 = _process_rings(handler, param, data, &ring_processed);
+        BXIERR_CHAIN(err, err2);
+        processed += ring_processed;
+
+        err = _process_ierr(handler, param, err);
+        if (bxierr_isko(err)) return err;
+    }
+    double tmp;
+    err2 = bxitime_duration(CLOCK_MONOTONIC_RAW, data->last_flush_time, &tmp);
+    if (bxierr_isko(err2)) bxierr_report(&err2, STDERR_FILENO);
+    long duration_since_last_flush = (long) (tmp * 1e3);
+
+    data->actual_timeout = param->flush_freq_ms - duration_since_last_flush;
+
+    // In a pool, the poll may have been woken up by another handler: only our own
+    // deadline tells whether we are idle
+    if ((!pooled && !polled && 0 == processed) || 0 >= data->actual_timeout) {
+        // !polled: nothing to poll -> do a flush() and start again
+        // 0 >= actual_timeout:
+        // we might have received billions of logs that were filtered out
+        // and very few of them have been filtered in (accepted by the handler)
+        // however, if we do not flush, those accepted messages might never
+        // be seen unless an explicit flush is requested. As an example,
+        // if the handler (file_handler) buffers messages, only few of them have
+        // reached the buffer in let say 10 minutes which is therefore almost
+        // empty and not written to the underlying storage. For the end user
+        // it seems therefore that nothing happened at all! So we must guarantee
+        // implicit flush is requested at regular interval
+        err2 = _process_implicit_flush(handler, param, data);
+        BXIERR_CHAIN(err, err2);
+
+        err2 = bxitime_get(CLOCK_MONOTONIC_RAW, &data->last_flush_time);
+        if (bxierr_isko(err2)) bxierr_report(&err2, STDERR_FILENO);
+        data->actual_timeout = param->flush_freq_ms;
+
+        return _process_ierr(handler, param, err);
+    }
+    if (items[0].revents & ZMQ_POLLIN) {
+        // Process ctrl message
+        err2 = _process_ctrl_cmd(handler, param, data);
+        BXIERR_CHAIN(err, err2);
+        // Treat explicit exit message
+        if (BXILOG_HANDLER_EXIT_CODE == err->code) return err;
+        err = _process_ierr(handler, param, err);
+        if (bxierr_isko(err)) return err;
+    }
+    if (items[1].revents & ZMQ_POLLIN) {
+        // Process data, this is the normal case
+        size_t received;
+        err2 = _process_log_records(handler, param, data, BXILOG__LANE_NORMAL,
+                                    &received);
+
+        if (EAGAIN == err2->code) {
+            // Might happened on interruption!
+            bxierr_destroy(&err2);
+            err2 = BXIERR_OK;
         }
-        if (items[1].revents & ZMQ_POLLIN) {
-            // Process data, this is the normal case
-            err2 = _process_log_record(handler, param, data);
+        BXIERR_CHAIN(err, err2);
 
-            if (EAGAIN == err2->code) {
-                // Might happened on interruption!
-                bxierr_destroy(&err2);
-                err2 = BXIERR_OK;
+        err = _process_ierr(handler, param, err);
+        if (bxierr_isko(err)) return err;
+    }
+    for (size_t i = 0; i < param->private_items_nb; i++) {
+        if (0 != items[data->first_private + i].revents) {
+            if (NULL != param->cbs[i]) {
+                err2 = param->cbs[i](param, items[data->first_private + i].revents);
+                BXIERR_CHAIN(err, err2);
+                err = _process_ierr(handler, param, err);
+                if (bxierr_isko(err)) return err;
             }
-            BXIERR_CHAIN(err, err2);
+        }
+    }
 
-            err = _process_ierr(handler, param, err);
-            if (bxierr_isko(err)) goto QUIT;
+    return err;
+}
+
+bxierr_p _pool_sync(bxilog__handler_pool_bundle_p bundle,
+                    handler_data_p datas,
+                    bxierr_p * eerrs,
+                    bool * exited) {
+
+    const size_t handlers_nb = bundle->handlers_nb;
+    bool synced[handlers_nb];
+    zmq_pollitem_t items[handlers_nb];
+    size_t ranks[handlers_nb];
+    size_t pending = 0;
+    for (size_t i = 0; i < handlers_nb; i++) {
+        // Without its ctrl zocket, a handler can't be synced
+        synced[i] = (NULL == datas[i].ctrl_zocket);
+        if (synced[i]) {
+            __atomic_store_n(&bundle->params[i]->status, BXI_LOG_HANDLER_ERROR,
+                             __ATOMIC_RELEASE);
+            bxierr_p eerr2 = _teardown(bundle->handlers[i], bundle->params[i], &datas[i]);
+            BXIERR_CHAIN(eerrs[i], eerr2);
+            exited[i] = true;
+        } else {
+            pending++;
+        }
+    }
+    // The business code sends one ready request per handler without knowing which
+    // one gets it: answer them in the order they arrive
+    while (0 < pending) {
+        size_t items_nb = 0;
+        for (size_t i = 0; i < handlers_nb; i++) {
+            if (synced[i]) continue;
+            items[items_nb].socket = datas[i].ctrl_zocket;
+            items[items_nb].fd = 0;
+            items[items_nb].events = ZMQ_POLLIN;
+            items[items_nb].revents = 0;
+            ranks[items_nb] = i;
+            items_nb++;
+        }
+        errno = 0;
+        int rc = zmq_poll(items, (int) items_nb, -1);
+        if (-1 == rc) {
+            if (EINTR == errno) continue;
+            return bxizmq_err(zmq_errno(), "Calling zmq_poll() failed");
         }
-        for (size_t i = 0; i < param->private_items_nb; i++) {
-            if (0 != items[2+i].revents) {
-                if (NULL != param->cbs[i]) {
-                    err2 = param->cbs[i](param, items[2+i].revents);
-                    if (bxierr_isko(err)) goto QUIT;
+        for (size_t n = 0; n < items_nb; n++) {
+            if (0 == (items[n].revents & ZMQ_POLLIN)) continue;
+            const size_t i = ranks[n];
+            bxilog_handler_p handler = bundle->handlers[i];
+            bxilog_handler_param_p param = bundle->params[i];
+
+            bxierr_p ierr = _send_ready_status(handler, param, &datas[i], eerrs[i]);
+            bxierr_p eerr2 = _process_ierr(handler, param, ierr);
+            BXIERR_CHAIN(eerrs[i], eerr2);
+            synced[i] = true;
+            pending--;
+            if (bxierr_isko(eerrs[i])) {
+                // The business code knows, other handlers go on
+                __atomic_store_n(&param->status, BXI_LOG_HANDLER_ERROR, __ATOMIC_RELEASE);
+                eerr2 = _teardown(handler, param, &datas[i]);
+                BXIERR_CHAIN(eerrs[i], eerr2);
+                exited[i] = true;
+            }
+        }
+    }
+
+    return BXIERR_OK;
+}
+
+bxierr_p _pool_loop(bxilog__handler_pool_bundle_p bundle,
+                    handler_data_p datas,
+                    bxierr_p * eerrs,
+                    bool * exited) {
+
+    const size_t handlers_nb = bundle->handlers_nb;
+    size_t alive = 0;
+    size_t offsets[handlers_nb];
+    zmq_pollitem_t * items = NULL;
+    size_t items_nb = 0;
+    bool rebuild = true;
+    for (size_t i = 0; i < handlers_nb; i++) if (!exited[i]) alive++;
+
+    while (0 < alive) {
+        if (rebuild) {
+            // All handlers data, ctrl and private items are multiplexed in one set
+            size_t new_nb = 0;
+            for (size_t i = 0; i < handlers_nb; i++) {
+                if (exited[i]) continue;
+                offsets[i] = new_nb;
+                new_nb += _items_nb(bundle->params[i], &datas[i]);
+            }
+            items = bximem_realloc(items, items_nb * sizeof(*items),
+                                   new_nb * sizeof(*items));
+            items_nb = new_nb;
+            for (size_t i = 0; i < handlers_nb; i++) {
+                if (exited[i]) continue;
+                const long timeout = datas[i].actual_timeout;
+                const struct timespec last_flush_time = datas[i].last_flush_time;
+                _loop_init(bundle->params[i], &datas[i], items + offsets[i]);
+                if (0 != last_flush_time.tv_sec || 0 != last_flush_time.tv_nsec) {
+                    // Only the poll set changed, keep implicit flush deadlines
+                    datas[i].actual_timeout = timeout;
+                    datas[i].last_flush_time = last_flush_time;
                 }
             }
+            rebuild = false;
+        }
+        // Wake up for the earliest implicit flush
+        long poll_timeout = 0;
+        bool timeout_set = false;
+        for (size_t i = 0; i < handlers_nb; i++) {
+            if (exited[i]) continue;
+            const long timeout = _loop_timeout(&datas[i]);
+            if (!timeout_set || timeout < poll_timeout) poll_timeout = timeout;
+            timeout_set = true;
+        }
+        // Already overdue
+        if (0 > poll_timeout) poll_timeout = 0;
+
+        errno = 0;
+        int rc = zmq_poll(items, (int) items_nb, poll_timeout);
+        const bool poll_failed = (-1 == rc);
+        if (poll_failed && EINTR == errno) continue;
+
+        for (size_t i = 0; i < handlers_nb; i++) {
+            if (exited[i]) continue;
+            bxilog_handler_p handler = bundle->handlers[i];
+            bxilog_handler_param_p param = bundle->params[i];
+
+            bxierr_p ierr = BXIERR_OK;
+            if (poll_failed) ierr = _loop_poll_failed(handler, param, &datas[i]);
+            // Each handler processes a bounded amount of records per wakeup
+            if (bxierr_isok(ierr)) ierr = _loop_step(handler, param, &datas[i],
+                                                     items + offsets[i],
+                                                     POOL_PRIORITY_BUDGET, true);
+            if (bxierr_isok(ierr)) continue;
+
+            // Including an explicit exit message. Otherwise, the thread goes on
+            // running: the business code must not wait for this handler anymore
+            if (BXILOG_HANDLER_EXIT_CODE != ierr->code) {
+                __atomic_store_n(&param->status, BXI_LOG_HANDLER_ERROR, __ATOMIC_RELEASE);
+            }
+            bxierr_p eerr2 = _process_ierr(handler, param, ierr);
+            BXIERR_CHAIN(eerrs[i], eerr2);
+            eerr2 = _teardown(handler, param, &datas[i]);
+            BXIERR_CHAIN(eerrs[i], eerr2);
+            exited[i] = true;
+            alive--;
+            rebuild = true;
         }
     }
-QUIT:
+    BXIFREE(items);
 
-    return err;
+    return BXIERR_OK;
 }
 
 bxierr_p _cleanup(bxilog_handler_p handler,
@@ -465,9 +1136,29 @@ bxierr_p _cleanup(bxilog_handler_p handler,
     err2 =  bxizmq_zocket_destroy(&data->data_zocket);
     BXIERR_CHAIN(err, err2);
 
+    if (NULL != data->priority_zocket) {
+        err2 = bxizmq_zocket_destroy(&data->priority_zocket);
+        BXIERR_CHAIN(err, err2);
+    }
+
     err2 = bxizmq_zocket_destroy(&data->ctrl_zocket);
     BXIERR_CHAIN(err, err2);
 
+    // Producers can't reach us anymore: release all rings we own
+    for (size_t i = 0; i < data->rings_nb; i++) {
+        bxilog__ring_unref(&data->rings[i]);
+    }
+    BXIFREE(data->rings);
+    data->rings_nb = 0;
+
+    for (size_t i = 0; i < BXILOG_HANDLER_BATCH_MAX; i++) {
+        BXIFREE(data->deferred_bufs[i]);
+        data->deferred_bufs_size[i] = 0;
+    }
+
+    BXIFREE(data->filter_levels);
+    data->filter_levels_nb = 0;
+
     return err;
 }
 
@@ -476,58 +1167,258 @@ bxierr_p _internal_flush(bxilog_handler_p handler,
                          handler_data_p data) {
 
 
-    bxierr_p err = BXIERR_OK;
+    bxierr_p err = BXIERR_OK, err2;
+    size_t processed;
+    if (NULL != data->priority_zocket) {
+        err2 = _process_priority(handler, param, data, SIZE_MAX, &processed);
+        BXIERR_CHAIN(err, err2);
+    }
+    if (NULL != data->ring_set) {
+        do {
+            err2 = _process_rings(handler, param, data, &processed);
+            BXIERR_CHAIN(err, err2);
+        } while (0 < processed);
+    }
     while(true) {
-        err = _process_log_record(handler, param, data);
-        if (bxierr_isko(err)) break;
+        err2 = _process_log_records(handler, param, data, BXILOG__LANE_NORMAL,
+                                    &processed);
+        if (bxierr_isko(err2)) break;
     }
-    if (EAGAIN == err->code) {
-        bxierr_destroy(&err);
-        err = BXIERR_OK;
+    if (EAGAIN == err2->code) {
+        bxierr_destroy(&err2);
+        err2 = BXIERR_OK;
     }
+    BXIERR_CHAIN(err, err2);
 
     return err;
 }
 
-bxierr_p _process_log_record(bxilog_handler_p handler,
-                             bxilog_handler_param_p param,
-                             handler_data_p data) {
-    zmq_msg_t zmsg;
-    errno = 0;
-    int rc = zmq_msg_init(&zmsg);
-    bxiassert(0 == rc);
+bxierr_p _process_log_records(bxilog_handler_p handler,
+                              bxilog_handler_param_p param,
+                              handler_data_p data,
+                              size_t lane,
+                              size_t * received) {
 
     bxierr_p err = BXIERR_OK, err2;
+    *received = 0;
+
+    void * zocket = (BXILOG__LANE_PRIORITY == lane) ? data->priority_zocket :
+                                                      data->data_zocket;
+    // Without process_log_batch(), each message is released once processed
+    const size_t zmsgs_max = (NULL == handler->process_log_batch) ?
+                                1 : BXILOG_HANDLER_BATCH_MAX;
+    zmq_msg_t zmsgs[zmsgs_max];
+    while (*received < zmsgs_max) {
+        zmq_msg_t * zmsg = &zmsgs[*received];
+        errno = 0;
+        int rc = zmq_msg_init(zmsg);
+        bxiassert(0 == rc);
+
+        err2 = bxizmq_msg_rcv(zocket, zmsg, ZMQ_DONTWAIT);
+        if (bxierr_isko(err2)) {
+            bxierr_p err3 = bxizmq_msg_close(zmsg);
+            BXIERR_CHAIN(err2, err3);
+            if (EAGAIN == err2->code && 0 < *received) {
+                // Nothing left: the caller only cares when nothing was received
+                bxierr_destroy(&err2);
+                err2 = BXIERR_OK;
+            }
+            BXIERR_CHAIN(err, err2);
+            break;
+        }
+        _lane_received(param, lane);
+        (*received)++;
 
-    err2 = bxizmq_msg_rcv(data->data_zocket, &zmsg, ZMQ_DONTWAIT);
+        err2 = _process_log_data(handler, param, data, lane,
+                                 zmq_msg_data(zmsg), zmq_msg_size(zmsg));
+        BXIERR_CHAIN(err, err2);
+    }
+    // Batched records refer to the messages: process them before the release
+    err2 = _process_batch(handler, param, data);
     BXIERR_CHAIN(err, err2);
-
-    if (bxierr_isko(err)) {
-        err2 = bxizmq_msg_close(&zmsg);
+    for (size_t i = 0; i < *received; i++) {
+        err2 = bxizmq_msg_close(&zmsgs[i]);
         BXIERR_CHAIN(err, err2);
-        return err;
     }
 
-    err2 = _process_log_zmsg(handler, param, data, zmsg);
-    BXIERR_CHAIN(err, err2);
-    /* Release */
-    err2 = bxizmq_msg_close(&zmsg);
+    return err;
+}
+
+bxierr_p _process_batch(bxilog_handler_p handler,
+                        bxilog_handler_param_p param,
+                        handler_data_p data) {
+
+    if (0 == data->batch_nb) return BXIERR_OK;
+
+    const size_t n = data->batch_nb;
+    data->batch_nb = 0;
+    return handler->process_log_batch(data->batch, n, param);
+}
+
+bxierr_p _process_priority(bxilog_handler_p handler,
+                           bxilog_handler_param_p param,
+                           handler_data_p data,
+                           size_t budget,
+                           size_t * processed) {
+
+    bxierr_p err = BXIERR_OK, err2 = BXIERR_OK;
+    *processed = 0;
+    while (*processed < budget) {
+        size_t received;
+        err2 = _process_log_records(handler, param, data, BXILOG__LANE_PRIORITY,
+                                    &received);
+        *processed += received;
+        if (bxierr_isko(err2)) break;
+    }
+    if (EAGAIN == err2->code) {
+        // Nothing left
+        bxierr_destroy(&err2);
+        err2 = BXIERR_OK;
+    }
     BXIERR_CHAIN(err, err2);
 
     return err;
 }
 
-bxierr_p _process_log_zmsg(bxilog_handler_p handler,
+void _lane_received(bxilog_handler_param_p param, size_t lane) {
+    bxilog__lane_s * const stats = &BXILOG__GLOBALS->backpressure[param->rank].lanes[lane];
+    // Frames are counted as sent before being queued: this includes the received one.
+    // A sender failing to count its frames must not make it wrap though
+    const size_t sent = __atomic_load_n(&stats->sent_nb, __ATOMIC_RELAXED);
+    const size_t depth = (sent > stats->received_nb) ? sent - stats->received_nb : 0;
+    if (depth > stats->depth_max) __atomic_store_n(&stats->depth_max, depth,
+                                                   __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->received_nb, stats->received_nb + 1, __ATOMIC_RELAXED);
+}
+
+bxierr_p _process_rings(bxilog_handler_p handler,
+                        bxilog_handler_param_p param,
+                        handler_data_p data,
+                        size_t * processed) {
+
+    bxierr_p err = BXIERR_OK, err2;
+    *processed = 0;
+
+    bxilog__ring_set_take(data->ring_set, &data->rings_version,
+                          &data->rings, &data->rings_nb);
+
+    size_t i = 0;
+    while (i < data->rings_nb) {
+        bxilog__ring_p ring = data->rings[i];
+        // Must be read before draining: the producer may close right after
+        // its last write
+        const bool closed = __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+        size_t n = 0;
+        size_t pos = ring->tail;
+        size_t size;
+        bool indirect;
+        void * entry;
+        while (n < RING_DRAIN_MAX &&
+               NULL != (entry = bxilog__ring_peek(ring, &pos, &size, &indirect))) {
+            _lane_received(param, BXILOG__LANE_NORMAL);
+            err2 = _process_log_data(handler, param, data, BXILOG__LANE_NORMAL,
+                                     entry, size);
+            BXIERR_CHAIN(err, err2);
+            if (indirect) {
+                // The copy is released as soon as the batch referring to it is done
+                err2 = _process_batch(handler, param, data);
+                BXIERR_CHAIN(err, err2);
+                BXIFREE(entry);
+            }
+            // Batched records refer to the ring: they must be processed first
+            if (0 == data->batch_nb) bxilog__ring_release(ring, pos);
+            n++;
+        }
+        err2 = _process_batch(handler, param, data);
+        BXIERR_CHAIN(err, err2);
+        bxilog__ring_release(ring, pos);
+        *processed += n;
+        if (closed && bxilog__ring_isempty(ring)) {
+            // The producer thread has exited
+            bxilog__ring_unref(&data->rings[i]);
+            data->rings[i] = data->rings[data->rings_nb - 1];
+            data->rings_nb--;
+            continue;
+        }
+        i++;
+    }
+
+    return err;
+}
+
+bool _rings_isempty(handler_data_p data) {
+    bxilog__ring_set_take(data->ring_set, &data->rings_version,
+                          &data->rings, &data->rings_nb);
+    for (size_t i = 0; i < data->rings_nb; i++) {
+        if (!bxilog__ring_isempty(data->rings[i])) return false;
+    }
+    return true;
+}
+
+bxierr_p _process_log_data(bxilog_handler_p handler,
                            bxilog_handler_param_p param,
                            handler_data_p data,
-                           zmq_msg_t zmsg) {
+                           const size_t lane,
+                           void * buf, size_t size) {
 
+    bxierr_p err = BXIERR_OK, err2;
+
+    // A saturated business thread asked to drop the frames queued before its own
+    const bxilog__backpressure_p backpressure =
+        &BXILOG__GLOBALS->backpressure[param->rank];
+    size_t * const drop_nb = &backpressure->lanes[lane].drop_nb;
+    if (0 < __atomic_load_n(drop_nb, __ATOMIC_RELAXED)) {
+        // Business threads only raise it: it can't drop to 0 meanwhile
+        __atomic_sub_fetch(drop_nb, 1, __ATOMIC_RELAXED);
+        size_t records_nb = 0;
+        for (size_t offset = 0; offset < size; records_nb++) {
+            const bxilog_record_p record = (bxilog_record_p) ((char *) buf + offset);
+            offset += BXILOG__RECORD_ALIGN(BXILOG__RECORD_LEN(record));
+        }
+        __atomic_add_fetch(&backpressure->drops.oldest_nb, records_nb, __ATOMIC_RELAXED);
+        return BXIERR_OK;
+    }
 
-    // bxiassert we received enough data
-//    const size_t received_size = zmq_msg_size(&zmsg);
-//    bxiassert(received_size >= BXILOG__GLOBALS->RECORD_MINIMUM_SIZE);
+    // A frame holds either a single record or a batch of aligned records
+    size_t offset = 0;
+    while (offset < size) {
+        bxilog_record_p record = (bxilog_record_p) ((char *) buf + offset);
+        const size_t len = BXILOG__RECORD_LEN(record);
+        bxiassert(offset + len <= size);
+        err2 = _process_log_record_data(handler, param, data, record);
+        BXIERR_CHAIN(err, err2);
+        offset += BXILOG__RECORD_ALIGN(len);
+    }
 
-    bxilog_record_s * record = zmq_msg_data(&zmsg);
+    return err;
+}
+
+bxilog_level_e _filter_level(bxilog_handler_param_p param,
+                             handler_data_p data,
+                             const uint32_t logger_id,
+                             const char * const loggername) {
+    if (0 == logger_id) return bxilog__filters_level(param->filters, loggername);
+
+    if (logger_id >= data->filter_levels_nb) {
+        const size_t old_nb = data->filter_levels_nb;
+        size_t new_nb = (0 == old_nb) ? 64 : old_nb;
+        while (logger_id >= new_nb) new_nb *= 2;
+        data->filter_levels = bximem_realloc(data->filter_levels, old_nb, new_nb);
+        memset(data->filter_levels + old_nb, FILTER_LEVEL_UNKNOWN, new_nb - old_nb);
+        data->filter_levels_nb = new_nb;
+    }
+    // Filters of a handler do not change while it runs: resolve each logger once
+    if (FILTER_LEVEL_UNKNOWN == data->filter_levels[logger_id]) {
+        const bxilog_level_e level = bxilog__filters_level(param->filters, loggername);
+        data->filter_levels[logger_id] = (uint8_t) level;
+    }
+    return (bxilog_level_e) data->filter_levels[logger_id];
+}
+
+bxierr_p _process_log_record_data(bxilog_handler_p handler,
+                                  bxilog_handler_param_p param,
+                                  handler_data_p data,
+                                  bxilog_record_p record) {
 
     // Fetch other strings: filename, funcname, loggername, logmsg
     char * filename = (char *) record + sizeof(*record);
@@ -535,33 +1426,49 @@ bxierr_p _process_log_zmsg(bxilog_handler_p handler,
     char * loggername = funcname + record->funcname_len;
     char * logmsg = loggername + record->logname_len;
 
-    bxilog_level_e filter_level = BXILOG_OFF;
-
-    for (size_t i = 0; i < param->filters->nb; i++) {
-        bxilog_filter_p filter = param->filters->list[i];
-        if (NULL == filter) break;
+    const bxilog_level_e filter_level = _filter_level(param, data,
+                                                      record->logger_id, loggername);
+    if (record->level > filter_level) return BXIERR_OK;
+    if (NULL == handler->process_log && NULL == handler->process_log_batch) {
+        return BXIERR_OK;
+    }
 
-        if (0 == strncmp(filter->prefix, loggername, strlen(filter->prefix))) {
-            filter_level = filter->level;
-//            fprintf(stderr, "%d.%d: %s MATCH [%zu] %s:%d\n",
-//                                    record->pid, record->tid, loggername,
-//                                    i, filter->prefix, filter->level);
-        } else {
-//            fprintf(stderr, "%d.%d: %s MISMATCH [%zu] %s:%d\n",
-//                                                record->pid, record->tid, loggername,
-//                                                i, filter->prefix, filter->level);
-        }
+    // Batched records must remain valid until the whole batch is processed
+    const size_t slot = (NULL == handler->process_log_batch) ? 0 : data->batch_nb;
+    if (0 != (record->flags & BXILOG__RECORD_DEFERRED)) {
+        // The record may be shared with other handlers: never modify it
+        record = _format_deferred(data, slot, record);
+        filename = (char *) record + sizeof(*record);
+        funcname = filename + record->filename_len;
+        loggername = funcname + record->funcname_len;
+        logmsg = loggername + record->logname_len;
     }
-    bxierr_p err = BXIERR_OK;
-    if ((record->level <= filter_level) && (NULL != handler->process_log)) {
-            err = handler->process_log(record,
-                                       filename, funcname, loggername, logmsg,
-                                       param);
-    } else {
-        UNUSED(data);
+    if (0 != record->site_id) {
+        // Filename and funcname are not in the record: use the site ones
+        const bxilog__site_info_p site = bxilog__site_get(record->site_id);
+        bxilog_record_p resolved = &data->resolved[slot];
+        *resolved = *record;
+        resolved->filename_len = site->filename_len;
+        resolved->funcname_len = site->funcname_len;
+        filename = (char *) site->filename;
+        funcname = (char *) site->funcname;
+        record = resolved;
+    }
+    if (NULL == handler->process_log_batch) {
+        return handler->process_log(record,
+                                    filename, funcname, loggername, logmsg,
+                                    param);
     }
 
-    return err;
+    data->batch[slot].record = record;
+    data->batch[slot].filename = filename;
+    data->batch[slot].funcname = funcname;
+    data->batch[slot].loggername = loggername;
+    data->batch[slot].logmsg = logmsg;
+    data->batch_nb++;
+    if (BXILOG_HANDLER_BATCH_MAX > data->batch_nb) return BXIERR_OK;
+
+    return _process_batch(handler, param, data);
 }
 
 bxierr_p _process_ctrl_cmd(bxilog_handler_p handler,
@@ -684,3 +1591,33 @@ bxierr_p _process_ierr(bxilog_handler_p handler,
 
     return handler->process_ierr(&actual_err, param);
 }
+
+bxilog_record_s * _format_deferred(handler_data_p data,
+                                   size_t slot,
+                                   bxilog_record_s * record) {
+    // Everything but the message is copied as is
+    const size_t header_len = sizeof(*record) + record->filename_len
+                            + record->funcname_len + record->logname_len;
+    const char * blob = (char *) record + header_len;
+
+    while (true) {
+        char * out = data->deferred_bufs[slot] + header_len;
+        const size_t out_size = data->deferred_bufs_size[slot] > header_len ?
+                                data->deferred_bufs_size[slot] - header_len : 0;
+        const size_t n = bxilog__deferred_format(blob, record->logmsg_len,
+                                                 out, out_size);
+        if (n < out_size) {
+            memcpy(data->deferred_bufs[slot], record, header_len);
+            bxilog_record_s * result = (bxilog_record_s *) data->deferred_bufs[slot];
+            result->logmsg_len = n + 1;
+            result->flags &= ~BXILOG__RECORD_DEFERRED;
+            return result;
+        }
+        // Not enough space, grow the buffer: it is kept for next records
+        const size_t new_size = header_len + n + 1;
+        data->deferred_bufs[slot] = bximem_realloc(data->deferred_bufs[slot],
+                                                   data->deferred_bufs_size[slot],
+                                                   new_size);
+        data->deferred_bufs_size[slot] = new_size;
+    }
+}
@@ -17,6 +17,8 @@
 #include "bxi/base/err.h"
 #include "bxi/base/log.h"
 
+#include "ring_impl.h"
+
 //*********************************************************************************
 //********************************** Defines **************************************
 //*********************************************************************************
@@ -35,9 +37,19 @@
 typedef struct {
     bxilog_handler_p handler;
     bxilog_handler_param_p param;
+    bxilog__ring_set_p ring_set;    // NULL unless the ring transport is used
 } bxilog__handler_thread_bundle_s;
 
 typedef bxilog__handler_thread_bundle_s * bxilog__handler_thread_bundle_p;
+
+typedef struct {
+    size_t handlers_nb;
+    bxilog_handler_p * handlers;
+    bxilog_handler_param_p * params;
+    bxilog__ring_set_p * ring_sets;     // Entries are NULL unless the ring transport is used
+} bxilog__handler_pool_bundle_s;
+
+typedef bxilog__handler_pool_bundle_s * bxilog__handler_pool_bundle_p;
 //*********************************************************************************
 //********************************** Global Variables  ****************************
 //*********************************************************************************
@@ -49,4 +61,8 @@ typedef bxilog__handler_thread_bundle_s * bxilog__handler_thread_bundle_p;
 // Can be used directly with pthread_create()
 bxierr_p bxilog__handler_start(bxilog__handler_thread_bundle_p bundle);
 
+// Run all handlers of the given bundle in the calling thread.
+// Can be used directly with pthread_create()
+bxierr_p bxilog__handler_pool_start(bxilog__handler_pool_bundle_p bundle);
+
 #endif
@@ -16,9 +16,12 @@
 #define BXILOG_LOG_IMPL_H
 
 #include <pthread.h>
+#include <stdint.h>
 
 #include "bxi/base/log.h"
 
+#include "ring_impl.h"
+
 //*********************************************************************************
 //********************************** Defines **************************************
 //*********************************************************************************
@@ -41,12 +44,52 @@ typedef enum {
     UNSET, INITIALIZING, BROKEN, INITIALIZED, FINALIZING, FINALIZED, ILLEGAL, FORKED,
 } bxilog_state_e;
 
+/*
+ * Internal record flags (bxilog_record_s.flags)
+ */
+// The log message is a blob from bxilog__deferred_capture()
+#define BXILOG__RECORD_DEFERRED 0x1u
+
+// Size of a record with its strings
+#define BXILOG__RECORD_LEN(record) (sizeof(*(record)) + (record)->filename_len + \
+                                    (record)->funcname_len + (record)->logname_len + \
+                                    (record)->logmsg_len)
+// Records batched in a single frame are 8 bytes aligned
+#define BXILOG__RECORD_ALIGN(len) (((len) + 7u) & ~((size_t) 7u))
+// Handler lanes (see bxilog_handler_param_s.priority_level)
+#define BXILOG__LANE_NORMAL 0
+#define BXILOG__LANE_PRIORITY 1
+#define BXILOG__LANES_NB 2
+
 
 //*********************************************************************************
 //********************************** Types ****************************************
 //*********************************************************************************
 
 
+/*
+ * Queue depth of a handler lane, in frames.
+ */
+typedef struct {
+    size_t sent_nb;                 // Updated atomically by business threads
+    size_t received_nb;             // Only written by the handler thread
+    size_t depth_max;               // Only written by the handler thread
+    size_t drop_nb;                 // Queued frames the handler must drop
+                                    // (BXILOG_BACKPRESSURE_DROP_OLDEST): only raised
+                                    // by business threads, only lowered by the handler
+} bxilog__lane_s;
+
+/*
+ * Backpressure state of a handler, shared by business threads and the handler thread.
+ */
+typedef struct {
+    bxilog_drop_stats_s drops;      // Updated atomically
+    bxilog__lane_s lanes[BXILOG__LANES_NB];
+    bxilog_spin_stats_s spin;       // Only written by the handler thread
+} bxilog__backpressure_s;
+
+typedef bxilog__backpressure_s * bxilog__backpressure_p;
+
 typedef struct {
     bxilog_config_p config;
 
@@ -62,7 +105,16 @@ typedef struct {
     pthread_once_t tsd_key_once;
 
     size_t internal_handlers_nb;
+    /* Indexed by handler rank: handlers sharing a pool thread have the same entry */
     pthread_t *handlers_threads;
+    /* Number of pool threads (the first entries of handlers_threads), 0 if not pooled */
+    size_t pool_threads_nb;
+    /* One set of rings per handler when config->transport is BXILOG_TRANSPORT_RING */
+    bxilog__ring_set_p * ring_sets;
+    /* Indexed by handler rank */
+    bxilog__backpressure_p backpressure;
+    /* Least important level sent to at least one priority lane (BXILOG_OFF if none) */
+    bxilog_level_e priority_level;
 } bxilog__core_globals_s;
 
 typedef bxilog__core_globals_s * bxilog__core_globals_p;
@@ -81,4 +133,24 @@ void bxilog__wipeout();
 bxierr_p bxilog__finalize(void);
 bxierr_p bxilog__start_handlers(void);
 bxierr_p bxilog__stop_handlers(void);
+
+/*
+ * Log the number of logs suppressed by rate limiting since the last report,
+ * for each logger and each registered call site.
+ */
+void bxilog__report_suppressed(void);
+
+/*
+ * Reconfigure all the given loggers, sorted by name, at once.
+ *
+ * Equivalent to bxilog_logger_reconfigure() on each of them, but filters of all
+ * handlers are merged in a single prefix tree walked once per logger name.
+ */
+void bxilog__loggers_reconfigure(bxilog_logger_p * loggers, size_t loggers_nb);
+
+/*
+ * Return the level the given filters accept for the given logger name,
+ * as applied by handlers to each record.
+ */
+bxilog_level_e bxilog__filters_level(const bxilog_filters_p filters, const char * loggername);
 #endif
@@ -22,11 +22,13 @@
 #include <execinfo.h>
 #include <time.h>
 #include <errno.h>
+#include <inttypes.h>
 
 
 #include <limits.h>
 
 #include <pthread.h>
+#include <sched.h>
 
 #include <sys/syscall.h>
 #include <sys/types.h>
@@ -49,6 +51,8 @@
 #include "log_impl.h"
 #include "tsd_impl.h"
 #include "fork_impl.h"
+#include "deferred_impl.h"
+#include "site_impl.h"
 
 //*********************************************************************************
 //********************************** Defines **************************************
@@ -57,25 +61,103 @@
 
 #define RETRY_DELAY 500000l
 
+// Non blocking policies retry that many times before dropping a record they keep
+#define BACKPRESSURE_RETRIES_MAX 64u
+
+// A handler has no filter with the prefix of a level_trie_s node
+#define NO_FILTER ((bxilog_level_e) (BXILOG_LOWEST + 1))
+
+// Minimum delay between two reports of suppressed logs from the same limiter
+#define RATELIMIT_REPORT_PERIOD_NS 1000000000ull
+
 //*********************************************************************************
 //********************************** Types ****************************************
 //*********************************************************************************
 
+// Header of a record shared by all handlers. The record follows immediately.
+// Its size keeps the record correctly aligned.
+typedef struct {
+    size_t refcount;                // Number of handlers still holding the record
+    size_t size;                    // Record (or batch) size
+} bxilog__shared_record_s;
+
+typedef bxilog__shared_record_s * bxilog__shared_record_p;
+
+// A node of the prefix tree of all handlers filters (see bxilog__loggers_reconfigure())
+typedef struct level_trie_s level_trie_s;
+typedef level_trie_s * level_trie_p;
+
+struct level_trie_s {
+    level_trie_p child;
+    level_trie_p sibling;
+    bxilog_level_e * levels;        // Per handler level of the last filter with this
+                                    // prefix (NO_FILTER if none), NULL if no filter
+    char c;
+};
 
 
 //*********************************************************************************
 //********************************** Static Functions  ****************************
 //*********************************************************************************
+static bxierr_p _vlog(const bxilog_logger_p logger, const bxilog_level_e level,
+                      uint32_t site_id,
+                      const char * fullfilename, size_t fullfilename_len,
+                      const char * funcname, size_t funcname_len,
+                      int line,
+                      const char * fmt, va_list arglist);
+static bxierr_p _log(const bxilog_logger_p logger, const bxilog_level_e level,
+                     uint32_t site_id,
+                     const char * fullfilename, size_t fullfilename_len,
+                     const char * funcname, size_t funcname_len,
+                     int line,
+                     const char * fmt, ...)
+                     __attribute__ ((format (printf, 9, 10)));
+static bxierr_p _vlog_site(const bxilog_logger_p logger, const bxilog_level_e level,
+                           bxilog_site_p site,
+                           double rate_per_s, size_t burst, size_t sample_every,
+                           const char * fmt, va_list ap);
+static level_trie_p _level_trie_new(bxilog_config_p config);
+static level_trie_p _level_trie_child(level_trie_p node, char c, bool create);
+static void _level_trie_free(level_trie_p node);
+static bool _site_wanted(bxilog_site_p site,
+                         const bxilog_logger_p logger, const bxilog_level_e level);
+static bool _handlers_want(const bxilog_logger_p logger, const bxilog_level_e level);
+static void _filters_changed(void);
+static bool _ratelimit(bxilog_ratelimit_s * limit, uint64_t * suppressed_nb,
+                       double rate_per_s, size_t burst, size_t sample_every);
+static bxierr_p _report_suppressed(const bxilog_logger_p logger, const bxilog_level_e level,
+                                   bxilog_ratelimit_s * limit, uint64_t * suppressed_nb,
+                                   uint32_t site_id,
+                                   const char * fullfilename, size_t fullfilename_len,
+                                   const char * funcname, size_t funcname_len,
+                                   int line);
+static uint64_t _now_ns(void);
 static bxierr_p _send2handlers(const bxilog_logger_p logger, const bxilog_level_e level,
-                               void ** log_channel,
-#ifdef __linux__
-                               pid_t tid,
-#endif
-                               uintptr_t thread_rank,
+                               tsd_p tsd, uint32_t flags, uint32_t site_id,
                                const char * filename, size_t filename_len,
                                const char * funcname, size_t funcname_len,
                                int line,
                                const char * rawstr, size_t rawstr_len);
+static void _fill_record(bxilog_record_p record,
+                         bxilog_logger_p logger, bxilog_level_e level,
+                         tsd_p tsd, uint32_t flags, uint32_t site_id,
+                         const char * filename, size_t filename_len,
+                         const char * funcname, size_t funcname_len,
+                         int line,
+                         const char * rawstr, size_t rawstr_len);
+static bxierr_p _send_frame(tsd_p tsd, bxilog__shared_record_p shared_record,
+                            void * frame, size_t frame_len);
+static bxierr_p _send_data(size_t rank, size_t lane, void * zocket,
+                           bxilog__shared_record_p shared_record,
+                           void * frame, size_t frame_len);
+static bool _backpressure(size_t rank, size_t lane,
+                          const void * frame, size_t frame_len);
+static size_t _records_nb(const void * frame, size_t frame_len);
+static void _overflow(size_t rank, const void * frame, size_t frame_len);
+static void * _batch_data(tsd_p tsd);
+static void _shared_record_release(void * data, void * hint);
+static bxierr_p _send2ring(size_t rank, bxilog__ring_p ring,
+                           bxilog_record_p record, size_t data_len);
 //*********************************************************************************
 //********************************** Global Variables  ****************************
 //*********************************************************************************
@@ -83,6 +165,10 @@ static bxierr_p _send2handlers(const bxilog_logger_p logger, const bxilog_level_
 // The internal logger
 SET_LOGGER(LOGGER, BXILOG_LIB_PREFIX "bxilog.logger");
 
+// Bumped whenever what handlers accept may have changed: invalidates the sites cache.
+// Starts at 1 so zero initialized sites are never valid.
+static uint32_t FILTERS_GENERATION = 1;
+
 //*********************************************************************************
 //********************************** Implementation    ****************************
 //*********************************************************************************
@@ -97,6 +183,20 @@ void bxilog_logger_set_level(const bxilog_logger_p logger, const bxilog_level_e
     bxiassert(NULL != logger);
     bxiassert(BXILOG_LOWEST >= level);
     logger->level = level;
+    _filters_changed();
+}
+
+void bxilog_logger_set_ratelimit(const bxilog_logger_p logger,
+                                 const double rate_per_s, const size_t burst) {
+    bxiassert(NULL != logger);
+    bxiassert(0 <= rate_per_s);
+    logger->rate_burst = burst;
+    logger->rate_per_s = rate_per_s;
+}
+
+void bxilog_logger_set_sampling(const bxilog_logger_p logger, const size_t every) {
+    bxiassert(NULL != logger);
+    logger->sample_every = every;
 }
 
 void bxilog_logger_reconfigure(const bxilog_logger_p logger) {
@@ -132,8 +232,74 @@ void bxilog_logger_reconfigure(const bxilog_logger_p logger) {
         minimum_level = best_match_level;
     }
     logger->level = minimum_level;
+    _filters_changed();
+}
+
+
+bxilog_level_e bxilog_get_compile_min_level(void) {
+    return BXILOG_COMPILE_MIN_LEVEL;
 }
 
+void bxilog__loggers_reconfigure(bxilog_logger_p * const loggers, const size_t loggers_nb) {
+    if (NULL == BXILOG__GLOBALS || NULL == BXILOG__GLOBALS->config) return;
+    const size_t handlers_nb = BXILOG__GLOBALS->config->handlers_nb;
+    if (0 == handlers_nb) {
+        for (size_t l = 0; l < loggers_nb; l++) loggers[l]->level = BXILOG_OFF;
+        _filters_changed();
+        return;
+    }
+
+    level_trie_p root = _level_trie_new(BXILOG__GLOBALS->config);
+
+    size_t name_len_max = 0;
+    for (size_t l = 0; l < loggers_nb; l++) {
+        if (name_len_max < loggers[l]->name_length) name_len_max = loggers[l]->name_length;
+    }
+    // State after each matched character of the current name: the trie node and
+    // the level of the longest matching filter of each handler (as in
+    // bxilog_logger_reconfigure(), BXILOG_LOWEST when none matches)
+    level_trie_p * nodes = bximem_calloc((name_len_max + 1) * sizeof(*nodes));
+    bxilog_level_e * best = bximem_calloc((name_len_max + 1) * handlers_nb * sizeof(*best));
+    nodes[0] = root;
+    for (size_t h = 0; h < handlers_nb; h++) {
+        best[h] = (NULL == root->levels || NO_FILTER == root->levels[h]) ?
+                  BXILOG_LOWEST : root->levels[h];
+    }
+
+    const char * previous = "";
+    size_t depth = 0;
+    for (size_t l = 0; l < loggers_nb; l++) {
+        const char * const name = loggers[l]->name;
+        // States of the prefix shared with the previous (sorted) name are still valid
+        size_t common = 0;
+        while (common < depth && previous[common] == name[common]) common++;
+        depth = common;
+        while ('\0' != name[depth]) {
+            level_trie_p child = _level_trie_child(nodes[depth], name[depth], false);
+            if (NULL == child) break;
+            bxilog_level_e * const from = best + depth * handlers_nb;
+            bxilog_level_e * const to = from + handlers_nb;
+            for (size_t h = 0; h < handlers_nb; h++) {
+                to[h] = (NULL == child->levels || NO_FILTER == child->levels[h]) ?
+                        from[h] : child->levels[h];
+            }
+            nodes[++depth] = child;
+        }
+        // The most detailed level required across handlers
+        bxilog_level_e minimum_level = BXILOG_OFF;
+        const bxilog_level_e * const levels = best + depth * handlers_nb;
+        for (size_t h = 0; h < handlers_nb; h++) {
+            if (levels[h] > minimum_level) minimum_level = levels[h];
+        }
+        loggers[l]->level = minimum_level;
+        previous = name;
+    }
+
+    BXIFREE(best);
+    BXIFREE(nodes);
+    _level_trie_free(root);
+    _filters_changed();
+}
 
 // Defined inline in bxilog.h
 extern bool bxilog_logger_is_enabled_for(const bxilog_logger_p logger,
@@ -160,18 +326,22 @@ bxierr_p bxilog_logger_log_rawstr(const bxilog_logger_p logger, const bxilog_lev
                                   const int line,
                                   const char * const rawstr, const size_t rawstr_len) {
     if (INITIALIZED != BXILOG__GLOBALS->state) return BXIERR_OK;
+    if (!_ratelimit(&logger->ratelimit, &logger->ratelimit.suppressed_nb,
+                    logger->rate_per_s, logger->rate_burst, logger->sample_every)) {
+        return _report_suppressed(logger, level,
+                                  &logger->ratelimit, &logger->ratelimit.suppressed_nb, 0,
+                                  filename, filename_len,
+                                  funcname, funcname_len,
+                                  line);
+    }
     tsd_p tsd;
     bxierr_p err = bxilog__tsd_get(&tsd);
     if (bxierr_isko(err)) return err;
-    err = _send2handlers(logger, level, tsd->data_channel,
-#ifdef __linux__
-                    tsd->tid,
-#endif
-                    tsd->thread_rank,
-                    filename, filename_len,
-                    funcname, funcname_len,
-                    line,
-                    rawstr, rawstr_len);
+    err = _send2handlers(logger, level, tsd, 0, 0,
+                         filename, filename_len,
+                         funcname, funcname_len,
+                         line,
+                         rawstr, rawstr_len);
     return err;
 }
 
@@ -184,6 +354,304 @@ bxierr_p bxilog_logger_vlog_nolevelcheck(const bxilog_logger_p logger,
                                          const int line,
                                          const char * const fmt, va_list arglist) {
 
+    if (!_ratelimit(&logger->ratelimit, &logger->ratelimit.suppressed_nb,
+                    logger->rate_per_s, logger->rate_burst, logger->sample_every)) {
+        return _report_suppressed(logger, level,
+                                  &logger->ratelimit, &logger->ratelimit.suppressed_nb, 0,
+                                  fullfilename, fullfilename_len,
+                                  funcname, funcname_len,
+                                  line);
+    }
+    return _vlog(logger, level, 0,
+                 fullfilename, fullfilename_len,
+                 funcname, funcname_len,
+                 line,
+                 fmt, arglist);
+}
+
+bxierr_p bxilog_logger_log_site_nolevelcheck(const bxilog_logger_p logger,
+                                             const bxilog_level_e level,
+                                             const bxilog_site_p site,
+                                             const char * const fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    bxierr_p err = _vlog_site(logger, level, site, 0, 0, 0, fmt, ap);
+    va_end(ap);
+
+    return err;
+}
+
+bxierr_p bxilog_logger_log_site_limited_nolevelcheck(const bxilog_logger_p logger,
+                                                     const bxilog_level_e level,
+                                                     const bxilog_site_p site,
+                                                     const double rate_per_s,
+                                                     const size_t burst,
+                                                     const size_t sample_every,
+                                                     const char * const fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    bxierr_p err = _vlog_site(logger, level, site, rate_per_s, burst, sample_every,
+                              fmt, ap);
+    va_end(ap);
+
+    return err;
+}
+
+bxierr_p bxilog_logger_log_nolevelcheck(const bxilog_logger_p logger,
+                                        const bxilog_level_e level,
+                                        char * filename, size_t filename_len,
+                                        const char * funcname, size_t funcname_len,
+                                        const int line,
+                                        const char * fmt, ...) {
+    va_list ap;
+    bxierr_p err;
+
+    va_start(ap, fmt);
+    err = bxilog_logger_vlog_nolevelcheck(logger, level,
+                                          filename, filename_len,
+                                          funcname, funcname_len,
+                                          line,
+                                          fmt, ap);
+    va_end(ap);
+
+    return err;
+}
+
+bxierr_p bxilog__batch_flush(const tsd_p tsd) {
+    if (NULL == tsd->batch || 0 == tsd->batch_len) return BXIERR_OK;
+
+    bxilog__shared_record_p frame = tsd->batch;
+    const size_t frame_len = tsd->batch_len;
+    tsd->batch_len = 0;
+    tsd->batch_records_nb = 0;
+
+    if (!BXILOG__GLOBALS->config->shared_records) {
+        // Copied by ZMQ: the batch buffer is reused
+        return _send_frame(tsd, NULL, frame + 1, frame_len);
+    }
+    // The frame now belongs to handlers
+    tsd->batch = bxilog__batch_new(BXILOG__GLOBALS->config->batch_size);
+    return _send_frame(tsd, frame, frame + 1, frame_len);
+}
+
+void * bxilog__batch_new(const size_t batch_size) {
+    // Not from the slab: batches are larger than records
+    return bxilog__slab_alloc(NULL, sizeof(bxilog__shared_record_s) + batch_size);
+}
+
+//*********************************************************************************
+//********************************** Static Helpers Implementation ****************
+//*********************************************************************************
+
+bxierr_p _log(const bxilog_logger_p logger, const bxilog_level_e level,
+              const uint32_t site_id,
+              const char * const fullfilename, const size_t fullfilename_len,
+              const char * const funcname, const size_t funcname_len,
+              const int line,
+              const char * const fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    bxierr_p err = _vlog(logger, level, site_id,
+                         fullfilename, fullfilename_len,
+                         funcname, funcname_len,
+                         line,
+                         fmt, ap);
+    va_end(ap);
+
+    return err;
+}
+
+bxierr_p _vlog_site(const bxilog_logger_p logger, const bxilog_level_e level,
+                    const bxilog_site_p site,
+                    const double rate_per_s, const size_t burst, const size_t sample_every,
+                    const char * const fmt, va_list ap) {
+    uint32_t site_id = __atomic_load_n(&site->id, __ATOMIC_ACQUIRE);
+    if (0 == site_id) site_id = bxilog__site_register(site, logger);
+    // No record at all when no handler would keep it
+    if (!_site_wanted(site, logger, level)) return BXIERR_OK;
+
+    // Unregistered sites have no id: records must then carry the names
+    const bool named = BXILOG__SITE_ID_NONE == site_id;
+    const uint32_t record_site_id = named ? 0 : site_id;
+    const char * const fullfilename = named ? site->fullfilename : NULL;
+    const size_t fullfilename_len = named ? site->fullfilename_len : 0;
+    const char * const funcname = named ? site->funcname : NULL;
+    const size_t funcname_len = named ? site->funcname_len : 0;
+
+    // Limits given by the call site take precedence over those of the logger
+    const bool own = 0 < rate_per_s || 1 < sample_every;
+    // Registered sites are counted in the sites table, which outlives their module
+    uint64_t * const suppressed_nb = named ? &site->ratelimit.suppressed_nb :
+                                             &bxilog__site_get(site_id)->suppressed_nb;
+    // Checked before any formatting
+    if (!_ratelimit(&site->ratelimit, suppressed_nb,
+                    own ? rate_per_s : logger->rate_per_s,
+                    own ? burst : logger->rate_burst,
+                    own ? sample_every : logger->sample_every)) {
+        return _report_suppressed(logger, level,
+                                  &site->ratelimit, suppressed_nb, record_site_id,
+                                  fullfilename, fullfilename_len,
+                                  funcname, funcname_len,
+                                  site->line);
+    }
+
+    return _vlog(logger, level, record_site_id,
+                 fullfilename, fullfilename_len,
+                 funcname, funcname_len,
+                 site->line,
+                 fmt, ap);
+}
+
+level_trie_p _level_trie_new(const bxilog_config_p config) {
+    const size_t handlers_nb = config->handlers_nb;
+    level_trie_p root = bximem_calloc(sizeof(*root));
+    for (size_t h = 0; h < handlers_nb; h++) {
+        const bxilog_filters_p filters = config->handlers_params[h]->filters;
+        for (size_t f = 0; f < filters->nb; f++) {
+            const bxilog_filter_p filter = filters->list[f];
+            level_trie_p node = root;
+            for (const char * c = filter->prefix; '\0' != *c; c++) {
+                node = _level_trie_child(node, *c, true);
+            }
+            if (NULL == node->levels) {
+                node->levels = bximem_calloc(handlers_nb * sizeof(*node->levels));
+                for (size_t i = 0; i < handlers_nb; i++) node->levels[i] = NO_FILTER;
+            }
+            // With equal prefixes, the last filter wins
+            node->levels[h] = filter->level;
+        }
+    }
+    return root;
+}
+
+level_trie_p _level_trie_child(const level_trie_p node, const char c, const bool create) {
+    level_trie_p child = node->child;
+    while (NULL != child && c != child->c) child = child->sibling;
+    if (NULL == child && create) {
+        child = bximem_calloc(sizeof(*child));
+        child->c = c;
+        child->sibling = node->child;
+        node->child = child;
+    }
+    return child;
+}
+
+void _level_trie_free(level_trie_p node) {
+    while (NULL != node) {
+        level_trie_p sibling = node->sibling;
+        _level_trie_free(node->child);
+        BXIFREE(node->levels);
+        BXIFREE(node);
+        node = sibling;
+    }
+}
+
+bool _site_wanted(const bxilog_site_p site,
+                  const bxilog_logger_p logger, const bxilog_level_e level) {
+    // Only the decision for the logger of the first log is cached: others are
+    // filtered by handlers as usual
+    if (logger != site->logger) return true;
+
+    // The generation is read before the configuration: a concurrent change makes
+    // the stored decision stale, it is then computed again on next log
+    const uint64_t generation = __atomic_load_n(&FILTERS_GENERATION, __ATOMIC_ACQUIRE);
+    const uint64_t key = (generation << 32) | ((uint64_t) level << 1);
+    const uint64_t cached = __atomic_load_n(&site->wanted, __ATOMIC_RELAXED);
+    if (key == (cached & ~1ull)) return 0 != (cached & 1ull);
+
+    const bool wanted = _handlers_want(logger, level);
+    __atomic_store_n(&site->wanted, key | (wanted ? 1ull : 0ull), __ATOMIC_RELAXED);
+    return wanted;
+}
+
+bool _handlers_want(const bxilog_logger_p logger, const bxilog_level_e level) {
+    if (INITIALIZED != BXILOG__GLOBALS->state) return true;
+    const bxilog_config_p config = BXILOG__GLOBALS->config;
+    for (size_t i = 0; i < config->handlers_nb; i++) {
+        const bxilog_filters_p filters = config->handlers_params[i]->filters;
+        if (level <= bxilog__filters_level(filters, logger->name)) return true;
+    }
+    return false;
+}
+
+void _filters_changed(void) {
+    __atomic_add_fetch(&FILTERS_GENERATION, 1, __ATOMIC_RELEASE);
+}
+
+bool _ratelimit(bxilog_ratelimit_s * const limit, uint64_t * const suppressed_nb,
+                const double rate_per_s, const size_t burst, const size_t sample_every) {
+    if (1 < sample_every) {
+        const uint64_t seen = __atomic_fetch_add(&limit->seen_nb, 1, __ATOMIC_RELAXED);
+        if (0 != seen % sample_every) goto SUPPRESSED;
+    }
+    if (0 < rate_per_s) {
+        // Token bucket expressed as a theoretical arrival time (GCRA): a log is allowed
+        // when it is not more than burst - 1 intervals ahead of the expected rate.
+        const uint64_t interval = (uint64_t) (1e9 / rate_per_s);
+        const uint64_t tolerance = interval * (0 < burst ? burst - 1 : 0);
+        const uint64_t now = _now_ns();
+        uint64_t tat = __atomic_load_n(&limit->tat_ns, __ATOMIC_RELAXED);
+        uint64_t next;
+        do {
+            const uint64_t start = (tat > now) ? tat : now;
+            if (start - now > tolerance) goto SUPPRESSED;
+            next = start + interval;
+        } while (!__atomic_compare_exchange_n(&limit->tat_ns, &tat, next,
+                                              true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+    return true;
+
+SUPPRESSED:
+    __atomic_add_fetch(suppressed_nb, 1, __ATOMIC_RELAXED);
+    return false;
+}
+
+bxierr_p _report_suppressed(const bxilog_logger_p logger, const bxilog_level_e level,
+                            bxilog_ratelimit_s * const limit,
+                            uint64_t * const suppressed_nb,
+                            const uint32_t site_id,
+                            const char * const fullfilename, const size_t fullfilename_len,
+                            const char * const funcname, const size_t funcname_len,
+                            const int line) {
+    const uint64_t now = _now_ns();
+    uint64_t reported = __atomic_load_n(&limit->reported_ns, __ATOMIC_RELAXED);
+    if (0 != reported && RATELIMIT_REPORT_PERIOD_NS > now - reported) return BXIERR_OK;
+    // Only the thread that wins the period reports
+    if (!__atomic_compare_exchange_n(&limit->reported_ns, &reported, now,
+                                     false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return BXIERR_OK;
+    }
+    const uint64_t suppressed = __atomic_exchange_n(suppressed_nb, 0, __ATOMIC_RELAXED);
+    if (0 == suppressed) return BXIERR_OK;
+
+    return _log(logger, level, site_id,
+                fullfilename, fullfilename_len,
+                funcname, funcname_len,
+                line,
+                "%" PRIu64 " similar logs suppressed by rate limiting since the last report",
+                suppressed);
+}
+
+uint64_t _now_ns(void) {
+    struct timespec now;
+    bxierr_p err = bxitime_get(CLOCK_MONOTONIC, &now);
+    bxierr_abort_ifko(err);
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+bxierr_p _vlog(const bxilog_logger_p logger,
+               const bxilog_level_e level,
+               const uint32_t site_id,
+               const char * const fullfilename,
+               const size_t fullfilename_len,
+               const char * const funcname,
+               const size_t funcname_len,
+               const int line,
+               const char * const fmt, va_list arglist) {
+
     if (INITIALIZED != BXILOG__GLOBALS->state) return BXIERR_OK;
 
     tsd_p tsd;
@@ -197,7 +665,32 @@ bxierr_p bxilog_logger_vlog_nolevelcheck(const bxilog_logger_p logger,
     size_t logmsg_len = BXILOG__GLOBALS->config->tsd_log_buf_size;
     bool logmsg_allocated = false; // When true,  means that a new special buffer has been
                                    // allocated -> it will have to be freed
-    while (true) {
+    uint32_t flags = 0;
+    // Deferred formatting: only capture the arguments, handlers will format them
+    while (BXILOG__GLOBALS->config->deferred_formatting) {
+        va_list arglist_copy;
+        va_copy(arglist_copy, arglist);
+        size_t n = bxilog__deferred_capture(fmt, arglist_copy, logmsg, logmsg_len);
+        va_end(arglist_copy);
+
+        // Not supported by the deferred mode, format it now
+        if (0 == n) break;
+
+        if (n <= logmsg_len) {
+            logmsg_len = n;
+            flags |= BXILOG__RECORD_DEFERRED;
+            break;
+        }
+
+        if (logmsg_allocated) BXIFREE(logmsg);
+        logmsg_len = n;
+        logmsg = malloc(logmsg_len);
+        bxiassert(NULL != logmsg);
+        logmsg_allocated = true;
+
+        tsd->rsz_log_nb++;
+    }
+    while (0 == (flags & BXILOG__RECORD_DEFERRED)) {
         va_list arglist_copy;
         va_copy(arglist_copy, arglist);
         // Does not include the null terminated byte
@@ -230,14 +723,14 @@ bxierr_p bxilog_logger_vlog_nolevelcheck(const bxilog_logger_p logger,
 
     bxiassert(bxierr_isok(err));
 
-    const char * filename;
-    size_t filename_len = bxistr_rsub(fullfilename, fullfilename_len, '/', &filename);
+    // With a site, handlers resolve filename and funcname from its id
+    const char * filename = NULL;
+    size_t filename_len = 0;
+    if (0 == site_id) {
+        filename_len = bxistr_rsub(fullfilename, fullfilename_len, '/', &filename);
+    }
 
-    err = _send2handlers(logger, level, tsd->data_channel,
-#ifdef __linux__
-                         tsd->tid,
-#endif
-                         tsd->thread_rank,
+    err = _send2handlers(logger, level, tsd, flags, site_id,
                          filename, filename_len,
                          funcname, funcname_len,
                          line,
@@ -252,37 +745,11 @@ bxierr_p bxilog_logger_vlog_nolevelcheck(const bxilog_logger_p logger,
     return err;
 }
 
-bxierr_p bxilog_logger_log_nolevelcheck(const bxilog_logger_p logger,
-                                        const bxilog_level_e level,
-                                        char * filename, size_t filename_len,
-                                        const char * funcname, size_t funcname_len,
-                                        const int line,
-                                        const char * fmt, ...) {
-    va_list ap;
-    bxierr_p err;
-
-    va_start(ap, fmt);
-    err = bxilog_logger_vlog_nolevelcheck(logger, level,
-                                          filename, filename_len,
-                                          funcname, funcname_len,
-                                          line,
-                                          fmt, ap);
-    va_end(ap);
-
-    return err;
-}
-
-//*********************************************************************************
-//********************************** Static Helpers Implementation ****************
-//*********************************************************************************
-
 bxierr_p _send2handlers(const bxilog_logger_p logger,
                         const bxilog_level_e level,
-                        void ** const log_channel,
-#ifdef __linux__
-                        const pid_t tid,
-#endif
-                        const uintptr_t thread_rank,
+                        const tsd_p tsd,
+                        const uint32_t flags,
+                        const uint32_t site_id,
                         const char * const filename, const size_t filename_len,
                         const char * const funcname, const size_t funcname_len,
                         const int line,
@@ -290,23 +757,119 @@ bxierr_p _send2handlers(const bxilog_logger_p logger,
 
     bxierr_p err = BXIERR_OK, err2;
     bxilog_record_p record;
-    char * data;
 
     size_t var_len = filename_len + funcname_len + logger->name_length;
     size_t data_len = sizeof(*record) + var_len + rawstr_len;
 
-    // We need a mallocated buffer to prevent ZMQ from making its own copy
-    // We use malloc() instead of calloc() for performance reason
-    // This has been profiled! There is a significant gain doing this!
-    // If you change this, you must know what you are doing!
-    record = malloc(data_len);
-    bxiassert(NULL != record);
-    // Fill the buffer
-    record->level = level;
+    const bxilog_config_p config = BXILOG__GLOBALS->config;
+    // The timer thread may send our batch with our zockets meanwhile
+    if (NULL != tsd->batch) {
+        int rc = pthread_mutex_lock(&tsd->batch_lock);
+        bxiassert(0 == rc);
+    }
+    // Priority records are never batched: they would wait in the normal lane
+    if (NULL != tsd->batch && level > BXILOG__GLOBALS->priority_level) {
+        const size_t aligned_len = BXILOG__RECORD_ALIGN(data_len);
+        if (tsd->batch_len + aligned_len > config->batch_size) {
+            // Keep records order: send what has been batched so far
+            err2 = bxilog__batch_flush(tsd);
+            BXIERR_CHAIN(err, err2);
+        }
+        if (aligned_len <= config->batch_size) {
+            record = (bxilog_record_p) ((char *) _batch_data(tsd) + tsd->batch_len);
+            _fill_record(record, logger, level, tsd, flags, site_id,
+                         filename, filename_len,
+                         funcname, funcname_len,
+                         line,
+                         rawstr, rawstr_len);
+            tsd->batch_len += aligned_len;
+            tsd->batch_records_nb++;
+            if (1 == tsd->batch_records_nb) tsd->batch_start = record->detail_time;
+
+            double elapsed = (double) (record->detail_time.tv_sec - tsd->batch_start.tv_sec)
+                           + (double) (record->detail_time.tv_nsec
+                                       - tsd->batch_start.tv_nsec) * 1e-9;
+            if (tsd->batch_records_nb >= config->batch_records_max ||
+                elapsed >= config->batch_latency_s) {
+                err2 = bxilog__batch_flush(tsd);
+                BXIERR_CHAIN(err, err2);
+            }
+            goto QUIT;
+        }
+        // Too large for a batch: sent alone
+    } else if (NULL != tsd->batch) {
+        // Keep records order in the normal lanes
+        err2 = bxilog__batch_flush(tsd);
+        BXIERR_CHAIN(err, err2);
+    }
 
-    err2 = bxitime_get(CLOCK_REALTIME, &record->detail_time);
+    const size_t handlers_nb = BXILOG__GLOBALS->internal_handlers_nb;
+    // With rings, records are copied into preallocated memory anyway
+    const bool shared = config->shared_records && NULL == tsd->rings;
+    bxilog__shared_record_p shared_record = NULL;
+
+    // We need an allocated buffer to prevent ZMQ from making its own copy.
+    // It comes from the thread slab: malloc() shows up in profiles under contention.
+    // Otherwise, the record is copied anyway: the thread buffer is used.
+    if (shared) {
+        shared_record = bxilog__slab_alloc(tsd->slab, sizeof(*shared_record) + data_len);
+        record = (bxilog_record_p) (shared_record + 1);
+    } else {
+        if (tsd->record_buf_size < data_len) {
+            tsd->record_buf = bximem_realloc(tsd->record_buf,
+                                             tsd->record_buf_size, data_len);
+            tsd->record_buf_size = data_len;
+        }
+        record = (bxilog_record_p) tsd->record_buf;
+    }
+    _fill_record(record, logger, level, tsd, flags, site_id,
+                 filename, filename_len,
+                 funcname, funcname_len,
+                 line,
+                 rawstr, rawstr_len);
+
+    if (NULL != tsd->rings) {
+        for (size_t i = 0; i < handlers_nb; i++) {
+            // Not our shard
+            if (NULL == tsd->data_channel[i]) continue;
+            if (NULL != tsd->priority_channel[i] &&
+                level <= config->handlers_params[i]->priority_level) {
+                // Priority lanes are always zockets
+                err2 = _send_data(i, BXILOG__LANE_PRIORITY, tsd->priority_channel[i],
+                                  NULL, record, data_len);
+            } else {
+                err2 = _send2ring(i, tsd->rings[i], record, data_len);
+            }
+            BXIERR_CHAIN(err, err2);
+        }
+        goto QUIT;
+    }
+    err2 = _send_frame(tsd, shared_record, record, data_len);
     BXIERR_CHAIN(err, err2);
 
+QUIT:
+    if (NULL != tsd->batch) {
+        int rc = pthread_mutex_unlock(&tsd->batch_lock);
+        bxiassert(0 == rc);
+    }
+    return err;
+}
+
+void _fill_record(const bxilog_record_p record,
+                  const bxilog_logger_p logger,
+                  const bxilog_level_e level,
+                  const tsd_p tsd,
+                  const uint32_t flags,
+                  const uint32_t site_id,
+                  const char * const filename, const size_t filename_len,
+                  const char * const funcname, const size_t funcname_len,
+                  const int line,
+                  const char * const rawstr, const size_t rawstr_len) {
+
+    record->level = level;
+    record->flags = flags;
+
+    bxierr_p err = bxitime_get(CLOCK_REALTIME, &record->detail_time);
     if (bxierr_isko(err)) {
         char * err_str = bxierr_str(err);
         fprintf(stderr, "[W] Calling bxitime_get() failed: %s\n", err_str);
@@ -317,44 +880,249 @@ bxierr_p _send2handlers(const bxilog_logger_p logger,
     }
     record->pid = BXILOG__GLOBALS->pid;
 #ifdef __linux__
-    record->tid = tid;
+    record->tid = tsd->tid;
 #endif
-    record->thread_rank = thread_rank;
+    record->thread_rank = tsd->thread_rank;
     record->line_nb = line;
+    record->site_id = site_id;
+    record->logger_id = logger->id;
     record->filename_len = filename_len;
     record->funcname_len = funcname_len;
     record->logname_len = logger->name_length;
     record->logmsg_len = rawstr_len;
 
     // Now copy the rest after the record
-    data = (char *) record + sizeof(*record);
-    memcpy(data, filename, filename_len);
-    data += filename_len;
-    memcpy(data, funcname, funcname_len);
-    data += funcname_len;
+    char * data = (char *) record + sizeof(*record);
+    if (0 == site_id) {
+        memcpy(data, filename, filename_len);
+        data += filename_len;
+        memcpy(data, funcname, funcname_len);
+        data += funcname_len;
+    }
     memcpy(data, logger->name, logger->name_length);
     data += logger->name_length;
     memcpy(data, rawstr, rawstr_len);
+}
 
-    for (size_t i = 0; i< BXILOG__GLOBALS->internal_handlers_nb; i++) {
-        // Send the frame
-        // normal version if record comes from the stack 'buf'
-        err2 = bxizmq_data_snd(record, data_len,
-                               log_channel[i], ZMQ_DONTWAIT,
-                               RETRIES_MAX, RETRY_DELAY);
-
-        // Zero-copy version (if record has been mallocated).
-//        err2 = bxizmq_data_snd_zc(record, data_len,
-//                                 log_channel[i], ZMQ_DONTWAIT,
-//                                 RETRIES_MAX, RETRY_DELAY,
-//                                 bxizmq_data_free, NULL);
-
-        if (err2->code == BXIZMQ_RETRIES_MAX_ERR) {
-            bxierr_destroy(&err2);
+bxierr_p _send_frame(const tsd_p tsd,
+                     const bxilog__shared_record_p shared_record,
+                     void * const frame, const size_t frame_len) {
+
+    bxierr_p err = BXIERR_OK, err2;
+    const size_t handlers_nb = BXILOG__GLOBALS->internal_handlers_nb;
+
+    if (NULL != shared_record) {
+        // Set before the first send: a handler may release it immediately.
+        // Only one shard of sharded handlers receives it.
+        shared_record->refcount = tsd->handlers_nb;
+        shared_record->size = frame_len;
+    }
+
+    // Batches never hold priority records
+    const bxilog_level_e level = ((bxilog_record_p) frame)->level;
+    for (size_t i = 0; i < handlers_nb; i++) {
+        // Not our shard
+        if (NULL == tsd->data_channel[i]) continue;
+        if (NULL != tsd->priority_channel[i] &&
+            level <= BXILOG__GLOBALS->config->handlers_params[i]->priority_level) {
+            err2 = _send_data(i, BXILOG__LANE_PRIORITY, tsd->priority_channel[i],
+                              shared_record, frame, frame_len);
         } else {
-            BXIERR_CHAIN(err, err2);
+            err2 = _send_data(i, BXILOG__LANE_NORMAL, tsd->data_channel[i],
+                              shared_record, frame, frame_len);
+        }
+        BXIERR_CHAIN(err, err2);
+    }
+    if (NULL != shared_record && 0 == tsd->handlers_nb) bxilog__slab_free(shared_record);
+
+    return err;
+}
+
+bxierr_p _send_data(const size_t rank, const size_t lane, void * const zocket,
+                    const bxilog__shared_record_p shared_record,
+                    void * const frame, const size_t frame_len) {
+
+    zmq_msg_t msg;
+    int rc;
+    errno = 0;
+    if (NULL != shared_record) {
+        // Zero-copy: the frame is released by the last handler
+        rc = zmq_msg_init_data(&msg, frame, frame_len,
+                               _shared_record_release, shared_record);
+    } else {
+        rc = zmq_msg_init_size(&msg, frame_len);
+        if (0 == rc) memcpy(zmq_msg_data(&msg), frame, frame_len);
+    }
+    if (0 != rc) {
+        bxierr_p err = bxizmq_err(errno, "Calling zmq_msg_init() failed");
+        // This handler will never release it
+        if (NULL != shared_record) _shared_record_release(frame, shared_record);
+        return err;
+    }
+
+    bxierr_p err = BXIERR_OK, err2;
+    const bxilog_handler_param_p param = BXILOG__GLOBALS->config->handlers_params[rank];
+    // Counted before sending: the handler may receive it immediately
+    size_t * const sent_nb = &BXILOG__GLOBALS->backpressure[rank].lanes[lane].sent_nb;
+    __atomic_add_fetch(sent_nb, 1, __ATOMIC_RELAXED);
+    bool sent = false;
+    if (BXILOG_BACKPRESSURE_BLOCK == param->backpressure) {
+        err2 = bxizmq_msg_snd(&msg, zocket, ZMQ_DONTWAIT, RETRIES_MAX, RETRY_DELAY);
+        if (err2->code == BXIZMQ_RETRIES_MAX_ERR) bxierr_destroy(&err2);
+        sent = bxierr_isok(err2);
+        BXIERR_CHAIN(err, err2);
+    } else {
+        // Never wait for the handler: the policy drops the record, or it is
+        // retried a few times and dropped anyway when the queue stays full
+        for (size_t retries = 0;; retries++) {
+            errno = 0;
+            if (-1 != zmq_msg_send(&msg, zocket, ZMQ_DONTWAIT)) {
+                sent = true;
+                break;
+            }
+            if (EINTR == errno) continue;
+            if (EAGAIN != errno) {
+                err2 = bxizmq_err(errno, "Can't send msg through zsocket %p", zocket);
+                BXIERR_CHAIN(err, err2);
+                break;
+            }
+            if (0 == retries && _backpressure(rank, lane, frame, frame_len)) break;
+            if (BACKPRESSURE_RETRIES_MAX <= retries) {
+                _overflow(rank, frame, frame_len);
+                break;
+            }
+            sched_yield();
         }
     }
-    BXIFREE(record);
+    if (!sent) __atomic_sub_fetch(sent_nb, 1, __ATOMIC_RELAXED);
+    // When the message has not been sent, this releases the frame
+    err2 = bxizmq_msg_close(&msg);
+    BXIERR_CHAIN(err, err2);
+
     return err;
 }
+
+bool _backpressure(const size_t rank, const size_t lane,
+                   const void * const frame, const size_t frame_len) {
+    const bxilog_handler_param_p param = BXILOG__GLOBALS->config->handlers_params[rank];
+    const bxilog__backpressure_p backpressure = &BXILOG__GLOBALS->backpressure[rank];
+
+    // The frame may be a batch
+    size_t records_nb = 0, kept_nb = 0;
+    for (size_t offset = 0; offset < frame_len;) {
+        const bxilog_record_p record = (bxilog_record_p) ((char *) frame + offset);
+        records_nb++;
+        if (record->level <= param->backpressure_level) kept_nb++;
+        offset += BXILOG__RECORD_ALIGN(BXILOG__RECORD_LEN(record));
+    }
+
+    switch (param->backpressure) {
+        case BXILOG_BACKPRESSURE_DROP_NEWEST:
+            __atomic_add_fetch(&backpressure->drops.newest_nb, records_nb,
+                               __ATOMIC_RELAXED);
+            return true;
+        case BXILOG_BACKPRESSURE_DROP_BELOW_LEVEL:
+            // Records of a batch are not sent separately: retry them all
+            if (0 < kept_nb) return false;
+            __atomic_add_fetch(&backpressure->drops.below_level_nb, records_nb,
+                               __ATOMIC_RELAXED);
+            return true;
+        case BXILOG_BACKPRESSURE_DROP_OLDEST: {
+            // Queued frames cannot be removed from here: ask the handler to drop
+            // as many frames as are queued before ours, it then catches up quickly
+            // and ours is retried. The handler counts them down, so later frames
+            // are not affected.
+            bxilog__lane_s * const stats = &backpressure->lanes[lane];
+            const size_t sent = __atomic_load_n(&stats->sent_nb, __ATOMIC_RELAXED);
+            const size_t received = __atomic_load_n(&stats->received_nb,
+                                                    __ATOMIC_RELAXED);
+            // Ours is already counted as sent
+            const size_t queued = (sent > received) ? sent - received - 1 : 0;
+            size_t current = __atomic_load_n(&stats->drop_nb, __ATOMIC_RELAXED);
+            while (current < queued &&
+                   !__atomic_compare_exchange_n(&stats->drop_nb,
+                                                &current, queued,
+                                                false,
+                                                __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED));
+            return false;
+        }
+        default:
+            return false;
+    }
+}
+
+size_t _records_nb(const void * const frame, const size_t frame_len) {
+    size_t records_nb = 0;
+    for (size_t offset = 0; offset < frame_len; records_nb++) {
+        const bxilog_record_p record = (bxilog_record_p) ((char *) frame + offset);
+        offset += BXILOG__RECORD_ALIGN(BXILOG__RECORD_LEN(record));
+    }
+    return records_nb;
+}
+
+void _overflow(const size_t rank, const void * const frame, const size_t frame_len) {
+    __atomic_add_fetch(&BXILOG__GLOBALS->backpressure[rank].drops.overflow_nb,
+                       _records_nb(frame, frame_len), __ATOMIC_RELAXED);
+}
+
+void _shared_record_release(void * data, void * hint) {
+    UNUSED(data);
+    bxilog__shared_record_p shared_record = hint;
+    // Called by each handler thread when it closes its message
+    if (0 == __atomic_sub_fetch(&shared_record->refcount, 1, __ATOMIC_ACQ_REL)) {
+        bxilog__slab_free(shared_record);
+    }
+}
+
+bxierr_p _send2ring(const size_t rank, bxilog__ring_p ring,
+                    bxilog_record_p record, size_t data_len) {
+
+    // Too large for the ring: only a pointer to a copy goes through it, so the
+    // record is still processed in order with the other ones of this thread
+    void * copy = NULL;
+    if (data_len > bxilog__ring_max_entry(ring)) {
+        copy = bximem_calloc(data_len);
+        memcpy(copy, record, data_len);
+    }
+
+    size_t * const sent_nb =
+        &BXILOG__GLOBALS->backpressure[rank].lanes[BXILOG__LANE_NORMAL].sent_nb;
+    __atomic_add_fetch(sent_nb, 1, __ATOMIC_RELAXED);
+    const bool blocking = BXILOG_BACKPRESSURE_BLOCK ==
+                          BXILOG__GLOBALS->config->handlers_params[rank]->backpressure;
+    for (size_t retries = 0;
+         NULL == copy ? !bxilog__ring_write(ring, record, data_len)
+                      : !bxilog__ring_write_indirect(ring, copy, data_len);
+         retries++) {
+        // The handler is late: make sure it is awake
+        bxilog__ring_notify(ring);
+        bool dropped = false;
+        if (0 == retries) {
+            dropped = _backpressure(rank, BXILOG__LANE_NORMAL, record, data_len);
+        } else if (!blocking && BACKPRESSURE_RETRIES_MAX <= retries) {
+            // Only BXILOG_BACKPRESSURE_BLOCK waits for the handler
+            _overflow(rank, record, data_len);
+            dropped = true;
+        }
+        if (dropped) {
+            __atomic_sub_fetch(sent_nb, 1, __ATOMIC_RELAXED);
+            BXIFREE(copy);
+            return BXIERR_OK;
+        }
+        // Wait for it
+        if (2 > __atomic_load_n(&ring->refcount, __ATOMIC_ACQUIRE)) {
+            __atomic_sub_fetch(sent_nb, 1, __ATOMIC_RELAXED);
+            BXIFREE(copy);
+            return bxierr_gen("Handler has exited, ring is full, record lost");
+        }
+        sched_yield();
+    }
+    bxilog__ring_notify(ring);
+
+    return BXIERR_OK;
+}
+
+void * _batch_data(const tsd_p tsd) {
+    return (bxilog__shared_record_p) tsd->batch + 1;
+}
@@ -326,6 +326,9 @@ bxierr_p _internal_log_func(bxilog_level_e level,
 
     bxilog_record_s record;
     record.level = level;
+    record.flags = 0;
+    record.site_id = 0;
+    record.logger_id = 0;
 
     err2 = bxitime_get(CLOCK_REALTIME, &record.detail_time);
     BXIERR_CHAIN(err, err2);
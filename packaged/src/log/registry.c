@@ -30,18 +30,37 @@
 //*********************************************************************************
 //********************************** Defines **************************************
 //*********************************************************************************
+// Must be a power of 2
 #define REGISTERED_LOGGERS_DEFAULT_ARRAY_SIZE 64
 
 //*********************************************************************************
 //********************************** Types ****************************************
 //*********************************************************************************
 
+/*
+ * An open addressing hash table of loggers indexed by name.
+ *
+ * Slots are only modified under REGISTER_LOCK, but read without it: a table that
+ * has been replaced by a larger one is kept until bxilog__cfg_release_loggers(),
+ * so readers never access freed memory.
+ */
+typedef struct table_s table_s;
+typedef table_s * table_p;
 
+struct table_s {
+    table_p retired;                // Previous (smaller) table, kept for readers
+    size_t size;                    // Number of slots, a power of 2
+    bxilog_logger_p slots[];        // NULL: free, TOMBSTONE: deleted
+};
 
 //*********************************************************************************
 //********************************** Static Functions  ****************************
 //*********************************************************************************
 
+static void _add(bxilog_logger_p logger);
+static bxilog_logger_p _lookup(const char * logger_name);
+static void _resize(size_t size);
+static size_t _hash(const char * name);
 static void _sort(void);
 static int _logger_compar(const void * l1, const void * l2);
 static void _reset_config();
@@ -51,20 +70,40 @@ static void _reset_config();
 //*********************************************************************************
 
 /**
- * Initial number of registered loggers array size
- */
-static size_t REGISTERED_LOGGERS_ARRAY_SIZE = REGISTERED_LOGGERS_DEFAULT_ARRAY_SIZE;
-/**
- * The array of registered loggers.
+ * The registered loggers.
  */
-static bxilog_logger_p * REGISTERED_LOGGERS = NULL;
+static table_p REGISTERED_LOGGERS = NULL;
 /**
  * Number of registered loggers.
  */
 static size_t REGISTERED_LOGGERS_NB = 0;
+/**
+ * Number of deleted slots in REGISTERED_LOGGERS.
+ */
+static size_t TOMBSTONES_NB = 0;
+
+/**
+ * Marks deleted slots, so lookups do not stop there.
+ */
+static struct bxilog_logger_s TOMBSTONE_S;
+#define TOMBSTONE (&TOMBSTONE_S)
+
+/**
+ * Registered loggers sorted by name, rebuilt by bxilog_registry_getall()
+ * only when the registry has changed.
+ */
+static bxilog_logger_p * SORTED_LOGGERS = NULL;
+static size_t SORTED_LOGGERS_NB = 0;
+static bool SORTED_LOGGERS_VALID = false;
 
 static pthread_mutex_t REGISTER_LOCK = PTHREAD_MUTEX_INITIALIZER;
 
+/**
+ * Next logger id to give. Ids are never reused, so handlers can cache
+ * their decision per logger id.
+ */
+static uint32_t NEXT_LOGGER_ID = 1;
+
 //*********************************************************************************
 //********************************** Implementation    ****************************
 //*********************************************************************************
@@ -75,48 +114,21 @@ void bxilog_registry_add(bxilog_logger_p logger) {
     int rc = pthread_mutex_lock(&REGISTER_LOCK);
     bxiassert(0 == rc);
 
-    if (REGISTERED_LOGGERS == NULL) {
-        size_t bytes = REGISTERED_LOGGERS_ARRAY_SIZE * sizeof(*REGISTERED_LOGGERS);
-        REGISTERED_LOGGERS = bximem_calloc(bytes);
-        int rc = atexit(bxilog__wipeout);
+    if (NULL == REGISTERED_LOGGERS) {
+        rc = atexit(bxilog__wipeout);
         bxiassert(0 == rc);
-
-    } else if (REGISTERED_LOGGERS_NB >= REGISTERED_LOGGERS_ARRAY_SIZE) {
-        size_t old_size = REGISTERED_LOGGERS_ARRAY_SIZE;
-        REGISTERED_LOGGERS_ARRAY_SIZE *= 2;
-        size_t bytes = REGISTERED_LOGGERS_ARRAY_SIZE * sizeof(*REGISTERED_LOGGERS);
-        REGISTERED_LOGGERS = bximem_realloc(REGISTERED_LOGGERS,
-                                            old_size * sizeof(*REGISTERED_LOGGERS),
-                                            bytes);
-
-        DBG("[I] Reallocation of %zu slots for (currently) "
-            "%zu registered loggers\n",
-            REGISTERED_LOGGERS_ARRAY_SIZE,
-            REGISTERED_LOGGERS_NB);
     }
-
-    size_t slot = REGISTERED_LOGGERS_NB;
-    for (size_t i = 0; i < REGISTERED_LOGGERS_ARRAY_SIZE; i++) {
-        // Find next free slot
-        if (NULL == REGISTERED_LOGGERS[i]) {
-            if (slot == REGISTERED_LOGGERS_NB) slot = i;
-
-        } else if (0 == strncmp(REGISTERED_LOGGERS[i]->name,
-                                logger->name,
-                                logger->name_length)) {
-            // TODO: provide something better here!
-            fprintf(stderr,
-                    "[W] Logger name '%s' already registered at position %zu, "
-                    "this can lead to various problems such as wrong logging level "
-                    "configuration or misleading messages!\n",
-                    logger->name, i);
-        }
+    bxilog_logger_p other = _lookup(logger->name);
+    if (NULL != other) {
+        // TODO: provide something better here!
+        fprintf(stderr,
+                "[W] Logger name '%s' already registered, "
+                "this can lead to various problems such as wrong logging level "
+                "configuration or misleading messages!\n",
+                logger->name);
     }
-    DBG("Registering new logger[%zu]: %s\n", slot, logger->name);
-    REGISTERED_LOGGERS[slot] = logger;
-    REGISTERED_LOGGERS_NB++;
-    _sort();
-    bxilog_logger_reconfigure(logger);
+    _add(logger);
+
     rc = pthread_mutex_unlock(&REGISTER_LOCK);
     bxiassert(0 == rc);
 }
@@ -125,68 +137,54 @@ void bxilog_registry_del(bxilog_logger_p logger) {
     bxiassert(logger != NULL);
     int rc = pthread_mutex_lock(&REGISTER_LOCK);
     bxiassert(0 == rc);
-    bool found = false;
     DBG("Nb Registered loggers: %zu\n", REGISTERED_LOGGERS_NB);
-    for (size_t i = 0; i < REGISTERED_LOGGERS_ARRAY_SIZE; i++) {
-        bxilog_logger_p current = REGISTERED_LOGGERS[i];
-        if (NULL == current) continue;
-        DBG("Logger[%zu]: %s\n", i, current->name);
-        if (current == logger) {
-         DBG("Unregistering loggers[%zu]: %s\n", i, current->name);
-            REGISTERED_LOGGERS[i] = NULL;
-            found = true;
+    table_p table = REGISTERED_LOGGERS;
+    if (NULL != table) {
+        const size_t mask = table->size - 1;
+        for (size_t i = _hash(logger->name) & mask; ; i = (i + 1) & mask) {
+            bxilog_logger_p current = table->slots[i];
+            if (NULL == current) break;
+            if (current != logger) continue;
+            DBG("Unregistering loggers[%zu]: %s\n", i, current->name);
+            __atomic_store_n(&table->slots[i], TOMBSTONE, __ATOMIC_RELEASE);
+            REGISTERED_LOGGERS_NB--;
+            TOMBSTONES_NB++;
+            SORTED_LOGGERS_VALID = false;
+            break;
         }
     }
-    if (!found) {
-//        bxierr_p bxierr = bxierr_gen("[W] Can't find registered logger: %s\n",
-//                                     logger->name);
-//        char * str = NULL;
-//        if (err->str != NULL) {
-//            err_str = err->str(err);
-//        } else {
-//            err_str = bxierr_str(err);
-//        }
-//        _display_err_msg(str);
-//        BXIFREE(str);
-    } else REGISTERED_LOGGERS_NB--;
-
-    if (0 == REGISTERED_LOGGERS_NB) {
-        BXIFREE(REGISTERED_LOGGERS);
-    } else {
-        _sort();
-    }
     rc = pthread_mutex_unlock(&REGISTER_LOCK);
     bxiassert(0 == rc);
 }
 
 
 bxierr_p bxilog_registry_get(const char * logger_name, bxilog_logger_p * result) {
-    *result = NULL;
+    // Lock-free fast path: the logger usually exists
+    *result = _lookup(logger_name);
+    if (NULL != *result) return BXIERR_OK;
 
     int rc = pthread_mutex_lock(&REGISTER_LOCK);
     if (0 != rc) return bxierr_errno("Call to pthread_mutex_lock() failed (rc=%d)", rc);
 
-    for (size_t i = 0; i < REGISTERED_LOGGERS_ARRAY_SIZE; i++) {
-        bxilog_logger_p logger = REGISTERED_LOGGERS[i];
-        if (NULL == logger) continue;
-        if (strncmp(logger->name, logger_name, logger->name_length) == 0) {
-            *result = logger;
-            break;
-        }
-    }
-
-    rc = pthread_mutex_unlock(&REGISTER_LOCK);
-    if (0 != rc) return bxierr_errno("Call to pthread_mutex_unlock() failed (rc=%d)", rc);
-
+    // Another thread may have created it in the meantime
+    *result = _lookup(logger_name);
     if (NULL == *result) { // Not found
+        if (NULL == REGISTERED_LOGGERS) {
+            rc = atexit(bxilog__wipeout);
+            bxiassert(0 == rc);
+        }
         bxilog_logger_p self = bximem_calloc(sizeof(*self));
         self->allocated = true;
         self->name = strdup(logger_name);
         self->name_length = strlen(logger_name) + 1;
         self->level = BXILOG_LOWEST;
-        bxilog_registry_add(self);
+        _add(self);
         *result = self;
     }
+
+    rc = pthread_mutex_unlock(&REGISTER_LOCK);
+    if (0 != rc) return bxierr_errno("Call to pthread_mutex_unlock() failed (rc=%d)", rc);
+
     DBG("Returning %s %d\n", (*result)->name, (*result)->level);
     return BXIERR_OK;
 }
@@ -196,16 +194,16 @@ size_t bxilog_registry_getall(bxilog_logger_p *loggers[]) {
     bxiassert(NULL != loggers);
     int rc = pthread_mutex_lock(&REGISTER_LOCK);
     bxiassert(0 == rc);
-    bxilog_logger_p * result = bximem_calloc(REGISTERED_LOGGERS_NB * sizeof(*result));
-    size_t j = 0;
-    for (size_t i = 0; i < REGISTERED_LOGGERS_ARRAY_SIZE; i++) {
-        if (NULL == REGISTERED_LOGGERS[i]) continue;
-        result[j++] = REGISTERED_LOGGERS[i];
+    if (!SORTED_LOGGERS_VALID) _sort();
+    bxilog_logger_p * result = bximem_calloc(SORTED_LOGGERS_NB * sizeof(*result));
+    if (0 < SORTED_LOGGERS_NB) {
+        memcpy(result, SORTED_LOGGERS, SORTED_LOGGERS_NB * sizeof(*result));
     }
+    const size_t n = SORTED_LOGGERS_NB;
     rc = pthread_mutex_unlock(&REGISTER_LOCK);
     bxiassert(0 == rc);
     *loggers = result;
-    return j;
+    return n;
 }
 
 
@@ -219,33 +217,122 @@ void bxilog_registry_reset() {
 
 
 void bxilog__cfg_release_loggers() {
-    if (NULL != REGISTERED_LOGGERS) {
-        DBG("Nb Registered loggers: %zu\n", REGISTERED_LOGGERS_NB);
-        for (size_t i = 0; i < REGISTERED_LOGGERS_ARRAY_SIZE; i++) {
-            if (NULL == REGISTERED_LOGGERS[i]) {
-                continue;
-            }
-            DBG("loggers[%zu]: %s\n", i, REGISTERED_LOGGERS[i]->name);
-            if (REGISTERED_LOGGERS[i]->allocated) {
-                DBG("[I] Destroying %s\n", REGISTERED_LOGGERS[i]->name);
-                bxilog_logger_destroy(&REGISTERED_LOGGERS[i]);
-            }
-            REGISTERED_LOGGERS[i] = NULL;
-            REGISTERED_LOGGERS_NB--;
+    table_p table = REGISTERED_LOGGERS;
+    if (NULL == table) return;
+
+    DBG("Nb Registered loggers: %zu\n", REGISTERED_LOGGERS_NB);
+    for (size_t i = 0; i < table->size; i++) {
+        bxilog_logger_p logger = table->slots[i];
+        if (NULL == logger || TOMBSTONE == logger) continue;
+        DBG("loggers[%zu]: %s\n", i, logger->name);
+        if (logger->allocated) {
+            DBG("[I] Destroying %s\n", logger->name);
+            bxilog_logger_destroy(&logger);
         }
-        bxiassert(0 == REGISTERED_LOGGERS_NB);
-        DBG("[I] Removing registered loggers\n");
-        BXIFREE(REGISTERED_LOGGERS);
-        REGISTERED_LOGGERS_ARRAY_SIZE = 0;
+        REGISTERED_LOGGERS_NB--;
+    }
+    bxiassert(0 == REGISTERED_LOGGERS_NB);
+    DBG("[I] Removing registered loggers\n");
+    REGISTERED_LOGGERS = NULL;
+    TOMBSTONES_NB = 0;
+    while (NULL != table) {
+        table_p retired = table->retired;
+        BXIFREE(table);
+        table = retired;
     }
+    BXIFREE(SORTED_LOGGERS);
+    SORTED_LOGGERS_NB = 0;
+    SORTED_LOGGERS_VALID = false;
 }
 
 //*********************************************************************************
 //********************************** Static Helpers Implementation ****************
 //*********************************************************************************
+
+void _add(bxilog_logger_p logger) {
+    // Keep the load factor (including deleted slots) below 3/4
+    table_p table = REGISTERED_LOGGERS;
+    const size_t used = REGISTERED_LOGGERS_NB + TOMBSTONES_NB + 1;
+    if (NULL == table || 4 * used > 3 * table->size) {
+        size_t size = REGISTERED_LOGGERS_DEFAULT_ARRAY_SIZE;
+        // Only live loggers are moved: deleted slots may be enough to reclaim
+        while (4 * (REGISTERED_LOGGERS_NB + 1) > 2 * size) size *= 2;
+        _resize(size);
+        table = REGISTERED_LOGGERS;
+    }
+
+    const size_t mask = table->size - 1;
+    size_t i = _hash(logger->name) & mask;
+    // Tombstones can't be reused: a concurrent reader may be going past them
+    while (NULL != table->slots[i]) i = (i + 1) & mask;
+
+    DBG("Registering new logger[%zu]: %s\n", i, logger->name);
+    if (0 == logger->id) logger->id = NEXT_LOGGER_ID++;
+    __atomic_store_n(&table->slots[i], logger, __ATOMIC_RELEASE);
+    REGISTERED_LOGGERS_NB++;
+    SORTED_LOGGERS_VALID = false;
+    bxilog_logger_reconfigure(logger);
+}
+
+bxilog_logger_p _lookup(const char * const logger_name) {
+    table_p table = __atomic_load_n(&REGISTERED_LOGGERS, __ATOMIC_ACQUIRE);
+    if (NULL == table) return NULL;
+
+    const size_t mask = table->size - 1;
+    for (size_t i = _hash(logger_name) & mask; ; i = (i + 1) & mask) {
+        bxilog_logger_p logger = __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE);
+        if (NULL == logger) return NULL;
+        if (TOMBSTONE == logger) continue;
+        if (0 == strcmp(logger->name, logger_name)) return logger;
+    }
+}
+
+void _resize(const size_t size) {
+    DBG("[I] Reallocation of %zu slots for (currently) "
+        "%zu registered loggers\n", size, REGISTERED_LOGGERS_NB);
+    table_p old = REGISTERED_LOGGERS;
+    table_p table = bximem_calloc(sizeof(*table) + size * sizeof(table->slots[0]));
+    table->size = size;
+    table->retired = old;
+    if (NULL != old) {
+        const size_t mask = size - 1;
+        for (size_t j = 0; j < old->size; j++) {
+            bxilog_logger_p logger = old->slots[j];
+            if (NULL == logger || TOMBSTONE == logger) continue;
+            size_t i = _hash(logger->name) & mask;
+            while (NULL != table->slots[i]) i = (i + 1) & mask;
+            table->slots[i] = logger;
+        }
+    }
+    TOMBSTONES_NB = 0;
+    // Publish the fully populated table
+    __atomic_store_n(&REGISTERED_LOGGERS, table, __ATOMIC_RELEASE);
+}
+
+size_t _hash(const char * name) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (const char * c = name; '\0' != *c; c++) {
+        hash ^= (unsigned char) *c;
+        hash *= 1099511628211ull;
+    }
+    return (size_t) hash;
+}
+
 void _sort(void) {
-    qsort(REGISTERED_LOGGERS, REGISTERED_LOGGERS_ARRAY_SIZE, sizeof(*REGISTERED_LOGGERS),
-          _logger_compar);
+    SORTED_LOGGERS = bximem_realloc(SORTED_LOGGERS,
+                                    SORTED_LOGGERS_NB * sizeof(*SORTED_LOGGERS),
+                                    REGISTERED_LOGGERS_NB * sizeof(*SORTED_LOGGERS));
+    SORTED_LOGGERS_NB = 0;
+    table_p table = REGISTERED_LOGGERS;
+    for (size_t i = 0; NULL != table && i < table->size; i++) {
+        bxilog_logger_p logger = table->slots[i];
+        if (NULL == logger || TOMBSTONE == logger) continue;
+        SORTED_LOGGERS[SORTED_LOGGERS_NB++] = logger;
+    }
+    bxiassert(REGISTERED_LOGGERS_NB == SORTED_LOGGERS_NB);
+    qsort(SORTED_LOGGERS, SORTED_LOGGERS_NB, sizeof(*SORTED_LOGGERS), _logger_compar);
+    SORTED_LOGGERS_VALID = true;
 }
 
 int _logger_compar(const void * l1, const void * l2) {
@@ -254,11 +341,6 @@ int _logger_compar(const void * l1, const void * l2) {
 
     if (logger1 == logger2) return 0;
 
-    if (NULL == logger1) return -1; // l2 is different, therefore it is not NULL and greater
-    if (NULL == logger2) return 1; // Reverse case
-
-
-
     return strcmp(logger1->name, logger2->name);
 }
 
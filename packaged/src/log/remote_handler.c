@@ -51,6 +51,8 @@ typedef struct bxilog_remote_handler_param_s_f {
     void * cfg_zock;  // Only when bind is false
     void * ctrl_zock;
     void * data_zock;
+    char * record_buf;  // Record frames, see bxilog_remote_record_header_s
+    size_t record_buf_size;
 
 } bxilog_remote_handler_param_s;
 
@@ -328,6 +330,7 @@ bxierr_p _process_exit(bxilog_remote_handler_param_p data) {
     BXIERR_CHAIN(err, err2);
 
     BXIFREE(data->pub_url);
+    BXIFREE(data->record_buf);
     BXIFREE(data->generic.private_items);
     BXIFREE(data->generic.cbs);
 
@@ -353,11 +356,6 @@ bxierr_p _process_log(bxilog_record_p record,
 
     bxierr_p err = BXIERR_OK, err2;
 
-    UNUSED(filename);
-    UNUSED(funcname);
-    UNUSED(loggername);
-    UNUSED(logmsg);
-
     const char * header =  _LOG_LEVEL_HEADER[record->level];
 
     err2 = bxizmq_str_snd_zc(header, data->data_zock, ZMQ_SNDMORE,
@@ -370,7 +368,32 @@ bxierr_p _process_log(bxilog_record_p record,
             record->logname_len +\
             record->logmsg_len;
 
-    err2 = bxizmq_data_snd(record, record_len, data->data_zock, 0, 0, 0);
+    // Versioned: the record is sent raw
+    const size_t frame_len = sizeof(bxilog_remote_record_header_s) + record_len;
+    if (data->record_buf_size < frame_len) {
+        data->record_buf = bximem_realloc(data->record_buf,
+                                          data->record_buf_size, frame_len);
+        data->record_buf_size = frame_len;
+    }
+    bxilog_remote_record_header_s * frame_header =
+        (bxilog_remote_record_header_s *) data->record_buf;
+    frame_header->magic = BXILOG_REMOTE_HANDLER_RECORD_MAGIC;
+    frame_header->version = BXILOG_REMOTE_HANDLER_RECORD_VERSION;
+    bxilog_record_p copy = (bxilog_record_p) (frame_header + 1);
+    *copy = *record;
+    // Call site ids are only meaningful in this process: send filename and
+    // funcname instead
+    copy->site_id = 0;
+    char * next = (char *) (copy + 1);
+    memcpy(next, filename, record->filename_len);
+    next += record->filename_len;
+    memcpy(next, funcname, record->funcname_len);
+    next += record->funcname_len;
+    memcpy(next, loggername, record->logname_len);
+    next += record->logname_len;
+    memcpy(next, logmsg, record->logmsg_len);
+
+    err2 = bxizmq_data_snd(data->record_buf, frame_len, data->data_zock, 0, 0, 0);
     BXIERR_CHAIN(err, err2);
 
     return err;
@@ -19,6 +19,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <pthread.h>
+#include <inttypes.h>
 
 
 #include "tsd_impl.h"
@@ -563,18 +564,41 @@ bxierr_p _recv_log_record(void * zock, bxilog_record_p * record_p, size_t * reco
     *record_p = NULL;
     *record_len = 0;
 
-    bxilog_record_p record = NULL;
+    char * frame = NULL;
     size_t size;
-    err2 = bxizmq_data_rcv((void**)&record, 0, zock, 0, true, &size);
+    err2 = bxizmq_data_rcv((void**)&frame, 0, zock, 0, true, &size);
     BXIERR_CHAIN(err, err2);
+    if (bxierr_isko(err)) return err;
+
+    // Records are sent raw: both ends must agree on their layout
+    const bxilog_remote_record_header_s * header = (bxilog_remote_record_header_s *) frame;
+    if (size < sizeof(*header) || BXILOG_REMOTE_HANDLER_RECORD_MAGIC != header->magic) {
+        BXIFREE(frame);
+        return bxierr_simple(_BAD_RECORD_ERR,
+                             "Wrong bxilog record: no protocol version, "
+                             "the sender is probably older than this receiver");
+    }
+    if (BXILOG_REMOTE_HANDLER_RECORD_VERSION != header->version) {
+        err = bxierr_simple(_BAD_RECORD_ERR,
+                            "Wrong bxilog record: protocol version %"PRIu32
+                            " received, version %u expected",
+                            header->version, BXILOG_REMOTE_HANDLER_RECORD_VERSION);
+        BXIFREE(frame);
+        return err;
+    }
+    bxilog_record_p record = (bxilog_record_p) (header + 1);
+    size -= sizeof(*header);
 
-    size_t expected_len = sizeof(*record) + \
-            record->filename_len + \
-            record->funcname_len + \
-            record->logname_len + \
-            record->logmsg_len;
+    size_t expected_len = sizeof(*record);
+    if (size >= expected_len) {
+        expected_len += record->filename_len + \
+                        record->funcname_len + \
+                        record->logname_len + \
+                        record->logmsg_len;
+    }
 
     if (size != expected_len) {
+        BXIFREE(frame);
         return bxierr_simple(_BAD_RECORD_ERR,
                              "Wrong bxilog record: expected size=%zu, received size=%zu",
                              expected_len, size);
@@ -582,6 +606,8 @@ bxierr_p _recv_log_record(void * zock, bxilog_record_p * record_p, size_t * reco
     LOWEST(LOGGER, "Record received, size: %zu", size);
 
     if (bxierr_isok(err)) {
+        // Logger ids are only meaningful in the sending process
+        record->logger_id = 0;
         *record_p = record;
         *record_len = size;
     }
@@ -598,12 +624,23 @@ bxierr_p _dispatch_log_record(tsd_p tsd, bxilog_record_p record, size_t data_len
            BXILOG__GLOBALS->internal_handlers_nb);
 
     for (size_t i = 0; i < BXILOG__GLOBALS->internal_handlers_nb; i++) {
+      // Not our shard
+      if (NULL == tsd->data_channel[i]) continue;
+      // Counted before sending as by business threads: the handler may receive
+      // it immediately
+      size_t * const sent_nb =
+          &BXILOG__GLOBALS->backpressure[i].lanes[BXILOG__LANE_NORMAL].sent_nb;
+      __atomic_add_fetch(sent_nb, 1, __ATOMIC_RELAXED);
       // Send the frame
       // normal version if record comes from the stack 'buf'
       err2 = bxizmq_data_snd(record, data_len,
                              tsd->data_channel[i], ZMQ_DONTWAIT,
                              BXILOG_RECEIVER_RETRIES_MAX,
                              BXILOG_RECEIVER_RETRY_DELAY);
+      // Sent anyway after too many retries otherwise
+      if (bxierr_isko(err2) && BXIZMQ_RETRIES_MAX_ERR != err2->code) {
+          __atomic_sub_fetch(sent_nb, 1, __ATOMIC_RELAXED);
+      }
 
       // Zero-copy version (if record has been mallocated).
       //            err2 = bxizmq_data_snd_zc(record, data_len,
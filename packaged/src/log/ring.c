@@ -0,0 +1,273 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "bxi/base/err.h"
+#include "bxi/base/mem.h"
+
+#include "ring_impl.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+// Each entry is preceded by its size
+#define HEADER_SIZE sizeof(uint64_t)
+// Marks the end of the usable space: the next entry starts at the beginning
+#define WRAP_MARKER UINT64_MAX
+// Set in the header of entries holding a pointer to the actual data
+#define INDIRECT_FLAG ((uint64_t) 1 << 63)
+
+#define ALIGN8(n) (((n) + 7u) & ~((size_t) 7u))
+
+#define RING_MIN_CAPACITY 4096u
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Static Functions  ****************************
+//*********************************************************************************
+
+static bool _ring_put(bxilog__ring_p ring, uint64_t header,
+                      const void * data, size_t size);
+static void _ring_free(bxilog__ring_p ring);
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Implementation    ****************************
+//*********************************************************************************
+
+bxierr_p bxilog__ring_set_new(bxilog__ring_set_p * result) {
+    bxiassert(NULL != result);
+
+    bxilog__ring_set_p set = bximem_calloc(sizeof(*set));
+    int rc = pthread_mutex_init(&set->lock, NULL);
+    if (0 != rc) {
+        BXIFREE(set);
+        return bxierr_fromidx(rc, NULL,
+                              "Calling pthread_mutex_init() failed (rc=%d)", rc);
+    }
+    errno = 0;
+    rc = pipe(set->wakeup_fd);
+    if (0 != rc) {
+        bxierr_p err = bxierr_errno("Calling pipe() failed");
+        pthread_mutex_destroy(&set->lock);
+        BXIFREE(set);
+        return err;
+    }
+    for (size_t i = 0; i < ARRAYLEN(set->wakeup_fd); i++) {
+        rc = fcntl(set->wakeup_fd[i], F_SETFL, O_NONBLOCK);
+        bxiassert(-1 != rc);
+        rc = fcntl(set->wakeup_fd[i], F_SETFD, FD_CLOEXEC);
+        bxiassert(-1 != rc);
+    }
+    *result = set;
+
+    return BXIERR_OK;
+}
+
+void bxilog__ring_set_destroy(bxilog__ring_set_p * set_p) {
+    bxiassert(NULL != set_p);
+    bxilog__ring_set_p set = *set_p;
+    if (NULL == set) return;
+
+    bxilog__ring_p ring = set->pending;
+    while (NULL != ring) {
+        bxilog__ring_p next = ring->next;
+        // Never taken by the consumer: release its reference
+        bxilog__ring_unref(&ring);
+        ring = next;
+    }
+    close(set->wakeup_fd[0]);
+    close(set->wakeup_fd[1]);
+    pthread_mutex_destroy(&set->lock);
+    BXIFREE(*set_p);
+}
+
+bxilog__ring_p bxilog__ring_new(bxilog__ring_set_p set, size_t capacity) {
+    bxiassert(NULL != set);
+
+    size_t actual = RING_MIN_CAPACITY;
+    while (actual < capacity) actual <<= 1;
+
+    bxilog__ring_p ring = bximem_calloc(sizeof(*ring));
+    ring->capacity = actual;
+    ring->mask = actual - 1;
+    ring->buf = bximem_calloc(actual);
+    ring->set = set;
+    ring->refcount = 2; // The producer and the consumer
+
+    int rc = pthread_mutex_lock(&set->lock);
+    bxiassert(0 == rc);
+    ring->next = set->pending;
+    set->pending = ring;
+    __atomic_add_fetch(&set->version, 1, __ATOMIC_RELEASE);
+    rc = pthread_mutex_unlock(&set->lock);
+    bxiassert(0 == rc);
+
+    return ring;
+}
+
+void bxilog__ring_set_take(bxilog__ring_set_p set, size_t * version,
+                           bxilog__ring_p ** rings, size_t * rings_nb) {
+
+    size_t current = __atomic_load_n(&set->version, __ATOMIC_ACQUIRE);
+    if (current == *version) return;
+
+    int rc = pthread_mutex_lock(&set->lock);
+    bxiassert(0 == rc);
+    bxilog__ring_p ring = set->pending;
+    set->pending = NULL;
+    *version = set->version;
+    rc = pthread_mutex_unlock(&set->lock);
+    bxiassert(0 == rc);
+
+    while (NULL != ring) {
+        bxilog__ring_p next = ring->next;
+        ring->next = NULL;
+        *rings = bximem_realloc(*rings,
+                                *rings_nb * sizeof(**rings),
+                                (*rings_nb + 1) * sizeof(**rings));
+        (*rings)[*rings_nb] = ring;
+        (*rings_nb)++;
+        ring = next;
+    }
+}
+
+void bxilog__ring_unref(bxilog__ring_p * ring_p) {
+    bxiassert(NULL != ring_p);
+    bxilog__ring_p ring = *ring_p;
+    if (NULL == ring) return;
+    *ring_p = NULL;
+
+    if (0 == __atomic_sub_fetch(&ring->refcount, 1, __ATOMIC_ACQ_REL)) _ring_free(ring);
+}
+
+size_t bxilog__ring_max_entry(bxilog__ring_p ring) {
+    // Limiting an entry to half the ring guarantees a wrap can always be done
+    // once the ring has been drained.
+    return ring->capacity / 2 - HEADER_SIZE;
+}
+
+bool bxilog__ring_write(bxilog__ring_p ring, const void * data, size_t size) {
+    bxiassert(size <= bxilog__ring_max_entry(ring));
+
+    return _ring_put(ring, (uint64_t) size, data, size);
+}
+
+bool bxilog__ring_write_indirect(bxilog__ring_p ring, void * data, size_t size) {
+    bxiassert(NULL != data);
+
+    return _ring_put(ring, INDIRECT_FLAG | (uint64_t) size, &data, sizeof(data));
+}
+
+void bxilog__ring_notify(bxilog__ring_p ring) {
+    bxilog__ring_set_p set = ring->set;
+    // Pairs with the fence in the consumer between setting 'sleeping'
+    // and checking rings for emptiness
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (0 == __atomic_load_n(&set->sleeping, __ATOMIC_RELAXED)) return;
+    if (0 == __atomic_exchange_n(&set->sleeping, 0, __ATOMIC_ACQ_REL)) return;
+
+    const char c = 0;
+    ssize_t rc = write(set->wakeup_fd[1], &c, 1);
+    // EAGAIN: the pipe is already full, the consumer will wake up anyway
+    UNUSED(rc);
+}
+
+void * bxilog__ring_peek(bxilog__ring_p ring, size_t * pos, size_t * size,
+                         bool * indirect) {
+    while (true) {
+        const size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (*pos == head) return NULL;
+
+        const size_t idx = *pos & ring->mask;
+        const uint64_t header = *(uint64_t *) (ring->buf + idx);
+        if (WRAP_MARKER == header) {
+            *pos += ring->capacity - idx;
+            continue;
+        }
+        void * const entry = ring->buf + idx + HEADER_SIZE;
+        *indirect = (0 != (header & INDIRECT_FLAG));
+        if (*indirect) {
+            *size = (size_t) (header & ~INDIRECT_FLAG);
+            *pos += ALIGN8(HEADER_SIZE + sizeof(void *));
+            return *(void **) entry;
+        }
+        *size = (size_t) header;
+        *pos += ALIGN8(HEADER_SIZE + *size);
+        return entry;
+    }
+}
+
+void bxilog__ring_release(bxilog__ring_p ring, size_t pos) {
+    __atomic_store_n(&ring->tail, pos, __ATOMIC_RELEASE);
+}
+
+bool bxilog__ring_isempty(bxilog__ring_p ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail;
+}
+
+//*********************************************************************************
+//********************************** Static Helpers Implementation ****************
+//*********************************************************************************
+
+bool _ring_put(bxilog__ring_p ring, const uint64_t header,
+               const void * data, const size_t size) {
+
+    const size_t need = ALIGN8(HEADER_SIZE + size);
+    size_t head = ring->head; // Only written by us
+    const size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    size_t idx = head & ring->mask;
+    const size_t contiguous = ring->capacity - idx;
+    size_t skip = 0;
+    if (contiguous < need) skip = contiguous;
+
+    if (head + skip + need - tail > ring->capacity) return false;
+
+    if (0 < skip) {
+        *(uint64_t *) (ring->buf + idx) = WRAP_MARKER;
+        head += skip;
+        idx = 0;
+    }
+    *(uint64_t *) (ring->buf + idx) = header;
+    memcpy(ring->buf + idx + HEADER_SIZE, data, size);
+
+    // Publish
+    __atomic_store_n(&ring->head, head + need, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+void _ring_free(bxilog__ring_p ring) {
+    // Data handed over but never processed
+    size_t pos = ring->tail;
+    size_t size;
+    bool indirect;
+    void * entry;
+    while (NULL != (entry = bxilog__ring_peek(ring, &pos, &size, &indirect))) {
+        if (indirect) BXIFREE(entry);
+    }
+    BXIFREE(ring->buf);
+    BXIFREE(ring);
+}
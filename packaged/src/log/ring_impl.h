@@ -0,0 +1,140 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#ifndef BXILOG_RING_IMPL_H
+#define BXILOG_RING_IMPL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "bxi/base/err.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+// Size of a cache line, used to keep producer and consumer indexes apart
+#define BXILOG__RING_CACHELINE 64
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+/*
+ * A single-producer/single-consumer byte ring.
+ *
+ * The producer is a business thread, the consumer is a handler thread.
+ * Entries are variable sized and 8 bytes aligned. head and tail are
+ * monotonically increasing byte counters: only the producer writes head,
+ * only the consumer writes tail.
+ *
+ * A ring is shared by exactly two owners (the producer and the consumer),
+ * the last one calling bxilog__ring_unref() releases it.
+ */
+typedef struct bxilog__ring_s bxilog__ring_s;
+typedef bxilog__ring_s * bxilog__ring_p;
+
+typedef struct bxilog__ring_set_s bxilog__ring_set_s;
+typedef bxilog__ring_set_s * bxilog__ring_set_p;
+
+struct bxilog__ring_s {
+    size_t capacity;                // Power of 2, in bytes
+    size_t mask;                    // capacity - 1
+    bxilog__ring_set_p set;         // The set (handler) this ring is drained by
+    bxilog__ring_p next;            // Used by the set for pending rings
+    int refcount;
+    bool closed;                    // Set by the producer on thread exit
+
+    char _pad0[BXILOG__RING_CACHELINE];
+    size_t head;                    // Written by the producer only
+    char _pad1[BXILOG__RING_CACHELINE - sizeof(size_t)];
+    size_t tail;                    // Written by the consumer only
+    char _pad2[BXILOG__RING_CACHELINE - sizeof(size_t)];
+
+    char * buf;
+};
+
+/*
+ * The set of rings drained by a given handler.
+ *
+ * Producers register their rings once (on their first log) under the mutex.
+ * The handler moves pending rings into its own private array, so the mutex is never
+ * taken on the logging path.
+ */
+struct bxilog__ring_set_s {
+    pthread_mutex_t lock;
+    bxilog__ring_p pending;         // Newly registered rings, protected by lock
+    size_t version;                 // Bumped (atomically) on each registration
+    int sleeping;                   // Non zero when the consumer is about to block
+    int wakeup_fd[2];               // Pipe used to wake up a sleeping consumer
+};
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Interface         ****************************
+//*********************************************************************************
+
+/* Create a new set of rings */
+bxierr_p bxilog__ring_set_new(bxilog__ring_set_p * result);
+
+/* Destroy the given set, rings not yet taken by the consumer are unreferenced */
+void bxilog__ring_set_destroy(bxilog__ring_set_p * set_p);
+
+/* Register a new ring of the given capacity (rounded up to a power of 2) in set */
+bxilog__ring_p bxilog__ring_new(bxilog__ring_set_p set, size_t capacity);
+
+/* Move newly registered rings into the consumer private array */
+void bxilog__ring_set_take(bxilog__ring_set_p set, size_t * version,
+                           bxilog__ring_p ** rings, size_t * rings_nb);
+
+/* Release one reference on the given ring */
+void bxilog__ring_unref(bxilog__ring_p * ring_p);
+
+/* Producer side: copy the given data into the ring. Return false if the ring is full */
+bool bxilog__ring_write(bxilog__ring_p ring, const void * data, size_t size);
+
+/*
+ * Producer side: hand over data, size bytes allocated with bximem_calloc(), through
+ * the ring. Only a pointer is copied so size is not limited by the ring capacity, the
+ * consumer releases data once processed. Return false if the ring is full.
+ */
+bool bxilog__ring_write_indirect(bxilog__ring_p ring, void * data, size_t size);
+
+/* Producer side: wake up the consumer if it is sleeping */
+void bxilog__ring_notify(bxilog__ring_p ring);
+
+/* Producer side: largest entry the given ring can hold */
+size_t bxilog__ring_max_entry(bxilog__ring_p ring);
+
+/*
+ * Consumer side: return the entry at *pos and its size, or NULL if there is none.
+ * *pos starts at ring->tail and is moved past the returned entry, so several
+ * entries can be read before being released.
+ *
+ * *indirect is set when the entry has been written by bxilog__ring_write_indirect():
+ * it then lives outside the ring and must be freed by the caller.
+ */
+void * bxilog__ring_peek(bxilog__ring_p ring, size_t * pos, size_t * size,
+                         bool * indirect);
+
+/* Consumer side: release all entries before pos */
+void bxilog__ring_release(bxilog__ring_p ring, size_t pos);
+
+/* Consumer side: true if nothing is left to read in the ring */
+bool bxilog__ring_isempty(bxilog__ring_p ring);
+
+#endif
@@ -0,0 +1,162 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#include <pthread.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "bxi/base/err.h"
+#include "bxi/base/mem.h"
+#include "bxi/base/str.h"
+
+#include "bxi/base/log.h"
+
+#include "site_impl.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+// Sites are stored in chunks that are never moved nor freed, so handler
+// threads can read them without locking. Nor are sites ever removed: records
+// of an unloaded module may still be queued.
+#define SITES_CHUNK_SIZE 1024u
+#define SITES_CHUNKS_MAX 1024u
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Static Functions  ****************************
+//*********************************************************************************
+
+static bxilog__site_info_p _info_get(uint32_t id);
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+/**
+ * The registered sites: id N is at SITES[N / SITES_CHUNK_SIZE][N % SITES_CHUNK_SIZE].
+ * Id 0 is never used.
+ *
+ * Sites keep their id as long as the module they are defined in (they are static
+ * variables), so this is not reset by bxilog_finalize().
+ */
+static bxilog__site_info_s * SITES[SITES_CHUNKS_MAX];
+
+/**
+ * Given for unknown ids.
+ */
+static bxilog__site_info_s UNKNOWN_SITE = {"?", 2, "?", 2, 0, 0};
+
+/**
+ * Next id to give.
+ */
+static uint32_t SITES_NEXT_ID = 1;
+
+static pthread_mutex_t SITES_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+SET_LOGGER(LOGGER, BXILOG_LIB_PREFIX "bxilog.site");
+
+//*********************************************************************************
+//********************************** Implementation    ****************************
+//*********************************************************************************
+
+uint32_t bxilog__site_register(bxilog_site_p site, bxilog_logger_p logger) {
+    bxiassert(NULL != site);
+
+    int rc = pthread_mutex_lock(&SITES_LOCK);
+    bxiassert(0 == rc);
+
+    // Another thread may have registered it in the meantime
+    uint32_t id = site->id;
+    if (0 != id) goto QUIT;
+
+    // Published with the id
+    site->logger = logger;
+    id = SITES_NEXT_ID;
+    const uint32_t chunk = id / SITES_CHUNK_SIZE;
+    if (SITES_CHUNKS_MAX <= chunk) {
+        id = BXILOG__SITE_ID_NONE;
+        __atomic_store_n(&site->id, id, __ATOMIC_RELEASE);
+        goto QUIT;
+    }
+    if (NULL == SITES[chunk]) {
+        bxilog__site_info_s * sites = bximem_calloc(SITES_CHUNK_SIZE * sizeof(*sites));
+        __atomic_store_n(&SITES[chunk], sites, __ATOMIC_RELEASE);
+    }
+    SITES_NEXT_ID++;
+
+    // The module of the site may be unloaded before its records are processed:
+    // handlers only use this copy
+    bxilog__site_info_p info = &SITES[chunk][id % SITES_CHUNK_SIZE];
+    const char * filename;
+    info->filename_len = bxistr_rsub(site->fullfilename, site->fullfilename_len,
+                                     '/', &filename);
+    info->funcname_len = site->funcname_len;
+    info->line = site->line;
+    char * names = bximem_calloc(info->filename_len + info->funcname_len);
+    memcpy(names, filename, info->filename_len);
+    memcpy(names + info->filename_len, site->funcname, info->funcname_len);
+    info->funcname = names + info->filename_len;
+    // Publish in the table: the info is complete
+    __atomic_store_n(&info->filename, names, __ATOMIC_RELEASE);
+    // Publish to the logging threads
+    __atomic_store_n(&site->id, id, __ATOMIC_RELEASE);
+
+QUIT:
+    rc = pthread_mutex_unlock(&SITES_LOCK);
+    bxiassert(0 == rc);
+
+    return id;
+}
+
+bxilog__site_info_p bxilog__site_get(uint32_t id) {
+    bxilog__site_info_p info = _info_get(id);
+
+    return (NULL == info) ? &UNKNOWN_SITE : info;
+}
+
+void bxilog__site_report_suppressed(void) {
+    const uint32_t next_id = __atomic_load_n(&SITES_NEXT_ID, __ATOMIC_ACQUIRE);
+    for (uint32_t id = 1; id < next_id; id++) {
+        // The site may not be published yet
+        bxilog__site_info_p info = _info_get(id);
+        if (NULL == info) continue;
+        const uint64_t suppressed = __atomic_exchange_n(&info->suppressed_nb, 0,
+                                                        __ATOMIC_RELAXED);
+        if (0 == suppressed) continue;
+        NOTICE(LOGGER, "%s:%d@%s(): %" PRIu64 " logs suppressed by rate limiting "
+               "since the last report",
+               info->filename, info->line, info->funcname, suppressed);
+    }
+}
+
+//*********************************************************************************
+//********************************** Static Helpers Implementation ****************
+//*********************************************************************************
+
+bxilog__site_info_p _info_get(const uint32_t id) {
+    if (0 == id || BXILOG__SITE_ID_NONE == id) return NULL;
+    const uint32_t chunk = id / SITES_CHUNK_SIZE;
+    if (SITES_CHUNKS_MAX <= chunk) return NULL;
+
+    bxilog__site_info_s * sites = __atomic_load_n(&SITES[chunk], __ATOMIC_ACQUIRE);
+    if (NULL == sites) return NULL;
+    bxilog__site_info_p info = &sites[id % SITES_CHUNK_SIZE];
+    if (NULL == __atomic_load_n(&info->filename, __ATOMIC_ACQUIRE)) return NULL;
+
+    return info;
+}
@@ -0,0 +1,84 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#ifndef BXILOG_SITE_IMPL_H
+#define BXILOG_SITE_IMPL_H
+
+#include <stdint.h>
+
+#include "bxi/base/log/logger.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+// Id given to sites that could not be registered
+#define BXILOG__SITE_ID_NONE UINT32_MAX
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+/*
+ * What is known of a registered site, copied into library memory on registration.
+ *
+ * The site itself is a static variable of its module: records may still refer to it
+ * once the module has been unloaded.
+ */
+typedef struct {
+    const char * filename;          // Basename of the site source file
+    size_t filename_len;            // Including NULL ending byte
+    const char * funcname;
+    size_t funcname_len;            // Including NULL ending byte
+    int line;
+    uint64_t suppressed_nb;         // Logs suppressed by rate limiting since last report
+} bxilog__site_info_s;
+
+typedef bxilog__site_info_s * bxilog__site_info_p;
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Interface         ****************************
+//*********************************************************************************
+
+/*
+ * Register the given site if required and return its id.
+ *
+ * The given logger is recorded as the logger whose decision the site caches.
+ *
+ * Callers should first check site->id with an acquire load: it is only written once,
+ * by the registration.
+ *
+ * Return BXILOG__SITE_ID_NONE if the site can't be registered (too many sites):
+ * the caller must then store filename and funcname in the record.
+ */
+uint32_t bxilog__site_register(bxilog_site_p site, bxilog_logger_p logger);
+
+/*
+ * Return what is known of the site registered with the given id.
+ *
+ * Unknown ids (e.g. from another process) give a site named "?".
+ *
+ * Lock-free: may be called by handler threads concurrently with registrations.
+ */
+bxilog__site_info_p bxilog__site_get(uint32_t id);
+
+/*
+ * Log the number of logs each site suppressed by rate limiting since its last report.
+ */
+void bxilog__site_report_suppressed(void);
+
+#endif
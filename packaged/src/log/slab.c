@@ -0,0 +1,202 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#include <stdlib.h>
+
+#include "bxi/base/err.h"
+#include "bxi/base/mem.h"
+
+#include "slab_impl.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+// Number of blocks allocated by the first refill of a class. Each refill doubles it,
+// so heavily used classes get larger chunks.
+#define REFILL_BLOCKS_MIN 8u
+#define REFILL_BLOCKS_MAX 256u
+
+#define CACHELINE 64
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+typedef struct block_s block_s;
+typedef block_s * block_p;
+
+// Header of each block, the caller memory follows
+struct block_s {
+    bxilog__slab_p slab;                        // NULL when malloc()ed
+    block_p next;                               // In a free list
+    size_t class;
+};
+
+struct bxilog__slab_s {
+    size_t refcount;                            // Owner + blocks in use
+    size_t classes_nb;
+    block_p local[BXILOG__SLAB_CLASSES_MAX];    // Free blocks, owner only
+    size_t refill[BXILOG__SLAB_CLASSES_MAX];    // Blocks nb of the next refill
+    void ** chunks;                             // Owner only, freed with the slab
+    size_t chunks_nb;
+    size_t bytes;
+
+    char _pad[CACHELINE];
+    block_p freed[BXILOG__SLAB_CLASSES_MAX];    // Blocks freed by other threads
+};
+
+//*********************************************************************************
+//********************************** Static Functions  ****************************
+//*********************************************************************************
+
+static void _refill(bxilog__slab_p slab, size_t class);
+static void _slab_free(bxilog__slab_p slab);
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+// Process-wide statistics, only updated on rare events (refills, oversized blocks)
+static bxilog_alloc_stats_s STATS;
+
+//*********************************************************************************
+//********************************** Implementation    ****************************
+//*********************************************************************************
+
+bxilog__slab_p bxilog__slab_new(size_t max_size) {
+    if (0 == max_size) return NULL;
+
+    bxilog__slab_p slab = bximem_calloc(sizeof(*slab));
+    slab->refcount = 1;
+    slab->classes_nb = 1;
+    while (slab->classes_nb < BXILOG__SLAB_CLASSES_MAX &&
+           (BXILOG__SLAB_MIN_BLOCK << (slab->classes_nb - 1)) < max_size) {
+        slab->classes_nb++;
+    }
+    for (size_t c = 0; c < slab->classes_nb; c++) slab->refill[c] = REFILL_BLOCKS_MIN;
+
+    return slab;
+}
+
+void bxilog__slab_unref(bxilog__slab_p * slab_p) {
+    bxiassert(NULL != slab_p);
+    bxilog__slab_p slab = *slab_p;
+    if (NULL == slab) return;
+    *slab_p = NULL;
+
+    if (0 == __atomic_sub_fetch(&slab->refcount, 1, __ATOMIC_ACQ_REL)) _slab_free(slab);
+}
+
+void * bxilog__slab_alloc(bxilog__slab_p slab, size_t size) {
+    const size_t needed = sizeof(block_s) + size;
+
+    size_t class = 0;
+    if (NULL != slab) {
+        while (class < slab->classes_nb && (BXILOG__SLAB_MIN_BLOCK << class) < needed) {
+            class++;
+        }
+    }
+    if (NULL == slab || class == slab->classes_nb) {
+        // We use malloc() instead of calloc() for performance reason
+        block_p block = malloc(needed);
+        bxiassert(NULL != block);
+        block->slab = NULL;
+        if (NULL == slab) return block + 1;
+
+        __atomic_add_fetch(&STATS.oversize_nb, 1, __ATOMIC_RELAXED);
+        size_t max = __atomic_load_n(&STATS.oversize_max, __ATOMIC_RELAXED);
+        while (max < size && !__atomic_compare_exchange_n(&STATS.oversize_max, &max, size,
+                                                          false,
+                                                          __ATOMIC_RELAXED,
+                                                          __ATOMIC_RELAXED));
+        return block + 1;
+    }
+
+    if (NULL == slab->local[class]) {
+        // Take back everything other threads have freed
+        slab->local[class] = __atomic_exchange_n(&slab->freed[class], NULL,
+                                                 __ATOMIC_ACQUIRE);
+    }
+    if (NULL == slab->local[class]) _refill(slab, class);
+
+    block_p block = slab->local[class];
+    slab->local[class] = block->next;
+    // The owner holds a reference: this can't reach 0 concurrently
+    __atomic_add_fetch(&slab->refcount, 1, __ATOMIC_RELAXED);
+
+    return block + 1;
+}
+
+void bxilog__slab_free(void * data) {
+    if (NULL == data) return;
+    block_p block = (block_p) data - 1;
+    bxilog__slab_p slab = block->slab;
+    if (NULL == slab) {
+        free(block);
+        return;
+    }
+    // Only the owner pops (by taking the whole stack), so there is no ABA problem
+    block_p head = __atomic_load_n(&slab->freed[block->class], __ATOMIC_RELAXED);
+    do {
+        block->next = head;
+    } while (!__atomic_compare_exchange_n(&slab->freed[block->class], &head, block,
+                                          true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (0 == __atomic_sub_fetch(&slab->refcount, 1, __ATOMIC_ACQ_REL)) _slab_free(slab);
+}
+
+void bxilog__slab_get_stats(bxilog_alloc_stats_p stats) {
+    bxiassert(NULL != stats);
+    stats->slab_bytes = __atomic_load_n(&STATS.slab_bytes, __ATOMIC_RELAXED);
+    stats->slab_refills_nb = __atomic_load_n(&STATS.slab_refills_nb, __ATOMIC_RELAXED);
+    stats->oversize_nb = __atomic_load_n(&STATS.oversize_nb, __ATOMIC_RELAXED);
+    stats->oversize_max = __atomic_load_n(&STATS.oversize_max, __ATOMIC_RELAXED);
+}
+
+//*********************************************************************************
+//********************************** Static Helpers Implementation ****************
+//*********************************************************************************
+
+void _refill(bxilog__slab_p slab, size_t class) {
+    const size_t block_size = BXILOG__SLAB_MIN_BLOCK << class;
+    const size_t blocks_nb = slab->refill[class];
+    const size_t bytes = block_size * blocks_nb;
+
+    char * chunk = malloc(bytes);
+    bxiassert(NULL != chunk);
+    slab->chunks = bximem_realloc(slab->chunks,
+                                  slab->chunks_nb * sizeof(*slab->chunks),
+                                  (slab->chunks_nb + 1) * sizeof(*slab->chunks));
+    slab->chunks[slab->chunks_nb++] = chunk;
+    slab->bytes += bytes;
+
+    for (size_t i = blocks_nb; i > 0; i--) {
+        block_p block = (block_p) (chunk + (i - 1) * block_size);
+        block->slab = slab;
+        block->class = class;
+        block->next = slab->local[class];
+        slab->local[class] = block;
+    }
+    if (REFILL_BLOCKS_MAX > blocks_nb) slab->refill[class] = 2 * blocks_nb;
+
+    __atomic_add_fetch(&STATS.slab_bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&STATS.slab_refills_nb, 1, __ATOMIC_RELAXED);
+}
+
+void _slab_free(bxilog__slab_p slab) {
+    for (size_t i = 0; i < slab->chunks_nb; i++) BXIFREE(slab->chunks[i]);
+    BXIFREE(slab->chunks);
+    __atomic_sub_fetch(&STATS.slab_bytes, slab->bytes, __ATOMIC_RELAXED);
+    BXIFREE(slab);
+}
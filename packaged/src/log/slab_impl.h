@@ -0,0 +1,78 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#ifndef BXILOG_SLAB_IMPL_H
+#define BXILOG_SLAB_IMPL_H
+
+#include <stddef.h>
+
+#include "bxi/base/log.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+// Size of the smallest block, including its header
+#define BXILOG__SLAB_MIN_BLOCK 128u
+// Maximum number of size classes: blocks are at most 128 << 15 = 4 MiB
+#define BXILOG__SLAB_CLASSES_MAX 16u
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+/*
+ * A per-thread record allocator.
+ *
+ * Blocks are allocated by the owner thread only, from power of 2 size classes.
+ * They can be freed by any thread (handler threads release shared records): freed
+ * blocks are pushed on a lock-free stack the owner takes back entirely when its own
+ * free list is empty.
+ *
+ * The slab is reference counted: one reference for the owner and one per block in
+ * use, so it survives its thread until the last record has been processed.
+ */
+typedef struct bxilog__slab_s bxilog__slab_s;
+typedef bxilog__slab_s * bxilog__slab_p;
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Interface         ****************************
+//*********************************************************************************
+
+/*
+ * Create a new slab serving blocks up to max_size bytes (rounded up to a power of 2).
+ * Return NULL if max_size is 0, in which case all blocks are malloc()ed.
+ */
+bxilog__slab_p bxilog__slab_new(size_t max_size);
+
+/* Release the owner reference on the given slab */
+void bxilog__slab_unref(bxilog__slab_p * slab_p);
+
+/*
+ * Owner side: return a block of at least size bytes.
+ * Falls back to malloc() when slab is NULL or size is too large (only the latter
+ * is accounted as an oversized block).
+ */
+void * bxilog__slab_alloc(bxilog__slab_p slab, size_t size);
+
+/* Any thread: release a block returned by bxilog__slab_alloc() */
+void bxilog__slab_free(void * block);
+
+/* Fill stats with the process-wide allocation statistics */
+void bxilog__slab_get_stats(bxilog_alloc_stats_p stats);
+
+#endif
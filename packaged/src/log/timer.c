@@ -0,0 +1,176 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include "bxi/base/err.h"
+#include "bxi/base/time.h"
+
+#include "bxi/base/log.h"
+
+#include "log_impl.h"
+#include "tsd_impl.h"
+#include "timer_impl.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+// Shortest period of the timer thread
+#define TIMER_PERIOD_MIN_S 0.001
+
+// Period of the reports of logs suppressed by rate limiting
+#define REPORT_PERIOD_S 1.0
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Static Functions  ****************************
+//*********************************************************************************
+
+static void * _timer_loop(void * arg);
+static void _timer_tick(bool batches, bool report);
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+static pthread_mutex_t TIMER_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t TIMER_COND;
+static pthread_t TIMER_THREAD;
+static bool TIMER_STARTED = false;
+// Protected by TIMER_LOCK
+static bool TIMER_STOPPING = false;
+static double TIMER_PERIOD_S = 0;
+static bool TIMER_BATCHES = false;
+static size_t TIMER_REPORT_TICKS = 1;
+
+//*********************************************************************************
+//********************************** Implementation    ****************************
+//*********************************************************************************
+
+bxierr_p bxilog__timer_start(void) {
+    bxiassert(!TIMER_STARTED);
+    const bxilog_config_p config = BXILOG__GLOBALS->config;
+
+    // Only threads logging through zmq batch their records
+    TIMER_BATCHES = 0 < config->batch_size && NULL == BXILOG__GLOBALS->ring_sets;
+    TIMER_PERIOD_S = REPORT_PERIOD_S;
+    if (TIMER_BATCHES && config->batch_latency_s / 2 < TIMER_PERIOD_S) {
+        // Batches are sent at most half a period late
+        TIMER_PERIOD_S = config->batch_latency_s / 2;
+        if (TIMER_PERIOD_MIN_S > TIMER_PERIOD_S) TIMER_PERIOD_S = TIMER_PERIOD_MIN_S;
+    }
+    TIMER_REPORT_TICKS = (size_t) (REPORT_PERIOD_S / TIMER_PERIOD_S + 0.5);
+    TIMER_STOPPING = false;
+
+    pthread_condattr_t attr;
+    int rc = pthread_condattr_init(&attr);
+    if (0 != rc) return bxierr_fromidx(rc, NULL,
+                                       "Calling pthread_condattr_init() failed (rc=%d)", rc);
+    rc = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    bxiassert(0 == rc);
+    rc = pthread_cond_init(&TIMER_COND, &attr);
+    pthread_condattr_destroy(&attr);
+    if (0 != rc) return bxierr_fromidx(rc, NULL,
+                                       "Calling pthread_cond_init() failed (rc=%d)", rc);
+
+    rc = pthread_create(&TIMER_THREAD, NULL, _timer_loop, NULL);
+    if (0 != rc) {
+        pthread_cond_destroy(&TIMER_COND);
+        return bxierr_fromidx(rc, NULL,
+                              "Calling pthread_create() failed (rc=%d)", rc);
+    }
+    TIMER_STARTED = true;
+
+    return BXIERR_OK;
+}
+
+bxierr_p bxilog__timer_stop(void) {
+    if (!TIMER_STARTED) return BXIERR_OK;
+
+    int rc = pthread_mutex_lock(&TIMER_LOCK);
+    bxiassert(0 == rc);
+    TIMER_STOPPING = true;
+    rc = pthread_cond_signal(&TIMER_COND);
+    bxiassert(0 == rc);
+    rc = pthread_mutex_unlock(&TIMER_LOCK);
+    bxiassert(0 == rc);
+
+    TIMER_STARTED = false;
+    rc = pthread_join(TIMER_THREAD, NULL);
+    pthread_cond_destroy(&TIMER_COND);
+    if (0 != rc) return bxierr_fromidx(rc, NULL,
+                                       "Calling pthread_join() failed (rc=%d)", rc);
+
+    return BXIERR_OK;
+}
+
+//*********************************************************************************
+//********************************** Static Helpers Implementation ****************
+//*********************************************************************************
+
+void * _timer_loop(void * arg) {
+    UNUSED(arg);
+
+    // Signals must be dealt with by business threads, see _mask_signals() in handler.c
+    sigset_t mask;
+    int rc = sigfillset(&mask);
+    bxiassert(0 == rc);
+    rc = pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    bxiassert(0 == rc);
+
+    const long period_ns = (long) (TIMER_PERIOD_S * 1e9);
+
+    size_t ticks = 0;
+    rc = pthread_mutex_lock(&TIMER_LOCK);
+    bxiassert(0 == rc);
+    while (true) {
+        struct timespec deadline;
+        bxierr_p err = bxitime_get(CLOCK_MONOTONIC, &deadline);
+        bxierr_abort_ifko(err);
+        deadline.tv_sec += (deadline.tv_nsec + period_ns) / 1000000000l;
+        deadline.tv_nsec = (deadline.tv_nsec + period_ns) % 1000000000l;
+        rc = 0;
+        while (!TIMER_STOPPING && ETIMEDOUT != rc) {
+            rc = pthread_cond_timedwait(&TIMER_COND, &TIMER_LOCK, &deadline);
+        }
+        if (TIMER_STOPPING) break;
+
+        rc = pthread_mutex_unlock(&TIMER_LOCK);
+        bxiassert(0 == rc);
+        ticks++;
+        _timer_tick(TIMER_BATCHES, 0 == ticks % TIMER_REPORT_TICKS);
+        rc = pthread_mutex_lock(&TIMER_LOCK);
+        bxiassert(0 == rc);
+    }
+    rc = pthread_mutex_unlock(&TIMER_LOCK);
+    bxiassert(0 == rc);
+
+    return NULL;
+}
+
+void _timer_tick(const bool batches, const bool report) {
+    // Counts left by bursts that stopped are reported nonetheless
+    if (report) bxilog__report_suppressed();
+    if (!batches) return;
+    // Batches being filled are sent by their own thread
+    bxierr_p err = bxilog__batch_flush_all(true, false);
+    // Logging it would go through a batch
+    if (bxierr_isko(err)) bxierr_report(&err, STDERR_FILENO);
+}
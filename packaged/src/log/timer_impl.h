@@ -0,0 +1,49 @@
+/* -*- coding: utf-8 -*-
+ ###############################################################################
+ # Author: Pierre Vigneras <pierre.vigneras@bull.net>
+ # Created on: May 24, 2013
+ # Contributors:
+ ###############################################################################
+ # Copyright (C) 2012  Bull S. A. S.  -  All rights reserved
+ # Bull, Rue Jean Jaures, B.P.68, 78340, Les Clayes-sous-Bois
+ # This is not Free or Open Source software.
+ # Please contact Bull S. A. S. for details about its license.
+ ###############################################################################
+ */
+
+#ifndef BXILOG_TIMER_IMPL_H
+#define BXILOG_TIMER_IMPL_H
+
+#include "bxi/base/err.h"
+
+//*********************************************************************************
+//********************************** Defines **************************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Types ****************************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Global Variables  ****************************
+//*********************************************************************************
+
+//*********************************************************************************
+//********************************** Interface         ****************************
+//*********************************************************************************
+
+/*
+ * Start the timer thread.
+ *
+ * The timer thread reports the logs suppressed by rate limiting every second,
+ * and sends the batches of idle threads once their first record is older
+ * than bxilog_config_s.batch_latency_s.
+ */
+bxierr_p bxilog__timer_start(void);
+
+/*
+ * Stop the timer thread, if started, and wait for its end.
+ */
+bxierr_p bxilog__timer_stop(void);
+
+#endif
@@ -12,9 +12,11 @@
  */
 
 
+#include <errno.h>
 #include <pthread.h>
 #include <sys/syscall.h>
 
+#include "bxi/base/time.h"
 #include "bxi/base/zmq.h"
 
 #include "log_impl.h"
@@ -37,6 +39,13 @@
 //*********************************************************************************
 //********************************** Static Functions  ****************************
 //*********************************************************************************
+static void _tsd_destroy(tsd_p tsd);
+static tsd_p _pool_get(void);
+static bool _pool_put(tsd_p tsd);
+static void _tsd_attach(tsd_p tsd);
+static void _batch_register(tsd_p tsd);
+static void _batch_unregister(tsd_p tsd);
+static bool _batch_expired(tsd_p tsd, const struct timespec * now);
 
 //*********************************************************************************
 //********************************** Global Variables  ****************************
@@ -47,6 +56,32 @@
  * we use thread-specific data to holds thread specific sockets,
  */
 
+/*
+ * Thread-specific data of exited threads, kept for reuse by new threads
+ * (see bxilog_config_s.tsd_pool_size).
+ *
+ * A zeromq socket may be migrated to another thread after a full memory barrier:
+ * taking POOL_LOCK provides it.
+ */
+static pthread_mutex_t POOL_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static tsd_p POOL = NULL;
+static size_t POOL_NB = 0;
+
+/*
+ * Thread-specific data with a batch (see bxilog_config_s.batch_size): batches of
+ * idle threads are sent by the timer thread, batches of all threads on flush.
+ *
+ * Locked before any batch_lock.
+ */
+static pthread_mutex_t BATCHES_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static tsd_p BATCHES = NULL;
+
+/*
+ * Given round-robin to new thread-specific data, so business threads are spread
+ * evenly over the shards of sharded handlers.
+ */
+static size_t SHARD_KEY_NEXT = 0;
+
 //*********************************************************************************
 //********************************** Interface         ****************************
 //*********************************************************************************
@@ -55,19 +90,37 @@
 void bxilog__tsd_free(void * const data) {
     const tsd_p tsd = (tsd_p) data;
 
-    if (NULL != tsd->data_channel) {
-        bxierr_p err = BXIERR_OK, err2;
-        for (size_t i = 0; i < BXILOG__GLOBALS->config->handlers_nb; i++) {
-            err2 = bxizmq_zocket_destroy(&tsd->data_channel[i]);
-            BXIERR_CHAIN(err, err2);
+    if (NULL != tsd->batch) {
+        // No other thread can send it anymore
+        _batch_unregister(tsd);
+        if (INITIALIZED == BXILOG__GLOBALS->state) {
+            int rc = pthread_mutex_lock(&tsd->batch_lock);
+            bxiassert(0 == rc);
+            bxierr_p err = bxilog__batch_flush(tsd);
+            if (bxierr_isko(err)) bxierr_report(&err, STDERR_FILENO);
+            rc = pthread_mutex_unlock(&tsd->batch_lock);
+            bxiassert(0 == rc);
         }
-        BXIFREE(tsd->data_channel);
-        err2 = bxizmq_zocket_destroy(&tsd->ctrl_channel);
-        BXIERR_CHAIN(err, err2);
-        if (bxierr_isko(err)) bxierr_report(&err, STDERR_FILENO);
     }
-    BXIFREE(tsd->log_buf);
-    BXIFREE(tsd);
+    if (_pool_put(tsd)) return;
+
+    _tsd_destroy(tsd);
+}
+
+void bxilog__tsd_pool_drain(void) {
+    int rc = pthread_mutex_lock(&POOL_LOCK);
+    bxiassert(0 == rc);
+    tsd_p tsd = POOL;
+    POOL = NULL;
+    POOL_NB = 0;
+    rc = pthread_mutex_unlock(&POOL_LOCK);
+    bxiassert(0 == rc);
+
+    while (NULL != tsd) {
+        tsd_p next = tsd->pool_next;
+        _tsd_destroy(tsd);
+        tsd = next;
+    }
 }
 
 
@@ -100,6 +153,14 @@ bxierr_p bxilog__tsd_get(tsd_p * result) {
         *result = NULL;
         return bxierr_gen("No zmq context available for socket creation");
     }
+
+    // Zockets and buffers of an exited thread are already connected and sized
+    tsd = _pool_get();
+    if (NULL != tsd) {
+        _tsd_attach(tsd);
+        *result = tsd;
+        return BXIERR_OK;
+    }
     errno = 0;
     tsd = bximem_calloc(sizeof(*tsd));
     tsd->min_log_size = SIZE_MAX;
@@ -107,17 +168,35 @@ bxierr_p bxilog__tsd_get(tsd_p * result) {
     bxiassert(NULL != BXILOG__GLOBALS->config->handlers);
     bxiassert(0 < BXILOG__GLOBALS->config->tsd_log_buf_size);
     tsd->log_buf = bximem_calloc(BXILOG__GLOBALS->config->tsd_log_buf_size);
+    tsd->slab = bxilog__slab_new(BXILOG__GLOBALS->config->slab_max_size);
     if (0 != BXILOG__GLOBALS->config->handlers_nb) {
         tsd->data_channel = bximem_calloc(BXILOG__GLOBALS->config->handlers_nb * 
                                           sizeof(*tsd->data_channel));
+        tsd->priority_channel = bximem_calloc(BXILOG__GLOBALS->config->handlers_nb *
+                                              sizeof(*tsd->priority_channel));
+        if (NULL != BXILOG__GLOBALS->ring_sets) {
+            tsd->rings = bximem_calloc(BXILOG__GLOBALS->config->handlers_nb *
+                                       sizeof(*tsd->rings));
+        } else if (0 < BXILOG__GLOBALS->config->batch_size) {
+            tsd->batch = bxilog__batch_new(BXILOG__GLOBALS->config->batch_size);
+            int rc = pthread_mutex_init(&tsd->batch_lock, NULL);
+            bxiassert(0 == rc);
+        }
     }
 
+    tsd->shard_key = __atomic_fetch_add(&SHARD_KEY_NEXT, 1, __ATOMIC_RELAXED);
+
     bxierr_list_p errlist = bxierr_list_new();
     for (size_t i = 0; i < BXILOG__GLOBALS->config->handlers_nb; i++) {
-        char * url = BXILOG__GLOBALS->config->handlers_params[i]->data_url;
+        const bxilog_handler_param_p param = BXILOG__GLOBALS->config->handlers_params[i];
+        char * url = param->data_url;
         bxiassert(NULL != url);
         bxierr_p err = BXIERR_OK, err2;
 
+        // Other shards of a sharded handler never receive our records
+        if (param->shard != tsd->shard_key % param->shards_nb) goto CTRL;
+        tsd->handlers_nb++;
+
         err2 = bxizmq_zocket_create(BXILOG__GLOBALS->zmq_ctx,
                                     ZMQ_PUSH,
                                     &tsd->data_channel[i]);
@@ -132,7 +211,31 @@ bxierr_p bxilog__tsd_get(tsd_p * result) {
         err2 = bxizmq_zocket_connect(tsd->data_channel[i], url);
         BXIERR_CHAIN(err, err2);
 
-        url = BXILOG__GLOBALS->config->handlers_params[i]->ctrl_url;
+        if (BXILOG_OFF != param->priority_level) {
+            err2 = bxizmq_zocket_create(BXILOG__GLOBALS->zmq_ctx,
+                                        ZMQ_PUSH,
+                                        &tsd->priority_channel[i]);
+            BXIERR_CHAIN(err, err2);
+
+            err2 = bxizmq_zocket_setopt(tsd->priority_channel[i],
+                                        ZMQ_SNDHWM,
+                                        &param->priority_hwm,
+                                        sizeof(param->priority_hwm));
+            BXIERR_CHAIN(err, err2);
+
+            err2 = bxizmq_zocket_connect(tsd->priority_channel[i], param->priority_url);
+            BXIERR_CHAIN(err, err2);
+        }
+
+        // The data zocket is still used by records too large for the ring
+        if (NULL != tsd->rings) {
+            tsd->rings[i] = bxilog__ring_new(BXILOG__GLOBALS->ring_sets[i],
+                                             BXILOG__GLOBALS->config->ring_size);
+        }
+
+CTRL:
+        // Flushes and exits are sent to all shards
+        url = param->ctrl_url;
 
         if (NULL == tsd->ctrl_channel) {
             err2 = bxizmq_zocket_create(BXILOG__GLOBALS->zmq_ctx,
@@ -163,6 +266,144 @@ bxierr_p bxilog__tsd_get(tsd_p * result) {
     }
     bxierr_list_destroy(&errlist);
 
+    _tsd_attach(tsd);
+    *result = tsd;
+
+    return BXIERR_OK;
+}
+
+
+bxierr_p bxilog__batch_flush_all(const bool expired_only, const bool wait) {
+    struct timespec now = {0, 0};
+    if (expired_only) {
+        // Records are stamped with this clock
+        bxierr_p err = bxitime_get(CLOCK_REALTIME, &now);
+        if (bxierr_isko(err)) return err;
+    }
+    const tsd_p self = pthread_getspecific(BXILOG__GLOBALS->tsd_key);
+
+    bxierr_p err = BXIERR_OK, err2;
+    int rc = pthread_mutex_lock(&BATCHES_LOCK);
+    bxiassert(0 == rc);
+    for (tsd_p tsd = BATCHES; NULL != tsd; tsd = tsd->batch_next) {
+        // The zockets of the thread are used from here: the lock provides the full
+        // memory barrier zeromq requires to migrate them
+        rc = (wait && tsd != self) ? pthread_mutex_lock(&tsd->batch_lock) :
+                                     pthread_mutex_trylock(&tsd->batch_lock);
+        if (EBUSY == rc) continue;
+        bxiassert(0 == rc);
+        if (!expired_only || _batch_expired(tsd, &now)) {
+            err2 = bxilog__batch_flush(tsd);
+            BXIERR_CHAIN(err, err2);
+        }
+        rc = pthread_mutex_unlock(&tsd->batch_lock);
+        bxiassert(0 == rc);
+    }
+    rc = pthread_mutex_unlock(&BATCHES_LOCK);
+    bxiassert(0 == rc);
+
+    return err;
+}
+
+void bxilog__batch_forget_all(void) {
+    int rc = pthread_mutex_lock(&BATCHES_LOCK);
+    bxiassert(0 == rc);
+    tsd_p tsd = BATCHES;
+    BATCHES = NULL;
+    while (NULL != tsd) {
+        tsd_p next = tsd->batch_next;
+        tsd->batch_prev = NULL;
+        tsd->batch_next = NULL;
+        tsd->batch_registered = false;
+        tsd = next;
+    }
+    rc = pthread_mutex_unlock(&BATCHES_LOCK);
+    bxiassert(0 == rc);
+}
+
+
+//*********************************************************************************
+//********************************** Static Helpers Implementation ****************
+//*********************************************************************************
+
+void _tsd_destroy(const tsd_p tsd) {
+    if (NULL != tsd->data_channel) {
+        bxierr_p err = BXIERR_OK, err2;
+        for (size_t i = 0; i < BXILOG__GLOBALS->config->handlers_nb; i++) {
+            err2 = bxizmq_zocket_destroy(&tsd->data_channel[i]);
+            BXIERR_CHAIN(err, err2);
+            if (NULL != tsd->priority_channel[i]) {
+                err2 = bxizmq_zocket_destroy(&tsd->priority_channel[i]);
+                BXIERR_CHAIN(err, err2);
+            }
+        }
+        BXIFREE(tsd->data_channel);
+        BXIFREE(tsd->priority_channel);
+        if (NULL != tsd->rings) {
+            for (size_t i = 0; i < BXILOG__GLOBALS->config->handlers_nb; i++) {
+                if (NULL == tsd->rings[i]) continue;
+                // The handler will release the ring once drained
+                __atomic_store_n(&tsd->rings[i]->closed, true, __ATOMIC_RELEASE);
+                bxilog__ring_unref(&tsd->rings[i]);
+            }
+            BXIFREE(tsd->rings);
+        }
+        err2 = bxizmq_zocket_destroy(&tsd->ctrl_channel);
+        BXIERR_CHAIN(err, err2);
+        if (bxierr_isko(err)) bxierr_report(&err, STDERR_FILENO);
+    }
+    BXIFREE(tsd->log_buf);
+    BXIFREE(tsd->record_buf);
+    if (NULL != tsd->batch) {
+        int rc = pthread_mutex_destroy(&tsd->batch_lock);
+        bxiassert(0 == rc);
+    }
+    bxilog__slab_free(tsd->batch);
+    // Records still being processed keep the slab alive
+    bxilog__slab_unref(&tsd->slab);
+    BXIFREE(tsd);
+}
+
+tsd_p _pool_get(void) {
+    if (0 == BXILOG__GLOBALS->config->tsd_pool_size) return NULL;
+
+    int rc = pthread_mutex_lock(&POOL_LOCK);
+    bxiassert(0 == rc);
+    tsd_p tsd = POOL;
+    if (NULL != tsd) {
+        POOL = tsd->pool_next;
+        POOL_NB--;
+        tsd->pool_next = NULL;
+    }
+    rc = pthread_mutex_unlock(&POOL_LOCK);
+    bxiassert(0 == rc);
+
+    return tsd;
+}
+
+bool _pool_put(const tsd_p tsd) {
+    // Only fully connected tsd can be reused
+    if (NULL == BXILOG__GLOBALS->config || 0 == BXILOG__GLOBALS->config->tsd_pool_size ||
+        NULL == tsd->data_channel) return false;
+
+    int rc = pthread_mutex_lock(&POOL_LOCK);
+    bxiassert(0 == rc);
+    // Checked under the lock: bxilog__tsd_pool_drain() is called once the state
+    // has changed, nothing can be pooled after it
+    const bool pooled = INITIALIZED == BXILOG__GLOBALS->state &&
+                        POOL_NB < BXILOG__GLOBALS->config->tsd_pool_size;
+    if (pooled) {
+        tsd->pool_next = POOL;
+        POOL = tsd;
+        POOL_NB++;
+    }
+    rc = pthread_mutex_unlock(&POOL_LOCK);
+    bxiassert(0 == rc);
+
+    return pooled;
+}
+
+void _tsd_attach(const tsd_p tsd) {
 #ifdef __linux__
     tsd->tid = (pid_t) syscall(SYS_gettid);
 #endif
@@ -176,13 +417,43 @@ bxierr_p bxilog__tsd_get(tsd_p * result) {
     // And the man page specified that there is
     bxiassert(0 == rc);
 
-    *result = tsd;
-
-    return BXIERR_OK;
+    if (NULL != tsd->batch) _batch_register(tsd);
 }
 
+void _batch_register(const tsd_p tsd) {
+    int rc = pthread_mutex_lock(&BATCHES_LOCK);
+    bxiassert(0 == rc);
+    tsd->batch_prev = NULL;
+    tsd->batch_next = BATCHES;
+    if (NULL != BATCHES) BATCHES->batch_prev = tsd;
+    BATCHES = tsd;
+    tsd->batch_registered = true;
+    rc = pthread_mutex_unlock(&BATCHES_LOCK);
+    bxiassert(0 == rc);
+}
 
-//*********************************************************************************
-//********************************** Static Helpers Implementation ****************
-//*********************************************************************************
+void _batch_unregister(const tsd_p tsd) {
+    int rc = pthread_mutex_lock(&BATCHES_LOCK);
+    bxiassert(0 == rc);
+    // Not if forgotten by bxilog__batch_forget_all()
+    if (tsd->batch_registered) {
+        if (NULL != tsd->batch_prev) {
+            tsd->batch_prev->batch_next = tsd->batch_next;
+        } else {
+            BATCHES = tsd->batch_next;
+        }
+        if (NULL != tsd->batch_next) tsd->batch_next->batch_prev = tsd->batch_prev;
+        tsd->batch_prev = NULL;
+        tsd->batch_next = NULL;
+        tsd->batch_registered = false;
+    }
+    rc = pthread_mutex_unlock(&BATCHES_LOCK);
+    bxiassert(0 == rc);
+}
 
+bool _batch_expired(const tsd_p tsd, const struct timespec * const now) {
+    if (0 == tsd->batch_records_nb) return false;
+    const double elapsed = (double) (now->tv_sec - tsd->batch_start.tv_sec)
+                         + (double) (now->tv_nsec - tsd->batch_start.tv_nsec) * 1e-9;
+    return elapsed >= BXILOG__GLOBALS->config->batch_latency_s;
+}
@@ -16,9 +16,15 @@
 
 #include <unistd.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "bxi/base/err.h"
 
+#include "ring_impl.h"
+#include "slab_impl.h"
+
 //*********************************************************************************
 //********************************** Defines **************************************
 //*********************************************************************************
@@ -35,13 +41,33 @@ struct tsd_s {
     size_t sum_log_size;
 
     char *  log_buf;                 // The per-thread log buffer
-    void ** data_channel;             // The thread-specific zmq logging socket;
+    char *  record_buf;              // The per-thread record buffer, when records
+                                     // are copied (rings or no shared records)
+    size_t  record_buf_size;
+    bxilog__slab_p slab;             // Shared records allocator
+    void *  batch;                   // Records not sent yet (batching only)
+    size_t  batch_len;
+    size_t  batch_records_nb;
+    struct timespec batch_start;     // Timestamp of the first batched record
+    pthread_mutex_t batch_lock;      // Held while the batch or the zockets are used:
+                                     // other threads send the batch of idle threads
+    struct tsd_s * batch_prev;       // Registered batches, see bxilog__batch_flush_all()
+    struct tsd_s * batch_next;
+    bool    batch_registered;
+    void ** data_channel;             // The thread-specific zmq logging socket,
+                                      // NULL for shards this thread does not log to
+    size_t  handlers_nb;              // Number of non NULL data channels
+    size_t  shard_key;                // Selects the shard of sharded handlers
+    void ** priority_channel;         // The thread-specific zmq priority logging socket,
+                                      // NULL for handlers without priority lane
     void *  ctrl_channel;             // The thread-specific zmq controlling socket;
+    bxilog__ring_p * rings;           // The thread-specific rings (ring transport only)
 #ifdef __linux__
     pid_t tid;                      // Cache the tid on Linux since we assume NPTL
                                     // and therefore a 1:1 thread implementation.
 #endif
     uintptr_t thread_rank;          // user thread rank
+    struct tsd_s * pool_next;       // Next free tsd, see bxilog_config_s.tsd_pool_size
 };
 
 typedef struct tsd_s * tsd_p;
@@ -63,5 +89,27 @@ void bxilog__tsd_key_new();
 /* Return the thread-specific data.*/
 bxierr_p bxilog__tsd_get(tsd_p * result);
 
+/* Destroy all thread-specific data kept for reuse: must be called before zmq_ctx is */
+void bxilog__tsd_pool_drain(void);
+
+/* Allocate a thread batch buffer, see bxilog_config_s.batch_size */
+void * bxilog__batch_new(size_t batch_size);
+
+/* Send the records batched by the given thread, if any: its batch_lock must be held */
+bxierr_p bxilog__batch_flush(tsd_p tsd);
+
+/*
+ * Send the records batched by all threads, or only the batches whose first record
+ * is older than config->batch_latency_s when expired_only is true.
+ *
+ * Batches being filled by their thread are skipped, unless wait is true. Even then,
+ * the batch of the calling thread is skipped when in use: the thread may be running
+ * a signal handler.
+ */
+bxierr_p bxilog__batch_flush_all(bool expired_only, bool wait);
+
+/* Forget all batches: called once the zockets of other threads are unusable */
+void bxilog__batch_forget_all(void);
+
 
 #endif
@@ -12,11 +12,14 @@
  */
 
 
+// For sched_getaffinity()
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <unistd.h>
 #include <time.h>
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
 #include <libgen.h>
 #include <sysexits.h>
 #include <sys/types.h>
@@ -29,6 +32,9 @@
 #include <signal.h>
 #include <syslog.h>
 #include <inttypes.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/resource.h>
 
 #include <CUnit/Basic.h>
 
@@ -336,6 +342,50 @@ static long _get_filesize(char* name) {
     return info.st_size;
 }
 
+static char * _file_content(int fd) {
+    off_t size = lseek(fd, 0, SEEK_END);
+    bxiassert(0 <= size);
+    char * content = bximem_calloc((size_t) size + 1);
+    ssize_t n = pread(fd, content, (size_t) size, 0);
+    bxiassert(size == n);
+    return content;
+}
+
+static size_t _count_in_file(int fd, const char * str) {
+    char * content = _file_content(fd);
+    size_t count = 0;
+    for (char * p = strstr(content, str); NULL != p; p = strstr(p + 1, str)) count++;
+    BXIFREE(content);
+    return count;
+}
+
+static size_t _lines_in_file(int fd) {
+    return _count_in_file(fd, "\n");
+}
+
+// Check the text of the n-th line of the file is the given format applied to n % modulo,
+// return the number of lines and their total length
+static size_t _check_texts_in_file(const char * filename,
+                                   const char * format, size_t modulo,
+                                   off_t * size) {
+    FILE * file = fopen(filename, "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    char line[1024];
+    size_t n = 0;
+    if (NULL != size) *size = 0;
+    while (NULL != fgets(line, sizeof(line), file)) {
+        if (NULL != size) *size += (off_t) strlen(line);
+        char * text = strrchr(line, '|');
+        CU_ASSERT_PTR_NOT_NULL_FATAL(text);
+        char expected[64];
+        snprintf(expected, sizeof(expected), format, n % modulo);
+        CU_ASSERT_STRING_EQUAL(text + 1, expected);
+        n++;
+    }
+    fclose(file);
+    return n;
+}
+
 void test_logger_existing_file(void) {
     bxilog_config_p config = bxilog_unit_test_config(PROGNAME,
                                                      FULLFILENAME,
@@ -959,16 +1009,8 @@ void test_logger_threads(void) {
     size_t total_expected = 0;
     size_t total_found = 0;
     for (size_t i = 0; i < threads_nb; i++) {
-        size_t lines_nb = 0;
-        off_t rc = lseek(fds[i], 0, SEEK_SET);
-        bxiassert(0 == rc);
         CU_ASSERT_TRUE_FATAL(0 < fds[i]);
-        while(true) {
-            char c;
-            ssize_t n = read(fds[i], &c, 1);
-            if (0 >= n) break;
-            if ('\n' == c) lines_nb++;
-        }
+        const size_t lines_nb = _lines_in_file(fds[i]);
         //    lines_nb++; // Consider the EOF as a new line.
         OUT(TEST_LOGGER,
             "Number of lines expected for logger %s in file %s: %zu, found: %zu",
@@ -992,6 +1034,1704 @@ void test_logger_threads(void) {
 
 }
 
+void test_logger_ring(void) {
+    // Same as test_logger_threads() but using the ring transport, with a small
+    // ring so wrap-around, full ring and oversized records are all exercised.
+    size_t threads_nb = 4;
+    bxilog_logger_p loggers[threads_nb];
+    size_t logs_nb[threads_nb];
+
+    char * filename = strdup("/tmp/test_logger_ring.XXXXXX");
+    int fd = mkstemp(filename);
+    bxiassert(0 < fd);
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    config->transport = BXILOG_TRANSPORT_RING;
+    config->ring_size = 4096;
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              BXILOG_FILTERS_ALL_ALL,
+                              PROGNAME, FULLFILENAME, BXI_APPEND_OPEN_FLAGS);
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.ring", BXILOG_ALL);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+
+    for (size_t i = 0; i < threads_nb; i++) {
+        char * logger_name = bxistr_new("test.ring.counting-%zu", i);
+        bxierr_p err = bxilog_registry_get(logger_name, &loggers[i]);
+        bxierr_abort_ifko(err);
+        BXIFREE(logger_name);
+    }
+
+    bxierr_p err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    pthread_t threads[threads_nb];
+    for (size_t i = 0; i < threads_nb; i++) {
+        int rc = pthread_create(&threads[i], NULL, logging_thread, loggers[i]);
+        CU_ASSERT_TRUE_FATAL(0 == rc);
+    }
+
+    size_t total_log_nb = 0;
+    for (size_t i = 0; i < threads_nb; i++) {
+        int rc = pthread_join(threads[i], (void**)&logs_nb[i]);
+        CU_ASSERT_TRUE_FATAL(0 == rc);
+        total_log_nb += logs_nb[i];
+    }
+
+    // Larger than the ring can hold: must still be processed in order
+    size_t len = config->ring_size;
+    char * big = bximem_calloc(len);
+    memset(big, 'R', len - 1);
+    OUT(loggers[0], "Before the oversized record");
+    OUT(loggers[0], "%s", big);
+    OUT(loggers[0], "After the oversized record");
+    total_log_nb += 3;
+
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    const size_t lines_nb = _lines_in_file(fd);
+    OUT(TEST_LOGGER,
+        "Number of lines expected in file %s: %zu, found: %zu",
+        filename, total_log_nb, lines_nb);
+    CU_ASSERT_TRUE_FATAL(lines_nb == total_log_nb);
+
+    struct stat st;
+    int rc = fstat(fd, &st);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    char * content = bximem_calloc((size_t) st.st_size + 1);
+    ssize_t n = pread(fd, content, (size_t) st.st_size, 0);
+    CU_ASSERT_EQUAL_FATAL(n, st.st_size);
+    char * before = strstr(content, "Before the oversized record");
+    char * oversized = strstr(content, big);
+    char * after = strstr(content, "After the oversized record");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(before);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(oversized);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(after);
+    CU_ASSERT_TRUE(before < oversized);
+    CU_ASSERT_TRUE(oversized < after);
+    BXIFREE(content);
+    BXIFREE(big);
+
+    close(fd);
+    unlink(filename);
+    BXIFREE(filename);
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+void test_logger_batch(void) {
+    // Records are batched by threads: they must all reach the handler,
+    // whatever triggers the sending (size, count, thread exit or flush)
+    size_t threads_nb = 4;
+    bxilog_logger_p loggers[threads_nb];
+    size_t logs_nb[threads_nb];
+
+    char * filename = strdup("/tmp/test_logger_batch.XXXXXX");
+    int fd = mkstemp(filename);
+    bxiassert(0 < fd);
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    config->batch_size = 4096;
+    config->batch_records_max = 16;
+    config->batch_latency_s = 60;
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.batch", BXILOG_ALL);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+
+    for (size_t i = 0; i < threads_nb; i++) {
+        char * logger_name = bxistr_new("test.batch.counting-%zu", i);
+        bxierr_p err = bxilog_registry_get(logger_name, &loggers[i]);
+        bxierr_abort_ifko(err);
+        BXIFREE(logger_name);
+    }
+
+    bxierr_p err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    pthread_t threads[threads_nb];
+    for (size_t i = 0; i < threads_nb; i++) {
+        int rc = pthread_create(&threads[i], NULL, logging_thread, loggers[i]);
+        CU_ASSERT_TRUE_FATAL(0 == rc);
+    }
+
+    size_t total_log_nb = 0;
+    for (size_t i = 0; i < threads_nb; i++) {
+        int rc = pthread_join(threads[i], (void**)&logs_nb[i]);
+        CU_ASSERT_TRUE_FATAL(0 == rc);
+        total_log_nb += logs_nb[i];
+    }
+
+    // Less than a batch: only sent by the flush
+    for (size_t i = 0; i < 3; i++) {
+        OUT(loggers[0], "Batched log %zu", i);
+        total_log_nb++;
+    }
+    // Larger than a batch: sent alone
+    size_t len = 2 * config->batch_size;
+    char * big = bximem_calloc(len);
+    memset(big, 'B', len - 1);
+    OUT(loggers[0], "%s", big);
+    total_log_nb++;
+    BXIFREE(big);
+
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    const size_t lines_nb = _lines_in_file(fd);
+    OUT(TEST_LOGGER,
+        "Number of lines expected in file %s: %zu, found: %zu",
+        filename, total_log_nb, lines_nb);
+    CU_ASSERT_TRUE_FATAL(lines_nb == total_log_nb);
+
+    close(fd);
+    unlink(filename);
+    BXIFREE(filename);
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+#define IDLE_POLL_MAX 500
+
+typedef struct {
+    int to_thread[2];
+    int to_main[2];
+} idle_pipes_s;
+
+static void * _idle_thread(void * arg) {
+    idle_pipes_s * pipes = arg;
+    for (size_t i = 0; i < 2; i++) {
+        OUT(TEST_LOGGER, "Idle thread record %zu", i);
+        char c = 0;
+        ssize_t n = write(pipes->to_main[1], &c, 1);
+        bxiassert(1 == n);
+        // Idle: nothing else would send our batch
+        n = read(pipes->to_thread[0], &c, 1);
+        bxiassert(1 == n);
+    }
+    return NULL;
+}
+
+void test_logger_batch_idle(void) {
+    // Batches of idle threads are sent on time, on flush and on finalize,
+    // whatever thread asks for it
+    for (size_t latency = 0; latency < 2; latency++) {
+        char * filename = strdup("/tmp/test_logger_batch_idle.XXXXXX");
+        int fd = mkstemp(filename);
+        bxiassert(0 < fd);
+
+        bxilog_config_p config = bxilog_config_new(PROGNAME);
+        config->batch_size = 4096;
+        config->batch_records_max = 16;
+        config->batch_latency_s = (0 == latency) ? 0.05 : 60;
+        bxilog_config_add_handler(config,
+                                  BXILOG_FILE_HANDLER,
+                                  BXILOG_FILTERS_ALL_ALL,
+                                  PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+        bxierr_p err = bxilog_init(config);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+        idle_pipes_s pipes;
+        int rc = pipe(pipes.to_thread);
+        bxiassert(0 == rc);
+        rc = pipe(pipes.to_main);
+        bxiassert(0 == rc);
+        pthread_t thread;
+        rc = pthread_create(&thread, NULL, _idle_thread, &pipes);
+        CU_ASSERT_TRUE_FATAL(0 == rc);
+
+        char c = 0;
+        ssize_t n = read(pipes.to_main[0], &c, 1);
+        bxiassert(1 == n);
+        if (0 == latency) {
+            // Sent by the timer thread
+            size_t found = 0;
+            for (size_t i = 0; i < IDLE_POLL_MAX && 0 == found; i++) {
+                err = bxitime_sleep(CLOCK_MONOTONIC, 0, 10000000);
+                bxierr_abort_ifko(err);
+                found = _count_in_file(fd, "Idle thread record 0");
+            }
+            CU_ASSERT_EQUAL(found, 1);
+        } else {
+            err = bxilog_flush();
+            CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+            CU_ASSERT_EQUAL(_count_in_file(fd, "Idle thread record 0"), 1);
+        }
+
+        n = write(pipes.to_thread[1], &c, 1);
+        bxiassert(1 == n);
+        n = read(pipes.to_main[0], &c, 1);
+        bxiassert(1 == n);
+        err = bxilog_finalize(true);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+        CU_ASSERT_EQUAL(_count_in_file(fd, "Idle thread record 1"), 1);
+
+        n = write(pipes.to_thread[1], &c, 1);
+        bxiassert(1 == n);
+        rc = pthread_join(thread, NULL);
+        CU_ASSERT_TRUE_FATAL(0 == rc);
+        close(pipes.to_thread[0]);
+        close(pipes.to_thread[1]);
+        close(pipes.to_main[0]);
+        close(pipes.to_main[1]);
+
+        close(fd);
+        unlink(filename);
+        BXIFREE(filename);
+    }
+}
+
+void test_logger_deferred(void) {
+    char * filename = strdup("/tmp/test_logger_deferred.XXXXXX");
+    int fd = mkstemp(filename);
+    bxiassert(0 < fd);
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    config->deferred_formatting = true;
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              BXILOG_FILTERS_ALL_ALL,
+                              PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+
+    bxierr_p err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    char * volatile_str = strdup("volatile");
+    OUT(TEST_LOGGER, "deferred: %d %u %ld %zu %hhd %x %c", -1, 2u, -3L, (size_t) 4,
+        (signed char) 5, 0xbeef, 'z');
+    OUT(TEST_LOGGER, "deferred: %.2f %e %Lg %p", 3.14159, 1e10, (long double) 0.5,
+        (void *) NULL);
+    OUT(TEST_LOGGER, "deferred: [%s] [%.3s] [%*d] [%-*.*s] %%", volatile_str, "abcdef",
+        5, 42, 6, 2, "xyz");
+    // Modified after the call: the string must have been copied
+    volatile_str[0] = 'V';
+    // Positional arguments are not deferred: formatted by the caller
+    OUT(TEST_LOGGER, "eager: %2$s %1$s", "world", "hello");
+    // Larger than the thread local buffer
+    size_t len = config->tsd_log_buf_size * 2;
+    char * big = bximem_calloc(len);
+    memset(big, 'D', len - 1);
+    OUT(TEST_LOGGER, "deferred big: %s", big);
+
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    struct stat sb;
+    int rc = fstat(fd, &sb);
+    CU_ASSERT_TRUE_FATAL(0 == rc);
+    char * content = bximem_calloc((size_t) sb.st_size + 1);
+    ssize_t n = read(fd, content, (size_t) sb.st_size);
+    CU_ASSERT_TRUE_FATAL(n == sb.st_size);
+
+    CU_ASSERT_PTR_NOT_NULL(strstr(content, "deferred: -1 2 -3 4 5 beef z"));
+    char * expected = bxistr_new("deferred: 3.14 %e %Lg %p", 1e10, (long double) 0.5,
+                                 (void *) NULL);
+    CU_ASSERT_PTR_NOT_NULL(strstr(content, expected));
+    BXIFREE(expected);
+    CU_ASSERT_PTR_NOT_NULL(strstr(content, "deferred: [volatile] [abc] [   42] [xy    ] %"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(content, "eager: hello world"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(content, big));
+
+    BXIFREE(content);
+    BXIFREE(big);
+    BXIFREE(volatile_str);
+    close(fd);
+    unlink(filename);
+    BXIFREE(filename);
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+void test_logger_site(void) {
+    char * filename = strdup("/tmp/test_logger_site.XXXXXX");
+    int fd = mkstemp(filename);
+    bxiassert(0 < fd);
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              BXILOG_FILTERS_ALL_ALL,
+                              PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+
+    bxierr_p err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    // Records only carry the site id, the handler must resolve it
+    int site_line = 0;
+    for (size_t i = 0; i < 3; i++) {
+        site_line = __LINE__ + 1;
+        OUT(TEST_LOGGER, "From a site: %zu", i);
+    }
+    // As a site of a module unloaded while its records are queued
+    bxilog_site_p site = bximem_calloc(sizeof(*site));
+    site->fullfilename = strdup("unloaded/module.c");
+    site->fullfilename_len = ARRAYLEN("unloaded/module.c");
+    site->funcname = strdup("unloaded_func");
+    site->funcname_len = ARRAYLEN("unloaded_func");
+    site->line = 7;
+    err = bxilog_logger_log_site_nolevelcheck(TEST_LOGGER, BXILOG_OUTPUT, site,
+                                              "From an unloaded site");
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    memset((char *) site->fullfilename, 'X', site->fullfilename_len - 1);
+    memset((char *) site->funcname, 'X', site->funcname_len - 1);
+    BXIFREE(site->fullfilename);
+    BXIFREE(site->funcname);
+    BXIFREE(site);
+    // Without a site, filename and funcname are in the record
+    bxilog_logger_log(TEST_LOGGER, BXILOG_OUTPUT,
+                      "dynamic/file.c", ARRAYLEN("dynamic/file.c"),
+                      "dynamic_func", ARRAYLEN("dynamic_func"), 42,
+                      "Not from a site");
+
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    struct stat sb;
+    int rc = fstat(fd, &sb);
+    CU_ASSERT_TRUE_FATAL(0 == rc);
+    char * content = bximem_calloc((size_t) sb.st_size + 1);
+    ssize_t n = read(fd, content, (size_t) sb.st_size);
+    CU_ASSERT_TRUE_FATAL(n == sb.st_size);
+
+    char * expected = bxistr_new("|test_logger.c:%d@%s|", site_line, __func__);
+    CU_ASSERT_PTR_NOT_NULL(strstr(content, expected));
+    BXIFREE(expected);
+    CU_ASSERT_PTR_NOT_NULL(strstr(content, "From a site: 2"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(content, "|module.c:7@unloaded_func|"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(content, "|file.c:42@dynamic_func|"));
+
+    BXIFREE(content);
+    close(fd);
+    unlink(filename);
+    BXIFREE(filename);
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+void test_logger_alloc_stats(void) {
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    config->slab_max_size = 1024;
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              BXILOG_FILTERS_ALL_ALL,
+                              PROGNAME, FULLFILENAME, BXI_APPEND_OPEN_FLAGS);
+    bxierr_p err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    bxilog_alloc_stats_s before;
+    bxilog_get_alloc_stats(&before);
+
+    for (size_t i = 0; i < 100; i++) {
+        OUT(TEST_LOGGER, "Small records come from the slab: %zu", i);
+    }
+    // Larger than the default too, in case this thread slab already exists
+    size_t len = 8 * config->slab_max_size;
+    char * big = bximem_calloc(len);
+    memset(big, 'S', len - 1);
+    OUT(TEST_LOGGER, "%s", big);
+    BXIFREE(big);
+
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    bxilog_alloc_stats_s after;
+    bxilog_get_alloc_stats(&after);
+    CU_ASSERT_TRUE(after.slab_bytes > 0);
+    CU_ASSERT_TRUE(after.oversize_nb > before.oversize_nb);
+    CU_ASSERT_TRUE(after.oversize_max >= len);
+
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+void test_logger_backpressure(void) {
+    char * filenames[2] = {strdup("/tmp/test_logger_backpressure_newest.XXXXXX"),
+                           strdup("/tmp/test_logger_backpressure_level.XXXXXX")};
+    int fds[2];
+    for (size_t i = 0; i < 2; i++) {
+        fds[i] = mkstemp(filenames[i]);
+        bxiassert(0 < fds[i]);
+    }
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.backpressure", BXILOG_ALL);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filenames[0], BXI_APPEND_OPEN_FLAGS);
+    filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.backpressure.level", BXILOG_ALL);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filenames[1], BXI_APPEND_OPEN_FLAGS);
+    CU_ASSERT_EQUAL(config->handlers_params[0]->backpressure,
+                    BXILOG_BACKPRESSURE_BLOCK);
+    config->handlers_params[0]->backpressure = BXILOG_BACKPRESSURE_DROP_NEWEST;
+    config->handlers_params[0]->data_hwm = 10;
+    config->handlers_params[1]->backpressure = BXILOG_BACKPRESSURE_DROP_BELOW_LEVEL;
+    config->handlers_params[1]->backpressure_level = BXILOG_WARNING;
+    config->handlers_params[1]->data_hwm = 10;
+
+    bxilog_logger_p newest_logger, level_logger;
+    bxierr_p err = bxilog_registry_get("test.backpressure.newest", &newest_logger);
+    bxierr_abort_ifko(err);
+    err = bxilog_registry_get("test.backpressure.level", &level_logger);
+    bxierr_abort_ifko(err);
+
+    err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    // Whether handlers are actually saturated or not, records are either
+    // written or accounted as dropped
+    size_t out_nb = 0, warning_nb = 0;
+    for (size_t i = 0; i < 10000; i++) {
+        if (0 == i % 10) {
+            WARNING(level_logger, "Never dropped silently %zu", i);
+            warning_nb++;
+        } else {
+            OUT(newest_logger, "May be dropped %zu", i);
+            out_nb++;
+        }
+    }
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    bxilog_drop_stats_s stats[2];
+    for (size_t i = 0; i < 2; i++) {
+        err = bxilog_get_drop_stats(i, &stats[i]);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+        CU_ASSERT_EQUAL(stats[i].oldest_nb, 0);
+    }
+    CU_ASSERT_EQUAL(stats[0].below_level_nb, 0);
+    CU_ASSERT_EQUAL(stats[0].overflow_nb, 0);
+    CU_ASSERT_EQUAL(stats[1].newest_nb, 0);
+    err = bxilog_get_drop_stats(2, &stats[0]);
+    CU_ASSERT_TRUE(bxierr_isko(err));
+    bxierr_destroy(&err);
+
+    size_t lines_nb[2];
+    for (size_t i = 0; i < 2; i++) {
+        lines_nb[i] = _lines_in_file(fds[i]);
+        close(fds[i]);
+        unlink(filenames[i]);
+        BXIFREE(filenames[i]);
+    }
+    OUT(TEST_LOGGER,
+        "Backpressure: %zu/%zu lines written, %zu dropped (newest), "
+        "%zu/%zu lines written, %zu dropped (below level), %zu (overflow)",
+        lines_nb[0], out_nb + warning_nb, stats[0].newest_nb,
+        lines_nb[1], warning_nb, stats[1].below_level_nb, stats[1].overflow_nb);
+    // Internal logs may also have been dropped
+    CU_ASSERT_TRUE(lines_nb[0] <= out_nb + warning_nb);
+    CU_ASSERT_TRUE(lines_nb[0] + stats[0].newest_nb >= out_nb + warning_nb);
+    // Kept records are not waited for either, but their loss is accounted
+    CU_ASSERT_EQUAL(lines_nb[1] + stats[1].overflow_nb, warning_nb);
+
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    err = bxilog_get_drop_stats(0, &stats[0]);
+    CU_ASSERT_TRUE(bxierr_isko(err));
+    bxierr_destroy(&err);
+}
+
+#define OLDEST_LOGS_NB 100
+
+static void * _oldest_thread(void * arg) {
+    bxilog_logger_p logger = arg;
+    for (size_t i = 0; i < OLDEST_LOGS_NB; i++) {
+        OUT(logger, "After the episode %zu", i);
+        // Never saturate the handler again
+        bxierr_p err = bxilog_flush();
+        bxierr_abort_ifko(err);
+    }
+    return NULL;
+}
+
+void test_logger_backpressure_oldest(void) {
+    char * filename = strdup("/tmp/test_logger_backpressure_oldest.XXXXXX");
+    int fd = mkstemp(filename);
+    bxiassert(0 < fd);
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.backpressure.oldest", BXILOG_ALL);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+    config->handlers_params[0]->backpressure = BXILOG_BACKPRESSURE_DROP_OLDEST;
+    config->handlers_params[0]->data_hwm = 10;
+
+    bxilog_logger_p logger;
+    bxierr_p err = bxilog_registry_get("test.backpressure.oldest", &logger);
+    bxierr_abort_ifko(err);
+
+    err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    // Saturate the handler so it is asked to skip its backlog
+    const size_t logs_nb = 10000;
+    for (size_t i = 0; i < logs_nb; i++) {
+        OUT(logger, "May be dropped %zu", i);
+    }
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    bxilog_drop_stats_s before;
+    err = bxilog_get_drop_stats(0, &before);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    // Once the backlog has been skipped, nothing is dropped anymore,
+    // whatever the thread and the timestamp of the records
+    pthread_t thread;
+    int rc = pthread_create(&thread, NULL, _oldest_thread, logger);
+    CU_ASSERT_TRUE_FATAL(0 == rc);
+    rc = pthread_join(thread, NULL);
+    CU_ASSERT_TRUE_FATAL(0 == rc);
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    bxilog_drop_stats_s after;
+    err = bxilog_get_drop_stats(0, &after);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    CU_ASSERT_EQUAL(after.oldest_nb, before.oldest_nb);
+    CU_ASSERT_EQUAL(after.overflow_nb, before.overflow_nb);
+
+    const size_t lines_nb = _lines_in_file(fd);
+    const size_t after_nb = _count_in_file(fd, "|After the episode ");
+    close(fd);
+    OUT(TEST_LOGGER, "Backpressure: %zu/%zu lines written, %zu dropped (oldest), "
+        "%zu (overflow)",
+        lines_nb, logs_nb + OLDEST_LOGS_NB, after.oldest_nb, after.overflow_nb);
+    CU_ASSERT_EQUAL(after_nb, OLDEST_LOGS_NB);
+    CU_ASSERT_TRUE(lines_nb + after.oldest_nb + after.overflow_nb
+                   >= logs_nb + OLDEST_LOGS_NB);
+
+    unlink(filename);
+    BXIFREE(filename);
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+void test_logger_priority(void) {
+    char * filename = strdup("/tmp/test_logger_priority.XXXXXX");
+    int fd = mkstemp(filename);
+    bxiassert(0 < fd);
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    // Priority records must bypass batches
+    config->batch_size = 4096;
+    config->batch_latency_s = 60;
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.priority", BXILOG_ALL);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+    CU_ASSERT_EQUAL(config->handlers_params[0]->priority_level, BXILOG_OFF);
+    config->handlers_params[0]->priority_level = BXILOG_ERROR;
+    config->handlers_params[0]->priority_hwm = 100;
+
+    bxilog_logger_p logger;
+    bxierr_p err = bxilog_registry_get("test.priority", &logger);
+    bxierr_abort_ifko(err);
+
+    err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    size_t total_nb = 0, priority_nb = 0;
+    for (size_t i = 0; i < 1000; i++) {
+        if (0 == i % 100) {
+            ERROR(logger, "Priority record %zu", i);
+            priority_nb++;
+        } else {
+            DEBUG(logger, "Normal record %zu", i);
+        }
+        total_nb++;
+    }
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    bxilog_lane_stats_s normal, priority;
+    err = bxilog_get_lane_stats(0, false, &normal);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    err = bxilog_get_lane_stats(0, true, &priority);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    OUT(TEST_LOGGER,
+        "Normal lane: %zu processed, %zu max queued. "
+        "Priority lane: %zu processed, %zu max queued",
+        normal.processed_nb, normal.queued_max,
+        priority.processed_nb, priority.queued_max);
+    CU_ASSERT_EQUAL(priority.processed_nb, priority_nb);
+    CU_ASSERT_EQUAL(priority.queued_nb, 0);
+    CU_ASSERT_TRUE(priority.queued_max >= 1);
+    CU_ASSERT_TRUE(normal.processed_nb > 0);
+    CU_ASSERT_TRUE(normal.queued_max >= 1);
+    err = bxilog_get_lane_stats(1, true, &priority);
+    CU_ASSERT_TRUE(bxierr_isko(err));
+    bxierr_destroy(&err);
+
+    // Lanes do not lose anything
+    const size_t lines_nb = _lines_in_file(fd);
+    CU_ASSERT_EQUAL(lines_nb, total_nb);
+
+    close(fd);
+    unlink(filename);
+    BXIFREE(filename);
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+static void * _get_thread_rank(void * arg) {
+    bxierr_p * err_p = arg;
+    uintptr_t rank;
+    *err_p = bxilog_get_thread_rank(&rank);
+    return NULL;
+}
+
+void test_logger_tsd_pool(void) {
+    // Threads reusing the data of exited ones must not lose any record,
+    // whatever the transport
+    bxilog_transport_e transports[] = {BXILOG_TRANSPORT_ZMQ, BXILOG_TRANSPORT_RING};
+    for (size_t t = 0; t < ARRAYLEN(transports); t++) {
+        char * filename = strdup("/tmp/test_logger_tsd_pool.XXXXXX");
+        int fd = mkstemp(filename);
+        bxiassert(0 < fd);
+
+        bxilog_config_p config = bxilog_config_new(PROGNAME);
+        config->transport = transports[t];
+        // Less than threads of a round: some are pooled, others are destroyed
+        config->tsd_pool_size = 2;
+        bxilog_filters_p filters = bxilog_filters_new();
+        bxilog_filters_add(&filters, "test.tsd_pool", BXILOG_ALL);
+        bxilog_config_add_handler(config,
+                                  BXILOG_FILE_HANDLER,
+                                  filters,
+                                  PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+
+        bxilog_logger_p logger;
+        bxierr_p err = bxilog_registry_get("test.tsd_pool", &logger);
+        bxierr_abort_ifko(err);
+
+        err = bxilog_init(config);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+        size_t total_log_nb = 0;
+        for (size_t round = 0; round < 3; round++) {
+            size_t threads_nb = 4;
+            pthread_t threads[threads_nb];
+            for (size_t i = 0; i < threads_nb; i++) {
+                int rc = pthread_create(&threads[i], NULL, logging_thread, logger);
+                CU_ASSERT_TRUE_FATAL(0 == rc);
+            }
+            for (size_t i = 0; i < threads_nb; i++) {
+                size_t log_nb;
+                int rc = pthread_join(threads[i], (void**)&log_nb);
+                CU_ASSERT_TRUE_FATAL(0 == rc);
+                total_log_nb += log_nb;
+            }
+        }
+        err = bxilog_flush();
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+        const size_t lines_nb = _lines_in_file(fd);
+        OUT(TEST_LOGGER,
+            "Number of lines expected in file %s: %zu, found: %zu",
+            filename, total_log_nb, lines_nb);
+        CU_ASSERT_EQUAL(lines_nb, total_log_nb);
+
+        close(fd);
+        unlink(filename);
+        BXIFREE(filename);
+        err = bxilog_finalize(true);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    }
+
+    // Once finalized, a new thread gets an error instead of a pooled tsd
+    pthread_t thread;
+    bxierr_p thread_err = BXIERR_OK;
+    int rc = pthread_create(&thread, NULL, _get_thread_rank, &thread_err);
+    CU_ASSERT_TRUE_FATAL(0 == rc);
+    rc = pthread_join(thread, NULL);
+    CU_ASSERT_TRUE_FATAL(0 == rc);
+    CU_ASSERT_TRUE(bxierr_isko(thread_err));
+    bxierr_destroy(&thread_err);
+}
+
+void test_logger_ratelimit(void) {
+    char * filename = strdup("/tmp/test_logger_ratelimit.XXXXXX");
+    int fd = mkstemp(filename);
+    bxiassert(0 < fd);
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.ratelimit", BXILOG_ALL);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+
+    bxilog_logger_p logger, sampled;
+    bxierr_p err = bxilog_registry_get("test.ratelimit", &logger);
+    bxierr_abort_ifko(err);
+    err = bxilog_registry_get("test.ratelimit.sampled", &sampled);
+    bxierr_abort_ifko(err);
+
+    err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    // Far below the loop rate: only the burst goes through
+    for (size_t i = 0; i < 1000; i++) {
+        bxilog_site_log_ratelimit(logger, BXILOG_WARNING, 0.001, 5, "Limited record %zu", i);
+    }
+    for (size_t i = 0; i < 1000; i++) {
+        bxilog_site_log_sample(logger, BXILOG_WARNING, 10, "Site sampled record %zu", i);
+    }
+    bxilog_logger_set_sampling(sampled, 100);
+    for (size_t i = 0; i < 1000; i++) {
+        DEBUG(sampled, "Logger sampled record %zu", i);
+    }
+    // Logs without call site share the logger limiter
+    bxilog_logger_set_sampling(sampled, 0);
+    bxilog_logger_set_ratelimit(sampled, 0.001, 3);
+    for (size_t i = 0; i < 1000; i++) {
+        bxilog_logger_log(sampled, BXILOG_DEBUG, __FILE__, ARRAYLEN(__FILE__),
+                          __func__, ARRAYLEN(__func__), __LINE__,
+                          "Logger limited record %zu", i);
+    }
+    bxilog_logger_set_ratelimit(sampled, 0, 0);
+
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    CU_ASSERT_EQUAL(_count_in_file(fd, "Limited record"), 5);
+    CU_ASSERT_EQUAL(_count_in_file(fd, "Site sampled record"), 100);
+    CU_ASSERT_EQUAL(_count_in_file(fd, "Logger sampled record"), 10);
+    CU_ASSERT_EQUAL(_count_in_file(fd, "Logger limited record"), 3);
+    // Each limiter reported its first suppressed log at least
+    CU_ASSERT_TRUE(_count_in_file(fd, "suppressed by rate limiting") >= 4);
+
+    close(fd);
+    unlink(filename);
+    BXIFREE(filename);
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+void test_logger_ratelimit_report(void) {
+    char * filename = strdup("/tmp/test_logger_ratelimit_report.XXXXXX");
+    int fd = mkstemp(filename);
+    bxiassert(0 < fd);
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.ratelimit", BXILOG_ALL);
+    // Periodic reports come from the library
+    bxilog_filters_add(&filters, BXILOG_LIB_PREFIX "bxilog", BXILOG_NOTICE);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+
+    bxilog_logger_p logger;
+    bxierr_p err = bxilog_registry_get("test.ratelimit.report", &logger);
+    bxierr_abort_ifko(err);
+
+    err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    // A short burst: the first suppressed log is reported at once, the next ones
+    // are not since the burst stops before the report period
+    bxilog_logger_set_ratelimit(logger, 0.001, 1);
+    for (size_t i = 0; i < 10; i++) {
+        bxilog_logger_log(logger, BXILOG_OUTPUT, __FILE__, ARRAYLEN(__FILE__),
+                          __func__, ARRAYLEN(__func__), __LINE__,
+                          "Burst record %zu", i);
+    }
+    // Reported nonetheless once the period elapsed
+    struct timespec delay = {.tv_sec = 1, .tv_nsec = 500000000};
+    nanosleep(&delay, NULL);
+    bxilog_logger_set_ratelimit(logger, 0, 0);
+
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    CU_ASSERT_EQUAL(_count_in_file(fd, "Burst record"), 1);
+    CU_ASSERT_TRUE(_count_in_file(fd, "Logger test.ratelimit.report: ") >= 1);
+    CU_ASSERT_EQUAL(logger->ratelimit.suppressed_nb, 0);
+
+    close(fd);
+    unlink(filename);
+    BXIFREE(filename);
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+static size_t _site_cache_round(bxilog_level_e filter_level) {
+    char * filename = strdup("/tmp/test_logger_site_cache.XXXXXX");
+    int fd = mkstemp(filename);
+    bxiassert(0 < fd);
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.site_cache", filter_level);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+
+    bxilog_logger_p logger;
+    bxierr_p err = bxilog_registry_get("test.site_cache", &logger);
+    bxierr_abort_ifko(err);
+
+    err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    // More detailed than what the handler accepts
+    bxilog_logger_set_level(logger, BXILOG_LOWEST);
+
+    for (size_t i = 0; i < 100; i++) {
+        DEBUG(logger, "Debug record %zu", i);
+        if (0 == i % 10) WARNING(logger, "Warning record %zu", i);
+    }
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    bxilog_lane_stats_s stats;
+    err = bxilog_get_lane_stats(0, false, &stats);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    const size_t lines_nb = _lines_in_file(fd);
+    // Records are not even sent when the handler would discard them
+    CU_ASSERT_EQUAL(stats.processed_nb, lines_nb);
+
+    close(fd);
+    unlink(filename);
+    BXIFREE(filename);
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    return lines_nb;
+}
+
+void test_logger_site_cache(void) {
+    CU_ASSERT_EQUAL(_site_cache_round(BXILOG_WARNING), 10);
+    // The same sites must see the new configuration
+    CU_ASSERT_EQUAL(_site_cache_round(BXILOG_DEBUG), 110);
+    CU_ASSERT_EQUAL(_site_cache_round(BXILOG_WARNING), 10);
+}
+
+void test_logger_filter_table(void) {
+    char * filename = strdup("/tmp/test_logger_filter_table.XXXXXX");
+    int fd = mkstemp(filename);
+    bxiassert(0 < fd);
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_filters_p filters;
+    bxierr_p err = bxilog_filters_parse("test.filter_table:warning,"
+                                        "test.filter_table.detailed:debug,"
+                                        "test.filter_table.detailed.off:off",
+                                        &filters);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+
+    const char * names[] = {"test.filter_table", "test.filter_table.detailed",
+                            "test.filter_table.detailedx", "test.filter_table.detailed.off",
+                            "test.filter"};
+    const size_t expected[] = {1, 2, 2, 0, 0};
+    bxilog_logger_p loggers[ARRAYLEN(names)];
+    for (size_t l = 0; l < ARRAYLEN(names); l++) {
+        err = bxilog_registry_get(names[l], &loggers[l]);
+        bxierr_abort_ifko(err);
+    }
+
+    err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    size_t expected_nb = 0;
+    for (size_t l = 0; l < ARRAYLEN(names); l++) {
+        // Send everything: filtering is left to the handler
+        bxilog_logger_set_level(loggers[l], BXILOG_LOWEST);
+        for (size_t i = 0; i < 10; i++) {
+            bxilog_logger_log(loggers[l], BXILOG_WARNING, __FILE__, ARRAYLEN(__FILE__),
+                              __func__, ARRAYLEN(__func__), __LINE__,
+                              "Warning record %zu", i);
+            bxilog_logger_log(loggers[l], BXILOG_DEBUG, __FILE__, ARRAYLEN(__FILE__),
+                              __func__, ARRAYLEN(__func__), __LINE__,
+                              "Debug record %zu", i);
+        }
+        expected_nb += 10 * expected[l];
+    }
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    const size_t lines_nb = _lines_in_file(fd);
+    CU_ASSERT_EQUAL(lines_nb, expected_nb);
+
+    close(fd);
+    unlink(filename);
+    BXIFREE(filename);
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+void test_registry_many(void) {
+    const size_t n = 5000;
+    bxilog_logger_p * created = bximem_calloc(n * sizeof(*created));
+    for (size_t i = 0; i < n; i++) {
+        char * name = bxistr_new("test.registry.many.%zu", i);
+        bxierr_p err = bxilog_registry_get(name, &created[i]);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+        CU_ASSERT_STRING_EQUAL(created[i]->name, name);
+        BXIFREE(name);
+    }
+    // Lookups return the same instances
+    for (size_t i = 0; i < n; i++) {
+        char * name = bxistr_new("test.registry.many.%zu", i);
+        bxilog_logger_p logger;
+        bxierr_p err = bxilog_registry_get(name, &logger);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+        CU_ASSERT_PTR_EQUAL(logger, created[i]);
+        BXIFREE(name);
+    }
+
+    bxilog_logger_p * loggers;
+    size_t loggers_nb = bxilog_registry_getall(&loggers);
+    CU_ASSERT_TRUE(loggers_nb >= n);
+    size_t found_nb = 0;
+    for (size_t i = 0; i < loggers_nb; i++) {
+        if (0 < i) CU_ASSERT_TRUE(0 <= strcmp(loggers[i]->name, loggers[i - 1]->name));
+        if (0 == strncmp(loggers[i]->name, "test.registry.many.",
+                         strlen("test.registry.many."))) found_nb++;
+    }
+    CU_ASSERT_EQUAL(found_nb, n);
+    BXIFREE(loggers);
+
+    // Deleted loggers are not found anymore, others still are
+    bxilog_registry_del(created[0]);
+    CU_ASSERT_FALSE(_is_logger_in_registered(created[0]));
+    CU_ASSERT_TRUE(_is_logger_in_registered(created[1]));
+    bxilog_logger_p logger;
+    bxierr_p err = bxilog_registry_get("test.registry.many.0", &logger);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    CU_ASSERT_PTR_NOT_EQUAL(logger, created[0]);
+    bxilog_logger_free(created[0]);
+
+    BXIFREE(created);
+}
+
+void test_logger_bulk_reconfigure(void) {
+    const size_t handlers_nb = 3, filters_nb = 50, loggers_nb = 2000;
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    for (size_t h = 0; h < handlers_nb; h++) {
+        bxilog_filters_p filters = bxilog_filters_new();
+        for (size_t f = 0; f < filters_nb; f++) {
+            // Nested prefixes, some of them shared by several handlers
+            char * prefix = bxistr_new("test.bulk.%zu.%zu", (f * 7 + h) % 10, f % 5);
+            bxilog_filters_add(&filters, 0 == f % 10 ? "test.bulk." : prefix,
+                               (bxilog_level_e) ((f + h) % BXILOG_LOWEST + 1));
+            BXIFREE(prefix);
+        }
+        bxilog_config_add_handler(config, BXILOG_NULL_HANDLER, filters);
+    }
+
+    bxilog_logger_p * loggers = bximem_calloc(loggers_nb * sizeof(*loggers));
+    for (size_t l = 0; l < loggers_nb; l++) {
+        char * name = bxistr_new("test.bulk.%zu.%zu.%zu", l % 11, l % 6, l);
+        bxierr_p err = bxilog_registry_get(name, &loggers[l]);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+        BXIFREE(name);
+    }
+
+    struct timespec start;
+    bxierr_p err = bxitime_get(CLOCK_MONOTONIC, &start);
+    bxierr_abort_ifko(err);
+    // Reconfigures all loggers at once
+    err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    double duration;
+    err = bxitime_duration(CLOCK_MONOTONIC, start, &duration);
+    bxierr_abort_ifko(err);
+    OUT(TEST_LOGGER, "Initialization with %zu loggers: %f s", loggers_nb, duration);
+
+    // Same levels as one logger at a time
+    for (size_t l = 0; l < loggers_nb; l++) {
+        const bxilog_level_e level = loggers[l]->level;
+        bxilog_logger_reconfigure(loggers[l]);
+        CU_ASSERT_EQUAL(loggers[l]->level, level);
+    }
+    BXIFREE(loggers);
+
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+static size_t BATCH_RECORDS_NB = 0;
+static size_t BATCH_SIZE_MAX = 0;
+
+static bxilog_handler_param_p _batch_param_new(bxilog_handler_p self,
+                                               bxilog_filters_p filters,
+                                               va_list ap) {
+    UNUSED(ap);
+    bxilog_handler_param_p result = bximem_calloc(sizeof(*result));
+    bxilog_handler_init_param(self, filters, result);
+    return result;
+}
+
+static bxierr_p _batch_process_log_batch(bxilog_batch_entry_p entries, size_t n,
+                                         bxilog_handler_param_p param) {
+    UNUSED(param);
+    for (size_t i = 0; i < n; i++) {
+        if (0 != strcmp(entries[i].loggername, "test.batch")) continue;
+        __atomic_add_fetch(&BATCH_RECORDS_NB, 1, __ATOMIC_RELAXED);
+    }
+    if (n > __atomic_load_n(&BATCH_SIZE_MAX, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&BATCH_SIZE_MAX, n, __ATOMIC_RELAXED);
+    }
+    return BXIERR_OK;
+}
+
+static bxierr_p _batch_process_ierr(bxierr_p * err, bxilog_handler_param_p param) {
+    UNUSED(param);
+    UNUSED(err);
+    return BXIERR_OK;
+}
+
+static bxierr_p _batch_noop(bxilog_handler_param_p param) {
+    UNUSED(param);
+    return BXIERR_OK;
+}
+
+static bxierr_p _batch_param_destroy(bxilog_handler_param_p * param_p) {
+    bxilog_handler_clean_param(*param_p);
+    bximem_destroy((char**) param_p);
+    return BXIERR_OK;
+}
+
+static const bxilog_handler_s BATCH_HANDLER_S = {
+                  .name = "Test Batch Handler",
+                  .param_new = _batch_param_new,
+                  .init = _batch_noop,
+                  .process_log_batch = _batch_process_log_batch,
+                  .process_ierr = _batch_process_ierr,
+                  .process_implicit_flush = _batch_noop,
+                  .process_explicit_flush = _batch_noop,
+                  .process_exit = _batch_noop,
+                  .process_cfg = _batch_noop,
+                  .param_destroy = _batch_param_destroy,
+};
+
+void test_handler_batch(void) {
+    const size_t logs_nb = 10000;
+    BATCH_RECORDS_NB = 0;
+    BATCH_SIZE_MAX = 0;
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_config_add_handler(config, (bxilog_handler_p) &BATCH_HANDLER_S,
+                              BXILOG_FILTERS_ALL_ALL);
+    bxierr_p err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    bxilog_logger_p logger;
+    err = bxilog_registry_get("test.batch", &logger);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    for (size_t i = 0; i < logs_nb; i++) {
+        OUT(logger, "Batched log %zu", i);
+    }
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    // Every record is given exactly once, by batches of bounded size
+    CU_ASSERT_EQUAL(__atomic_load_n(&BATCH_RECORDS_NB, __ATOMIC_RELAXED), logs_nb);
+    const size_t size_max = __atomic_load_n(&BATCH_SIZE_MAX, __ATOMIC_RELAXED);
+    CU_ASSERT_TRUE(0 < size_max);
+    CU_ASSERT_TRUE(BXILOG_HANDLER_BATCH_MAX >= size_max);
+
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+#define SHARDED_THREADS_NB 6
+#define SHARDED_LOGS_NB 100
+
+static void * _sharded_thread(void * arg) {
+    const size_t rank = (size_t) arg;
+    bxilog_logger_p logger;
+    bxierr_p err = bxilog_registry_get("test.sharded", &logger);
+    bxierr_abort_ifko(err);
+    for (size_t i = 0; i < SHARDED_LOGS_NB; i++) {
+        OUT(logger, "Sharded thread %zu record %zu", rank, i);
+    }
+    return NULL;
+}
+
+void test_handler_sharded(void) {
+    const size_t shards_nb = 3;
+    char * filename = bxistr_new("/tmp/test_handler_sharded.%d", getpid());
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.sharded", BXILOG_ALL);
+    bxilog_config_add_sharded_handler(config, shards_nb,
+                                      BXILOG_FILE_HANDLER,
+                                      filters,
+                                      PROGNAME, filename, BXI_TRUNC_OPEN_FLAGS);
+    bxierr_p err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    pthread_t threads[SHARDED_THREADS_NB];
+    for (size_t t = 0; t < SHARDED_THREADS_NB; t++) {
+        int rc = pthread_create(&threads[t], NULL, _sharded_thread, (void *) t);
+        bxiassert(0 == rc);
+    }
+    for (size_t t = 0; t < SHARDED_THREADS_NB; t++) {
+        int rc = pthread_join(threads[t], NULL);
+        bxiassert(0 == rc);
+    }
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    // All records of a thread are in a single segment
+    size_t found[SHARDED_THREADS_NB] = { 0 };
+    for (size_t shard = 0; shard < shards_nb; shard++) {
+        char * segment = bxistr_new("%s.%zu", filename, shard);
+        int fd = open(segment, O_RDONLY);
+        CU_ASSERT_TRUE_FATAL(0 <= fd);
+        for (size_t t = 0; t < SHARDED_THREADS_NB; t++) {
+            char * str = bxistr_new("Sharded thread %zu record", t);
+            const size_t n = _count_in_file(fd, str);
+            CU_ASSERT_TRUE(0 == n || SHARDED_LOGS_NB == n);
+            found[t] += n;
+            BXIFREE(str);
+        }
+        close(fd);
+        unlink(segment);
+        BXIFREE(segment);
+    }
+    for (size_t t = 0; t < SHARDED_THREADS_NB; t++) {
+        CU_ASSERT_EQUAL(found[t], SHARDED_LOGS_NB);
+    }
+    BXIFREE(filename);
+}
+
+#define POOL_LOGS_NB 1000
+
+void test_handler_pool(void) {
+    char * filename1 = bxistr_new("/tmp/test_handler_pool1.%d", getpid());
+    char * filename2 = bxistr_new("/tmp/test_handler_pool2.%d", getpid());
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    // Three handlers in a single thread
+    config->handler_threads_nb = 1;
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.pool", BXILOG_ALL);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filename1, BXI_TRUNC_OPEN_FLAGS);
+    bxilog_config_add_handler(config,
+                              BXILOG_NULL_HANDLER,
+                              bxilog_filters_dup(filters));
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              bxilog_filters_dup(filters),
+                              PROGNAME, filename2, BXI_TRUNC_OPEN_FLAGS);
+    bxierr_p err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    bxilog_logger_p logger;
+    err = bxilog_registry_get("test.pool", &logger);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    for (size_t i = 0; i < POOL_LOGS_NB; i++) {
+        OUT(logger, "Pooled record %zu", i);
+    }
+    // Each handler of the pool replies to its own flush request
+    err = bxilog_flush();
+    CU_ASSERT_TRUE(bxierr_isok(err));
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    char * files[] = {filename1, filename2};
+    for (size_t f = 0; f < ARRAYLEN(files); f++) {
+        int fd = open(files[f], O_RDONLY);
+        CU_ASSERT_TRUE_FATAL(0 <= fd);
+        CU_ASSERT_EQUAL(_count_in_file(fd, "Pooled record"), POOL_LOGS_NB);
+        close(fd);
+        unlink(files[f]);
+    }
+    BXIFREE(filename1);
+    BXIFREE(filename2);
+}
+
+// What the placement handler thread sees of itself
+static cpu_set_t PLACEMENT_CPUS;
+static int PLACEMENT_NICE = 0;
+static int PLACEMENT_POLICY = -1;
+static bool PLACEMENT_PROBED = false;
+
+static bxierr_p _placement_process_log(bxilog_record_p record,
+                                       char * filename,
+                                       char * funcname,
+                                       char * loggername,
+                                       char * logmsg,
+                                       bxilog_handler_param_p param) {
+    UNUSED(record);
+    UNUSED(filename);
+    UNUSED(funcname);
+    UNUSED(loggername);
+    UNUSED(logmsg);
+    UNUSED(param);
+    if (__atomic_load_n(&PLACEMENT_PROBED, __ATOMIC_ACQUIRE)) return BXIERR_OK;
+    int rc = sched_getaffinity(0, sizeof(PLACEMENT_CPUS), &PLACEMENT_CPUS);
+    if (0 != rc) return bxierr_errno("Calling sched_getaffinity() failed");
+    // On Linux, the nice value is per thread
+    errno = 0;
+    PLACEMENT_NICE = getpriority(PRIO_PROCESS, 0);
+    if (0 != errno) return bxierr_errno("Calling getpriority() failed");
+    PLACEMENT_POLICY = sched_getscheduler(0);
+    __atomic_store_n(&PLACEMENT_PROBED, true, __ATOMIC_RELEASE);
+    return BXIERR_OK;
+}
+
+static const bxilog_handler_s PLACEMENT_HANDLER_S = {
+                  .name = "Test Placement Handler",
+                  .param_new = _batch_param_new,
+                  .init = _batch_noop,
+                  .process_log = _placement_process_log,
+                  .process_ierr = _batch_process_ierr,
+                  .process_implicit_flush = _batch_noop,
+                  .process_explicit_flush = _batch_noop,
+                  .process_exit = _batch_noop,
+                  .process_cfg = _batch_noop,
+                  .param_destroy = _batch_param_destroy,
+};
+
+void test_handler_placement(void) {
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_config_add_handler(config,
+                              (bxilog_handler_p) &PLACEMENT_HANDLER_S,
+                              BXILOG_FILTERS_ALL_ALL);
+    bxilog_handler_param_p param = config->handlers_params[0];
+    PLACEMENT_PROBED = false;
+
+    bxierr_p err = bxilog_handler_param_set_cpus(param, "0-");
+    CU_ASSERT_TRUE(bxierr_isko(err));
+    bxierr_destroy(&err);
+    err = bxilog_handler_param_set_cpus(param, "1,0-x");
+    CU_ASSERT_TRUE(bxierr_isko(err));
+    bxierr_destroy(&err);
+    CU_ASSERT_PTR_NULL(param->cpus);
+
+    // A CPU we may run on: CPU 0 may be excluded by a cpuset
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    int rc = sched_getaffinity(0, sizeof(allowed), &allowed);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed)) cpu++;
+    char * cpus = bxistr_new("%d", cpu);
+    err = bxilog_handler_param_set_cpus(param, cpus);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    CU_ASSERT_STRING_EQUAL(param->cpus, cpus);
+    BXIFREE(cpus);
+    param->nice = 1;
+    param->sched_policy = BXILOG_SCHED_BATCH;
+
+    err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    DEBUG(TEST_LOGGER, "Logging from a placed handler thread");
+    err = bxilog_flush();
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    // The handler thread runs where and how it was asked to
+    CU_ASSERT_TRUE_FATAL(__atomic_load_n(&PLACEMENT_PROBED, __ATOMIC_ACQUIRE));
+    CU_ASSERT_EQUAL(CPU_COUNT(&PLACEMENT_CPUS), 1);
+    CU_ASSERT_TRUE(CPU_ISSET(cpu, &PLACEMENT_CPUS));
+    CU_ASSERT_EQUAL(PLACEMENT_NICE, 1);
+    CU_ASSERT_EQUAL(PLACEMENT_POLICY, SCHED_BATCH);
+
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+void test_handler_spin(void) {
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_config_add_handler(config,
+                              BXILOG_NULL_HANDLER,
+                              BXILOG_FILTERS_ALL_ALL);
+    config->handlers_params[0]->spin_us = 100;
+    bxierr_p err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    for (size_t i = 0; i < 100; i++) {
+        DEBUG(TEST_LOGGER, "Record %zu for a spinning handler", i);
+    }
+    err = bxilog_flush();
+    CU_ASSERT_TRUE(bxierr_isok(err));
+
+    bxilog_spin_stats_s stats;
+    err = bxilog_get_spin_stats(0, &stats);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    CU_ASSERT_TRUE(0 < stats.spins_nb);
+    CU_ASSERT_TRUE(stats.hits_nb <= stats.spins_nb);
+
+    err = bxilog_get_spin_stats(1, &stats);
+    CU_ASSERT_TRUE(bxierr_isko(err));
+    bxierr_destroy(&err);
+
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+}
+
+void test_file_handler_format(void) {
+    char * filename = bxistr_new("/tmp/test_file_handler_format.%d", getpid());
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.format", BXILOG_ALL);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filename, BXI_TRUNC_OPEN_FLAGS);
+    bxierr_p err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    bxilog_logger_p logger;
+    err = bxilog_registry_get("test.format", &logger);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    const int line_nb = __LINE__ + 1;
+    OUT(logger, "First line\nSecond line\nThird line");
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    int fd = open(filename, O_RDONLY);
+    CU_ASSERT_TRUE_FATAL(0 <= fd);
+    char content[4096];
+    ssize_t n = read(fd, content, sizeof(content) - 1);
+    CU_ASSERT_TRUE_FATAL(0 < n);
+    content[n] = '\0';
+    close(fd);
+    unlink(filename);
+    BXIFREE(filename);
+
+    // O|YYYYMMDDTHHMMSS.NNNNNNNNN|PID.TID=RANK:progname|file:line@func|logger|line
+    const char * lines[] = {"First line", "Second line", "Third line"};
+    char * prefix = NULL;
+    char * line = content;
+    for (size_t i = 0; i < ARRAYLEN(lines); i++) {
+        char * end = strchr(line, '\n');
+        CU_ASSERT_PTR_NOT_NULL_FATAL(end);
+        *end = '\0';
+        char * text = strrchr(line, '|');
+        CU_ASSERT_PTR_NOT_NULL_FATAL(text);
+        CU_ASSERT_STRING_EQUAL(text + 1, lines[i]);
+        text[1] = '\0';
+        // All lines of a record have the same prefix
+        if (NULL == prefix) prefix = line;
+        CU_ASSERT_STRING_EQUAL(line, prefix);
+        line = end + 1;
+    }
+    CU_ASSERT_EQUAL(prefix[0], 'O');
+    CU_ASSERT_EQUAL(prefix[1], '|');
+    for (size_t i = 2; i < 2 + 15; i++) {
+        CU_ASSERT_TRUE((10 == i) ? 'T' == prefix[i] : isdigit((unsigned char) prefix[i]));
+    }
+    CU_ASSERT_EQUAL(prefix[17], '.');
+    for (size_t i = 18; i < 18 + 9; i++) CU_ASSERT_TRUE(isdigit((unsigned char) prefix[i]));
+    char * pid = bxistr_new("|%0*d.", 5, getpid());
+    CU_ASSERT_PTR_NOT_NULL(strstr(prefix, pid));
+    BXIFREE(pid);
+    char * site = bxistr_new("|test_logger.c:%d@test_file_handler_format|test.format|",
+                             line_nb);
+    CU_ASSERT_PTR_NOT_NULL(strstr(prefix, site));
+    BXIFREE(site);
+}
+
+void test_file_handler_writev(void) {
+    char * filename = bxistr_new("/tmp/test_file_handler_writev.%d", getpid());
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.writev", BXILOG_ALL);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filename, BXI_TRUNC_OPEN_FLAGS);
+    // Modes are exclusive: writev() has nothing in flight
+    bxierr_p err = bxilog_file_handler_param_set_write(config->handlers_params[0],
+                                                       BXILOG_FILE_WRITE_WRITEV, 2, 0);
+    CU_ASSERT_TRUE(bxierr_isko(err));
+    bxierr_destroy(&err);
+    err = bxilog_file_handler_param_set_write(config->handlers_params[0],
+                                              BXILOG_FILE_WRITE_WRITEV, 0, 0);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    bxilog_logger_p logger;
+    err = bxilog_registry_get("test.writev", &logger);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    // More lines than segments a single writev() can take
+    const size_t lines_nb = 1000;
+    char * msg = bximem_calloc(lines_nb * 8);
+    for (size_t i = 0; i < lines_nb; i++) {
+        sprintf(msg + strlen(msg), (i + 1 < lines_nb) ? "L%04zu\n" : "L%04zu", i);
+    }
+    const size_t logs_nb = 10;
+    for (size_t i = 0; i < logs_nb; i++) {
+        OUT(logger, "%s", msg);
+    }
+    BXIFREE(msg);
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    const size_t n = _check_texts_in_file(filename, "L%04zu\n", lines_nb, NULL);
+    CU_ASSERT_EQUAL(n, logs_nb * lines_nb);
+    unlink(filename);
+    BXIFREE(filename);
+}
+
+void test_file_handler_async(void) {
+    const bxilog_file_write_e modes[] = {BXILOG_FILE_WRITE_ASYNC,
+                                         BXILOG_FILE_WRITE_THREAD};
+    for (size_t m = 0; m < ARRAYLEN(modes); m++) {
+        char * filename = bxistr_new("/tmp/test_file_handler_async.%d", getpid());
+
+        bxilog_config_p config = bxilog_config_new(PROGNAME);
+        bxilog_filters_p filters = bxilog_filters_new();
+        bxilog_filters_add(&filters, "test.async", BXILOG_ALL);
+        bxilog_config_add_handler(config,
+                                  BXILOG_FILE_HANDLER,
+                                  filters,
+                                  PROGNAME, filename, BXI_TRUNC_OPEN_FLAGS);
+        // A small in-flight limit so the handler has to wait for writes
+        bxierr_p err = bxilog_file_handler_param_set_write(config->handlers_params[0],
+                                                           modes[m], 1, 4096);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+        err = bxilog_init(config);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+        bxilog_logger_p logger;
+        err = bxilog_registry_get("test.async", &logger);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+        const size_t logs_nb = 10000;
+        for (size_t i = 0; i < logs_nb; i++) {
+            OUT(logger, "L%05zu", i);
+        }
+        // Flushed means written
+        err = bxilog_flush();
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+        const size_t n = _check_texts_in_file(filename, "L%05zu\n", SIZE_MAX, NULL);
+        CU_ASSERT_EQUAL(n, logs_nb);
+
+        err = bxilog_finalize(true);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+        unlink(filename);
+        BXIFREE(filename);
+    }
+}
+
+void test_file_handler_mmap(void) {
+    char * filename = bxistr_new("/tmp/test_file_handler_mmap.%d", getpid());
+
+    // Truncated, then appended
+    const int flags[] = {BXI_TRUNC_OPEN_FLAGS, BXI_APPEND_OPEN_FLAGS};
+    const size_t logs_nb = 10000;
+    for (size_t f = 0; f < ARRAYLEN(flags); f++) {
+        bxilog_config_p config = bxilog_config_new(PROGNAME);
+        bxilog_filters_p filters = bxilog_filters_new();
+        bxilog_filters_add(&filters, "test.mmap", BXILOG_ALL);
+        bxilog_config_add_handler(config,
+                                  BXILOG_FILE_HANDLER,
+                                  filters,
+                                  PROGNAME, filename, flags[f]);
+        bxierr_p err = bxilog_file_handler_param_set_write(config->handlers_params[0],
+                                                           BXILOG_FILE_WRITE_MMAP,
+                                                           0, 0);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+        err = bxilog_init(config);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+        bxilog_logger_p logger;
+        err = bxilog_registry_get("test.mmap", &logger);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+        for (size_t i = 0; i < logs_nb; i++) {
+            OUT(logger, "L%05zu", f * logs_nb + i);
+        }
+        err = bxilog_finalize(true);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    }
+
+    // The file is truncated to its written length: no trailing zeroes
+    struct stat st;
+    int rc = stat(filename, &st);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    off_t size;
+    const size_t n = _check_texts_in_file(filename, "L%05zu\n", SIZE_MAX, &size);
+    CU_ASSERT_EQUAL(n, ARRAYLEN(flags) * logs_nb);
+    CU_ASSERT_EQUAL(size, st.st_size);
+    unlink(filename);
+    BXIFREE(filename);
+}
+
+void test_file_handler_mmap_reopen(void) {
+    char * filename = bxistr_new("/tmp/test_file_handler_mmap_reopen.%d", getpid());
+
+    // As left by a process that did not finalize: lines, then its preallocated extent
+    const size_t crashed_nb = 10;
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    CU_ASSERT_TRUE_FATAL(0 <= fd);
+    for (size_t i = 0; i < crashed_nb; i++) {
+        char line[32];
+        const int len = snprintf(line, sizeof(line), "O|crashed|L%05zu\n", i);
+        ssize_t n = write(fd, line, (size_t) len);
+        CU_ASSERT_EQUAL_FATAL(n, len);
+    }
+    off_t written = lseek(fd, 0, SEEK_CUR);
+    int rc = ftruncate(fd, written + 1024 * 1024);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    close(fd);
+
+    bxilog_config_p config = bxilog_config_new(PROGNAME);
+    bxilog_filters_p filters = bxilog_filters_new();
+    bxilog_filters_add(&filters, "test.mmap", BXILOG_ALL);
+    bxilog_config_add_handler(config,
+                              BXILOG_FILE_HANDLER,
+                              filters,
+                              PROGNAME, filename, BXI_APPEND_OPEN_FLAGS);
+    bxierr_p err = bxilog_file_handler_param_set_write(config->handlers_params[0],
+                                                       BXILOG_FILE_WRITE_MMAP,
+                                                       0, 0);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    err = bxilog_init(config);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    bxilog_logger_p logger;
+    err = bxilog_registry_get("test.mmap", &logger);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+    const size_t logs_nb = 100;
+    for (size_t i = 0; i < logs_nb; i++) {
+        OUT(logger, "L%05zu", crashed_nb + i);
+    }
+    err = bxilog_finalize(true);
+    CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+    // New lines follow the old ones, without the zeroes in between
+    struct stat st;
+    rc = stat(filename, &st);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    off_t size;
+    const size_t n = _check_texts_in_file(filename, "L%05zu\n", SIZE_MAX, &size);
+    CU_ASSERT_EQUAL(n, crashed_nb + logs_nb);
+    CU_ASSERT_EQUAL(size, st.st_size);
+    unlink(filename);
+    BXIFREE(filename);
+}
+
+void test_file_handler_rotation(void) {
+    // Writes in flight and mapped files are handed over to the background thread
+    const bxilog_file_write_e modes[] = {BXILOG_FILE_WRITE_SYNC,
+                                         BXILOG_FILE_WRITE_THREAD,
+                                         BXILOG_FILE_WRITE_MMAP};
+    for (size_t m = 0; m < ARRAYLEN(modes); m++) {
+        char * filename = bxistr_new("/tmp/test_file_handler_rotation.%d", getpid());
+        const size_t max_bytes = 4096;
+        const size_t keep_nb = 3;
+
+        bxilog_config_p config = bxilog_config_new(PROGNAME);
+        bxilog_filters_p filters = bxilog_filters_new();
+        bxilog_filters_add(&filters, "test.rotation", BXILOG_ALL);
+        bxilog_config_add_handler(config,
+                                  BXILOG_FILE_HANDLER,
+                                  filters,
+                                  PROGNAME, filename, BXI_TRUNC_OPEN_FLAGS);
+        bxierr_p err = bxilog_file_handler_param_set_rotation(config->handlers_params[0],
+                                                              max_bytes, 0, keep_nb,
+                                                              BXILOG_FILE_COMPRESS_NONE);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+        err = bxilog_file_handler_param_set_write(config->handlers_params[0],
+                                                  modes[m], 0, 0);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+        err = bxilog_init(config);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+        bxilog_logger_p logger;
+        err = bxilog_registry_get("test.rotation", &logger);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+        const size_t logs_nb = 1000;
+        for (size_t i = 0; i < logs_nb; i++) {
+            OUT(logger, "L%05zu", i);
+            if (0 != i % 10) continue;
+            // Rotations are postponed until the next file is created in the background
+            struct timespec delay = {.tv_sec = 0, .tv_nsec = 1000000};
+            nanosleep(&delay, NULL);
+        }
+        // Wait for the background removal of the oldest segments
+        err = bxilog_finalize(true);
+        CU_ASSERT_TRUE_FATAL(bxierr_isok(err));
+
+        // The current file is smaller than the limit plus a record and ends the logs
+        struct stat st;
+        int rc = stat(filename, &st);
+        CU_ASSERT_EQUAL_FATAL(rc, 0);
+        CU_ASSERT_TRUE((size_t) st.st_size <= max_bytes + 1024);
+        int fd = open(filename, O_RDONLY);
+        CU_ASSERT_TRUE_FATAL(0 <= fd);
+        char * content = _file_content(fd);
+        close(fd);
+        char expected[16];
+        sprintf(expected, "|L%05zu\n", logs_nb - 1);
+        const size_t len = strlen(content);
+        CU_ASSERT_TRUE_FATAL(len >= strlen(expected));
+        CU_ASSERT_STRING_EQUAL(content + len - strlen(expected), expected);
+        BXIFREE(content);
+
+        // Only the most recent segments are kept, complete and truncated
+        const char * dirname = "/tmp";
+        char * prefix = bxistr_new("test_file_handler_rotation.%d.", getpid());
+        DIR * dir = opendir(dirname);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(dir);
+        size_t segments_nb = 0;
+        struct dirent * entry;
+        while (NULL != (entry = readdir(dir))) {
+            if (0 != strncmp(entry->d_name, prefix, strlen(prefix))) continue;
+            segments_nb++;
+            char * segment = bxistr_new("%s/%s", dirname, entry->d_name);
+            fd = open(segment, O_RDONLY);
+            CU_ASSERT_TRUE_FATAL(0 <= fd);
+            rc = fstat(fd, &st);
+            CU_ASSERT_EQUAL_FATAL(rc, 0);
+            CU_ASSERT_TRUE_FATAL(0 < st.st_size);
+            content = _file_content(fd);
+            close(fd);
+            CU_ASSERT_EQUAL(strlen(content), (size_t) st.st_size);
+            CU_ASSERT_EQUAL(content[st.st_size - 1], '\n');
+            BXIFREE(content);
+            unlink(segment);
+            BXIFREE(segment);
+        }
+        closedir(dir);
+        CU_ASSERT_EQUAL(segments_nb, keep_nb);
+
+        unlink(filename);
+        BXIFREE(prefix);
+        BXIFREE(filename);
+    }
+}
+
 void test_handlers(void) {
     bxilog_config_p config = bxilog_config_new(PROGNAME);
 
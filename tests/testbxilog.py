@@ -29,6 +29,7 @@ import random
 import bxi.base as bxibase
 import bxi.base.err as bxierr
 import bxi.base.log as bxilog
+import bxi.base.log.logger as bxilogger
 
 
 BASENAME = os.path.basename(__file__)
@@ -121,6 +122,13 @@ class BXILogTest(unittest.TestCase):
             level = bxilog.get_level_from_str(bxilog.LEVEL_NAMES[i])
             self.assertEquals(i, level)
 
+    def test_compile_min_level(self):
+        """
+        Test the query of the least severe level compiled in the C library
+        """
+        level = bxilogger.get_compile_min_level()
+        self.assertTrue(bxilog.PANIC <= level <= bxilog.LOWEST)
+
 
     def test_default_logger(self):
         """Test default logging functions"""
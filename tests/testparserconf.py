@@ -299,6 +299,25 @@ class ParserConfTest(unittest.TestCase):
             configobj.ConfigObj(config).write(f)
         self._test_logs(['--logcfgfile=%s' % fileconf])
     
+    def test_log_thread_options(self):
+        "Options of handler threads can be set from the command line."
+        config = {'handlers': ['console',],
+                  'setsighandler': True,
+                  'console': {'module': bxilog_consolehandler.__name__,
+                              'filters': ':output',
+                              'stderr_level': 'WARNING',
+                              'colors': '216_dark',
+                              'nice': 0,
+                              },
+                 }
+        fileconf = os.path.join(self.bxiconfigdir, 'bxilog.conf')
+        with open(fileconf, 'w') as f:
+            configobj.ConfigObj(config).write(f)
+        self._test_logs(['--logcfgfile=%s' % fileconf,
+                         '--log-console-nice=1',
+                         '--log-console-sched_policy=batch',
+                         '--log-console-spin_us=10'])
+
     def test_log_directref_conf(self):
         config = {'handlers': ['console',],
                   'setsighandler': True,
@@ -89,6 +89,33 @@ void test_filters_simple(void);
 void test_filters_symetric(void);
 void test_filters_complex(void);
 void test_logger_threads(void);
+void test_logger_ring(void);
+void test_logger_batch(void);
+void test_logger_batch_idle(void);
+void test_logger_deferred(void);
+void test_logger_site(void);
+void test_logger_alloc_stats(void);
+void test_logger_backpressure(void);
+void test_logger_backpressure_oldest(void);
+void test_logger_priority(void);
+void test_logger_tsd_pool(void);
+void test_logger_ratelimit(void);
+void test_logger_ratelimit_report(void);
+void test_logger_site_cache(void);
+void test_logger_filter_table(void);
+void test_registry_many(void);
+void test_logger_bulk_reconfigure(void);
+void test_handler_batch(void);
+void test_handler_sharded(void);
+void test_handler_pool(void);
+void test_handler_placement(void);
+void test_handler_spin(void);
+void test_file_handler_format(void);
+void test_file_handler_writev(void);
+void test_file_handler_async(void);
+void test_file_handler_mmap(void);
+void test_file_handler_mmap_reopen(void);
+void test_file_handler_rotation(void);
 void test_handlers(void);
 void test_very_long_log(void);
 void test_strange_log(void);
@@ -304,6 +331,33 @@ int main(int argc, char * argv[]) {
         || (NULL == CU_add_test(bxilog_suite, "test logger filters complex", test_filters_complex))
         || (NULL == CU_add_test(bxilog_suite, "test handlers", test_handlers))
         || (NULL == CU_add_test(bxilog_suite, "test logger threads", test_logger_threads))
+        || (NULL == CU_add_test(bxilog_suite, "test logger ring", test_logger_ring))
+        || (NULL == CU_add_test(bxilog_suite, "test logger batch", test_logger_batch))
+        || (NULL == CU_add_test(bxilog_suite, "test logger batch idle", test_logger_batch_idle))
+        || (NULL == CU_add_test(bxilog_suite, "test logger deferred", test_logger_deferred))
+        || (NULL == CU_add_test(bxilog_suite, "test logger site", test_logger_site))
+        || (NULL == CU_add_test(bxilog_suite, "test logger alloc stats", test_logger_alloc_stats))
+        || (NULL == CU_add_test(bxilog_suite, "test logger backpressure", test_logger_backpressure))
+        || (NULL == CU_add_test(bxilog_suite, "test logger backpressure oldest", test_logger_backpressure_oldest))
+        || (NULL == CU_add_test(bxilog_suite, "test logger priority", test_logger_priority))
+        || (NULL == CU_add_test(bxilog_suite, "test logger tsd pool", test_logger_tsd_pool))
+        || (NULL == CU_add_test(bxilog_suite, "test logger ratelimit", test_logger_ratelimit))
+        || (NULL == CU_add_test(bxilog_suite, "test logger ratelimit report", test_logger_ratelimit_report))
+        || (NULL == CU_add_test(bxilog_suite, "test logger site cache", test_logger_site_cache))
+        || (NULL == CU_add_test(bxilog_suite, "test logger filter table", test_logger_filter_table))
+        || (NULL == CU_add_test(bxilog_suite, "test registry many", test_registry_many))
+        || (NULL == CU_add_test(bxilog_suite, "test logger bulk reconfigure", test_logger_bulk_reconfigure))
+        || (NULL == CU_add_test(bxilog_suite, "test handler batch", test_handler_batch))
+        || (NULL == CU_add_test(bxilog_suite, "test handler sharded", test_handler_sharded))
+        || (NULL == CU_add_test(bxilog_suite, "test handler pool", test_handler_pool))
+        || (NULL == CU_add_test(bxilog_suite, "test handler placement", test_handler_placement))
+        || (NULL == CU_add_test(bxilog_suite, "test handler spin", test_handler_spin))
+        || (NULL == CU_add_test(bxilog_suite, "test file handler format", test_file_handler_format))
+        || (NULL == CU_add_test(bxilog_suite, "test file handler writev", test_file_handler_writev))
+        || (NULL == CU_add_test(bxilog_suite, "test file handler async", test_file_handler_async))
+        || (NULL == CU_add_test(bxilog_suite, "test file handler mmap", test_file_handler_mmap))
+        || (NULL == CU_add_test(bxilog_suite, "test file handler mmap reopen", test_file_handler_mmap_reopen))
+        || (NULL == CU_add_test(bxilog_suite, "test file handler rotation", test_file_handler_rotation))
         || (NULL == CU_add_test(bxilog_suite, "test logger fork", test_logger_fork))
 //        || (NULL == CU_add_test(bxilog_suite, "test logger signal", test_logger_signal))
 